@@ -0,0 +1,44 @@
+// Copyright 2024 Ant Group Co., Ltd.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <memory>
+
+#include "ic_impl/algo/lr/lr_context.h"
+#include "ic_impl/algo/lr/optimizer.h"
+#include "ic_impl/context.h"
+#include "ic_impl/protocol_family/paillier/paillier.h"
+
+namespace ic_impl::algo::he_lr {
+
+struct HeLrContext {
+  lr::LrHyperParam lr_param;
+
+  lr::LrIoParam io_param;
+
+  optimizer::Optimizer optimizer;
+
+  protocol_family::paillier::PaillierParam paillier_param;
+
+  std::shared_ptr<IcContext> ic_ctx;
+
+  bool HasLabel() const {
+    return static_cast<int32_t>(ic_ctx->lctx->Rank()) == io_param.label_rank;
+  }
+};
+
+std::shared_ptr<HeLrContext> CreateHeLrContext(std::shared_ptr<IcContext>);
+
+}  // namespace ic_impl::algo::he_lr
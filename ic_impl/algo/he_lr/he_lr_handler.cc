@@ -0,0 +1,538 @@
+// Copyright 2024 Ant Group Co., Ltd.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "ic_impl/algo/he_lr/he_lr_handler.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+
+#include "gflags/gflags.h"
+#include "spdlog/spdlog.h"
+
+#include "ic_impl/proto/paillier.pb.h"
+#include "ic_impl/proto/vendor_types.pb.h"
+
+DECLARE_bool(disable_handshake);
+
+namespace ic_impl::algo::he_lr {
+
+using ic_impl::proto::ALGO_TYPE_HE_LR;
+using ic_impl::proto::PaillierProtocolProposal;
+using ic_impl::proto::PaillierProtocolResult;
+using ic_impl::proto::PROTOCOL_FAMILY_PAILLIER;
+
+using org::interconnection::v2::algos::LrDataIoProposal;
+using org::interconnection::v2::algos::LrDataIoResult;
+using org::interconnection::v2::algos::LAST_BATCH_POLICY_DISCARD;
+using org::interconnection::v2::algos::LrHyperparamsProposal;
+using org::interconnection::v2::algos::LrHyperparamsResult;
+using org::interconnection::v2::algos::OPTIMIZER_SGD;
+using org::interconnection::v2::algos::SgdOptimizer;
+
+using protocol_family::paillier::BuildPaillierProposal;
+using protocol_family::paillier::BuildPaillierResult;
+using protocol_family::paillier::DeserializeCiphertexts;
+using protocol_family::paillier::MaskBits;
+using protocol_family::paillier::NegotiatePaillierParam;
+using protocol_family::paillier::PackPlaintexts;
+using protocol_family::paillier::PaillierPublicKey;
+using protocol_family::paillier::PaillierSecretKey;
+using protocol_family::paillier::ProcessPaillierResult;
+using protocol_family::paillier::RandomMasks;
+using protocol_family::paillier::SerializeCiphertexts;
+using protocol_family::paillier::UnpackPlaintexts;
+using yacl::math::MPInt;
+
+namespace {
+
+constexpr char kPublicKeyTag[] = "he_lr_public_key";
+constexpr char kResidualTag[] = "he_lr_residual";
+constexpr char kGradientTag[] = "he_lr_gradient";
+constexpr char kUnmaskedTag[] = "he_lr_unmasked";
+
+// fraction bits of the features and residuals, so gradients carry twice as
+// many and must stay below 2^(63 - 2 * kFxpBits) in magnitude
+constexpr int32_t kFxpBits = 20;
+
+// added to each gradient to make it non-negative before packing
+constexpr uint64_t kGradientOffset = uint64_t{1} << 63;
+
+int64_t Encode(double value) {
+  return std::llround(std::ldexp(value, kFxpBits));
+}
+
+std::vector<MPInt> ToPlaintexts(const std::vector<int64_t> &values) {
+  std::vector<MPInt> plaintexts;
+  plaintexts.reserve(values.size());
+  for (auto value : values) {
+    plaintexts.emplace_back(value);
+  }
+  return plaintexts;
+}
+
+std::set<int32_t> IntersectOptimizers(
+    const std::vector<LrHyperparamsProposal> &lr_params) {
+  int field_num = LrHyperparamsProposal::kOptimizersFieldNumber;
+  return util::IntersectParamItems<LrHyperparamsProposal>(lr_params, field_num);
+}
+
+std::set<int32_t> IntersectLastBatchPolicies(
+    const std::vector<LrHyperparamsProposal> &lr_params) {
+  int field_num = LrHyperparamsProposal::kLastBatchPoliciesFieldNumber;
+  return util::IntersectParamItems<LrHyperparamsProposal>(lr_params, field_num);
+}
+
+bool UsePenaltyTerm(double value) { return !util::AlmostZero(value); }
+
+}  // namespace
+
+HeLrHandler::HeLrHandler(std::shared_ptr<HeLrContext> ctx)
+    : AlgoV2Handler(ctx->ic_ctx), ctx_(std::move(ctx)) {
+  YACL_ENFORCE(ctx_->ic_ctx->lctx->WorldSize() == 2,
+               "HE-LR runs between two parties");
+  YACL_ENFORCE(ctx_->optimizer.type == OPTIMIZER_SGD,
+               "Unimplemented optimizer type {}", ctx_->optimizer.type);
+  peer_rank_ = ctx_->ic_ctx->lctx->Rank() == 0 ? 1 : 0;
+}
+
+HeLrHandler::~HeLrHandler() = default;
+
+bool HeLrHandler::PrepareDataset() {
+  auto [sample_size, col_num] = lr::CountDataset();
+  counted_shape_ = {sample_size, col_num};
+  int32_t feature_num = ctx_->HasLabel() ? col_num - 1 : col_num;
+  YACL_ENFORCE(sample_size > 0);
+
+  ctx_->io_param.sample_size = sample_size;
+  auto self_rank = ctx_->ic_ctx->lctx->Rank();
+
+  if (util::GetParamEnv("disable_handshake", FLAGS_disable_handshake)) {
+    YACL_ENFORCE(ctx_->io_param.feature_nums.at(self_rank) == feature_num);
+  } else {
+    // the label party may hold no features
+    YACL_ENFORCE(feature_num > 0 || ctx_->HasLabel());
+    ctx_->io_param.feature_nums.resize(ctx_->ic_ctx->lctx->WorldSize());
+    ctx_->io_param.feature_nums.at(self_rank) = feature_num;
+  }
+
+  return true;
+}
+
+void HeLrHandler::LoadDataset() {
+  // generating primes takes a while, better done during the handshake
+  const auto &param = ctx_->paillier_param;
+  secret_key_ = std::make_unique<PaillierSecretKey>(param.key_size);
+  if (param.pool_size > 0) {
+    // the residuals of every step are encrypted under the own key
+    secret_key_->StartRandomnessPool(param.pool_size, param.pool_threads);
+  }
+
+  auto rows = lr::ReadDatasetRows();
+  YACL_ENFORCE(static_cast<int64_t>(rows.size()) == counted_shape_[0],
+               "dataset changed while loading");
+  int64_t col_num = counted_shape_[1];
+  int64_t feature_num = ctx_->HasLabel() ? col_num - 1 : col_num;
+  features_.assign(feature_num, std::vector<int64_t>(rows.size()));
+  for (size_t i = 0; i < rows.size(); ++i) {
+    YACL_ENFORCE(static_cast<int64_t>(rows[i].size()) == col_num,
+                 "row {} has {} columns", i, rows[i].size());
+    for (int64_t j = 0; j < feature_num; ++j) {
+      features_[j][i] = Encode(rows[i][j]);
+    }
+    if (ctx_->HasLabel()) {
+      labels_.push_back(rows[i].back());
+    }
+  }
+  if (ctx_->HasLabel()) {
+    features_.emplace_back(rows.size(), Encode(1.0));
+  }
+}
+
+HandshakeRequestV2 HeLrHandler::BuildHandshakeRequest() {
+  HandshakeRequestV2 request;
+  auto self_rank = ctx_->ic_ctx->lctx->Rank();
+
+  request.set_version(2);
+  request.set_requester_rank(self_rank);
+
+  request.add_supported_algos(ALGO_TYPE_HE_LR);
+  LrHyperparamsProposal lr_param;
+  lr_param.add_supported_versions(1);
+  lr_param.add_optimizers(ctx_->optimizer.type);
+  lr_param.add_last_batch_policies(ctx_->lr_param.last_batch_policy);
+  lr_param.set_use_l2_norm(UsePenaltyTerm(ctx_->lr_param.l2_norm));
+  request.add_algo_params()->PackFrom(lr_param);
+
+  request.add_protocol_families(PROTOCOL_FAMILY_PAILLIER);
+  request.add_protocol_family_params()->PackFrom(
+      BuildPaillierProposal(ctx_->paillier_param));
+
+  LrDataIoProposal lr_io;
+  lr_io.set_sample_size(ctx_->io_param.sample_size);
+  lr_io.set_feature_num(ctx_->io_param.feature_nums.at(self_rank));
+  lr_io.set_has_label(ctx_->HasLabel());
+  request.mutable_io_param()->PackFrom(lr_io);
+
+  return request;
+}
+
+status::ErrorStatus HeLrHandler::NegotiateHandshakeParams(
+    const std::vector<HandshakeRequestV2> &requests) {
+  auto status = NegotiateLrAlgoParams(requests);
+  if (!status.ok()) {
+    return status;
+  }
+
+  status = NegotiatePaillierParams(requests);
+  if (!status.ok()) {
+    return status;
+  }
+
+  status = NegotiateLrIoParams(requests);
+  if (!status.ok()) {
+    return status;
+  }
+
+  return status::OkStatus();
+}
+
+status::ErrorStatus HeLrHandler::NegotiateLrAlgoParams(
+    const std::vector<HandshakeRequestV2> &requests) {
+  auto lr_params =
+      ExtractReqAlgoParams<LrHyperparamsProposal>(requests, ALGO_TYPE_HE_LR);
+  if (lr_params.empty()) {
+    return status::InvalidRequestError("certain request has no lr algo params");
+  }
+
+  auto optimizers = IntersectOptimizers(lr_params);
+  if (optimizers.find(ctx_->optimizer.type) == optimizers.end()) {
+    return status::UnsupportedArgumentError("negotiate optimizer failed");
+  }
+
+  // the partial last batch is always discarded
+  auto policies = IntersectLastBatchPolicies(lr_params);
+  if (ctx_->lr_param.last_batch_policy != LAST_BATCH_POLICY_DISCARD ||
+      policies.find(ctx_->lr_param.last_batch_policy) == policies.end()) {
+    return status::UnsupportedArgumentError(
+        "negotiate last batch policy failed");
+  }
+
+  // only l2 norm is supported
+  auto use_l2_norm = util::AlignParamItem<LrHyperparamsProposal, bool>(
+      lr_params, LrHyperparamsProposal::kUseL2NormFieldNumber);
+  if (!use_l2_norm.has_value() || !use_l2_norm.value()) {
+    ctx_->lr_param.l2_norm = 0.0;
+  }
+
+  return status::OkStatus();
+}
+
+status::ErrorStatus HeLrHandler::NegotiatePaillierParams(
+    const std::vector<HandshakeRequestV2> &requests) {
+  auto paillier_params = ExtractReqPfParams<PaillierProtocolProposal>(
+      requests, PROTOCOL_FAMILY_PAILLIER);
+  if (paillier_params.empty()) {
+    return status::InvalidRequestError(
+        "certain request has no paillier params");
+  }
+
+  if (!NegotiatePaillierParam(paillier_params, &ctx_->paillier_param)) {
+    return status::UnsupportedArgumentError("negotiate paillier params failed");
+  }
+
+  return status::OkStatus();
+}
+
+status::ErrorStatus HeLrHandler::NegotiateLrIoParams(
+    const std::vector<HandshakeRequestV2> &requests) {
+  for (const auto &request : requests) {
+    LrDataIoProposal io_param;
+    if (!request.io_param().UnpackTo(&io_param)) {
+      return status::InvalidRequestError(
+          "certain request has invalid io param");
+    }
+
+    if (io_param.sample_size() != ctx_->io_param.sample_size) {
+      return status::HandshakeRefusedError("sample size inconsistent");
+    }
+
+    if (io_param.feature_num() < 0 ||
+        (io_param.feature_num() == 0 && !io_param.has_label())) {
+      return status::InvalidRequestError(
+          "certain request has invalid feature_num");
+    }
+    YACL_ENFORCE(static_cast<int32_t>(ctx_->io_param.feature_nums.size()) >
+                 request.requester_rank());
+    ctx_->io_param.feature_nums[request.requester_rank()] =
+        io_param.feature_num();
+
+    if (io_param.has_label()) {
+      if (ctx_->io_param.label_rank != -1) {
+        return status::HandshakeRefusedError("more than one party have label");
+      }
+      ctx_->io_param.label_rank = request.requester_rank();
+    }
+  }
+
+  if (ctx_->io_param.label_rank == -1) {
+    return status::InvalidRequestError("no party has label");
+  }
+
+  return status::OkStatus();
+}
+
+HandshakeResponseV2 HeLrHandler::BuildHandshakeResponse() {
+  HandshakeResponseV2 response;
+  response.mutable_header()->set_error_code(org::interconnection::OK);
+
+  response.set_algo(ALGO_TYPE_HE_LR);
+  LrHyperparamsResult lr_param;
+  lr_param.set_version(1);
+  lr_param.set_num_epoch(ctx_->lr_param.num_epoch);
+  lr_param.set_batch_size(ctx_->lr_param.batch_size);
+  lr_param.set_last_batch_policy(ctx_->lr_param.last_batch_policy);
+  if (UsePenaltyTerm(ctx_->lr_param.l2_norm)) {
+    lr_param.set_l2_norm(ctx_->lr_param.l2_norm);
+  }
+  lr_param.set_optimizer_name(ctx_->optimizer.type);
+  lr_param.mutable_optimizer_param()->PackFrom(
+      std::get<SgdOptimizer>(ctx_->optimizer.param));
+  response.mutable_algo_param()->PackFrom(lr_param);
+
+  response.add_protocol_families(PROTOCOL_FAMILY_PAILLIER);
+  response.add_protocol_family_params()->PackFrom(
+      BuildPaillierResult(ctx_->paillier_param));
+
+  LrDataIoResult io_param;
+  io_param.set_version(1);
+  io_param.set_sample_size(ctx_->io_param.sample_size);
+  io_param.mutable_feature_nums()->Add(ctx_->io_param.feature_nums.begin(),
+                                       ctx_->io_param.feature_nums.end());
+  io_param.set_label_rank(ctx_->io_param.label_rank);
+  response.mutable_io_param()->PackFrom(io_param);
+
+  return response;
+}
+
+bool HeLrHandler::ProcessHandshakeResponse(
+    const HandshakeResponseV2 &response) {
+  if (!AlgoV2Handler::ProcessHandshakeResponse(response)) {
+    return false;
+  }
+
+  LrHyperparamsResult lr_param;
+  YACL_ENFORCE(response.algo() == ALGO_TYPE_HE_LR);
+  YACL_ENFORCE(response.algo_param().UnpackTo(&lr_param));
+  ctx_->lr_param.num_epoch = lr_param.num_epoch();
+  ctx_->lr_param.batch_size = lr_param.batch_size();
+  if (UsePenaltyTerm(lr_param.l2_norm())) {
+    YACL_ENFORCE(UsePenaltyTerm(ctx_->lr_param.l2_norm));
+  }
+  ctx_->lr_param.l2_norm = lr_param.l2_norm();
+
+  YACL_ENFORCE(lr_param.optimizer_name() == OPTIMIZER_SGD);
+  SgdOptimizer optimizer;
+  YACL_ENFORCE(lr_param.optimizer_param().UnpackTo(&optimizer));
+  std::get<SgdOptimizer>(ctx_->optimizer.param).CopyFrom(optimizer);
+
+  auto paillier_param_optional = ExtractRspPfParam<PaillierProtocolResult>(
+      response, PROTOCOL_FAMILY_PAILLIER);
+  YACL_ENFORCE(paillier_param_optional.has_value());
+  ProcessPaillierResult(paillier_param_optional.value(),
+                        &ctx_->paillier_param);
+
+  LrDataIoResult io_param;
+  YACL_ENFORCE(response.io_param().UnpackTo(&io_param));
+  YACL_ENFORCE(io_param.sample_size() == ctx_->io_param.sample_size);
+  YACL_ENFORCE(io_param.feature_nums().size() ==
+               static_cast<int>(ctx_->io_param.feature_nums.size()));
+  for (int i = 0; i < io_param.feature_nums().size(); ++i) {
+    if (i == static_cast<int>(ctx_->ic_ctx->lctx->Rank())) {
+      YACL_ENFORCE(ctx_->io_param.feature_nums[i] == io_param.feature_nums(i));
+      continue;
+    }
+    ctx_->io_param.feature_nums[i] = io_param.feature_nums(i);
+  }
+  if (ctx_->HasLabel()) {
+    YACL_ENFORCE(io_param.label_rank() == ctx_->io_param.label_rank);
+  }
+  ctx_->io_param.label_rank = io_param.label_rank();
+
+  return true;
+}
+
+bool HeLrHandler::ResumeHandshake(const std::vector<HandshakeRequestV2> &,
+                                  const HandshakeResponseV2 &response) {
+  return ProcessHandshakeResponse(response);
+}
+
+void HeLrHandler::RunAlgo() {
+  YACL_ENFORCE(ctx_->io_param.label_rank == 0 ||
+               ctx_->io_param.label_rank == 1);
+  YACL_ENFORCE(ctx_->lr_param.batch_size > 0 &&
+                   ctx_->lr_param.batch_size <= ctx_->io_param.sample_size,
+               "invalid batch size {}", ctx_->lr_param.batch_size);
+  ExchangePublicKeys();
+  Train();
+  ProduceOutput();
+}
+
+void HeLrHandler::ExchangePublicKeys() {
+  YACL_ENFORCE(secret_key_);
+  Send(secret_key_->PublicKey().Serialize(), kPublicKeyTag);
+  peer_key_ = std::make_unique<PaillierPublicKey>(
+      PaillierPublicKey::Deserialize(Recv(kPublicKeyTag)));
+  YACL_ENFORCE(peer_key_->N().BitCount() ==
+                   static_cast<size_t>(ctx_->paillier_param.key_size),
+               "public key of unexpected size");
+}
+
+void HeLrHandler::Train() {
+  weights_.assign(features_.size(), 0.0);
+  int64_t num_batch = ctx_->io_param.sample_size / ctx_->lr_param.batch_size;
+
+  const auto &stats = ctx_->ic_ctx->lctx->GetStats();
+  for (int64_t epoch = 0; epoch < ctx_->lr_param.num_epoch; ++epoch) {
+    auto start = std::chrono::steady_clock::now();
+    size_t sent_bytes = stats->sent_bytes;
+    for (int64_t batch = 0; batch < num_batch; ++batch) {
+      SPDLOG_INFO("Running train iteration {}", batch);
+
+      const int64_t rows_beg = batch * ctx_->lr_param.batch_size;
+      const int64_t rows_end = rows_beg + ctx_->lr_param.batch_size;
+      TrainStep(rows_beg, rows_end);
+    }
+
+    std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+    SPDLOG_INFO(
+        "rank:{} algo:HE_LR epoch:{} slots:{} seconds:{:.3f} sent_bytes:{}",
+        ctx_->ic_ctx->lctx->Rank(), epoch, ctx_->paillier_param.slots,
+        elapsed.count(), stats->sent_bytes - sent_bytes);
+  }
+}
+
+void HeLrHandler::TrainStep(int64_t rows_beg, int64_t rows_end) {
+  // the own share of the residual of each row
+  std::vector<int64_t> shares(rows_end - rows_beg);
+  for (int64_t i = rows_beg; i < rows_end; ++i) {
+    double score = 0.0;
+    for (size_t j = 0; j < features_.size(); ++j) {
+      score += weights_[j] * std::ldexp(features_[j][i], -kFxpBits);
+    }
+    double share = score / 4;
+    if (ctx_->HasLabel()) {
+      share += 0.5 - labels_[i];
+    }
+    shares[i - rows_beg] = Encode(share);
+  }
+
+  auto plaintexts = ToPlaintexts(shares);
+  Send(SerializeCiphertexts(secret_key_->PublicKey().Encrypt(plaintexts)),
+       kResidualTag);
+  auto residuals = peer_key_->AddPlain(
+      DeserializeCiphertexts(Recv(kResidualTag)), plaintexts);
+  YACL_ENFORCE(static_cast<int64_t>(residuals.size()) == rows_end - rows_beg);
+
+  auto gradient = DecryptGradient(residuals, rows_beg, rows_end);
+
+  const auto &sgd = std::get<SgdOptimizer>(ctx_->optimizer.param);
+  double batch_size = static_cast<double>(rows_end - rows_beg);
+  // the intercept of the label party is not penalized
+  size_t penalized = ctx_->HasLabel() ? weights_.size() - 1 : weights_.size();
+  for (size_t j = 0; j < weights_.size(); ++j) {
+    double grad = gradient[j] / batch_size;
+    if (j < penalized) {
+      grad += ctx_->lr_param.l2_norm * weights_[j];
+    }
+    weights_[j] -= sgd.learning_rate() * grad;
+  }
+}
+
+std::vector<double> HeLrHandler::DecryptGradient(
+    const std::vector<MPInt> &residuals, int64_t rows_beg, int64_t rows_end) {
+  const auto &param = ctx_->paillier_param;
+  size_t col_num = features_.size();
+  std::vector<std::vector<int64_t>> columns(col_num);
+  for (size_t j = 0; j < col_num; ++j) {
+    columns[j].assign(features_[j].begin() + rows_beg,
+                      features_[j].begin() + rows_end);
+  }
+  auto gradient = peer_key_->Dot(residuals, columns);
+
+  // masks of MaskBits bits over gradients made non-negative, so the slots
+  // of a packed plaintext never carry into each other
+  gradient = peer_key_->AddPlain(
+      gradient, std::vector<MPInt>(col_num, MPInt(kGradientOffset)));
+  if (param.slots > 1) {
+    gradient = peer_key_->Pack(gradient, param.slots, param.slot_bits);
+  }
+  std::vector<uint64_t> low_masks;
+  auto masks = RandomMasks(
+      col_num, MaskBits(param.stat_bits, param.headroom_bits), &low_masks);
+  auto masked = peer_key_->Add(
+      gradient, peer_key_->Encrypt(
+                    PackPlaintexts(masks, param.slots, param.slot_bits)));
+  Send(SerializeCiphertexts(masked), kGradientTag);
+
+  UnmaskPeerGradient();
+
+  auto buf = Recv(kUnmaskedTag);
+  YACL_ENFORCE(static_cast<size_t>(buf.size()) == col_num * sizeof(uint64_t));
+  std::vector<double> result(col_num);
+  for (size_t j = 0; j < col_num; ++j) {
+    uint64_t value = 0;
+    std::memcpy(&value, buf.data<uint8_t>() + j * sizeof(value),
+                sizeof(value));
+    auto fxp = static_cast<int64_t>(value - low_masks[j] - kGradientOffset);
+    result[j] = std::ldexp(static_cast<double>(fxp), -2 * kFxpBits);
+  }
+
+  return result;
+}
+
+void HeLrHandler::UnmaskPeerGradient() {
+  const auto &param = ctx_->paillier_param;
+  size_t col_num = ctx_->io_param.feature_nums.at(peer_rank_) +
+                   (ctx_->io_param.label_rank == peer_rank_ ? 1 : 0);
+  auto masked = DeserializeCiphertexts(Recv(kGradientTag));
+  auto values = UnpackPlaintexts(secret_key_->Decrypt(masked), param.slots,
+                                 param.slot_bits, col_num);
+  Send(std::string(reinterpret_cast<const char *>(values.data()),
+                   values.size() * sizeof(uint64_t)),
+       kUnmaskedTag);
+}
+
+void HeLrHandler::ProduceOutput() const {
+  // the own weights, the intercept last on the label party
+  std::string out_file_name = lr::GetLrOutputFileName();
+  std::ofstream of(out_file_name);
+  YACL_ENFORCE(of, "open file={} failed", out_file_name);
+  for (auto weight : weights_) {
+    of << weight << '\n';
+  }
+}
+
+void HeLrHandler::Send(const std::string &buf, std::string_view tag) {
+  ctx_->ic_ctx->lctx->SendAsync(peer_rank_, buf, tag);
+}
+
+yacl::Buffer HeLrHandler::Recv(std::string_view tag) {
+  return ctx_->ic_ctx->lctx->Recv(peer_rank_, tag);
+}
+
+}  // namespace ic_impl::algo::he_lr
@@ -0,0 +1,115 @@
+// Copyright 2024 Ant Group Co., Ltd.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <array>
+#include <memory>
+#include <vector>
+
+#include "ic_impl/algo/he_lr/he_lr_context.h"
+#include "ic_impl/handler.h"
+#include "ic_impl/protocol_family/paillier/paillier_cipher.h"
+
+#include "interconnection/handshake/algos/lr.pb.h"
+
+namespace ic_impl::algo::he_lr {
+
+// Vertical logistic regression of two parties on Paillier encryption, for a
+// party with features and one holding the labels, with or without features
+// of its own.
+//
+// The sigmoid is taken to first order, so the residual of a row is
+// d = u_0 / 4 + u_1 / 4 + 1 / 2 - y, where u_i is the partial score of
+// party i. Each party encrypts its share of d under its own key, the label
+// party's one holding 1 / 2 - y, and adds its own share to the ciphertexts
+// of the peer. The gradient of its weights X^T * d is then computed on
+// ciphertexts of the peer, masked and decrypted by the peer. Only the
+// ciphertexts of a batch and the masked gradients cross the link, instead of
+// the shares of the whole feature matrix that SS-LR moves. Each party learns
+// the gradient of its own weights, as usual without a third party. The
+// intercept goes with the label party.
+class HeLrHandler : public AlgoV2Handler {
+ public:
+  explicit HeLrHandler(std::shared_ptr<HeLrContext> ctx);
+
+  ~HeLrHandler() override;
+
+ private:
+  bool ProcessHandshakeResponse(const HandshakeResponseV2 &) override;
+
+  HandshakeRequestV2 BuildHandshakeRequest() override;
+
+  HandshakeResponseV2 BuildHandshakeResponse() override;
+
+  status::ErrorStatus NegotiateHandshakeParams(
+      const std::vector<HandshakeRequestV2> &) override;
+
+  bool ResumeHandshake(const std::vector<HandshakeRequestV2> &,
+                       const HandshakeResponseV2 &) override;
+
+  status::ErrorStatus NegotiateLrAlgoParams(
+      const std::vector<HandshakeRequestV2> &requests);
+
+  status::ErrorStatus NegotiatePaillierParams(
+      const std::vector<HandshakeRequestV2> &requests);
+
+  status::ErrorStatus NegotiateLrIoParams(
+      const std::vector<HandshakeRequestV2> &requests);
+
+  bool PrepareDataset() override;
+
+  // Read the dataset and generate the key pair during the handshake
+  void LoadDataset() override;
+
+  void RunAlgo() override;
+
+  void ExchangePublicKeys();
+
+  void Train();
+
+  void TrainStep(int64_t rows_beg, int64_t rows_end);
+
+  // The gradient of the own weights over the rows, given the ciphertexts of
+  // their residuals under the key of the peer
+  std::vector<double> DecryptGradient(
+      const std::vector<yacl::math::MPInt> &residuals, int64_t rows_beg,
+      int64_t rows_end);
+
+  // Decrypt the masked gradient of the peer and send it back
+  void UnmaskPeerGradient();
+
+  void ProduceOutput() const;
+
+  void Send(const std::string &buf, std::string_view tag);
+
+  yacl::Buffer Recv(std::string_view tag);
+
+  std::shared_ptr<HeLrContext> ctx_;
+  int32_t peer_rank_;
+
+  // rows and columns of the dataset file, counted before it is loaded
+  std::array<int64_t, 2> counted_shape_{};
+
+  // fixed-point features of the own weights by column, the intercept last
+  // on the label party
+  std::vector<std::vector<int64_t>> features_;
+  std::vector<double> labels_;
+  std::vector<double> weights_;
+
+  std::unique_ptr<protocol_family::paillier::PaillierSecretKey> secret_key_;
+  std::unique_ptr<protocol_family::paillier::PaillierPublicKey> peer_key_;
+};
+
+}  // namespace ic_impl::algo::he_lr
@@ -0,0 +1,182 @@
+// Copyright 2024 Ant Group Co., Ltd.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include "ic_impl/algo/he_ss/he_ss_context.h"
+
+#include <fstream>
+
+#include "absl/strings/match.h"
+#include "absl/strings/numbers.h"
+#include "absl/strings/str_split.h"
+#include "absl/strings/strip.h"
+#include "gflags/gflags.h"
+
+#include "ic_impl/util.h"
+
+DEFINE_string(he_ss_input, "",
+              "values to convert, one integer per line, or the ciphertexts "
+              "written by SS2HE");
+DEFINE_string(he_ss_output, "/tmp/he_ss_result",
+              "full path name of the shares or ciphertexts converted");
+DEFINE_bool(he_ss_key_owner, false,
+            "whether this party owns the Paillier key pair");
+DEFINE_string(he_ss_key_path, "",
+              "file keeping the Paillier key pair of the key owner, "
+              "generated if missing");
+DEFINE_int64(he_ss_batch_size, 8192, "number of values converted per round");
+
+namespace ic_impl::algo::he_ss {
+
+namespace {
+
+constexpr std::string_view kCiphertextHeader = "# paillier";
+
+yacl::math::MPInt ParseHex(std::string_view hex) {
+  absl::ConsumePrefix(&hex, "0x");
+  return yacl::math::MPInt(std::string(hex), 16);
+}
+
+CiphertextFile ParseCiphertextHeader(std::string_view line) {
+  YACL_ENFORCE(absl::ConsumePrefix(&line, kCiphertextHeader),
+               "not a ciphertext file");
+  CiphertextFile file;
+  for (std::string_view field : absl::StrSplit(line, ' ', absl::SkipEmpty())) {
+    std::pair<std::string_view, std::string_view> name_value =
+        absl::StrSplit(field, absl::MaxSplits('=', 1));
+    const auto &[name, value] = name_value;
+    bool parsed = true;
+    if (name == "n") {
+      file.n = ParseHex(value);
+    } else if (name == "slots") {
+      parsed = absl::SimpleAtoi(value, &file.slots);
+    } else if (name == "slot_bits") {
+      parsed = absl::SimpleAtoi(value, &file.slot_bits);
+    } else if (name == "items") {
+      parsed = absl::SimpleAtoi(value, &file.item_num);
+    }
+    YACL_ENFORCE(parsed, "invalid ciphertext header field {}", field);
+  }
+  YACL_ENFORCE(!file.n.IsZero() && file.slots > 0 && file.slot_bits > 0,
+               "incomplete ciphertext header");
+
+  return file;
+}
+
+}  // namespace
+
+std::shared_ptr<HeSsContext> CreateHeSsContext(
+    std::shared_ptr<IcContext> ic_ctx) {
+  auto ctx = std::make_shared<HeSsContext>();
+  ctx->batch_size =
+      util::GetParamEnv("he_ss_batch_size", FLAGS_he_ss_batch_size);
+  YACL_ENFORCE(ctx->batch_size > 0, "invalid batch size {}", ctx->batch_size);
+  ctx->paillier_param = protocol_family::paillier::SuggestedPaillierParam();
+  ctx->key_owner = util::GetParamEnv("he_ss_key_owner", FLAGS_he_ss_key_owner);
+  ctx->input_path = util::GetParamEnv("he_ss_input", FLAGS_he_ss_input);
+  ctx->output_path = util::GetParamEnv("he_ss_output", FLAGS_he_ss_output);
+  ctx->key_path = util::GetParamEnv("he_ss_key_path", FLAGS_he_ss_key_path);
+  ctx->ic_ctx = std::move(ic_ctx);
+
+  return ctx;
+}
+
+bool IsCiphertextFile(const std::string &path) {
+  std::ifstream in(path);
+  std::string line;
+  return std::getline(in, line) && absl::StartsWith(line, kCiphertextHeader);
+}
+
+int64_t CountInputItems(const std::string &path) {
+  std::ifstream in(path);
+  YACL_ENFORCE(in, "cannot open {}", path);
+  std::string line;
+  if (std::getline(in, line) && absl::StartsWith(line, kCiphertextHeader)) {
+    return ParseCiphertextHeader(line).item_num;
+  }
+
+  int64_t count = 0;
+  do {
+    if (!absl::StripAsciiWhitespace(line).empty()) {
+      ++count;
+    }
+  } while (std::getline(in, line));
+
+  return count;
+}
+
+std::vector<uint64_t> ReadValues(const std::string &path) {
+  std::ifstream in(path);
+  YACL_ENFORCE(in, "cannot open {}", path);
+  std::vector<uint64_t> values;
+  std::string line;
+  while (std::getline(in, line)) {
+    auto text = absl::StripAsciiWhitespace(line);
+    if (text.empty()) {
+      continue;
+    }
+    uint64_t value = 0;
+    int64_t signed_value = 0;
+    if (absl::SimpleAtoi(text, &value)) {
+      values.push_back(value);
+    } else if (absl::SimpleAtoi(text, &signed_value)) {
+      values.push_back(static_cast<uint64_t>(signed_value));
+    } else {
+      YACL_THROW("invalid value {} in {}", text, path);
+    }
+  }
+
+  return values;
+}
+
+void WriteValues(const std::string &path, const std::vector<uint64_t> &values) {
+  std::ofstream out(path);
+  YACL_ENFORCE(out, "cannot open {}", path);
+  for (auto value : values) {
+    out << value << '\n';
+  }
+  YACL_ENFORCE(out.flush(), "write {} failed", path);
+}
+
+CiphertextFile ReadCiphertexts(const std::string &path) {
+  std::ifstream in(path);
+  YACL_ENFORCE(in, "cannot open {}", path);
+  std::string line;
+  YACL_ENFORCE(std::getline(in, line), "empty ciphertext file {}", path);
+  auto file = ParseCiphertextHeader(line);
+  while (std::getline(in, line)) {
+    auto text = absl::StripAsciiWhitespace(line);
+    if (!text.empty()) {
+      file.ciphertexts.push_back(ParseHex(text));
+    }
+  }
+  auto expected = (file.item_num + file.slots - 1) / file.slots;
+  YACL_ENFORCE(static_cast<int64_t>(file.ciphertexts.size()) == expected,
+               "{} holds {} ciphertexts, {} expected", path,
+               file.ciphertexts.size(), expected);
+
+  return file;
+}
+
+void WriteCiphertexts(const std::string &path, const CiphertextFile &file) {
+  std::ofstream out(path);
+  YACL_ENFORCE(out, "cannot open {}", path);
+  out << kCiphertextHeader << " n=" << file.n.ToHexString()
+      << " slots=" << file.slots << " slot_bits=" << file.slot_bits
+      << " items=" << file.item_num << '\n';
+  for (const auto &ciphertext : file.ciphertexts) {
+    out << ciphertext.ToHexString() << '\n';
+  }
+  YACL_ENFORCE(out.flush(), "write {} failed", path);
+}
+
+}  // namespace ic_impl::algo::he_ss
@@ -0,0 +1,73 @@
+// Copyright 2024 Ant Group Co., Ltd.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "yacl/math/mpint/mp_int.h"
+
+#include "ic_impl/context.h"
+#include "ic_impl/protocol_family/paillier/paillier.h"
+
+namespace ic_impl::algo::he_ss {
+
+struct HeSsContext {
+  // values converted per round
+  int64_t batch_size{};
+  protocol_family::paillier::PaillierParam paillier_param;
+  // whether this party owns the Paillier key pair
+  bool key_owner{};
+  // the owner of the key pair, fixed by the handshake
+  int32_t key_rank = -1;
+  int64_t item_num{};
+  std::string input_path;
+  std::string output_path;
+  // file keeping the key pair of the key owner, empty if it is not kept
+  std::string key_path;
+  std::shared_ptr<IcContext> ic_ctx;
+
+  bool IsKeyOwner() const {
+    return static_cast<int32_t>(ic_ctx->lctx->Rank()) == key_rank;
+  }
+};
+
+// Ciphertexts under the key of the key owner as written by SS2HE, holding
+// `slots` values of `slot_bits` bits each
+struct CiphertextFile {
+  yacl::math::MPInt n;
+  int32_t slots = 1;
+  int32_t slot_bits{};
+  int64_t item_num{};
+  std::vector<yacl::math::MPInt> ciphertexts;
+};
+
+std::shared_ptr<HeSsContext> CreateHeSsContext(std::shared_ptr<IcContext>);
+
+// Whether `path` holds ciphertexts rather than plain values
+bool IsCiphertextFile(const std::string &path);
+
+// The number of values in `path`, either kind
+int64_t CountInputItems(const std::string &path);
+
+// The values of `path`, one integer per line, taken modulo 2^64
+std::vector<uint64_t> ReadValues(const std::string &path);
+
+void WriteValues(const std::string &path, const std::vector<uint64_t> &values);
+
+CiphertextFile ReadCiphertexts(const std::string &path);
+
+void WriteCiphertexts(const std::string &path, const CiphertextFile &file);
+
+}  // namespace ic_impl::algo::he_ss
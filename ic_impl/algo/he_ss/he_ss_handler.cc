@@ -0,0 +1,507 @@
+// Copyright 2024 Ant Group Co., Ltd.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include "ic_impl/algo/he_ss/he_ss_handler.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+
+#include "spdlog/spdlog.h"
+
+#include "ic_impl/proto/he_ss.pb.h"
+#include "ic_impl/proto/paillier.pb.h"
+#include "ic_impl/proto/vendor_types.pb.h"
+
+namespace ic_impl::algo::he_ss {
+
+using ic_impl::proto::ALGO_TYPE_HE2SS;
+using ic_impl::proto::ALGO_TYPE_SS2HE;
+using ic_impl::proto::HeSsDataIoProposal;
+using ic_impl::proto::HeSsDataIoResult;
+using ic_impl::proto::HeSsHyperparamsProposal;
+using ic_impl::proto::HeSsHyperparamsResult;
+using ic_impl::proto::PaillierProtocolProposal;
+using ic_impl::proto::PaillierProtocolResult;
+using ic_impl::proto::PROTOCOL_FAMILY_PAILLIER;
+
+using protocol_family::paillier::BuildPaillierProposal;
+using protocol_family::paillier::BuildPaillierResult;
+using protocol_family::paillier::DeserializeCiphertexts;
+using protocol_family::paillier::MaskBits;
+using protocol_family::paillier::NegotiatePaillierParam;
+using protocol_family::paillier::PackPlaintexts;
+using protocol_family::paillier::PaillierPublicKey;
+using protocol_family::paillier::PaillierSecretKey;
+using protocol_family::paillier::ProcessPaillierResult;
+using protocol_family::paillier::RandomMasks;
+using protocol_family::paillier::SerializeCiphertexts;
+using protocol_family::paillier::UnpackPlaintexts;
+using yacl::math::MPInt;
+
+namespace {
+
+constexpr char kPublicKeyTag[] = "he_ss_public_key";
+constexpr char kBatchTag[] = "he_ss_batch";
+
+std::vector<PaillierProtocolProposal> ExtractReqPaillierParams(
+    const std::vector<HandshakeRequestV2> &requests) {
+  return ExtractReqPfParams<PaillierProtocolProposal>(requests,
+                                                      PROTOCOL_FAMILY_PAILLIER);
+}
+
+std::optional<PaillierProtocolResult> ExtractRspPaillierParam(
+    const HandshakeResponseV2 &response) {
+  return ExtractRspPfParam<PaillierProtocolResult>(response,
+                                                   PROTOCOL_FAMILY_PAILLIER);
+}
+
+std::vector<MPInt> ToPlaintexts(const std::vector<uint64_t> &values,
+                                size_t begin, size_t end) {
+  std::vector<MPInt> plaintexts;
+  plaintexts.reserve(end - begin);
+  for (size_t i = begin; i < end; ++i) {
+    plaintexts.emplace_back(values[i]);
+  }
+  return plaintexts;
+}
+
+std::unique_ptr<PaillierSecretKey> LoadOrGenerateKey(const std::string &path,
+                                                     int32_t key_size) {
+  if (!path.empty() && std::filesystem::exists(path)) {
+    std::ifstream in(path, std::ios::binary);
+    std::stringstream buf;
+    buf << in.rdbuf();
+    YACL_ENFORCE(in, "read {} failed", path);
+    auto key = std::make_unique<PaillierSecretKey>(
+        PaillierSecretKey::Deserialize(buf.str()));
+    YACL_ENFORCE(key->PublicKey().N().BitCount() ==
+                     static_cast<size_t>(key_size),
+                 "the key pair in {} is not {} bits", path, key_size);
+    return key;
+  }
+
+  auto key = std::make_unique<PaillierSecretKey>(key_size);
+  if (!path.empty()) {
+    // created owner only, the primes are never readable by others
+    auto tmp_path = path + ".tmp";
+    ::unlink(tmp_path.c_str());
+    int fd = ::open(tmp_path.c_str(), O_CREAT | O_EXCL | O_WRONLY, 0600);
+    YACL_ENFORCE(fd >= 0, "open {} failed, errno={}", tmp_path, errno);
+    auto data = key->Serialize();
+    size_t written = 0;
+    while (written < data.size()) {
+      auto ret = ::write(fd, data.data() + written, data.size() - written);
+      if (ret < 0 && errno == EINTR) {
+        continue;
+      }
+      if (ret <= 0) {
+        break;
+      }
+      written += ret;
+    }
+    bool synced = written == data.size() && ::fsync(fd) == 0;
+    int write_errno = errno;
+    ::close(fd);
+    YACL_ENFORCE(synced, "write {} failed, errno={}", tmp_path, write_errno);
+    std::filesystem::rename(tmp_path, path);
+  }
+  return key;
+}
+
+}  // namespace
+
+HeSsHandler::HeSsHandler(std::shared_ptr<HeSsContext> ctx)
+    : AlgoV2Handler(ctx->ic_ctx), ctx_(std::move(ctx)) {
+  YACL_ENFORCE(ctx_->ic_ctx->lctx->WorldSize() == 2,
+               "HE and SS conversions run between two parties");
+  peer_rank_ = ctx_->ic_ctx->lctx->Rank() == 0 ? 1 : 0;
+}
+
+HeSsHandler::~HeSsHandler() = default;
+
+bool HeSsHandler::PrepareDataset() {
+  bool he2ss = ctx_->ic_ctx->algo == ALGO_TYPE_HE2SS;
+  if (ctx_->input_path.empty()) {
+    // the key owner converts the input of the other party only
+    YACL_ENFORCE(he2ss && ctx_->key_owner, "--he_ss_input is required");
+    ctx_->item_num = 0;
+  } else {
+    ctx_->item_num = CountInputItems(ctx_->input_path);
+    YACL_ENFORCE(ctx_->item_num > 0, "empty input {}", ctx_->input_path);
+  }
+  // confirmed by the handshake
+  ctx_->key_rank =
+      ctx_->key_owner ? static_cast<int32_t>(ctx_->ic_ctx->lctx->Rank())
+                      : peer_rank_;
+
+  return true;
+}
+
+void HeSsHandler::LoadDataset() {
+  if (ctx_->key_owner) {
+    // generating primes takes a while, better done during the handshake
+    secret_key_ = LoadOrGenerateKey(ctx_->key_path,
+                                    ctx_->paillier_param.key_size);
+    const auto &param = ctx_->paillier_param;
+    if (ctx_->ic_ctx->algo == ALGO_TYPE_SS2HE && param.pool_size > 0) {
+      // the random factors of SS2HE are ready by the end of the handshake
+      secret_key_->StartRandomnessPool(param.pool_size, param.pool_threads);
+    }
+  }
+
+  if (ctx_->input_path.empty()) {
+    return;
+  }
+  if (IsCiphertextFile(ctx_->input_path)) {
+    YACL_ENFORCE(ctx_->ic_ctx->algo == ALGO_TYPE_HE2SS && !ctx_->key_owner,
+                 "only the other party of HE2SS takes ciphertexts");
+    ciphertexts_ = ReadCiphertexts(ctx_->input_path);
+  } else {
+    values_ = ReadValues(ctx_->input_path);
+  }
+}
+
+HandshakeRequestV2 HeSsHandler::BuildHandshakeRequest() {
+  HandshakeRequestV2 request;
+  request.set_version(ctx_->ic_ctx->version);
+  request.set_requester_rank(ctx_->ic_ctx->lctx->Rank());
+
+  request.add_supported_algos(ctx_->ic_ctx->algo);
+  HeSsHyperparamsProposal he_ss_param;
+  he_ss_param.add_supported_versions(1);
+  he_ss_param.set_batch_size(ctx_->batch_size);
+  request.add_algo_params()->PackFrom(he_ss_param);
+
+  request.add_protocol_families(PROTOCOL_FAMILY_PAILLIER);
+  request.add_protocol_family_params()->PackFrom(
+      BuildPaillierProposal(ctx_->paillier_param));
+
+  HeSsDataIoProposal he_ss_io;
+  he_ss_io.add_supported_versions(1);
+  he_ss_io.set_item_num(ctx_->item_num);
+  he_ss_io.set_key_owner(ctx_->key_owner);
+  request.mutable_io_param()->PackFrom(he_ss_io);
+
+  return request;
+}
+
+status::ErrorStatus HeSsHandler::NegotiateHandshakeParams(
+    const std::vector<HandshakeRequestV2> &requests) {
+  auto status = NegotiateHeSsAlgoParams(requests);
+  if (!status.ok()) {
+    return status;
+  }
+
+  status = NegotiatePaillierParams(requests);
+  if (!status.ok()) {
+    return status;
+  }
+
+  status = NegotiateHeSsIoParams(requests);
+  if (!status.ok()) {
+    return status;
+  }
+
+  return status::OkStatus();
+}
+
+status::ErrorStatus HeSsHandler::NegotiateHeSsAlgoParams(
+    const std::vector<HandshakeRequestV2> &requests) {
+  auto he_ss_params = ExtractReqAlgoParams<HeSsHyperparamsProposal>(
+      requests, ctx_->ic_ctx->algo);
+  if (he_ss_params.empty()) {
+    return status::InvalidRequestError(
+        "certain request has no he_ss algo params");
+  }
+
+  for (const auto &he_ss_param : he_ss_params) {
+    if (he_ss_param.batch_size() <= 0) {
+      return status::UnsupportedArgumentError("invalid batch size");
+    }
+    ctx_->batch_size = std::min(ctx_->batch_size, he_ss_param.batch_size());
+  }
+
+  return status::OkStatus();
+}
+
+status::ErrorStatus HeSsHandler::NegotiatePaillierParams(
+    const std::vector<HandshakeRequestV2> &requests) {
+  auto paillier_params = ExtractReqPaillierParams(requests);
+  if (paillier_params.empty()) {
+    return status::InvalidRequestError(
+        "certain request has no paillier params");
+  }
+
+  if (!NegotiatePaillierParam(paillier_params, &ctx_->paillier_param)) {
+    return status::UnsupportedArgumentError("negotiate paillier params failed");
+  }
+
+  return status::OkStatus();
+}
+
+status::ErrorStatus HeSsHandler::NegotiateHeSsIoParams(
+    const std::vector<HandshakeRequestV2> &requests) {
+  auto io_params = ExtractReqIoParams<HeSsDataIoProposal>(requests);
+  if (io_params.empty()) {
+    return status::InvalidRequestError(
+        "certain request has no he_ss io params");
+  }
+
+  // two parties, so a single request
+  const auto &io_param = io_params.front();
+  if (io_param.key_owner() == ctx_->key_owner) {
+    return status::HandshakeRefusedError(
+        "exactly one party must own the key pair");
+  }
+  ctx_->key_rank = ctx_->key_owner
+                       ? static_cast<int32_t>(ctx_->ic_ctx->lctx->Rank())
+                       : requests.front().requester_rank();
+
+  if (ctx_->ic_ctx->algo == ALGO_TYPE_HE2SS) {
+    // the key owner of HE2SS has no input
+    ctx_->item_num = std::max(ctx_->item_num, io_param.item_num());
+  } else if (io_param.item_num() != ctx_->item_num) {
+    return status::HandshakeRefusedError("share numbers mismatch");
+  }
+
+  return status::OkStatus();
+}
+
+HandshakeResponseV2 HeSsHandler::BuildHandshakeResponse() {
+  HandshakeResponseV2 response;
+  response.mutable_header()->set_error_code(org::interconnection::OK);
+
+  response.set_algo(ctx_->ic_ctx->algo);
+  HeSsHyperparamsResult he_ss_param;
+  he_ss_param.set_version(1);
+  he_ss_param.set_batch_size(ctx_->batch_size);
+  response.mutable_algo_param()->PackFrom(he_ss_param);
+
+  response.add_protocol_families(PROTOCOL_FAMILY_PAILLIER);
+  response.add_protocol_family_params()->PackFrom(
+      BuildPaillierResult(ctx_->paillier_param));
+
+  HeSsDataIoResult he_ss_io;
+  he_ss_io.set_version(1);
+  he_ss_io.set_item_num(ctx_->item_num);
+  he_ss_io.set_key_rank(ctx_->key_rank);
+  response.mutable_io_param()->PackFrom(he_ss_io);
+
+  return response;
+}
+
+bool HeSsHandler::ProcessHandshakeResponse(
+    const HandshakeResponseV2 &response) {
+  if (!AlgoV2Handler::ProcessHandshakeResponse(response)) {
+    return false;
+  }
+
+  YACL_ENFORCE(response.algo() == ctx_->ic_ctx->algo);
+  HeSsHyperparamsResult he_ss_param;
+  YACL_ENFORCE(response.algo_param().UnpackTo(&he_ss_param));
+  YACL_ENFORCE(he_ss_param.batch_size() > 0 &&
+               he_ss_param.batch_size() <= ctx_->batch_size);
+  ctx_->batch_size = he_ss_param.batch_size();
+
+  auto paillier_param_optional = ExtractRspPaillierParam(response);
+  YACL_ENFORCE(paillier_param_optional.has_value());
+  ProcessPaillierResult(paillier_param_optional.value(),
+                        &ctx_->paillier_param);
+
+  HeSsDataIoResult he_ss_io;
+  YACL_ENFORCE(response.io_param().UnpackTo(&he_ss_io));
+  if (ctx_->key_owner) {
+    YACL_ENFORCE(he_ss_io.key_rank() ==
+                 static_cast<int32_t>(ctx_->ic_ctx->lctx->Rank()));
+  } else {
+    YACL_ENFORCE(he_ss_io.key_rank() == peer_rank_);
+  }
+  ctx_->key_rank = he_ss_io.key_rank();
+  if (ctx_->item_num != 0) {
+    YACL_ENFORCE(he_ss_io.item_num() == ctx_->item_num);
+  }
+  ctx_->item_num = he_ss_io.item_num();
+
+  return true;
+}
+
+void HeSsHandler::RunAlgo() {
+  // the key owner of HE2SS learns the number from the handshake
+  YACL_ENFORCE(ctx_->item_num > 0, "nothing to convert");
+  auto start = std::chrono::steady_clock::now();
+  ExchangePublicKey();
+  if (ctx_->ic_ctx->algo == ALGO_TYPE_HE2SS) {
+    RunHe2Ss();
+  } else {
+    RunSs2He();
+  }
+
+  std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+  SPDLOG_INFO(
+      "rank:{} algo:{} items:{} slots:{} seconds:{:.3f} "
+      "conversions_per_second:{:.0f} sent_bytes:{}",
+      ctx_->ic_ctx->lctx->Rank(),
+      ic_impl::proto::VendorAlgoType_Name(ctx_->ic_ctx->algo), ctx_->item_num,
+      ctx_->paillier_param.slots, elapsed.count(),
+      ctx_->item_num / std::max(elapsed.count(), 1e-9), sent_bytes_);
+}
+
+void HeSsHandler::ExchangePublicKey() {
+  if (ctx_->IsKeyOwner()) {
+    YACL_ENFORCE(secret_key_);
+    public_key_ =
+        std::make_unique<PaillierPublicKey>(secret_key_->PublicKey());
+    Send(public_key_->Serialize(), kPublicKeyTag);
+  } else {
+    auto buf = Recv(kPublicKeyTag);
+    public_key_ = std::make_unique<PaillierPublicKey>(
+        PaillierPublicKey::Deserialize(buf));
+    YACL_ENFORCE(public_key_->N().BitCount() ==
+                     static_cast<size_t>(ctx_->paillier_param.key_size),
+                 "public key of unexpected size");
+    const auto &param = ctx_->paillier_param;
+    if (ctx_->ic_ctx->algo == ALGO_TYPE_HE2SS && param.pool_size > 0) {
+      public_key_->StartRandomnessPool(param.pool_size, param.pool_threads);
+    }
+  }
+}
+
+void HeSsHandler::RunHe2Ss() {
+  const auto &param = ctx_->paillier_param;
+  size_t item_num = ctx_->item_num;
+  std::vector<uint64_t> shares(item_num);
+
+  if (ctx_->IsKeyOwner()) {
+    for (size_t begin = 0; begin < item_num; begin += BatchSize()) {
+      size_t end = std::min(begin + BatchSize(), item_num);
+      auto masked = DeserializeCiphertexts(Recv(kBatchTag));
+      auto values = UnpackPlaintexts(secret_key_->Decrypt(masked),
+                                     param.slots, param.slot_bits,
+                                     end - begin);
+      std::copy(values.begin(), values.end(), shares.begin() + begin);
+    }
+    WriteValues(ctx_->output_path, shares);
+    return;
+  }
+
+  bool packed_input = false;
+  if (ciphertexts_.has_value()) {
+    YACL_ENFORCE(ciphertexts_->n == public_key_->N(),
+                 "the ciphertexts are not under the key of the key owner");
+    YACL_ENFORCE(static_cast<size_t>(ciphertexts_->item_num) == item_num);
+    packed_input = ciphertexts_->slots > 1;
+    if (packed_input) {
+      // packed by SS2HE, whose slots leave room for the masks as well
+      YACL_ENFORCE(ciphertexts_->slots == param.slots &&
+                       ciphertexts_->slot_bits == param.slot_bits,
+                   "the ciphertexts are packed differently");
+    }
+  }
+
+  int32_t mask_bits = MaskBits(param.stat_bits, param.headroom_bits);
+  std::vector<uint64_t> low_masks;
+  for (size_t begin = 0; begin < item_num; begin += BatchSize()) {
+    size_t end = std::min(begin + BatchSize(), item_num);
+    size_t count = end - begin;
+
+    std::vector<MPInt> ciphertexts;
+    if (packed_input) {
+      size_t slots = param.slots;
+      ciphertexts.assign(ciphertexts_->ciphertexts.begin() + begin / slots,
+                         ciphertexts_->ciphertexts.begin() +
+                             (end + slots - 1) / slots);
+    } else {
+      if (ciphertexts_.has_value()) {
+        ciphertexts.assign(ciphertexts_->ciphertexts.begin() + begin,
+                           ciphertexts_->ciphertexts.begin() + end);
+      } else {
+        // plain input stands for the ciphertexts of an earlier HE step
+        ciphertexts = public_key_->Encrypt(ToPlaintexts(values_, begin, end));
+      }
+      if (param.slots > 1) {
+        ciphertexts =
+            public_key_->Pack(ciphertexts, param.slots, param.slot_bits);
+      }
+    }
+
+    auto masks = RandomMasks(count, mask_bits, &low_masks);
+    for (size_t i = 0; i < count; ++i) {
+      shares[begin + i] = -low_masks[i];
+    }
+    auto masked = public_key_->Add(
+        ciphertexts,
+        public_key_->Encrypt(
+            PackPlaintexts(masks, param.slots, param.slot_bits)));
+    Send(SerializeCiphertexts(masked), kBatchTag);
+  }
+
+  WriteValues(ctx_->output_path, shares);
+}
+
+void HeSsHandler::RunSs2He() {
+  const auto &param = ctx_->paillier_param;
+  size_t item_num = ctx_->item_num;
+  YACL_ENFORCE(values_.size() == item_num);
+
+  if (ctx_->IsKeyOwner()) {
+    for (size_t begin = 0; begin < item_num; begin += BatchSize()) {
+      size_t end = std::min(begin + BatchSize(), item_num);
+      auto encrypted = public_key_->Encrypt(PackPlaintexts(
+          ToPlaintexts(values_, begin, end), param.slots, param.slot_bits));
+      Send(SerializeCiphertexts(encrypted), kBatchTag);
+    }
+    return;
+  }
+
+  CiphertextFile result;
+  result.n = public_key_->N();
+  result.slots = param.slots;
+  result.slot_bits = param.slot_bits;
+  result.item_num = item_num;
+  for (size_t begin = 0; begin < item_num; begin += BatchSize()) {
+    size_t end = std::min(begin + BatchSize(), item_num);
+    auto encrypted = DeserializeCiphertexts(Recv(kBatchTag));
+    auto sums = public_key_->AddPlain(
+        encrypted, PackPlaintexts(ToPlaintexts(values_, begin, end),
+                                  param.slots, param.slot_bits));
+    std::move(sums.begin(), sums.end(),
+              std::back_inserter(result.ciphertexts));
+  }
+
+  WriteCiphertexts(ctx_->output_path, result);
+}
+
+void HeSsHandler::Send(const std::string &buf, std::string_view tag) {
+  ctx_->ic_ctx->lctx->SendAsync(peer_rank_, buf, tag);
+  sent_bytes_ += buf.size();
+}
+
+yacl::Buffer HeSsHandler::Recv(std::string_view tag) {
+  return ctx_->ic_ctx->lctx->Recv(peer_rank_, tag);
+}
+
+size_t HeSsHandler::BatchSize() const {
+  // a batch never splits a ciphertext
+  size_t slots = ctx_->paillier_param.slots;
+  return std::max<size_t>(ctx_->batch_size / slots, 1) * slots;
+}
+
+}  // namespace ic_impl::algo::he_ss
@@ -0,0 +1,94 @@
+// Copyright 2024 Ant Group Co., Ltd.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#pragma once
+
+#include <memory>
+#include <optional>
+#include <vector>
+
+#include "ic_impl/algo/he_ss/he_ss_context.h"
+#include "ic_impl/handler.h"
+#include "ic_impl/protocol_family/paillier/paillier_cipher.h"
+
+namespace ic_impl::algo::he_ss {
+
+// Conversion between Paillier ciphertexts under the key of one party and
+// additive shares in Z_2^64 of two parties.
+//
+// HE2SS: the other party adds a fresh mask r of 64 + headroom_bits +
+// stat_bits bits to each Enc(x), the key owner decrypts x + r as its share
+// and the other party keeps -r. SS2HE: the key owner encrypts its shares,
+// the other party adds its own and keeps Enc(x + k * 2^64), k in {0, 1}.
+// Several values are packed into one ciphertext if both parties agree.
+class HeSsHandler : public AlgoV2Handler {
+ public:
+  explicit HeSsHandler(std::shared_ptr<HeSsContext> ctx);
+
+  ~HeSsHandler() override;
+
+ private:
+  bool ProcessHandshakeResponse(const HandshakeResponseV2 &) override;
+
+  HandshakeRequestV2 BuildHandshakeRequest() override;
+
+  HandshakeResponseV2 BuildHandshakeResponse() override;
+
+  status::ErrorStatus NegotiateHandshakeParams(
+      const std::vector<HandshakeRequestV2> &) override;
+
+  status::ErrorStatus NegotiateHeSsAlgoParams(
+      const std::vector<HandshakeRequestV2> &requests);
+
+  status::ErrorStatus NegotiatePaillierParams(
+      const std::vector<HandshakeRequestV2> &requests);
+
+  status::ErrorStatus NegotiateHeSsIoParams(
+      const std::vector<HandshakeRequestV2> &requests);
+
+  bool PrepareDataset() override;
+
+  // Read the input and, on the key owner, load or generate the key pair
+  void LoadDataset() override;
+
+  void RunAlgo() override;
+
+  void RunHe2Ss();
+
+  void RunSs2He();
+
+  // Send the public key from the key owner to the other party
+  void ExchangePublicKey();
+
+  void Send(const std::string &buf, std::string_view tag);
+
+  yacl::Buffer Recv(std::string_view tag);
+
+  // values per round, whole ciphertexts each
+  size_t BatchSize() const;
+
+  std::shared_ptr<HeSsContext> ctx_;
+  int32_t peer_rank_;
+
+  std::unique_ptr<protocol_family::paillier::PaillierSecretKey> secret_key_;
+  std::unique_ptr<protocol_family::paillier::PaillierPublicKey> public_key_;
+
+  // plain input values
+  std::vector<uint64_t> values_;
+  // ciphertext input of HE2SS
+  std::optional<CiphertextFile> ciphertexts_;
+
+  size_t sent_bytes_ = 0;
+};
+
+}  // namespace ic_impl::algo::he_ss
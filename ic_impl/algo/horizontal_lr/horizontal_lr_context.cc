@@ -0,0 +1,37 @@
+// Copyright 2024 Ant Group Co., Ltd.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "ic_impl/algo/horizontal_lr/horizontal_lr_context.h"
+
+namespace ic_impl::algo::horizontal_lr {
+
+std::shared_ptr<HorizontalLrContext> CreateHorizontalLrContext(
+    std::shared_ptr<IcContext> ic_ctx) {
+  auto ctx = std::make_shared<HorizontalLrContext>();
+  ctx->lr_param = lr::SuggestedLrHyperParam();
+
+  ctx->io_param = lr::SuggestedLrIoParam(ic_ctx);
+
+  ctx->optimizer = optimizer::SuggestedOptimizer();
+
+  ctx->ss_param = protocol_family::ss::SuggestedSsProtocolParam();
+
+  ctx->agg_param = protocol_family::ss::SuggestedSecureAggParam();
+
+  ctx->ic_ctx = std::move(ic_ctx);
+
+  return ctx;
+}
+
+}  // namespace ic_impl::algo::horizontal_lr
@@ -0,0 +1,45 @@
+// Copyright 2024 Ant Group Co., Ltd.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#pragma once
+
+#include <memory>
+
+#include "ic_impl/algo/lr/lr_context.h"
+#include "ic_impl/algo/lr/optimizer.h"
+#include "ic_impl/context.h"
+#include "ic_impl/protocol_family/ss/secure_aggregation.h"
+#include "ic_impl/protocol_family/ss/ss.h"
+
+namespace ic_impl::algo::horizontal_lr {
+
+struct HorizontalLrContext {
+  lr::LrHyperParam lr_param;
+
+  // the own sample size, and the feature numbers shared by every party
+  lr::LrIoParam io_param;
+
+  optimizer::Optimizer optimizer;
+
+  // fraction bits of the aggregated weights
+  protocol_family::ss::SsProtocolParam ss_param;
+
+  protocol_family::ss::SecureAggParam agg_param;
+
+  std::shared_ptr<IcContext> ic_ctx;
+};
+
+std::shared_ptr<HorizontalLrContext> CreateHorizontalLrContext(
+    std::shared_ptr<IcContext>);
+
+}  // namespace ic_impl::algo::horizontal_lr
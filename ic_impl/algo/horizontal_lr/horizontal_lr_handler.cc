@@ -0,0 +1,483 @@
+// Copyright 2024 Ant Group Co., Ltd.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "ic_impl/algo/horizontal_lr/horizontal_lr_handler.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <set>
+
+#include "gflags/gflags.h"
+#include "spdlog/spdlog.h"
+
+#include "ic_impl/proto/secure_agg.pb.h"
+#include "ic_impl/proto/vendor_types.pb.h"
+
+#include "interconnection/handshake/protocol_family/ss.pb.h"
+
+DECLARE_bool(disable_handshake);
+
+namespace ic_impl::algo::horizontal_lr {
+
+using ic_impl::proto::ALGO_TYPE_HORIZONTAL_LR;
+using ic_impl::proto::SecureAggExt;
+
+using org::interconnection::v2::PROTOCOL_FAMILY_SS;
+
+using org::interconnection::v2::algos::LrDataIoProposal;
+using org::interconnection::v2::algos::LrDataIoResult;
+using org::interconnection::v2::algos::LAST_BATCH_POLICY_DISCARD;
+using org::interconnection::v2::algos::LrHyperparamsProposal;
+using org::interconnection::v2::algos::LrHyperparamsResult;
+using org::interconnection::v2::algos::OPTIMIZER_SGD;
+using org::interconnection::v2::algos::SgdOptimizer;
+
+using org::interconnection::v2::protocol::CRYPTO_TYPE_AES128_CTR;
+using org::interconnection::v2::protocol::FIELD_TYPE_64;
+using org::interconnection::v2::protocol::PrgConfigProposal;
+using org::interconnection::v2::protocol::SSProtocolProposal;
+using org::interconnection::v2::protocol::SSProtocolResult;
+
+using protocol_family::ss::SecureAggregator;
+
+namespace {
+
+std::set<int32_t> IntersectOptimizers(
+    const std::vector<LrHyperparamsProposal> &lr_params) {
+  int field_num = LrHyperparamsProposal::kOptimizersFieldNumber;
+  return util::IntersectParamItems<LrHyperparamsProposal>(lr_params, field_num);
+}
+
+std::set<int32_t> IntersectLastBatchPolicies(
+    const std::vector<LrHyperparamsProposal> &lr_params) {
+  int field_num = LrHyperparamsProposal::kLastBatchPoliciesFieldNumber;
+  return util::IntersectParamItems<LrHyperparamsProposal>(lr_params, field_num);
+}
+
+std::set<int32_t> IntersectFieldTypes(
+    const std::vector<SSProtocolProposal> &ss_params) {
+  int field_num = SSProtocolProposal::kFieldTypesFieldNumber;
+  return util::IntersectParamItems<SSProtocolProposal>(ss_params, field_num);
+}
+
+std::set<int32_t> IntersectPrgCryptoTypes(
+    const std::vector<SSProtocolProposal> &ss_params) {
+  int field_num_1 = SSProtocolProposal::kPrgConfigsFieldNumber;
+  int field_num_2 = PrgConfigProposal::kCryptoTypeFieldNumber;
+  return util::IntersectParamItems<SSProtocolProposal, PrgConfigProposal>(
+      ss_params, field_num_1, field_num_2);
+}
+
+bool UsePenaltyTerm(double value) { return !util::AlmostZero(value); }
+
+double Sigmoid(double x) { return 1.0 / (1.0 + std::exp(-x)); }
+
+}  // namespace
+
+HorizontalLrHandler::HorizontalLrHandler(
+    std::shared_ptr<HorizontalLrContext> ctx)
+    : AlgoV2Handler(ctx->ic_ctx), ctx_(std::move(ctx)) {
+  YACL_ENFORCE(ctx_->optimizer.type == OPTIMIZER_SGD,
+               "Unimplemented optimizer type {}", ctx_->optimizer.type);
+  YACL_ENFORCE(ctx_->ss_param.field_type == FIELD_TYPE_64,
+               "secure aggregation runs in Ring64");
+}
+
+HorizontalLrHandler::~HorizontalLrHandler() = default;
+
+bool HorizontalLrHandler::PrepareDataset() {
+  auto [sample_size, col_num] = lr::CountDataset();
+  counted_shape_ = {sample_size, col_num};
+  int32_t feature_num = col_num - 1;
+  YACL_ENFORCE(sample_size > 0 && feature_num > 0);
+
+  ctx_->io_param.sample_size = sample_size;
+  auto self_rank = ctx_->ic_ctx->lctx->Rank();
+
+  if (util::GetParamEnv("disable_handshake", FLAGS_disable_handshake)) {
+    YACL_ENFORCE(ctx_->io_param.feature_nums.at(self_rank) == feature_num);
+  } else {
+    YACL_ENFORCE(
+        ctx_->io_param.label_rank == static_cast<int32_t>(self_rank),
+        "every party of horizontal LR holds labels, set -has_label=true");
+    ctx_->io_param.feature_nums.resize(ctx_->ic_ctx->lctx->WorldSize());
+    ctx_->io_param.feature_nums.at(self_rank) = feature_num;
+  }
+
+  return true;
+}
+
+void HorizontalLrHandler::LoadDataset() {
+  rows_ = lr::ReadDatasetRows();
+  YACL_ENFORCE(static_cast<int64_t>(rows_.size()) == counted_shape_[0],
+               "dataset changed while loading");
+  int64_t col_num = counted_shape_[1];
+  for (size_t i = 0; i < rows_.size(); ++i) {
+    YACL_ENFORCE(static_cast<int64_t>(rows_[i].size()) == col_num,
+                 "row {} has {} columns", i, rows_[i].size());
+    // the label makes way for the intercept
+    labels_.push_back(rows_[i].back());
+    rows_[i].back() = 1.0;
+  }
+}
+
+HandshakeRequestV2 HorizontalLrHandler::BuildHandshakeRequest() {
+  HandshakeRequestV2 request;
+  auto self_rank = ctx_->ic_ctx->lctx->Rank();
+
+  request.set_version(2);
+  request.set_requester_rank(self_rank);
+
+  request.add_supported_algos(ALGO_TYPE_HORIZONTAL_LR);
+  LrHyperparamsProposal lr_param;
+  lr_param.add_supported_versions(1);
+  lr_param.add_optimizers(ctx_->optimizer.type);
+  lr_param.add_last_batch_policies(ctx_->lr_param.last_batch_policy);
+  lr_param.set_use_l2_norm(UsePenaltyTerm(ctx_->lr_param.l2_norm));
+  request.add_algo_params()->PackFrom(lr_param);
+
+  request.add_protocol_families(PROTOCOL_FAMILY_SS);
+  SSProtocolProposal protocol_param;
+  protocol_param.add_supported_versions(1);
+  protocol_param.add_field_types(FIELD_TYPE_64);
+  auto *prg_param = protocol_param.add_prg_configs();
+  prg_param->add_supported_versions(1);
+  prg_param->set_crypto_type(CRYPTO_TYPE_AES128_CTR);
+  SecureAggExt agg_ext;
+  agg_ext.set_chunk_size(ctx_->agg_param.chunk_size);
+  util::SetVendorExt(&protocol_param, agg_ext);
+  request.add_protocol_family_params()->PackFrom(protocol_param);
+
+  LrDataIoProposal lr_io;
+  lr_io.set_sample_size(ctx_->io_param.sample_size);
+  lr_io.set_feature_num(ctx_->io_param.feature_nums.at(self_rank));
+  lr_io.set_has_label(true);
+  request.mutable_io_param()->PackFrom(lr_io);
+
+  return request;
+}
+
+status::ErrorStatus HorizontalLrHandler::NegotiateHandshakeParams(
+    const std::vector<HandshakeRequestV2> &requests) {
+  auto status = NegotiateLrAlgoParams(requests);
+  if (!status.ok()) {
+    return status;
+  }
+
+  status = NegotiateSsParams(requests);
+  if (!status.ok()) {
+    return status;
+  }
+
+  status = NegotiateLrIoParams(requests);
+  if (!status.ok()) {
+    return status;
+  }
+
+  return status::OkStatus();
+}
+
+status::ErrorStatus HorizontalLrHandler::NegotiateLrAlgoParams(
+    const std::vector<HandshakeRequestV2> &requests) {
+  auto lr_params = ExtractReqAlgoParams<LrHyperparamsProposal>(
+      requests, ALGO_TYPE_HORIZONTAL_LR);
+  if (lr_params.empty()) {
+    return status::InvalidRequestError("certain request has no lr algo params");
+  }
+
+  auto optimizers = IntersectOptimizers(lr_params);
+  if (optimizers.find(ctx_->optimizer.type) == optimizers.end()) {
+    return status::UnsupportedArgumentError("negotiate optimizer failed");
+  }
+
+  // the partial last batch is always discarded
+  auto policies = IntersectLastBatchPolicies(lr_params);
+  if (ctx_->lr_param.last_batch_policy != LAST_BATCH_POLICY_DISCARD ||
+      policies.find(ctx_->lr_param.last_batch_policy) == policies.end()) {
+    return status::UnsupportedArgumentError(
+        "negotiate last batch policy failed");
+  }
+
+  // only l2 norm is supported
+  auto use_l2_norm = util::AlignParamItem<LrHyperparamsProposal, bool>(
+      lr_params, LrHyperparamsProposal::kUseL2NormFieldNumber);
+  if (!use_l2_norm.has_value() || !use_l2_norm.value()) {
+    ctx_->lr_param.l2_norm = 0.0;
+  }
+
+  return status::OkStatus();
+}
+
+status::ErrorStatus HorizontalLrHandler::NegotiateSsParams(
+    const std::vector<HandshakeRequestV2> &requests) {
+  auto ss_params =
+      ExtractReqPfParams<SSProtocolProposal>(requests, PROTOCOL_FAMILY_SS);
+  if (ss_params.empty()) {
+    return status::InvalidRequestError("certain request has no ss params");
+  }
+
+  auto field_types = IntersectFieldTypes(ss_params);
+  if (field_types.find(FIELD_TYPE_64) == field_types.end()) {
+    return status::UnsupportedArgumentError("negotiate field type failed");
+  }
+
+  // the masks of the aggregation come from this PRG
+  auto crypto_types = IntersectPrgCryptoTypes(ss_params);
+  if (crypto_types.find(CRYPTO_TYPE_AES128_CTR) == crypto_types.end()) {
+    return status::UnsupportedArgumentError("negotiate PRG config failed");
+  }
+
+  for (const auto &ss_param : ss_params) {
+    auto agg_ext = util::GetVendorExt<SecureAggExt>(ss_param);
+    if (!agg_ext.has_value() || agg_ext->chunk_size() <= 0) {
+      return status::InvalidRequestError(
+          "certain request has no secure aggregation params");
+    }
+    ctx_->agg_param.chunk_size =
+        std::min(ctx_->agg_param.chunk_size, agg_ext->chunk_size());
+  }
+
+  return status::OkStatus();
+}
+
+status::ErrorStatus HorizontalLrHandler::NegotiateLrIoParams(
+    const std::vector<HandshakeRequestV2> &requests) {
+  int32_t feature_num =
+      ctx_->io_param.feature_nums.at(ctx_->ic_ctx->lctx->Rank());
+  for (const auto &request : requests) {
+    LrDataIoProposal io_param;
+    if (!request.io_param().UnpackTo(&io_param)) {
+      return status::InvalidRequestError(
+          "certain request has invalid io param");
+    }
+
+    if (io_param.sample_size() <= 0) {
+      return status::InvalidRequestError(
+          "certain request has invalid sample_size");
+    }
+
+    if (io_param.feature_num() != feature_num) {
+      return status::HandshakeRefusedError("feature number inconsistent");
+    }
+
+    if (!io_param.has_label()) {
+      return status::HandshakeRefusedError("certain party has no label");
+    }
+
+    YACL_ENFORCE(static_cast<int32_t>(ctx_->io_param.feature_nums.size()) >
+                 request.requester_rank());
+    ctx_->io_param.feature_nums[request.requester_rank()] = feature_num;
+  }
+
+  return status::OkStatus();
+}
+
+HandshakeResponseV2 HorizontalLrHandler::BuildHandshakeResponse() {
+  HandshakeResponseV2 response;
+  response.mutable_header()->set_error_code(org::interconnection::OK);
+
+  response.set_algo(ALGO_TYPE_HORIZONTAL_LR);
+  LrHyperparamsResult lr_param;
+  lr_param.set_version(1);
+  lr_param.set_num_epoch(ctx_->lr_param.num_epoch);
+  lr_param.set_batch_size(ctx_->lr_param.batch_size);
+  lr_param.set_last_batch_policy(ctx_->lr_param.last_batch_policy);
+  if (UsePenaltyTerm(ctx_->lr_param.l2_norm)) {
+    lr_param.set_l2_norm(ctx_->lr_param.l2_norm);
+  }
+  lr_param.set_optimizer_name(ctx_->optimizer.type);
+  lr_param.mutable_optimizer_param()->PackFrom(
+      std::get<SgdOptimizer>(ctx_->optimizer.param));
+  response.mutable_algo_param()->PackFrom(lr_param);
+
+  response.add_protocol_families(PROTOCOL_FAMILY_SS);
+  SSProtocolResult ss_param;
+  ss_param.set_field_type(FIELD_TYPE_64);
+  ss_param.set_fxp_fraction_bits(ctx_->ss_param.fxp_bits);
+  ss_param.mutable_prg_config()->set_version(1);
+  ss_param.mutable_prg_config()->set_crypto_type(CRYPTO_TYPE_AES128_CTR);
+  SecureAggExt agg_ext;
+  agg_ext.set_chunk_size(ctx_->agg_param.chunk_size);
+  util::SetVendorExt(&ss_param, agg_ext);
+  response.add_protocol_family_params()->PackFrom(ss_param);
+
+  // every party holds labels, and the sample sizes are left out
+  LrDataIoResult io_param;
+  io_param.set_version(1);
+  io_param.mutable_feature_nums()->Add(ctx_->io_param.feature_nums.begin(),
+                                       ctx_->io_param.feature_nums.end());
+  response.mutable_io_param()->PackFrom(io_param);
+
+  return response;
+}
+
+bool HorizontalLrHandler::ProcessHandshakeResponse(
+    const HandshakeResponseV2 &response) {
+  if (!AlgoV2Handler::ProcessHandshakeResponse(response)) {
+    return false;
+  }
+
+  LrHyperparamsResult lr_param;
+  YACL_ENFORCE(response.algo() == ALGO_TYPE_HORIZONTAL_LR);
+  YACL_ENFORCE(response.algo_param().UnpackTo(&lr_param));
+  ctx_->lr_param.num_epoch = lr_param.num_epoch();
+  ctx_->lr_param.batch_size = lr_param.batch_size();
+  if (UsePenaltyTerm(lr_param.l2_norm())) {
+    YACL_ENFORCE(UsePenaltyTerm(ctx_->lr_param.l2_norm));
+  }
+  ctx_->lr_param.l2_norm = lr_param.l2_norm();
+
+  YACL_ENFORCE(lr_param.optimizer_name() == OPTIMIZER_SGD);
+  SgdOptimizer optimizer;
+  YACL_ENFORCE(lr_param.optimizer_param().UnpackTo(&optimizer));
+  std::get<SgdOptimizer>(ctx_->optimizer.param).CopyFrom(optimizer);
+
+  auto ss_param_optional =
+      ExtractRspPfParam<SSProtocolResult>(response, PROTOCOL_FAMILY_SS);
+  YACL_ENFORCE(ss_param_optional.has_value());
+  const auto &ss_param = ss_param_optional.value();
+  YACL_ENFORCE(ss_param.field_type() == FIELD_TYPE_64);
+  YACL_ENFORCE(ss_param.prg_config().crypto_type() == CRYPTO_TYPE_AES128_CTR);
+  ctx_->ss_param.fxp_bits = ss_param.fxp_fraction_bits();
+  auto agg_ext = util::GetVendorExt<SecureAggExt>(ss_param);
+  YACL_ENFORCE(agg_ext.has_value());
+  YACL_ENFORCE(agg_ext->chunk_size() > 0 &&
+               agg_ext->chunk_size() <= ctx_->agg_param.chunk_size);
+  ctx_->agg_param.chunk_size = agg_ext->chunk_size();
+
+  LrDataIoResult io_param;
+  YACL_ENFORCE(response.io_param().UnpackTo(&io_param));
+  YACL_ENFORCE(io_param.feature_nums().size() ==
+               static_cast<int>(ctx_->io_param.feature_nums.size()));
+  int32_t feature_num =
+      ctx_->io_param.feature_nums.at(ctx_->ic_ctx->lctx->Rank());
+  for (int i = 0; i < io_param.feature_nums().size(); ++i) {
+    YACL_ENFORCE(io_param.feature_nums(i) == feature_num);
+    ctx_->io_param.feature_nums[i] = feature_num;
+  }
+
+  return true;
+}
+
+bool HorizontalLrHandler::ResumeHandshake(
+    const std::vector<HandshakeRequestV2> &,
+    const HandshakeResponseV2 &response) {
+  return ProcessHandshakeResponse(response);
+}
+
+void HorizontalLrHandler::RunAlgo() {
+  YACL_ENFORCE(ctx_->lr_param.batch_size > 0, "invalid batch size {}",
+               ctx_->lr_param.batch_size);
+  YACL_ENFORCE(ctx_->ss_param.fxp_bits > 0 && ctx_->ss_param.fxp_bits < 64,
+               "invalid fxp bits {}", ctx_->ss_param.fxp_bits);
+  aggregator_ = std::make_unique<SecureAggregator>(ctx_->ic_ctx->lctx,
+                                                   ctx_->agg_param);
+  aggregator_->ExchangeSeeds();
+  Train();
+  ProduceOutput();
+}
+
+void HorizontalLrHandler::Train() {
+  weights_.assign(counted_shape_[1], 0.0);
+  // the parties may hold fewer rows than a batch
+  int64_t batch_size =
+      std::min(ctx_->lr_param.batch_size, ctx_->io_param.sample_size);
+  int64_t num_batch = ctx_->io_param.sample_size / batch_size;
+
+  const auto &stats = ctx_->ic_ctx->lctx->GetStats();
+  for (int64_t epoch = 0; epoch < ctx_->lr_param.num_epoch; ++epoch) {
+    auto start = std::chrono::steady_clock::now();
+    size_t sent_bytes = stats->sent_bytes;
+    for (int64_t batch = 0; batch < num_batch; ++batch) {
+      const int64_t rows_beg = batch * batch_size;
+      TrainStep(rows_beg, rows_beg + batch_size);
+    }
+
+    auto aggregation_start = std::chrono::steady_clock::now();
+    AverageWeights();
+
+    auto end = std::chrono::steady_clock::now();
+    std::chrono::duration<double> elapsed = end - start;
+    std::chrono::duration<double> aggregation = end - aggregation_start;
+    SPDLOG_INFO(
+        "rank:{} algo:HORIZONTAL_LR epoch:{} parties:{} seconds:{:.3f} "
+        "aggregation_seconds:{:.3f} sent_bytes:{}",
+        ctx_->ic_ctx->lctx->Rank(), epoch, ctx_->ic_ctx->lctx->WorldSize(),
+        elapsed.count(), aggregation.count(), stats->sent_bytes - sent_bytes);
+  }
+}
+
+void HorizontalLrHandler::TrainStep(int64_t rows_beg, int64_t rows_end) {
+  std::vector<double> gradient(weights_.size(), 0.0);
+  for (int64_t i = rows_beg; i < rows_end; ++i) {
+    const auto &row = rows_[i];
+    double score = 0.0;
+    for (size_t j = 0; j < weights_.size(); ++j) {
+      score += weights_[j] * row[j];
+    }
+    double residual = Sigmoid(score) - labels_[i];
+    for (size_t j = 0; j < weights_.size(); ++j) {
+      gradient[j] += residual * row[j];
+    }
+  }
+
+  const auto &sgd = std::get<SgdOptimizer>(ctx_->optimizer.param);
+  double batch_size = static_cast<double>(rows_end - rows_beg);
+  // the intercept is not penalized
+  size_t penalized = weights_.size() - 1;
+  for (size_t j = 0; j < weights_.size(); ++j) {
+    double grad = gradient[j] / batch_size;
+    if (j < penalized) {
+      grad += ctx_->lr_param.l2_norm * weights_[j];
+    }
+    weights_[j] -= sgd.learning_rate() * grad;
+  }
+}
+
+void HorizontalLrHandler::AverageWeights() {
+  // the weights scaled by the sample size in fixed point, which must stay
+  // below 2^(63 - fxp_bits) in magnitude summed over the parties, and the
+  // sample size last to divide the sum by
+  int32_t fxp_bits = ctx_->ss_param.fxp_bits;
+  auto sample_size = static_cast<double>(ctx_->io_param.sample_size);
+  std::vector<uint64_t> values(weights_.size() + 1);
+  for (size_t j = 0; j < weights_.size(); ++j) {
+    values[j] = static_cast<uint64_t>(
+        std::llround(std::ldexp(weights_[j] * sample_size, fxp_bits)));
+  }
+  values.back() = ctx_->io_param.sample_size;
+
+  aggregator_->AllReduceSum(&values);
+
+  auto total = static_cast<double>(values.back());
+  YACL_ENFORCE(total > 0, "invalid total sample size");
+  for (size_t j = 0; j < weights_.size(); ++j) {
+    auto sum = static_cast<double>(static_cast<int64_t>(values[j]));
+    weights_[j] = std::ldexp(sum, -fxp_bits) / total;
+  }
+}
+
+void HorizontalLrHandler::ProduceOutput() const {
+  // the common weights, the intercept last
+  std::string out_file_name = lr::GetLrOutputFileName();
+  std::ofstream of(out_file_name);
+  YACL_ENFORCE(of, "open file={} failed", out_file_name);
+  for (auto weight : weights_) {
+    of << weight << '\n';
+  }
+}
+
+}  // namespace ic_impl::algo::horizontal_lr
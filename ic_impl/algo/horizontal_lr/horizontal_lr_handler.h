@@ -0,0 +1,91 @@
+// Copyright 2024 Ant Group Co., Ltd.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#pragma once
+
+#include <array>
+#include <memory>
+#include <vector>
+
+#include "ic_impl/algo/horizontal_lr/horizontal_lr_context.h"
+#include "ic_impl/handler.h"
+#include "ic_impl/protocol_family/ss/secure_aggregation.h"
+
+#include "interconnection/handshake/algos/lr.pb.h"
+
+namespace ic_impl::algo::horizontal_lr {
+
+// Logistic regression of parties holding different rows with the same
+// features and labels. Each epoch, every party runs SGD over its own rows
+// and the weights are then averaged over the parties, weighted by their
+// sample sizes, by secure aggregation: no party sees the weights or the
+// sample size of another, only the average. The pairwise masks are drawn
+// from the AES128-CTR PRG negotiated in the SS protocol family.
+class HorizontalLrHandler : public AlgoV2Handler {
+ public:
+  explicit HorizontalLrHandler(std::shared_ptr<HorizontalLrContext> ctx);
+
+  ~HorizontalLrHandler() override;
+
+ private:
+  bool ProcessHandshakeResponse(const HandshakeResponseV2 &) override;
+
+  HandshakeRequestV2 BuildHandshakeRequest() override;
+
+  HandshakeResponseV2 BuildHandshakeResponse() override;
+
+  status::ErrorStatus NegotiateHandshakeParams(
+      const std::vector<HandshakeRequestV2> &) override;
+
+  bool ResumeHandshake(const std::vector<HandshakeRequestV2> &,
+                       const HandshakeResponseV2 &) override;
+
+  status::ErrorStatus NegotiateLrAlgoParams(
+      const std::vector<HandshakeRequestV2> &requests);
+
+  status::ErrorStatus NegotiateSsParams(
+      const std::vector<HandshakeRequestV2> &requests);
+
+  status::ErrorStatus NegotiateLrIoParams(
+      const std::vector<HandshakeRequestV2> &requests);
+
+  bool PrepareDataset() override;
+
+  void LoadDataset() override;
+
+  void RunAlgo() override;
+
+  void Train();
+
+  void TrainStep(int64_t rows_beg, int64_t rows_end);
+
+  // Replace the own weights with the average of those of every party
+  void AverageWeights();
+
+  void ProduceOutput() const;
+
+  std::shared_ptr<HorizontalLrContext> ctx_;
+
+  // rows and columns of the dataset file, counted before it is loaded
+  std::array<int64_t, 2> counted_shape_{};
+
+  // features by row, each followed by a 1 for the intercept
+  std::vector<std::vector<double>> rows_;
+  std::vector<double> labels_;
+  // the intercept last
+  std::vector<double> weights_;
+
+  std::unique_ptr<protocol_family::ss::SecureAggregator> aggregator_;
+};
+
+}  // namespace ic_impl::algo::horizontal_lr
@@ -14,23 +14,53 @@
 
 #include "ic_impl/algo/lr/lr_context.h"
 
+#include <algorithm>
+#include <fstream>
+
+#include "absl/strings/numbers.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_split.h"
 #include "gflags/gflags.h"
 #include "nlohmann/json.hpp"
 
 #include "ic_impl/op/sigmoid/sigmoid.h"
 #include "ic_impl/util.h"
 
+#include "ic_impl/proto/vendor_types.pb.h"
+
 #include "interconnection/handshake/algos/lr.pb.h"
 
+DEFINE_string(dataset, "data.csv", "dataset file");
+DEFINE_string(dataset_format, "csv",
+              "format of the dataset file, csv or libsvm, whose lines start "
+              "with the label if --has_label");
+DEFINE_int32(skip_rows, 1, "skip number of rows from dataset");
+DEFINE_string(lr_output, "/tmp/sslr_result", "full path name of output file");
 DEFINE_bool(has_label, false, "if true, label is the last column of dataset");
 DEFINE_int64(batch_size, 21, "size of each batch");
 DEFINE_string(last_batch_policy, "discard",
-              "policy to process the partial last batch of each epoch");
+              "policy to process the partial last batch of each epoch, "
+              "discard or pad");
 DEFINE_int64(num_epoch, 1, "number of epoch");
 DEFINE_double(l0_norm, 0.0, "l0 norm");
 DEFINE_double(l1_norm, 0.0, "l1 norm");
 DEFINE_double(l2_norm, 0.5, "l2 norm");
-
+DEFINE_string(sweep_learning_rates, "",
+              "comma-separated learning rates of models trained side by side "
+              "in one session");
+DEFINE_string(sweep_l2_norms, "",
+              "comma-separated l2 norms of models trained side by side in "
+              "one session, paired with --sweep_learning_rates");
+DEFINE_int64(cv_folds, 0,
+             "number of folds cross validated before training on all rows, "
+             "none if less than 2");
+DEFINE_int64(cv_seed, 0,
+             "seed of the public permutation dealing the rows into folds");
+DEFINE_int64(cv_threads, 1,
+             "number of cross validation folds trained at the same time, "
+             "each over a link of its own");
+
+DECLARE_int32(rank);
 DECLARE_bool(disable_handshake);
 
 namespace ic_impl::algo::lr {
@@ -41,6 +71,18 @@ int64_t SuggestedNumEpoch() {
   return util::GetParamEnv("num_epoch", FLAGS_num_epoch);
 }
 
+int64_t SuggestedCvFolds() {
+  return util::GetParamEnv("cv_folds", FLAGS_cv_folds);
+}
+
+int64_t SuggestedCvSeed() {
+  return util::GetParamEnv("cv_seed", FLAGS_cv_seed);
+}
+
+int64_t SuggestedCvThreads() {
+  return util::GetParamEnv("cv_threads", FLAGS_cv_threads);
+}
+
 int64_t SuggestedBatchSize() {
   return util::GetParamEnv("batch_size", FLAGS_batch_size);
 }
@@ -49,7 +91,8 @@ int32_t SuggestedLastBatchPolicy() {
   return util::GetFlagValue(
       org::interconnection::v2::algos::LastBatchPolicy_descriptor(),
       "LAST_BATCH_POLICY_",
-      util::GetParamEnv("last_batch_policy", FLAGS_last_batch_policy));
+      util::GetParamEnv("last_batch_policy", FLAGS_last_batch_policy),
+      ic_impl::proto::VendorLastBatchPolicy_descriptor());
 }
 
 double SuggestedL0Norm() { return util::GetParamEnv("l0_norm", FLAGS_l0_norm); }
@@ -58,25 +101,75 @@ double SuggestedL1Norm() { return util::GetParamEnv("l1_norm", FLAGS_l1_norm); }
 
 double SuggestedL2Norm() { return util::GetParamEnv("l2_norm", FLAGS_l2_norm); }
 
-LrHyperParam SuggestedLrHyperParam() {
-  LrHyperParam lr_param;
-  lr_param.num_epoch = SuggestedNumEpoch();
-  lr_param.batch_size = SuggestedBatchSize();
-  lr_param.last_batch_policy = SuggestedLastBatchPolicy();
-  lr_param.l0_norm = SuggestedL0Norm();
-  lr_param.l1_norm = SuggestedL1Norm();
-  lr_param.l2_norm = SuggestedL2Norm();
+std::vector<double> SuggestedSweep(std::string_view name,
+                                   const std::string& flag) {
+  std::vector<double> values;
+  auto list = util::GetParamEnv(name, flag);
+  if (list.empty()) {
+    return values;
+  }
+  for (auto item : absl::StrSplit(list, ',')) {
+    double value = 0.0;
+    YACL_ENFORCE(absl::SimpleAtod(item, &value), "invalid {}: {}", name, list);
+    values.push_back(value);
+  }
 
-  return lr_param;
+  return values;
+}
+
+bool HasLabel() { return util::GetParamEnv("has_label", FLAGS_has_label); }
+
+// The lines of the dataset that hold rows, passed to `func` one by one
+template <typename Func>
+void ForEachRow(Func func) {
+  std::string input_file = GetLrInputFileName();
+
+  std::ifstream file(input_file);
+  YACL_ENFORCE(file, "open file={} failed", input_file);
+
+  std::string line;
+  for (int32_t i = 0; i < SkipRows() && std::getline(file, line); ++i) {
+  }
+
+  while (std::getline(file, line)) {
+    if (line.empty() || line == "\r") {
+      continue;
+    }
+    func(std::string_view(line), input_file);
+  }
+}
+
+// The "index:value" pairs of a libsvm line after the label, if any
+template <typename Func>
+void ForEachEntry(std::string_view line, const std::string& input_file,
+                  Func func) {
+  bool label = HasLabel();
+  for (auto token : absl::StrSplit(line, absl::ByAnyChar(" \t\r"),
+                                   absl::SkipEmpty())) {
+    if (label) {
+      label = false;
+      continue;
+    }
+    std::pair<std::string_view, std::string_view> entry =
+        absl::StrSplit(token, absl::MaxSplits(':', 1));
+    int32_t index = 0;
+    float value = 0;
+    YACL_ENFORCE(absl::SimpleAtoi(entry.first, &index) && index > 0 &&
+                     absl::SimpleAtof(entry.second, &value),
+                 "invalid entry {} in {}", token, input_file);
+    func(index - 1, value);
+  }
 }
 
 int32_t GetLabelRank(const std::shared_ptr<IcContext>& ic_ctx) {
-  if (!FLAGS_disable_handshake) {
-    return FLAGS_has_label ? ic_ctx->lctx->Rank() : -1;
+  if (!util::GetParamEnv("disable_handshake", FLAGS_disable_handshake)) {
+    return util::GetParamEnv("has_label", FLAGS_has_label)
+               ? ic_ctx->lctx->Rank()
+               : -1;
   }
 
   // get parameters from ENV
-  char* label_owner = util::GetParamEnv("label_owner");
+  const char* label_owner = util::GetParamEnv("label_owner");
   YACL_ENFORCE(label_owner != nullptr, "label_owner not in ENV");
 
   size_t word_size = ic_ctx->lctx->WorldSize();
@@ -91,12 +184,12 @@ int32_t GetLabelRank(const std::shared_ptr<IcContext>& ic_ctx) {
 
 std::vector<int32_t> GetFeatureNums(const std::shared_ptr<IcContext>& ic_ctx) {
   std::vector<int32_t> feature_nums;
-  if (!FLAGS_disable_handshake) {
+  if (!util::GetParamEnv("disable_handshake", FLAGS_disable_handshake)) {
     return feature_nums;  // got through the handshake that follows
   }
 
   // get parameters from ENV
-  char* json_str = util::GetParamEnv("feature_nums");
+  const char* json_str = util::GetParamEnv("feature_nums");
   YACL_ENFORCE(json_str != nullptr, "feature_nums not in ENV");
 
   size_t word_size = ic_ctx->lctx->WorldSize();
@@ -115,9 +208,7 @@ std::shared_ptr<LrContext> CreateLrContext(std::shared_ptr<IcContext> ic_ctx) {
   auto ctx = std::make_shared<LrContext>();
   ctx->lr_param = SuggestedLrHyperParam();
 
-  ctx->io_param.label_rank = GetLabelRank(ic_ctx);
-
-  ctx->io_param.feature_nums = GetFeatureNums(ic_ctx);
+  ctx->io_param = SuggestedLrIoParam(ic_ctx);
 
   ctx->sigmoid_mode = op::sigmoid::SuggestedSigmoidMode();
 
@@ -132,4 +223,151 @@ std::shared_ptr<LrContext> CreateLrContext(std::shared_ptr<IcContext> ic_ctx) {
   return ctx;
 }
 
+LrHyperParam SuggestedLrHyperParam() {
+  LrHyperParam lr_param;
+  lr_param.num_epoch = SuggestedNumEpoch();
+  lr_param.batch_size = SuggestedBatchSize();
+  lr_param.last_batch_policy = SuggestedLastBatchPolicy();
+  lr_param.l0_norm = SuggestedL0Norm();
+  lr_param.l1_norm = SuggestedL1Norm();
+  lr_param.l2_norm = SuggestedL2Norm();
+  lr_param.sweep_learning_rates =
+      SuggestedSweep("sweep_learning_rates", FLAGS_sweep_learning_rates);
+  lr_param.sweep_l2_norms =
+      SuggestedSweep("sweep_l2_norms", FLAGS_sweep_l2_norms);
+  YACL_ENFORCE(lr_param.sweep_learning_rates.empty() ||
+                   lr_param.sweep_l2_norms.empty() ||
+                   lr_param.sweep_learning_rates.size() ==
+                       lr_param.sweep_l2_norms.size(),
+               "sweep lists of different sizes");
+  lr_param.cv_folds = SuggestedCvFolds();
+  lr_param.cv_seed = SuggestedCvSeed();
+  lr_param.cv_threads = SuggestedCvThreads();
+
+  return lr_param;
+}
+
+LrIoParam SuggestedLrIoParam(const std::shared_ptr<IcContext>& ic_ctx) {
+  LrIoParam io_param;
+  io_param.label_rank = GetLabelRank(ic_ctx);
+  io_param.feature_nums = GetFeatureNums(ic_ctx);
+
+  return io_param;
+}
+
+std::string GetLrInputFileName() {
+  return util::GetInputFileName(util::GetParamEnv("dataset", FLAGS_dataset));
+}
+
+std::string GetLrOutputFileName() {
+  return util::GetOutputFileName(absl::StrCat(
+      util::GetParamEnv("lr_output", FLAGS_lr_output), ".", FLAGS_rank));
+}
+
+std::string GetLrOutputFileName(size_t index) {
+  return util::GetOutputFileName(
+      absl::StrCat(util::GetParamEnv("lr_output", FLAGS_lr_output), ".", index,
+                   ".", FLAGS_rank));
+}
+
+int32_t SkipRows() { return util::GetParamEnv("skip_rows", FLAGS_skip_rows); }
+
+bool IsSparseDataset() {
+  auto format = util::GetParamEnv("dataset_format", FLAGS_dataset_format);
+  YACL_ENFORCE(format == "csv" || format == "libsvm",
+               "unknown dataset format {}", format);
+  return format == "libsvm";
+}
+
+std::pair<int64_t, int64_t> CountDataset() {
+  int64_t row_num = 0;
+  int64_t col_num = 0;
+  if (IsSparseDataset()) {
+    // the widest index of any row
+    ForEachRow([&](std::string_view line, const std::string& input_file) {
+      ++row_num;
+      ForEachEntry(line, input_file, [&](int32_t col, float) {
+        col_num = std::max<int64_t>(col_num, col + 1);
+      });
+    });
+    return {row_num, HasLabel() ? col_num + 1 : col_num};
+  }
+
+  ForEachRow([&](std::string_view line, const std::string&) {
+    if (row_num++ == 0) {
+      col_num = std::count(line.begin(), line.end(), ',') + 1;
+    }
+  });
+
+  return {row_num, col_num};
+}
+
+std::vector<std::vector<double>> ReadDatasetRows() {
+  std::vector<std::vector<double>> rows;
+  if (IsSparseDataset()) {
+    // densified, with the label last as in a csv dataset
+    std::vector<float> labels;
+    auto matrix = ReadSparseDataset(HasLabel() ? &labels : nullptr);
+    int64_t col_num = HasLabel() ? matrix.cols + 1 : matrix.cols;
+    rows.assign(matrix.rows, std::vector<double>(col_num));
+    for (int64_t i = 0; i < matrix.rows; ++i) {
+      for (auto k = matrix.row_offsets[i]; k < matrix.row_offsets[i + 1]; ++k) {
+        rows[i][matrix.columns[k]] = matrix.values[k];
+      }
+      if (HasLabel()) {
+        rows[i].back() = labels[i];
+      }
+    }
+    return rows;
+  }
+
+  ForEachRow([&](std::string_view line, const std::string& input_file) {
+    auto& row = rows.emplace_back();
+    for (auto field : absl::StrSplit(line, ',')) {
+      YACL_ENFORCE(absl::SimpleAtod(field, &row.emplace_back()),
+                   "invalid value {} in {}", field, input_file);
+    }
+  });
+
+  return rows;
+}
+
+void ReadDenseDataset(int64_t rows, int64_t cols, float* values) {
+  int64_t row_num = 0;
+  ForEachRow([&](std::string_view line, const std::string& input_file) {
+    YACL_ENFORCE(row_num < rows, "dataset changed while loading");
+    float* row = values + row_num++ * cols;
+    int64_t col_num = 0;
+    for (auto field : absl::StrSplit(line, ',')) {
+      YACL_ENFORCE(col_num < cols, "dataset changed while loading");
+      YACL_ENFORCE(absl::SimpleAtof(field, &row[col_num++]),
+                   "invalid value {} in {}", field, input_file);
+    }
+    YACL_ENFORCE(col_num == cols, "dataset changed while loading");
+  });
+  YACL_ENFORCE(row_num == rows, "dataset changed while loading");
+}
+
+CsrMatrix ReadSparseDataset(std::vector<float>* labels) {
+  CsrMatrix matrix;
+  ForEachRow([&](std::string_view line, const std::string& input_file) {
+    if (labels != nullptr) {
+      std::string_view label = line.substr(0, line.find_first_of(" \t\r"));
+      YACL_ENFORCE(absl::SimpleAtof(label, &labels->emplace_back()),
+                   "invalid label {} in {}", label, input_file);
+    }
+    ForEachEntry(line, input_file, [&](int32_t col, float value) {
+      if (value != 0) {
+        matrix.columns.push_back(col);
+        matrix.values.push_back(value);
+      }
+      matrix.cols = std::max<int64_t>(matrix.cols, col + 1);
+    });
+    matrix.row_offsets.push_back(matrix.NonZeros());
+    ++matrix.rows;
+  });
+
+  return matrix;
+}
+
 }  // namespace ic_impl::algo::lr
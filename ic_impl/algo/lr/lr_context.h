@@ -14,6 +14,10 @@
 
 #pragma once
 
+#include <string>
+#include <utility>
+#include <vector>
+
 #include "ic_impl/algo/lr/optimizer.h"
 #include "ic_impl/context.h"
 #include "ic_impl/protocol_family/ss/ss.h"
@@ -27,12 +31,23 @@ struct LrHyperParam {
   double l0_norm = 0.0;
   double l1_norm = 0.0;
   double l2_norm = 0.0;
+  // models trained side by side, one per entry; a list left empty takes
+  // l2_norm or the learning rate of the optimizer for every model
+  std::vector<double> sweep_learning_rates{};
+  std::vector<double> sweep_l2_norms{};
+  // folds of the cross validation run before training on all rows, none if
+  // less than 2
+  int64_t cv_folds{};
+  int64_t cv_seed{};
+  int64_t cv_threads = 1;
 };
 
 struct LrIoParam {
   int64_t sample_size{};
   std::vector<int32_t> feature_nums{};
   int32_t label_rank = -1;
+  // ranks whose features stay sparse in training, agreed on in the handshake
+  std::vector<int32_t> sparse_ranks{};
 };
 
 struct LrContext {
@@ -57,4 +72,49 @@ struct LrContext {
 
 std::shared_ptr<LrContext> CreateLrContext(std::shared_ptr<IcContext>);
 
+LrHyperParam SuggestedLrHyperParam();
+
+// Label rank and feature numbers, known before the handshake only if it is
+// disabled
+LrIoParam SuggestedLrIoParam(const std::shared_ptr<IcContext>& ic_ctx);
+
+std::string GetLrInputFileName();
+
+std::string GetLrOutputFileName();
+
+// The output file of the model trained at `index` in a sweep
+std::string GetLrOutputFileName(size_t index);
+
+int32_t SkipRows();
+
+// Rows of a sparse dataset in compressed sparse row form
+struct CsrMatrix {
+  int64_t rows{};
+  int64_t cols{};
+  // the entries of row i are at [row_offsets[i], row_offsets[i + 1])
+  std::vector<int64_t> row_offsets{0};
+  std::vector<int32_t> columns;
+  std::vector<float> values;
+
+  int64_t NonZeros() const { return static_cast<int64_t>(values.size()); }
+};
+
+// Whether --dataset is in libsvm format rather than csv
+bool IsSparseDataset();
+
+// Count the rows and columns of the dataset without parsing the values. The
+// label counts as a column, the last one of a libsvm dataset.
+std::pair<int64_t, int64_t> CountDataset();
+
+// The values of the dataset by row, the label last
+std::vector<std::vector<double>> ReadDatasetRows();
+
+// Parse a csv dataset of `rows` x `cols` values, as counted by CountDataset,
+// straight into `values` in row major order
+void ReadDenseDataset(int64_t rows, int64_t cols, float* values);
+
+// The features of a libsvm dataset, whose lines are "[label] index:value ..."
+// with indexes from 1. The label of each row goes to `labels` if not null.
+CsrMatrix ReadSparseDataset(std::vector<float>* labels);
+
 }  // namespace ic_impl::algo::lr
@@ -14,13 +14,22 @@
 
 #include "ic_impl/algo/lr/lr_handler.h"
 
+#include <algorithm>
+#include <chrono>
+#include <cmath>
 #include <cstdlib>
+#include <cstring>
 #include <fstream>
+#include <future>
+#include <numeric>
+#include <random>
 
 #include "absl/functional/bind_front.h"
 #include "gflags/gflags.h"
+#include "spdlog/spdlog.h"
 #include "libspu/core/config.h"
 #include "libspu/core/encoding.h"
+#include "libspu/core/ndarray_ref.h"
 #include "libspu/kernel/hal/constants.h"
 #include "libspu/kernel/hal/polymorphic.h"
 #include "libspu/kernel/hal/public_helper.h"
@@ -30,17 +39,25 @@
 #include "libspu/mpc/factory.h"
 #include "libspu/mpc/semi2k/type.h"
 #include "xtensor/xarray.hpp"
-#include "xtensor/xcsv.hpp"
-#include "xtensor/xview.hpp"
+#include "xtensor/xbuilder.hpp"
+
+#include "ic_impl/link/wire_codec.h"
+#include "ic_impl/protocol_family/paillier/paillier.h"
+
+#include "ic_impl/proto/lr_ext.pb.h"
+#include "ic_impl/proto/vendor_types.pb.h"
+#include "ic_impl/proto/wire_format.pb.h"
 
-DEFINE_string(dataset, "data.csv", "dataset file, only csv is supported");
-DEFINE_int32(skip_rows, 1, "skip number of rows from dataset");
-DEFINE_string(lr_output, "/tmp/sslr_result", "full path name of output file");
-DECLARE_int32(rank);
 DECLARE_bool(disable_handshake);
 
 namespace ic_impl::algo::lr {
 
+using ic_impl::proto::LAST_BATCH_POLICY_PAD;
+using ic_impl::proto::LrDataIoProposalExt;
+using ic_impl::proto::LrDataIoResultExt;
+using ic_impl::proto::LrHyperparamsProposalExt;
+using ic_impl::proto::LrHyperparamsResultExt;
+
 using org::interconnection::v2::ALGO_TYPE_SS_LR;
 using org::interconnection::v2::OP_TYPE_SIGMOID;
 using org::interconnection::v2::PROTOCOL_FAMILY_SS;
@@ -55,6 +72,7 @@ using org::interconnection::v2::op::SigmoidParamsProposal;
 using org::interconnection::v2::op::SigmoidParamsResult;
 
 using org::interconnection::v2::protocol::CRYPTO_TYPE_AES128_CTR;
+using org::interconnection::v2::protocol::FIELD_TYPE_64;
 using org::interconnection::v2::protocol::PrgConfigProposal;
 
 using org::interconnection::v2::protocol::TripleConfigProposal;
@@ -67,25 +85,6 @@ using org::interconnection::v2::protocol::TRUNC_MODE_PROBABILISTIC;
 
 namespace {
 
-std::string GetLrInputFileName() {
-  return util::GetInputFileName(FLAGS_dataset);
-}
-
-std::string GetLrOutputFileName() {
-  return util::GetOutputFileName(
-      absl::StrCat(FLAGS_lr_output, ".", FLAGS_rank));
-}
-
-std::unique_ptr<xt::xarray<float>> ReadDataset() {
-  std::string input_file = GetLrInputFileName();
-
-  std::ifstream file(input_file);
-  YACL_ENFORCE(file, "open file={} failed", input_file);
-
-  return std::make_unique<xt::xarray<float>>(
-      xt::load_csv<float>(file, ',', FLAGS_skip_rows));
-}
-
 std::vector<LrHyperparamsProposal> ExtractReqLrParams(
     const std::vector<HandshakeRequestV2>& requests) {
   return ExtractReqAlgoParams<LrHyperparamsProposal>(requests, ALGO_TYPE_SS_LR);
@@ -168,6 +167,101 @@ bool UsePenaltyTerm(double value) { return !util::AlmostZero(value); }
 
 void DisablePenaltyTerm(double& value) { value = 0.0; }
 
+bool UseL2Norm(const LrHyperParam& lr_param) {
+  const auto& norms = lr_param.sweep_l2_norms;
+  return UsePenaltyTerm(lr_param.l2_norm) ||
+         std::any_of(norms.begin(), norms.end(), UsePenaltyTerm);
+}
+
+// Number of models trained side by side
+int64_t ModelNum(const LrHyperParam& lr_param) {
+  size_t num = std::max(lr_param.sweep_learning_rates.size(),
+                        lr_param.sweep_l2_norms.size());
+  return std::max<int64_t>(1, num);
+}
+
+// The value of each model, `value` for all unless swept
+std::vector<double> PerModel(const LrHyperParam& lr_param,
+                             const std::vector<double>& sweep, double value) {
+  return sweep.empty() ? std::vector<double>(ModelNum(lr_param), value)
+                       : sweep;
+}
+
+// A public row holding a value per model
+spu::Value ModelRow(spu::SPUContext* ctx, const std::vector<double>& values) {
+  std::vector<float> row(values.begin(), values.end());
+  auto cols = static_cast<int64_t>(row.size());
+  return spu::kernel::hal::constant(
+      ctx, spu::PtBufferView(row.data(), spu::PT_F32, {1, cols}, {1, 1}),
+      spu::DT_F32);
+}
+
+// Rows [rows_beg, rows_end) of the rows of v in `ranges`, a view unless they
+// span more than one range
+spu::Value SliceRows(spu::SPUContext* ctx, const spu::Value& v,
+                     const RowRanges& ranges, int64_t rows_beg,
+                     int64_t rows_end) {
+  std::vector<spu::Value> pieces;
+  int64_t offset = 0;
+  for (const auto& [range_beg, range_end] : ranges) {
+    int64_t beg = std::max(rows_beg, offset);
+    int64_t end = std::min(rows_end, offset + range_end - range_beg);
+    if (beg < end) {
+      pieces.push_back(spu::kernel::hal::slice(
+          ctx, v, {range_beg + beg - offset, 0},
+          {range_beg + end - offset, v.shape()[1]}, {}));
+    }
+    offset += range_end - range_beg;
+  }
+  YACL_ENFORCE(!pieces.empty());
+
+  return pieces.size() == 1 ? pieces.front()
+                            : spu::kernel::hal::concatenate(ctx, pieces, 0);
+}
+
+// v with zero rows appended up to `rows`
+spu::Value PadRows(spu::SPUContext* ctx, const spu::Value& v, int64_t rows) {
+  if (v.shape()[0] == rows) {
+    return v;
+  }
+  auto zeros = spu::kernel::hal::zeros(ctx, v.dtype(),
+                                       {rows - v.shape()[0], v.shape()[1]});
+  if (v.isSecret()) {
+    zeros = spu::kernel::hal::seal(ctx, zeros);
+  }
+  return spu::kernel::hal::concatenate(ctx, {v, zeros}, 0);
+}
+
+// The rows misclassified by each model, a column of `scores`, against the
+// labels y. Counted on shares, so that only the counts are opened.
+std::vector<float> CountErrors(spu::SPUContext* ctx, const spu::Value& y,
+                               const spu::Value& scores) {
+  auto half = spu::kernel::hal::constant(ctx, 0.5F, spu::DT_F32,
+                                         scores.shape());
+  auto predicted = spu::kernel::hal::dtype_cast(
+      ctx, spu::kernel::hal::greater_equal(ctx, scores, half), spu::DT_F32);
+  auto labels = spu::kernel::hal::dtype_cast(
+      ctx,
+      spu::kernel::hal::greater_equal(
+          ctx, spu::kernel::hal::broadcast_to(ctx, y, scores.shape()), half),
+      spu::DT_F32);
+  // the square of the difference of two bits is 1 where they differ
+  auto diff = spu::kernel::hal::sub(ctx, predicted, labels);
+  auto errors = spu::kernel::hal::mul(ctx, diff, diff);
+  auto ones = spu::kernel::hal::constant(ctx, 1.0F, spu::DT_F32,
+                                         {1, scores.shape()[0]});
+  xt::xarray<float> counts = spu::kernel::hal::dump_public_as<float>(
+      ctx, spu::kernel::hal::reveal(
+               ctx, spu::kernel::hal::matmul(ctx, ones, errors)));
+
+  std::vector<float> result;
+  for (auto count : counts) {
+    // the truncations of the products leave a little noise
+    result.push_back(std::round(count));
+  }
+  return result;
+}
+
 }  // namespace
 
 LrHandler::LrHandler(std::shared_ptr<LrContext> ctx)
@@ -195,18 +289,16 @@ LrHandler::LrHandler(std::shared_ptr<LrContext> ctx)
 LrHandler::~LrHandler() = default;
 
 bool LrHandler::PrepareDataset() {
-  dataset_ = ReadDataset();
-  YACL_ENFORCE(dataset_->shape().size() == 2);
-
-  int64_t sample_size = dataset_->shape(0);
-  int32_t feature_num =
-      ctx_->HasLabel() ? dataset_->shape(1) - 1 : dataset_->shape(1);
+  sparse_input_ = IsSparseDataset();
+  auto [sample_size, col_num] = CountDataset();
+  counted_shape_ = {sample_size, col_num};
+  int32_t feature_num = ctx_->HasLabel() ? col_num - 1 : col_num;
   YACL_ENFORCE(sample_size > 0);
 
   ctx_->io_param.sample_size = sample_size;
   auto self_rank = ctx_->ic_ctx->lctx->Rank();
 
-  if (FLAGS_disable_handshake) {
+  if (util::GetParamEnv("disable_handshake", FLAGS_disable_handshake)) {
     YACL_ENFORCE(ctx_->io_param.feature_nums.at(self_rank) == feature_num);
   } else {
     YACL_ENFORCE(feature_num > 0);
@@ -217,6 +309,75 @@ bool LrHandler::PrepareDataset() {
   return true;
 }
 
+void LrHandler::LoadDataset() {
+  // the handshake runs meanwhile, so only the counts of PrepareDataset are
+  // compared
+  if (sparse_input_) {
+    auto dataset = std::make_unique<CsrMatrix>(
+        ReadSparseDataset(ctx_->HasLabel() ? &sparse_labels_ : nullptr));
+    int64_t col_num = ctx_->HasLabel() ? dataset->cols + 1 : dataset->cols;
+    YACL_ENFORCE(dataset->rows == counted_shape_[0] &&
+                     col_num == counted_shape_[1],
+                 "dataset changed while loading");
+    sparse_dataset_ = std::move(dataset);
+    return;
+  }
+
+  auto dataset =
+      std::make_unique<xt::xarray<float>>(xt::xarray<float>::from_shape(
+          {static_cast<size_t>(counted_shape_[0]),
+           static_cast<size_t>(counted_shape_[1])}));
+  ReadDenseDataset(counted_shape_[0], counted_shape_[1], dataset->data());
+  dataset_ = std::move(dataset);
+}
+
+void LrHandler::SetDataset(std::unique_ptr<xt::xarray<float>> dataset) {
+  YACL_ENFORCE(dataset && dataset->shape().size() == 2);
+
+  int64_t sample_size = dataset->shape(0);
+  int32_t feature_num =
+      ctx_->HasLabel() ? dataset->shape(1) - 1 : dataset->shape(1);
+  YACL_ENFORCE(sample_size > 0, "empty dataset");
+
+  auto self_rank = ctx_->ic_ctx->lctx->Rank();
+  YACL_ENFORCE(ctx_->io_param.feature_nums.at(self_rank) == feature_num);
+  ctx_->io_param.sample_size = sample_size;
+
+  dataset_ = std::move(dataset);
+}
+
+void LrHandler::SetSharedDataset(std::unique_ptr<SharedDataset> dataset) {
+  YACL_ENFORCE(dataset && dataset->row_num > 0, "empty dataset");
+  YACL_ENFORCE(ctx_->ic_ctx->lctx->WorldSize() == 2,
+               "shared dataset only supports two parties");
+  YACL_ENFORCE(ctx_->ss_param.protocol == PROTOCOL_KIND_SEMI2K &&
+                   ctx_->ss_param.field_type == FIELD_TYPE_64,
+               "shared dataset requires semi2k over FM64");
+
+  int32_t shared_rank = dataset->shared_rank;
+  YACL_ENFORCE(shared_rank == 0 || shared_rank == 1);
+  int32_t label_cols = ctx_->io_param.label_rank == shared_rank ? 1 : 0;
+  YACL_ENFORCE(dataset->shared_col_num ==
+               ctx_->io_param.feature_nums.at(shared_rank) + label_cols);
+  YACL_ENFORCE(dataset->shared_columns.size() ==
+               static_cast<size_t>(dataset->row_num * dataset->shared_col_num));
+  YACL_ENFORCE(dataset->match_shares.size() ==
+               static_cast<size_t>(dataset->row_num));
+
+  auto self_rank = static_cast<int32_t>(ctx_->ic_ctx->lctx->Rank());
+  if (self_rank != shared_rank) {
+    const auto& plain = dataset->plain_columns;
+    YACL_ENFORCE(plain.dimension() == 2 &&
+                 static_cast<int64_t>(plain.shape(0)) == dataset->row_num);
+    int32_t feature_num = ctx_->HasLabel() ? plain.shape(1) - 1
+                                           : plain.shape(1);
+    YACL_ENFORCE(ctx_->io_param.feature_nums.at(self_rank) == feature_num);
+  }
+
+  ctx_->io_param.sample_size = dataset->row_num;
+  shared_dataset_ = std::move(dataset);
+}
+
 bool LrHandler::ProcessHandshakeResponse(const HandshakeResponseV2& response) {
   if (!AlgoV2Handler::ProcessHandshakeResponse(response)) {
     return false;
@@ -228,6 +389,7 @@ bool LrHandler::ProcessHandshakeResponse(const HandshakeResponseV2& response) {
   YACL_ENFORCE(response.algo_param().UnpackTo(&lr_param));
   ctx_->lr_param.num_epoch = lr_param.num_epoch();
   ctx_->lr_param.batch_size = lr_param.batch_size();
+  ctx_->lr_param.last_batch_policy = lr_param.last_batch_policy();
   if (UsePenaltyTerm(lr_param.l0_norm())) {
     YACL_ENFORCE(UsePenaltyTerm(ctx_->lr_param.l0_norm));
   }
@@ -243,6 +405,21 @@ bool LrHandler::ProcessHandshakeResponse(const HandshakeResponseV2& response) {
   }
   ctx_->lr_param.l2_norm = lr_param.l2_norm();
 
+  ctx_->lr_param.sweep_learning_rates.clear();
+  ctx_->lr_param.sweep_l2_norms.clear();
+  ctx_->lr_param.cv_folds = 0;
+  if (auto ext = util::GetVendorExt<LrHyperparamsResultExt>(lr_param)) {
+    ctx_->lr_param.cv_folds = ext->cv_folds();
+    ctx_->lr_param.cv_seed = ext->cv_seed();
+    ctx_->lr_param.cv_threads = ext->cv_threads();
+    ctx_->lr_param.sweep_learning_rates.assign(ext->learning_rates().begin(),
+                                               ext->learning_rates().end());
+    ctx_->lr_param.sweep_l2_norms.assign(ext->l2_norms().begin(),
+                                         ext->l2_norms().end());
+    YACL_ENFORCE(ctx_->lr_param.sweep_learning_rates.size() ==
+                 ctx_->lr_param.sweep_l2_norms.size());
+  }
+
   // process optimizer parameters, currently only support SGD optimizer
   YACL_ENFORCE(lr_param.optimizer_name() ==
                org::interconnection::v2::algos::OPTIMIZER_SGD);
@@ -266,6 +443,13 @@ bool LrHandler::ProcessHandshakeResponse(const HandshakeResponseV2& response) {
     ctx_->io_param.feature_nums[i] = io_param.feature_nums(i);
   }
 
+  ctx_->io_param.sparse_ranks.clear();
+  if (auto ext = util::GetVendorExt<LrDataIoResultExt>(io_param)) {
+    ctx_->io_param.sparse_ranks.assign(ext->sparse_ranks().begin(),
+                                       ext->sparse_ranks().end());
+  }
+  YACL_ENFORCE(sparse_input_ || !IsSparseRank(ctx_->ic_ctx->lctx->Rank()));
+
   // process op parameters
   auto sigmoid_param_optional = ExtractRspSigmoidParam(response);
   YACL_ENFORCE(sigmoid_param_optional.has_value());
@@ -279,8 +463,18 @@ bool LrHandler::ProcessHandshakeResponse(const HandshakeResponseV2& response) {
 
   YACL_ENFORCE(ss_param.field_type() == ctx_->ss_param.field_type);
   YACL_ENFORCE(ss_param.trunc_mode().method() == ctx_->ss_param.trunc_mode);
-  YACL_ENFORCE(ss_param.shard_serialize_format() ==
-               ctx_->ss_param.shard_serialize_format);
+  const auto& wire_formats = ctx_->ic_ctx->wire_formats;
+  if (ss_param.shard_serialize_format() ==
+      ctx_->ss_param.shard_serialize_format) {
+    ctx_->ic_ctx->wire_format = ic_impl::proto::WIRE_FORMAT_RAW;
+  } else {
+    YACL_ENFORCE(std::find(wire_formats.begin(), wire_formats.end(),
+                           ss_param.shard_serialize_format()) !=
+                     wire_formats.end(),
+                 "unexpected shard serialize format {}",
+                 ss_param.shard_serialize_format());
+    ctx_->ic_ctx->wire_format = ss_param.shard_serialize_format();
+  }
   ctx_->ss_param.fxp_bits = ss_param.fxp_fraction_bits();
 
   YACL_ENFORCE(ss_param.triple_config().version() ==
@@ -291,6 +485,20 @@ bool LrHandler::ProcessHandshakeResponse(const HandshakeResponseV2& response) {
   return true;
 }
 
+bool LrHandler::ResumeHandshake(const std::vector<HandshakeRequestV2>&,
+                                const HandshakeResponseV2& response) {
+  if (!ProcessHandshakeResponse(response)) {
+    return false;
+  }
+
+  // only learned from the requests otherwise
+  LrDataIoResult io_param;
+  YACL_ENFORCE(response.io_param().UnpackTo(&io_param));
+  ctx_->io_param.label_rank = io_param.label_rank();
+
+  return true;
+}
+
 HandshakeRequestV2 LrHandler::BuildHandshakeRequest() {
   HandshakeRequestV2 request;
   auto self_rank = ctx_->ic_ctx->lctx->Rank();
@@ -303,8 +511,12 @@ HandshakeRequestV2 LrHandler::BuildHandshakeRequest() {
   lr_param.add_supported_versions(1);
   lr_param.add_optimizers(ctx_->optimizer.type);
   lr_param.add_last_batch_policies(ctx_->lr_param.last_batch_policy);
-  lr_param.set_use_l2_norm(UsePenaltyTerm(
-      ctx_->lr_param.l2_norm));  // Currently only support l2 norm
+  lr_param.set_use_l2_norm(
+      UseL2Norm(ctx_->lr_param));  // Currently only support l2 norm
+  LrHyperparamsProposalExt lr_ext;
+  lr_ext.set_sweep(true);
+  lr_ext.set_cross_validation(true);
+  util::SetVendorExt(&lr_param, lr_ext);
   request.add_algo_params()->PackFrom(lr_param);
 
   request.add_ops(OP_TYPE_SIGMOID);
@@ -322,6 +534,10 @@ HandshakeRequestV2 LrHandler::BuildHandshakeRequest() {
       protocol_param.add_field_types(ctx_->ss_param.field_type);
       protocol_param.add_shard_serialize_formats(
           ctx_->ss_param.shard_serialize_format);
+      // vendor formats of the whole link, ignored by other implementations
+      for (auto format : ctx_->ic_ctx->wire_formats) {
+        protocol_param.add_shard_serialize_formats(format);
+      }
       // set truncation mode
       auto* trunc_mode_param = protocol_param.add_trunc_modes();
       trunc_mode_param->add_supported_versions(1);
@@ -345,6 +561,11 @@ HandshakeRequestV2 LrHandler::BuildHandshakeRequest() {
   lr_io.set_sample_size(ctx_->io_param.sample_size);
   lr_io.set_feature_num(ctx_->io_param.feature_nums.at(self_rank));
   lr_io.set_has_label(ctx_->HasLabel());
+  if (sparse_input_) {
+    LrDataIoProposalExt ext;
+    ext.set_sparse(true);
+    util::SetVendorExt(&lr_io, ext);
+  }
   request.mutable_io_param()->PackFrom(lr_io);
 
   return request;
@@ -396,6 +617,16 @@ status::ErrorStatus LrHandler::NegotiateLrAlgoParams(
     return status::UnsupportedArgumentError("negotiate penalty terms failed");
   }
 
+  if (!NegotiateSweep(lr_params)) {
+    return status::UnsupportedArgumentError(
+        "negotiate hyperparameter sweep failed");
+  }
+
+  if (!NegotiateCrossValidation(lr_params)) {
+    return status::UnsupportedArgumentError(
+        "negotiate cross validation failed");
+  }
+
   return status::OkStatus();
 }
 
@@ -450,6 +681,11 @@ status::ErrorStatus LrHandler::NegotiateSsParams(
 
 status::ErrorStatus LrHandler::NegotiateLrIoParams(
     const std::vector<HandshakeRequestV2>& requests) {
+  std::set<int32_t> sparse_ranks;
+  if (sparse_input_) {
+    sparse_ranks.insert(ctx_->ic_ctx->lctx->Rank());
+  }
+
   for (const auto& request : requests) {
     LrDataIoProposal io_param;
     if (!request.io_param().UnpackTo(&io_param)) {
@@ -457,6 +693,11 @@ status::ErrorStatus LrHandler::NegotiateLrIoParams(
           "certain request has invalid io param");
     }
 
+    auto ext = util::GetVendorExt<LrDataIoProposalExt>(io_param);
+    if (ext && ext->sparse()) {
+      sparse_ranks.insert(request.requester_rank());
+    }
+
     // negotiate same_size
     if (io_param.sample_size() != ctx_->io_param.sample_size) {
       return status::HandshakeRefusedError("sample size inconsistent");
@@ -487,6 +728,21 @@ status::ErrorStatus LrHandler::NegotiateLrIoParams(
     return status::InvalidRequestError("no party has label");
   }
 
+  // sparse products run between two parties on shares of Z_2^64, and the
+  // intercept needs a dense block, so the label party densifies if both
+  // are sparse. The folds of a cross validation are not contiguous in the
+  // dataset, so every party densifies then.
+  ctx_->io_param.sparse_ranks.clear();
+  if (ctx_->lr_param.cv_folds < 2 && ctx_->ic_ctx->lctx->WorldSize() == 2 &&
+      ctx_->ss_param.protocol == PROTOCOL_KIND_SEMI2K &&
+      ctx_->ss_param.field_type == FIELD_TYPE_64) {
+    if (sparse_ranks.size() == 2) {
+      sparse_ranks.erase(ctx_->io_param.label_rank);
+    }
+    ctx_->io_param.sparse_ranks.assign(sparse_ranks.begin(),
+                                       sparse_ranks.end());
+  }
+
   return status::OkStatus();
 }
 
@@ -513,6 +769,7 @@ bool LrHandler::NegotiatePenaltyTerms(
     if (!others_use_norm) {
       DisablePenaltyTerm(norm);
     }
+    return others_use_norm;
   };
 
   negotiate_norm(lr_params, ctx_->lr_param.l0_norm,
@@ -521,12 +778,43 @@ bool LrHandler::NegotiatePenaltyTerms(
   negotiate_norm(lr_params, ctx_->lr_param.l1_norm,
                  LrHyperparamsProposal::kUseL1NormFieldNumber);
 
-  negotiate_norm(lr_params, ctx_->lr_param.l2_norm,
-                 LrHyperparamsProposal::kUseL2NormFieldNumber);
+  if (!negotiate_norm(lr_params, ctx_->lr_param.l2_norm,
+                      LrHyperparamsProposal::kUseL2NormFieldNumber)) {
+    auto& norms = ctx_->lr_param.sweep_l2_norms;
+    std::fill(norms.begin(), norms.end(), 0.0);
+  }
 
   return true;
 }
 
+bool LrHandler::NegotiateSweep(
+    const std::vector<LrHyperparamsProposal>& lr_params) {
+  if (ModelNum(ctx_->lr_param) == 1) {
+    return true;
+  }
+  return std::all_of(lr_params.begin(), lr_params.end(),
+                     [](const LrHyperparamsProposal& lr_param) {
+                       auto ext =
+                           util::GetVendorExt<LrHyperparamsProposalExt>(
+                               lr_param);
+                       return ext && ext->sweep();
+                     });
+}
+
+bool LrHandler::NegotiateCrossValidation(
+    const std::vector<LrHyperparamsProposal>& lr_params) {
+  if (ctx_->lr_param.cv_folds < 2) {
+    return true;
+  }
+  return std::all_of(lr_params.begin(), lr_params.end(),
+                     [](const LrHyperparamsProposal& lr_param) {
+                       auto ext =
+                           util::GetVendorExt<LrHyperparamsProposalExt>(
+                               lr_param);
+                       return ext && ext->cross_validation();
+                     });
+}
+
 bool LrHandler::NegotiateSigmoidParams(
     const std::vector<SigmoidParamsProposal>& sigmoid_params) {
   auto sigmoid_modes = IntersectSigmoidModes(sigmoid_params);
@@ -548,7 +836,13 @@ bool LrHandler::NegotiateFieldType(
 bool LrHandler::NegotiateShardSerializeFormat(
     const std::vector<SSProtocolProposal>& ss_params) {
   auto formats = IntersectShardSerializeFormats(ss_params);
-  return formats.find(ctx_->ss_param.shard_serialize_format) != formats.end();
+  if (formats.find(ctx_->ss_param.shard_serialize_format) == formats.end()) {
+    return false;
+  }
+
+  ctx_->ic_ctx->wire_format =
+      link::ChooseWireFormat(ctx_->ic_ctx->wire_formats, formats);
+  return true;
 }
 
 std::set<int32_t> LrHandler::IntersectTruncModes(
@@ -619,6 +913,26 @@ HandshakeResponseV2 LrHandler::BuildHandshakeResponse() {
       ctx_->optimizer.param));  // Currently only support SGD optimizer
   lr_param.mutable_optimizer_param()->PackFrom(optimizer);
 
+  LrHyperparamsResultExt lr_ext;
+  if (ModelNum(ctx_->lr_param) > 1) {
+    auto learning_rates =
+        PerModel(ctx_->lr_param, ctx_->lr_param.sweep_learning_rates,
+                 optimizer.learning_rate());
+    auto l2_norms = PerModel(ctx_->lr_param, ctx_->lr_param.sweep_l2_norms,
+                             ctx_->lr_param.l2_norm);
+    lr_ext.mutable_learning_rates()->Add(learning_rates.begin(),
+                                         learning_rates.end());
+    lr_ext.mutable_l2_norms()->Add(l2_norms.begin(), l2_norms.end());
+  }
+  if (ctx_->lr_param.cv_folds > 1) {
+    lr_ext.set_cv_folds(ctx_->lr_param.cv_folds);
+    lr_ext.set_cv_seed(ctx_->lr_param.cv_seed);
+    lr_ext.set_cv_threads(ctx_->lr_param.cv_threads);
+  }
+  if (lr_ext.ByteSizeLong() > 0) {
+    util::SetVendorExt(&lr_param, lr_ext);
+  }
+
   response.mutable_algo_param()->PackFrom(lr_param);
 
   // set op params
@@ -633,7 +947,11 @@ HandshakeResponseV2 LrHandler::BuildHandshakeResponse() {
   ss_param.set_protocol(ctx_->ss_param.protocol);
   ss_param.set_field_type(ctx_->ss_param.field_type);
   ss_param.set_fxp_fraction_bits(ctx_->ss_param.fxp_bits);
-  ss_param.set_shard_serialize_format(ctx_->ss_param.shard_serialize_format);
+  if (link::IsEncodedWireFormat(ctx_->ic_ctx->wire_format)) {
+    ss_param.set_shard_serialize_format(ctx_->ic_ctx->wire_format);
+  } else {
+    ss_param.set_shard_serialize_format(ctx_->ss_param.shard_serialize_format);
+  }
   ss_param.mutable_trunc_mode()->set_version(1);
   ss_param.mutable_trunc_mode()->set_method(ctx_->ss_param.trunc_mode);
   ss_param.mutable_triple_config()->set_version(1);
@@ -652,37 +970,35 @@ HandshakeResponseV2 LrHandler::BuildHandshakeResponse() {
   io_param.mutable_feature_nums()->Add(ctx_->io_param.feature_nums.begin(),
                                        ctx_->io_param.feature_nums.end());
   io_param.set_label_rank(ctx_->io_param.label_rank);
+  if (!ctx_->io_param.sparse_ranks.empty()) {
+    LrDataIoResultExt ext;
+    ext.mutable_sparse_ranks()->Add(ctx_->io_param.sparse_ranks.begin(),
+                                    ctx_->io_param.sparse_ranks.end());
+    util::SetVendorExt(&io_param, ext);
+  }
   response.mutable_io_param()->PackFrom(io_param);
 
   return response;
 }
 
-spu::Value inference(spu::SPUContext* ctx, const spu::Value& x,
-                     const spu::Value& weight) {
-  auto padding =
-      spu::kernel::hal::constant(ctx, 1.0F, spu::DT_F32, {x.shape()[0], 1});
-  auto padded_x = spu::kernel::hal::concatenate(
-      ctx, {x, spu::kernel::hal::seal(ctx, padding)}, 1);
-  return spu::kernel::hal::matmul(ctx, padded_x, weight);
-}
-
+// Accuracy of the scores of the model in column `model` of y_pred
 float Accuracy(const xt::xarray<float>& y_true,
-               const xt::xarray<float>& y_pred) {
-  int64_t total_num = 0;
+               const xt::xarray<float>& y_pred, size_t model) {
+  size_t total_num = std::min(y_true.shape(0), y_pred.shape(0));
   int64_t accurate_num = 0;
-  for (auto y_true_iter = y_true.begin(), y_pred_iter = y_pred.begin();
-       y_true_iter != y_true.end() && y_pred_iter != y_pred.end();
-       ++y_pred_iter, ++y_true_iter) {
-    if ((util::AlmostZero(*y_true_iter) && *y_pred_iter < 0.5) ||
-        (util::AlmostOne(*y_true_iter) && *y_pred_iter >= 0.5)) {
+  for (size_t i = 0; i < total_num; ++i) {
+    float label = y_true(i, 0);
+    float score = y_pred(i, model);
+    if ((util::AlmostZero(label) && score < 0.5) ||
+        (util::AlmostOne(label) && score >= 0.5)) {
       ++accurate_num;
     }
-    ++total_num;
   }
 
   return accurate_num / static_cast<float>(total_num);
 }
 
+// A weight file per column of w, that is per model
 void ProduceOutput(spu::SPUContext* sctx, const spu::Value& w) {
   // output result shares to the file
   spu::PtType pt_type = getDecodeType(w.dtype());
@@ -692,38 +1008,235 @@ void ProduceOutput(spu::SPUContext* sctx, const spu::Value& w) {
   spu::decodeFromRing(w.data(), w.dtype(), sctx->config().fxp_fraction_bits(),
                       &pv);
 
-  std::string out_file_name = GetLrOutputFileName();
-  std::ofstream of(out_file_name);
-  YACL_ENFORCE(of, "open file={} failed", out_file_name);
-  for (auto it = dst.begin(); it != dst.end(); ++it) {
-    auto* item = reinterpret_cast<float*>(it.getRawPtr());
-    of << *item << '\n';
+  spu::NdArrayView<float> weights(dst);
+  int64_t rows = w.shape()[0];
+  int64_t models = w.shape()[1];
+  for (int64_t k = 0; k < models; ++k) {
+    std::string out_file_name =
+        models == 1 ? GetLrOutputFileName() : GetLrOutputFileName(k);
+    std::ofstream of(out_file_name);
+    YACL_ENFORCE(of, "open file={} failed", out_file_name);
+    for (int64_t i = 0; i < rows; ++i) {
+      of << weights[i * models + k] << '\n';
+    }
   }
 }
 
 void LrHandler::RunAlgo() {
-  auto sctx = MakeSpuContext();
+  auto sctx = MakeSpuContext(ctx_->ic_ctx->lctx);
   spu::mpc::Factory::RegisterProtocol(sctx.get(), sctx->lctx());
-  auto [x, y] = ProcessDataset(sctx.get());
+  DensifyDataset();
+  ShuffleRows();
+  SetupSparseProducts();
+  auto [x, y] = shared_dataset_ ? ProcessSharedDataset(sctx.get())
+                                 : ProcessDataset(sctx.get());
+
+  // padded once, the batches and the scores being views of it
+  auto padded_x = PadDataset(sctx.get(), x);
+  if (ctx_->lr_param.cv_folds > 1) {
+    CrossValidate(sctx.get(), padded_x, y);
+  }
+  auto w = Train(sctx.get(), padded_x, y, {{0, ctx_->io_param.sample_size}});
 
-  auto w = Train(sctx.get(), x, y);
+  if (row_mask_) {
+    // revealing the labels would disclose which rows are valid
+    ProduceOutput(sctx.get(), w);
+    return;
+  }
 
   // to delete
-  const auto scores = inference(sctx.get(), x, w);
+  const auto scores =
+      Score(sctx.get(), padded_x, w, 0, ctx_->io_param.sample_size);
 
   xt::xarray<float> revealed_labels = spu::kernel::hal::dump_public_as<float>(
       sctx.get(), spu::kernel::hal::reveal(sctx.get(), y));
   xt::xarray<float> revealed_scores = spu::kernel::hal::dump_public_as<float>(
       sctx.get(), spu::kernel::hal::reveal(sctx.get(), scores));
 
-  auto accuracy = Accuracy(revealed_labels, revealed_scores);
-  std::cout << "Accuracy = " << accuracy << "\n";
+  std::vector<std::string> accuracies;
+  for (int64_t k = 0; k < w.shape()[1]; ++k) {
+    accuracies.push_back(
+        fmt::format("{}", Accuracy(revealed_labels, revealed_scores, k)));
+  }
+  PrintModelMetrics("Accuracy", accuracies);
 
   ProduceOutput(sctx.get(), w);
 }
 
-std::unique_ptr<spu::SPUContext> LrHandler::MakeSpuContext() {
-  auto lctx = ctx_->ic_ctx->lctx;
+void LrHandler::PrintModelMetrics(
+    std::string_view metric, const std::vector<std::string>& values) const {
+  if (values.size() == 1) {
+    std::cout << metric << " = " << values.front() << "\n";
+    return;
+  }
+
+  const auto& optimizer_param =
+      std::get<org::interconnection::v2::algos::SgdOptimizer>(
+          ctx_->optimizer.param);
+  auto learning_rates =
+      PerModel(ctx_->lr_param, ctx_->lr_param.sweep_learning_rates,
+               optimizer_param.learning_rate());
+  auto l2_norms = PerModel(ctx_->lr_param, ctx_->lr_param.sweep_l2_norms,
+                           ctx_->lr_param.l2_norm);
+  for (size_t k = 0; k < values.size(); ++k) {
+    std::cout << "Model " << k << " learning_rate = " << learning_rates[k]
+              << " l2_norm = " << l2_norms[k] << " " << metric << " = "
+              << values[k] << "\n";
+  }
+}
+
+void LrHandler::CrossValidate(spu::SPUContext* sctx,
+                              const spu::Value& padded_x,
+                              const spu::Value& y) {
+  int64_t folds = ctx_->lr_param.cv_folds;
+  YACL_ENFORCE(!row_mask_,
+               "cross validation would disclose which rows are valid");
+  YACL_ENFORCE(folds <= ctx_->io_param.sample_size, "more folds than rows");
+
+  // the contexts of the other threads are set up one after another, in the
+  // same order by every party
+  int64_t threads = std::clamp<int64_t>(ctx_->lr_param.cv_threads, 1, folds);
+  std::vector<std::unique_ptr<spu::SPUContext>> thread_ctxs;
+  for (int64_t t = 1; t < threads; ++t) {
+    auto lctx = ctx_->ic_ctx->lctx->Spawn(fmt::format("cv{}", t));
+    auto thread_ctx = MakeSpuContext(lctx);
+    spu::mpc::Factory::RegisterProtocol(thread_ctx.get(), lctx);
+    thread_ctxs.push_back(std::move(thread_ctx));
+  }
+
+  std::vector<std::vector<float>> accuracies(folds);
+  auto run = [&](spu::SPUContext* ctx, int64_t first_fold) {
+    for (int64_t fold = first_fold; fold < folds; fold += threads) {
+      accuracies[fold] = EvaluateFold(ctx, padded_x, y, fold);
+    }
+  };
+  std::vector<std::future<void>> running;
+  for (int64_t t = 1; t < threads; ++t) {
+    running.push_back(std::async(std::launch::async, run,
+                                 thread_ctxs[t - 1].get(), t));
+  }
+  run(sctx, 0);
+  for (auto& thread : running) {
+    thread.get();
+  }
+
+  std::vector<std::string> summaries;
+  for (size_t k = 0; k < accuracies.front().size(); ++k) {
+    double sum = 0.0;
+    double square_sum = 0.0;
+    for (const auto& fold_accuracies : accuracies) {
+      sum += fold_accuracies[k];
+      square_sum += fold_accuracies[k] * fold_accuracies[k];
+    }
+    double mean = sum / folds;
+    double stddev = std::sqrt(std::max(0.0, square_sum / folds - mean * mean));
+    summaries.push_back(fmt::format("{:.4f} +/- {:.4f}", mean, stddev));
+  }
+  PrintModelMetrics(fmt::format("{}-fold CV accuracy", folds), summaries);
+}
+
+std::vector<float> LrHandler::EvaluateFold(spu::SPUContext* ctx,
+                                           const spu::Value& padded_x,
+                                           const spu::Value& y, int64_t fold) {
+  int64_t rows = ctx_->io_param.sample_size;
+  int64_t folds = ctx_->lr_param.cv_folds;
+  int64_t test_beg = rows * fold / folds;
+  int64_t test_end = rows * (fold + 1) / folds;
+
+  auto w = Train(ctx, padded_x, y, {{0, test_beg}, {test_end, rows}});
+
+  auto test_x = spu::kernel::hal::slice(ctx, padded_x, {test_beg, 0},
+                                        {test_end, padded_x.shape()[1]}, {});
+  auto test_y = spu::kernel::hal::slice(ctx, y, {test_beg, 0},
+                                        {test_end, y.shape()[1]}, {});
+  auto scores = Score(ctx, test_x, w, test_beg, test_end);
+  // the labels and scores stay shared, every row is in some test fold
+  auto errors = CountErrors(ctx, test_y, scores);
+
+  std::vector<float> accuracies;
+  for (auto error_num : errors) {
+    accuracies.push_back(1.0F - error_num / (test_end - test_beg));
+  }
+  SPDLOG_INFO("fold {} of {} evaluated", fold, folds);
+
+  return accuracies;
+}
+
+bool LrHandler::IsSparseRank(int32_t rank) const {
+  const auto& ranks = ctx_->io_param.sparse_ranks;
+  return std::find(ranks.begin(), ranks.end(), rank) != ranks.end();
+}
+
+void LrHandler::DensifyDataset() {
+  auto self_rank = static_cast<int32_t>(ctx_->ic_ctx->lctx->Rank());
+  if (!sparse_dataset_ || IsSparseRank(self_rank)) {
+    return;
+  }
+
+  // laid out like a csv dataset, the label last
+  const auto& matrix = *sparse_dataset_;
+  int64_t feature_num = ctx_->io_param.feature_nums.at(self_rank);
+  int64_t col_num = ctx_->HasLabel() ? feature_num + 1 : feature_num;
+  auto dataset = std::make_unique<xt::xarray<float>>(
+      xt::zeros<float>({static_cast<size_t>(matrix.rows),
+                        static_cast<size_t>(col_num)}));
+  for (int64_t i = 0; i < matrix.rows; ++i) {
+    for (auto k = matrix.row_offsets[i]; k < matrix.row_offsets[i + 1]; ++k) {
+      (*dataset)(i, matrix.columns[k]) = matrix.values[k];
+    }
+    if (ctx_->HasLabel()) {
+      (*dataset)(i, feature_num) = sparse_labels_[i];
+    }
+  }
+
+  dataset_ = std::move(dataset);
+  sparse_dataset_.reset();
+  sparse_labels_.clear();
+}
+
+void LrHandler::ShuffleRows() {
+  if (ctx_->lr_param.cv_folds < 2 || !dataset_) {
+    return;
+  }
+  YACL_ENFORCE(!sparse_dataset_);
+
+  // Fisher-Yates on the raw output of mt19937_64, which unlike the standard
+  // distributions is the same everywhere
+  auto rows = static_cast<int64_t>(dataset_->shape(0));
+  auto cols = static_cast<int64_t>(dataset_->shape(1));
+  std::vector<int64_t> order(rows);
+  std::iota(order.begin(), order.end(), 0);
+  std::mt19937_64 rng(static_cast<uint64_t>(ctx_->lr_param.cv_seed));
+  for (int64_t i = rows - 1; i > 0; --i) {
+    std::swap(order[i], order[rng() % (i + 1)]);
+  }
+
+  auto shuffled = std::make_unique<xt::xarray<float>>(
+      xt::xarray<float>::from_shape(dataset_->shape()));
+  const float* src = dataset_->data();
+  float* dst = shuffled->data();
+  for (int64_t i = 0; i < rows; ++i) {
+    std::copy_n(src + order[i] * cols, cols, dst + i * cols);
+  }
+  dataset_ = std::move(shuffled);
+}
+
+void LrHandler::SetupSparseProducts() {
+  auto self_rank = static_cast<int32_t>(ctx_->ic_ctx->lctx->Rank());
+  auto param = protocol_family::paillier::SuggestedPaillierParam();
+  for (auto rank : ctx_->io_param.sparse_ranks) {
+    auto product = std::make_unique<SparseProduct>(
+        ctx_->ic_ctx->lctx, rank, ctx_->io_param.sample_size,
+        ctx_->io_param.feature_nums.at(rank),
+        rank == self_rank ? sparse_dataset_.get() : nullptr,
+        ctx_->ss_param.fxp_bits);
+    product->Setup(param);
+    sparse_products_[rank] = std::move(product);
+  }
+}
+
+std::unique_ptr<spu::SPUContext> LrHandler::MakeSpuContext(
+    std::shared_ptr<yacl::link::Context> lctx) {
   static const std::map<int32_t, spu::ProtocolKind> protocol_map{
       {org::interconnection::v2::protocol::PROTOCOL_KIND_SEMI2K,
        spu::ProtocolKind::SEMI2K},
@@ -768,19 +1281,11 @@ std::unique_ptr<spu::SPUContext> LrHandler::MakeSpuContext() {
 }
 
 spu::Value LrHandler::EncodingDataset(spu::PtBufferView dataset) {
-  // encode to ring.
-  auto array = convertToNdArray(dataset);
-  SPU_ENFORCE(array.eltype().isa<spu::PtTy>(), "expect PtType, got={}",
-              array.eltype());
-
-  const spu::PtType pt_type = array.eltype().as<spu::PtTy>()->pt_type();
-  spu::PtBufferView pv(static_cast<const void*>(array.data()), pt_type,
-                       array.shape(), array.strides());
-
+  // encode to ring straight from the plaintext, which may be a strided view
   spu::DataType dtype;
-  spu::NdArrayRef encoded =
-      encodeToRing(pv, static_cast<spu::FieldType>(ctx_->ss_param.field_type),
-                   ctx_->ss_param.fxp_bits, &dtype);
+  spu::NdArrayRef encoded = encodeToRing(
+      dataset, static_cast<spu::FieldType>(ctx_->ss_param.field_type),
+      ctx_->ss_param.fxp_bits, &dtype);
 
   return spu::Value(encoded, dtype);
 }
@@ -790,9 +1295,12 @@ spu::Value LrHandler::Concatenate(spu::SPUContext* sctx, spu::Value x) {
   size_t world_size = ctx_->ic_ctx->lctx->WorldSize();
   YACL_ENFORCE(self_rank < world_size);
   YACL_ENFORCE(ctx_->io_param.feature_nums.size() == world_size);
-  YACL_ENFORCE(x.shape().size() == 2);
-  YACL_ENFORCE(x.shape().at(0) == ctx_->io_param.sample_size);
-  YACL_ENFORCE(x.shape().at(1) == ctx_->io_param.feature_nums.at(self_rank));
+  if (!IsSparseRank(self_rank)) {
+    YACL_ENFORCE(x.shape().size() == 2);
+    YACL_ENFORCE(x.shape().at(0) == ctx_->io_param.sample_size);
+    YACL_ENFORCE(x.shape().at(1) ==
+                 ctx_->io_param.feature_nums.at(self_rank));
+  }
 
   spu::Type ty;
   if (ctx_->ss_param.protocol == PROTOCOL_KIND_SEMI2K) {
@@ -804,19 +1312,24 @@ spu::Value LrHandler::Concatenate(spu::SPUContext* sctx, spu::Value x) {
   } else {
     YACL_THROW("Unexpected error");
   }
-  x.storage_type() = ty;
 
-  std::vector<spu::Value> x_vec(world_size);
-  x_vec[self_rank] = std::move(x);
+  // the blocks kept sparse are multiplied apart
+  std::vector<spu::Value> x_vec;
   for (size_t i = 0; i < world_size; ++i) {
+    if (IsSparseRank(i)) {
+      continue;
+    }
     if (i == self_rank) {
+      x.storage_type() = ty;
+      x_vec.push_back(std::move(x));
       continue;
     }
 
     int64_t rows = ctx_->io_param.sample_size;
     int64_t columns = ctx_->io_param.feature_nums.at(i);
-    x_vec[i] = spu::kernel::hal::zeros(sctx, spu::DT_F32, {rows, columns});
-    x_vec[i].storage_type() = ty;
+    x_vec.push_back(
+        spu::kernel::hal::zeros(sctx, spu::DT_F32, {rows, columns}));
+    x_vec.back().storage_type() = ty;
   }
 
   return spu::kernel::hal::concatenate(sctx, x_vec, 1);
@@ -827,20 +1340,32 @@ std::pair<spu::Value, spu::Value> LrHandler::ProcessDataset(
   spu::Value x;
   spu::Value y;
 
-  YACL_ENFORCE(dataset_);
-  if (ctx_->HasLabel()) {
-    // the last column is label.
-    using xt::placeholders::_;  // required for `_` to work
-    xt::xarray<float> dx =
-        xt::view(*dataset_, xt::all(), xt::range(_, dataset_->shape(1) - 1));
-    xt::xarray<float> dy =
-        xt::view(*dataset_, xt::all(), xt::range(dataset_->shape(1) - 1, _));
-    x = EncodingDataset(spu::PtBufferView(dx));
-    y = EncodingDataset(spu::PtBufferView(dy));
+  int64_t rows = ctx_->io_param.sample_size;
+  if (sparse_dataset_) {
+    if (ctx_->HasLabel()) {
+      YACL_ENFORCE(static_cast<int64_t>(sparse_labels_.size()) == rows);
+      y = EncodingDataset(spu::PtBufferView(
+          sparse_labels_.data(), spu::PT_F32, {rows, 1}, {1, 1}));
+      std::vector<float>().swap(sparse_labels_);
+    }
   } else {
-    x = EncodingDataset(spu::PtBufferView(*dataset_));
-    y = spu::kernel::hal::constant(sctx, 0.0F, spu::DT_F32,
-                                   {ctx_->io_param.sample_size, 1});
+    // the features and the label, the last column, are encoded from views
+    // of the rows, and the plaintext is released before training
+    YACL_ENFORCE(dataset_ && dataset_->dimension() == 2 &&
+                 static_cast<int64_t>(dataset_->shape(0)) == rows);
+    int64_t cols = dataset_->shape(1);
+    int64_t feature_num = ctx_->HasLabel() ? cols - 1 : cols;
+    const float* data = dataset_->data();
+    x = EncodingDataset(
+        spu::PtBufferView(data, spu::PT_F32, {rows, feature_num}, {cols, 1}));
+    if (ctx_->HasLabel()) {
+      y = EncodingDataset(spu::PtBufferView(data + feature_num, spu::PT_F32,
+                                            {rows, 1}, {cols, 1}));
+    }
+    dataset_.reset();
+  }
+  if (!ctx_->HasLabel()) {
+    y = spu::kernel::hal::constant(sctx, 0.0F, spu::DT_F32, {rows, 1});
   }
 
   y.storage_type() = spu::makeType<spu::mpc::semi2k::AShrTy>(
@@ -849,59 +1374,305 @@ std::pair<spu::Value, spu::Value> LrHandler::ProcessDataset(
   return std::make_pair(Concatenate(sctx, std::move(x)), y);
 }
 
-spu::Value LrHandler::Train(spu::SPUContext* ctx, const spu::Value& x,
-                            const spu::Value& y) {
-  auto w =
-      spu::kernel::hal::constant(ctx, 0.0F, spu::DT_F32, {x.shape()[1] + 1, 1});
-  int64_t num_batch = ctx_->io_param.sample_size / ctx_->lr_param.batch_size;
+spu::Value LrHandler::MakeShares(const std::vector<uint64_t>& shares,
+                                 const spu::Shape& shape,
+                                 spu::DataType dtype) {
+  auto field = static_cast<spu::FieldType>(ctx_->ss_param.field_type);
+  spu::NdArrayRef array(spu::makeType<spu::RingTy>(field), shape);
+  YACL_ENFORCE(static_cast<size_t>(array.numel()) == shares.size());
+  std::memcpy(array.data(), shares.data(), shares.size() * sizeof(uint64_t));
+
+  spu::Value value(array, dtype);
+  value.storage_type() = spu::makeType<spu::mpc::semi2k::AShrTy>(field);
+  return value;
+}
 
-  // Run train loop
-  for (int64_t epoch = 0; epoch < ctx_->lr_param.num_epoch; ++epoch) {
-    for (int64_t batch = 0; batch < num_batch; ++batch) {
-      SPDLOG_INFO("Running train iteration {}", batch);
+std::pair<spu::Value, spu::Value> LrHandler::ProcessSharedDataset(
+    spu::SPUContext* sctx) {
+  YACL_ENFORCE(shared_dataset_);
+  const auto& data = *shared_dataset_;
+  int64_t rows = data.row_num;
+  int32_t shared_rank = data.shared_rank;
+  int32_t plain_rank = 1 - shared_rank;
+  auto self_rank = static_cast<int32_t>(ctx_->ic_ctx->lctx->Rank());
+
+  // the plaintext columns are shared as (value, 0) like in Concatenate
+  int64_t plain_cols = ctx_->io_param.feature_nums.at(plain_rank) +
+                       (ctx_->io_param.label_rank == plain_rank ? 1 : 0);
+  spu::Value plain;
+  if (self_rank == plain_rank) {
+    plain = EncodingDataset(spu::PtBufferView(data.plain_columns));
+  } else {
+    plain = spu::kernel::hal::zeros(sctx, spu::DT_F32, {rows, plain_cols});
+  }
+  plain.storage_type() = spu::makeType<spu::mpc::semi2k::AShrTy>(
+      static_cast<spu::FieldType>(ctx_->ss_param.field_type));
+
+  auto shared = MakeShares(data.shared_columns, {rows, data.shared_col_num},
+                           spu::DT_F32);
+  auto match = MakeShares(data.match_shares, {rows, 1}, spu::DT_I64);
+
+  // rows outside the intersection hold garbage, weight them by zero
+  auto mask = spu::kernel::hal::dtype_cast(
+      sctx,
+      spu::kernel::hal::equal(
+          sctx, match, spu::kernel::hal::zeros(sctx, spu::DT_I64, {rows, 1})),
+      spu::DT_F32);
+  shared = spu::kernel::hal::mul(
+      sctx, spu::kernel::hal::broadcast_to(sctx, mask, shared.shape()), shared);
+  row_mask_ = mask;
+
+  // split the label off the block of its owner
+  std::vector<spu::Value> x_vec(2);
+  x_vec[plain_rank] = std::move(plain);
+  x_vec[shared_rank] = std::move(shared);
+  spu::Value y;
+  int32_t label_rank = ctx_->io_param.label_rank;
+  if (label_rank == 0 || label_rank == 1) {
+    auto& block = x_vec[label_rank];
+    int64_t cols = block.shape()[1];
+    y = spu::kernel::hal::slice(sctx, block, {0, cols - 1}, {rows, cols}, {});
+    block = spu::kernel::hal::slice(sctx, block, {0, 0}, {rows, cols - 1}, {});
+  } else {
+    y = spu::kernel::hal::seal(
+        sctx, spu::kernel::hal::constant(sctx, 0.0F, spu::DT_F32, {rows, 1}));
+  }
+
+  return std::make_pair(spu::kernel::hal::concatenate(sctx, x_vec, 1), y);
+}
+
+std::vector<LrHandler::Batch> LrHandler::MakeBatches(
+    spu::SPUContext* ctx, const spu::Value& padded_x, const spu::Value& y,
+    const RowRanges& ranges) {
+  // the sparse blocks are multiplied by row numbers of the dataset
+  YACL_ENFORCE(sparse_products_.empty() ||
+               (ranges.size() == 1 && ranges.front().first == 0));
+
+  // slices and transposes only restride the shares, the batch boundaries
+  // being the same in every epoch
+  int64_t sample_size = 0;
+  for (const auto& [rows_beg, rows_end] : ranges) {
+    sample_size += rows_end - rows_beg;
+  }
+  auto rows_of = [&](const spu::Value& v, int64_t rows_beg, int64_t rows_end) {
+    return SliceRows(ctx, v, ranges, rows_beg, rows_end);
+  };
+  int64_t batch_size = ctx_->lr_param.batch_size;
+  int64_t num_batch = sample_size / batch_size;
+  std::vector<Batch> batches(num_batch);
+  for (int64_t i = 0; i < num_batch; ++i) {
+    auto& batch = batches[i];
+    batch.rows_beg = i * batch_size;
+    batch.rows_end = batch.rows_beg + batch_size;
+    batch.padded_x = rows_of(padded_x, batch.rows_beg, batch.rows_end);
+    batch.padded_x_t = spu::kernel::hal::transpose(ctx, batch.padded_x);
+    batch.y = rows_of(y, batch.rows_beg, batch.rows_end);
+    if (row_mask_) {
+      batch.mask = rows_of(*row_mask_, batch.rows_beg, batch.rows_end);
+    }
+  }
 
-      const int64_t rows_beg = batch * ctx_->lr_param.batch_size;
-      const int64_t rows_end = rows_beg + ctx_->lr_param.batch_size;
+  int64_t tail = sample_size % batch_size;
+  if (tail == 0 ||
+      ctx_->lr_param.last_batch_policy != LAST_BATCH_POLICY_PAD) {
+    return batches;
+  }
 
-      const auto x_slice = spu::kernel::hal::slice(
-          ctx, x, {rows_beg, 0}, {rows_end, x.shape()[1]}, {});
+  // the rows of the partial last batch, padded with zeros to the shape of
+  // the others and weighted 0 by the mask
+  auto pad_tail = [&](const spu::Value& v) {
+    return PadRows(ctx, rows_of(v, sample_size - tail, sample_size),
+                   batch_size);
+  };
+  auto& batch = batches.emplace_back();
+  batch.rows_beg = sample_size - tail;
+  batch.rows_end = sample_size;
+  batch.padded_x = pad_tail(padded_x);
+  batch.padded_x_t = spu::kernel::hal::transpose(ctx, batch.padded_x);
+  batch.y = pad_tail(y);
+  if (row_mask_) {
+    batch.mask = pad_tail(*row_mask_);
+  } else {
+    std::vector<float> weights(batch_size, 0.0F);
+    std::fill_n(weights.begin(), tail, 1.0F);
+    batch.mask = spu::kernel::hal::constant(
+        ctx,
+        spu::PtBufferView(weights.data(), spu::PT_F32, {batch_size, 1},
+                          {1, 1}),
+        spu::DT_F32);
+  }
 
-      const auto y_slice = spu::kernel::hal::slice(
-          ctx, y, {rows_beg, 0}, {rows_end, y.shape()[1]}, {});
+  return batches;
+}
 
-      w = TrainStep(ctx, x_slice, y_slice, w);
+spu::Value LrHandler::Train(spu::SPUContext* ctx, const spu::Value& padded_x,
+                            const spu::Value& y, const RowRanges& ranges) {
+  const auto& feature_nums = ctx_->io_param.feature_nums;
+  int64_t feature_num =
+      std::accumulate(feature_nums.begin(), feature_nums.end(), int64_t{0});
+  // a column per model
+  auto w = spu::kernel::hal::constant(
+      ctx, 0.0F, spu::DT_F32, {feature_num + 1, ModelNum(ctx_->lr_param)});
+  const auto batches = MakeBatches(ctx, padded_x, y, ranges);
+
+  // Run train loop
+  const auto& stats = ctx_->ic_ctx->lctx->GetStats();
+  for (int64_t epoch = 0; epoch < ctx_->lr_param.num_epoch; ++epoch) {
+    auto start = std::chrono::steady_clock::now();
+    size_t sent_bytes = stats->sent_bytes;
+    for (size_t batch = 0; batch < batches.size(); ++batch) {
+      SPDLOG_INFO("Running train iteration {}", batch);
+      w = TrainStep(ctx, batches[batch], w);
     }
+
+    std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+    SPDLOG_INFO("rank:{} algo:SS_LR epoch:{} seconds:{:.3f} sent_bytes:{}",
+                ctx_->ic_ctx->lctx->Rank(), epoch, elapsed.count(),
+                stats->sent_bytes - sent_bytes);
   }
 
   return w;
 }
 
-spu::Value LrHandler::TrainStep(spu::SPUContext* ctx, const spu::Value& x,
-                                const spu::Value& y, const spu::Value& w) {
-  // Padding x
+spu::Value LrHandler::PadDataset(spu::SPUContext* ctx, const spu::Value& x) {
   auto padding =
       spu::kernel::hal::constant(ctx, 1.0F, spu::DT_F32, {x.shape()[0], 1});
-  auto padded_x = spu::kernel::hal::concatenate(
+  return spu::kernel::hal::concatenate(
       ctx, {x, spu::kernel::hal::seal(ctx, padding)}, 1);
+}
+
+spu::Value LrHandler::Score(spu::SPUContext* ctx, const spu::Value& padded_x,
+                            const spu::Value& w, int64_t rows_beg,
+                            int64_t rows_end) {
+  if (sparse_products_.empty()) {
+    return spu::kernel::hal::matmul(ctx, padded_x, w);
+  }
+
+  // the weights of the sparse blocks go to their products, the others and
+  // the intercept to the dense one
+  std::vector<spu::Value> dense_w;
+  std::vector<spu::Value> sparse_scores;
+  int64_t offset = 0;
+  const auto& feature_nums = ctx_->io_param.feature_nums;
+  for (size_t rank = 0; rank < feature_nums.size(); ++rank) {
+    auto w_block = spu::kernel::hal::slice(
+        ctx, w, {offset, 0}, {offset + feature_nums[rank], w.shape()[1]}, {});
+    offset += feature_nums[rank];
+    if (IsSparseRank(rank)) {
+      sparse_scores.push_back(
+          SparseMultiply(ctx, rank, rows_beg, rows_end, w_block, false));
+    } else {
+      dense_w.push_back(std::move(w_block));
+    }
+  }
+  dense_w.push_back(spu::kernel::hal::slice(ctx, w, {offset, 0},
+                                            {offset + 1, w.shape()[1]}, {}));
+
+  auto score = spu::kernel::hal::matmul(
+      ctx, padded_x, spu::kernel::hal::concatenate(ctx, dense_w, 0));
+  for (const auto& sparse_score : sparse_scores) {
+    // the padding rows of a partial batch are not in the sparse blocks
+    score = spu::kernel::hal::add(
+        ctx, score, PadRows(ctx, sparse_score, score.shape()[0]));
+  }
+  return score;
+}
+
+spu::Value LrHandler::Gradient(spu::SPUContext* ctx,
+                               const spu::Value& padded_x_t,
+                               const spu::Value& err, int64_t rows_beg,
+                               int64_t rows_end) {
+  auto dense_grad = spu::kernel::hal::matmul(ctx, padded_x_t, err);
+  if (sparse_products_.empty()) {
+    return dense_grad;
+  }
+
+  // the padding rows of a partial batch are not in the sparse blocks
+  auto sparse_err = spu::kernel::hal::slice(
+      ctx, err, {0, 0}, {rows_end - rows_beg, err.shape()[1]}, {});
+
+  // in the order of the weights, the intercept last
+  std::vector<spu::Value> grads;
+  int64_t offset = 0;
+  const auto& feature_nums = ctx_->io_param.feature_nums;
+  for (size_t rank = 0; rank < feature_nums.size(); ++rank) {
+    if (IsSparseRank(rank)) {
+      grads.push_back(
+          SparseMultiply(ctx, rank, rows_beg, rows_end, sparse_err, true));
+      continue;
+    }
+    grads.push_back(spu::kernel::hal::slice(
+        ctx, dense_grad, {offset, 0},
+        {offset + feature_nums[rank], dense_grad.shape()[1]}, {}));
+    offset += feature_nums[rank];
+  }
+  grads.push_back(spu::kernel::hal::slice(
+      ctx, dense_grad, {offset, 0}, {offset + 1, dense_grad.shape()[1]}, {}));
+
+  return spu::kernel::hal::concatenate(ctx, grads, 0);
+}
+
+spu::Value LrHandler::SparseMultiply(spu::SPUContext* ctx, int32_t rank,
+                                     int64_t rows_beg, int64_t rows_end,
+                                     const spu::Value& v, bool transposed) {
+  if (v.shape()[1] > 1) {
+    // a product per model
+    std::vector<spu::Value> columns;
+    for (int64_t k = 0; k < v.shape()[1]; ++k) {
+      auto column = spu::kernel::hal::slice(ctx, v, {0, k},
+                                            {v.shape()[0], k + 1}, {});
+      columns.push_back(
+          SparseMultiply(ctx, rank, rows_beg, rows_end, column, transposed));
+    }
+    return spu::kernel::hal::concatenate(ctx, columns, 1);
+  }
+
+  // the own shares of v, sealed first while it is still public
+  auto secret = v.isSecret() ? v : spu::kernel::hal::seal(ctx, v);
+  spu::NdArrayView<uint64_t> view(secret.data());
+  std::vector<uint64_t> shares(secret.numel());
+  for (int64_t i = 0; i < secret.numel(); ++i) {
+    shares[i] = view[i];
+  }
+
+  auto& product = *sparse_products_.at(rank);
+  auto result = transposed
+                    ? product.MultiplyTransposed(rows_beg, rows_end, shares)
+                    : product.Multiply(rows_beg, rows_end, shares);
+  return MakeShares(result, {static_cast<int64_t>(result.size()), 1},
+                    spu::DT_F32);
+}
+
+spu::Value LrHandler::TrainStep(spu::SPUContext* ctx, const Batch& batch,
+                                const spu::Value& w) {
   auto pred = spu::kernel::hal::logistic(
-      ctx, spu::kernel::hal::matmul(ctx, padded_x, w));
+      ctx, Score(ctx, batch.padded_x, w, batch.rows_beg, batch.rows_end));
 
   SPDLOG_DEBUG("[SSLR] Err = Pred - Y");
-  auto err = spu::kernel::hal::sub(ctx, pred, y);
+  // the labels and the mask are shared by the models
+  auto err = spu::kernel::hal::sub(
+      ctx, pred, spu::kernel::hal::broadcast_to(ctx, batch.y, pred.shape()));
+  if (batch.mask) {
+    err = spu::kernel::hal::mul(
+        ctx, err,
+        spu::kernel::hal::broadcast_to(ctx, *batch.mask, err.shape()));
+  }
 
   SPDLOG_DEBUG("[SSLR] Grad = X.t * Err");
-  auto grad = spu::kernel::hal::matmul(
-      ctx, spu::kernel::hal::transpose(ctx, padded_x), err);
+  auto grad =
+      Gradient(ctx, batch.padded_x_t, err, batch.rows_beg, batch.rows_end);
 
   SPDLOG_DEBUG("[SSLR] Grad = Grad + W' * l2_norm");
-  if (UsePenaltyTerm(ctx_->lr_param.l2_norm)) {
-    auto w_with_zero_bias =
-        spu::kernel::hal::slice(ctx, w, {0, 0}, {w.shape()[0] - 1, 1}, {});
-    auto zeros = spu::kernel::hal::zeros(ctx, spu::DT_F32, {1, 1});
+  if (UseL2Norm(ctx_->lr_param)) {
+    auto w_with_zero_bias = spu::kernel::hal::slice(
+        ctx, w, {0, 0}, {w.shape()[0] - 1, w.shape()[1]}, {});
+    auto zeros = spu::kernel::hal::zeros(ctx, spu::DT_F32, {1, w.shape()[1]});
     auto w_superfix = spu::kernel::hal::concatenate(
         ctx, {w_with_zero_bias, spu::kernel::hal::seal(ctx, zeros)}, 0);
-    auto l2_norm = spu::kernel::hal::constant(
-        ctx, static_cast<float>(ctx_->lr_param.l2_norm), spu::DT_F32);
+    auto l2_norm = ModelRow(ctx, PerModel(ctx_->lr_param,
+                                          ctx_->lr_param.sweep_l2_norms,
+                                          ctx_->lr_param.l2_norm));
 
     grad = spu::kernel::hal::add(
         ctx, grad,
@@ -926,10 +1697,12 @@ spu::Value LrHandler::CalculateStepWithSgd(spu::SPUContext* ctx,
           &ctx_->optimizer.param);
   YACL_ENFORCE(optimizer_param);
 
-  auto lr = spu::kernel::hal::constant(
-      ctx, static_cast<float>(optimizer_param->learning_rate()), spu::DT_F32);
+  auto lr = ModelRow(ctx, PerModel(ctx_->lr_param,
+                                   ctx_->lr_param.sweep_learning_rates,
+                                   optimizer_param->learning_rate()));
   auto msize = spu::kernel::hal::constant(
-      ctx, static_cast<float>(ctx_->lr_param.batch_size), spu::DT_F32);
+      ctx, static_cast<float>(ctx_->lr_param.batch_size), spu::DT_F32,
+      lr.shape());
   auto p1 =
       spu::kernel::hal::mul(ctx, lr, spu::kernel::hal::reciprocal(ctx, msize));
   auto step = spu::kernel::hal::mul(
@@ -14,11 +14,20 @@
 
 #pragma once
 
+#include <array>
+#include <map>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
 #include "libspu/core/pt_buffer_view.h"
 #include "libspu/core/value.h"
 #include "xtensor/xarray.hpp"
 
 #include "ic_impl/algo/lr/lr_context.h"
+#include "ic_impl/algo/lr/sparse_product.h"
 #include "ic_impl/handler.h"
 
 #include "interconnection/handshake/algos/lr.pb.h"
@@ -29,9 +38,34 @@ namespace spu {
 class SPUContext;
 }
 
+namespace ic_impl::algo::psi_lr {
+class PsiLrHandler;
+}
+
 namespace ic_impl::algo::lr {
 
+// Rows [first, second) of each range, laid one after another
+using RowRanges = std::vector<std::pair<int64_t, int64_t>>;
+
+// Training rows whose membership is only known in secret-shared form, such
+// as the output of a shared PSI. Shares are additive in Z_2^64.
+struct SharedDataset {
+  int64_t row_num = 0;
+  // the rank whose columns are secret shared
+  int32_t shared_rank = -1;
+  // the columns of the other rank, zero on the rows it does not hold; empty
+  // on shared_rank
+  xt::xarray<float> plain_columns;
+  // shares of the fixed-point encoded columns of shared_rank, row major
+  int32_t shared_col_num = 0;
+  std::vector<uint64_t> shared_columns;
+  // shares of a value which is zero iff the row takes part in training
+  std::vector<uint64_t> match_shares;
+};
+
 class LrHandler : public AlgoV2Handler {
+  friend class psi_lr::PsiLrHandler;
+
  public:
   explicit LrHandler(std::shared_ptr<LrContext> ctx);
 
@@ -46,11 +80,22 @@ class LrHandler : public AlgoV2Handler {
 
   bool PrepareDataset() override;
 
+  void LoadDataset() override;
+
+  // Use a dataset produced in memory instead of reading --dataset
+  void SetDataset(std::unique_ptr<xt::xarray<float>> dataset);
+
+  // Train on secret-shared rows; rows that do not match contribute nothing
+  void SetSharedDataset(std::unique_ptr<SharedDataset> dataset);
+
   void RunAlgo() override;
 
   status::ErrorStatus NegotiateHandshakeParams(
       const std::vector<HandshakeRequestV2>&) override;
 
+  bool ResumeHandshake(const std::vector<HandshakeRequestV2>&,
+                       const HandshakeResponseV2&) override;
+
   status::ErrorStatus NegotiateLrAlgoParams(
       const std::vector<HandshakeRequestV2>& requests);
 
@@ -75,6 +120,15 @@ class LrHandler : public AlgoV2Handler {
       const std::vector<org::interconnection::v2::algos::LrHyperparamsProposal>&
           lr_params);
 
+  // Every peer has to train the models of a sweep side by side
+  bool NegotiateSweep(
+      const std::vector<org::interconnection::v2::algos::LrHyperparamsProposal>&
+          lr_params);
+
+  bool NegotiateCrossValidation(
+      const std::vector<org::interconnection::v2::algos::LrHyperparamsProposal>&
+          lr_params);
+
   bool NegotiateSigmoidParams(
       const std::vector<org::interconnection::v2::op::SigmoidParamsProposal>&
           params);
@@ -107,7 +161,19 @@ class LrHandler : public AlgoV2Handler {
       const std::vector<org::interconnection::v2::protocol::SSProtocolProposal>&
           ss_params);
 
-  std::unique_ptr<spu::SPUContext> MakeSpuContext();
+  bool IsSparseRank(int32_t rank) const;
+
+  // Densify the own sparse features unless they are kept sparse
+  void DensifyDataset();
+
+  void SetupSparseProducts();
+
+  // Deal the rows of the dataset into the folds of the cross validation, by
+  // a public permutation every party draws from the same seed
+  void ShuffleRows();
+
+  std::unique_ptr<spu::SPUContext> MakeSpuContext(
+      std::shared_ptr<yacl::link::Context> lctx);
 
   spu::Value EncodingDataset(spu::PtBufferView dataset);
 
@@ -115,11 +181,69 @@ class LrHandler : public AlgoV2Handler {
 
   std::pair<spu::Value, spu::Value> ProcessDataset(spu::SPUContext* sctx);
 
-  spu::Value Train(spu::SPUContext* ctx, const spu::Value& x,
-                   const spu::Value& y);
-
-  spu::Value TrainStep(spu::SPUContext* ctx, const spu::Value& x,
-                       const spu::Value& y, const spu::Value& w);
+  std::pair<spu::Value, spu::Value> ProcessSharedDataset(
+      spu::SPUContext* sctx);
+
+  spu::Value MakeShares(const std::vector<uint64_t>& shares,
+                        const spu::Shape& shape, spu::DataType dtype);
+
+  // A mini-batch, as views of the padded dataset made once and reused in
+  // every epoch
+  struct Batch {
+    int64_t rows_beg = 0;
+    int64_t rows_end = 0;
+    spu::Value padded_x;
+    // the transpose of padded_x, for the gradient
+    spu::Value padded_x_t;
+    spu::Value y;
+    std::optional<spu::Value> mask;
+  };
+
+  std::vector<Batch> MakeBatches(spu::SPUContext* ctx,
+                                 const spu::Value& padded_x,
+                                 const spu::Value& y, const RowRanges& ranges);
+
+  // Train on the rows in `ranges`
+  spu::Value Train(spu::SPUContext* ctx, const spu::Value& padded_x,
+                   const spu::Value& y, const RowRanges& ranges);
+
+  // x, which holds the rows [rows_beg, rows_end) of the dense blocks, padded
+  // with the column of the intercept
+  spu::Value PadDataset(spu::SPUContext* ctx, const spu::Value& x);
+
+  // The scores of the rows, padded_x holding them as above
+  spu::Value Score(spu::SPUContext* ctx, const spu::Value& padded_x,
+                   const spu::Value& w, int64_t rows_beg, int64_t rows_end);
+
+  // The gradient of the weights for the errors of the rows, padded_x_t being
+  // the transpose of padded_x
+  spu::Value Gradient(spu::SPUContext* ctx, const spu::Value& padded_x_t,
+                      const spu::Value& err, int64_t rows_beg,
+                      int64_t rows_end);
+
+  // The sparse block of `rank`, or its transpose, times v
+  spu::Value SparseMultiply(spu::SPUContext* ctx, int32_t rank,
+                            int64_t rows_beg, int64_t rows_end,
+                            const spu::Value& v, bool transposed);
+
+  spu::Value TrainStep(spu::SPUContext* ctx, const Batch& batch,
+                       const spu::Value& w);
+
+  // Train on all folds but one and evaluate on it, folds being contiguous
+  // once the rows are shuffled. Several folds run at the same time, each over
+  // a link and SPU context of its own.
+  void CrossValidate(spu::SPUContext* sctx, const spu::Value& padded_x,
+                     const spu::Value& y);
+
+  // The accuracy of each model on the fold
+  std::vector<float> EvaluateFold(spu::SPUContext* ctx,
+                                  const spu::Value& padded_x,
+                                  const spu::Value& y, int64_t fold);
+
+  // Print a metric per model, naming the models of a sweep by their
+  // hyperparameters
+  void PrintModelMetrics(std::string_view metric,
+                         const std::vector<std::string>& values) const;
 
   spu::Value CalculateStepWithSgd(spu::SPUContext* ctx, const spu::Value& grad);
 
@@ -127,6 +251,23 @@ class LrHandler : public AlgoV2Handler {
 
   std::unique_ptr<xt::xarray<float>> dataset_;
 
+  // whether the dataset file is in libsvm format, which is read into
+  // sparse_dataset_ and sparse_labels_
+  bool sparse_input_ = false;
+  std::unique_ptr<CsrMatrix> sparse_dataset_;
+  std::vector<float> sparse_labels_;
+
+  // by owner rank, for the blocks kept sparse
+  std::map<int32_t, std::unique_ptr<SparseProduct>> sparse_products_;
+
+  // rows and columns of the dataset file, counted before it is loaded
+  std::array<int64_t, 2> counted_shape_{};
+
+  std::unique_ptr<SharedDataset> shared_dataset_;
+
+  // secret 0/1 weight of each row, set when training on shared rows
+  std::optional<spu::Value> row_mask_;
+
   std::function<spu::Value(spu::SPUContext*, const spu::Value&)> optimizer_;
 };
 
@@ -27,7 +27,7 @@ namespace ic_impl::algo::optimizer {
 
 int32_t SuggestedOptimizerType() {
   std::string_view optimizer = FLAGS_optimizer;
-  if (char* env = util::GetParamEnv("optimizer")) {
+  if (const char* env = util::GetParamEnv("optimizer")) {
     optimizer = env;
   }
 
@@ -37,7 +37,7 @@ int32_t SuggestedOptimizerType() {
 }
 
 double SuggestedLearningRate() {
-  if (char* env = util::GetParamEnv("learning_rate")) {
+  if (const char* env = util::GetParamEnv("learning_rate")) {
     return std::stod(env);
   }
   return FLAGS_learning_rate;
@@ -0,0 +1,267 @@
+// Copyright 2024 Ant Group Co., Ltd.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "ic_impl/algo/lr/sparse_product.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+
+#include "absl/strings/str_cat.h"
+#include "yacl/base/exception.h"
+
+namespace ic_impl::algo::lr {
+
+using protocol_family::paillier::DeserializeCiphertexts;
+using protocol_family::paillier::PackPlaintexts;
+using protocol_family::paillier::PaillierParam;
+using protocol_family::paillier::PaillierPublicKey;
+using protocol_family::paillier::PaillierSecretKey;
+using protocol_family::paillier::RandomMasks;
+using protocol_family::paillier::SerializeCiphertexts;
+using protocol_family::paillier::SlotsPerPlaintext;
+using protocol_family::paillier::UnpackPlaintexts;
+using yacl::math::MPInt;
+
+namespace {
+
+constexpr char kPublicKeyTag[] = "sparse_product_public_key";
+constexpr char kLayoutTag[] = "sparse_product_layout";
+
+int32_t BitWidth(uint64_t value) {
+  int32_t bits = 0;
+  for (; value != 0; value >>= 1) {
+    ++bits;
+  }
+  return bits;
+}
+
+}  // namespace
+
+SparseProduct::SparseProduct(std::shared_ptr<yacl::link::Context> lctx,
+                             int32_t owner_rank, int64_t rows, int64_t cols,
+                             const CsrMatrix* block, int32_t fxp_bits)
+    : lctx_(std::move(lctx)),
+      owner_rank_(owner_rank),
+      other_rank_(1 - static_cast<int32_t>(lctx_->Rank())),
+      rows_(rows),
+      cols_(cols),
+      fxp_bits_(fxp_bits),
+      block_(block) {
+  YACL_ENFORCE(lctx_->WorldSize() == 2, "sparse products need two parties");
+  YACL_ENFORCE(owner_rank_ == 0 || owner_rank_ == 1);
+  YACL_ENFORCE(IsOwner() == (block_ != nullptr));
+  if (block_ != nullptr) {
+    YACL_ENFORCE(block_->rows == rows_ && block_->cols <= cols_);
+    scalars_.reserve(block_->NonZeros());
+    for (auto value : block_->values) {
+      scalars_.push_back(std::llround(std::ldexp(value, fxp_bits_)));
+    }
+  }
+}
+
+SparseProduct::~SparseProduct() = default;
+
+bool SparseProduct::IsOwner() const {
+  return static_cast<int32_t>(lctx_->Rank()) == owner_rank_;
+}
+
+void SparseProduct::Setup(const PaillierParam& param) {
+  std::string layout_tag = absl::StrCat(kLayoutTag, ":", owner_rank_);
+  std::string key_tag = absl::StrCat(kPublicKeyTag, ":", owner_rank_);
+  std::array<int32_t, 2> layout{};
+  if (!IsOwner()) {
+    secret_key_ = std::make_unique<PaillierSecretKey>(param.key_size);
+    if (param.pool_size > 0) {
+      // the shares of every product are encrypted under the own key
+      secret_key_->StartRandomnessPool(param.pool_size, param.pool_threads);
+    }
+    lctx_->SendAsync(other_rank_, secret_key_->PublicKey().Serialize(),
+                     key_tag);
+
+    auto buf = lctx_->Recv(other_rank_, layout_tag);
+    YACL_ENFORCE(static_cast<size_t>(buf.size()) == sizeof(layout));
+    std::memcpy(layout.data(), buf.data(), sizeof(layout));
+    slots_ = layout[0];
+    slot_bits_ = layout[1];
+    YACL_ENFORCE(slots_ > 0 &&
+                     slots_ * slot_bits_ < static_cast<int32_t>(
+                                               secret_key_->PublicKey()
+                                                   .N()
+                                                   .BitCount()),
+                 "invalid layout of sparse products");
+    return;
+  }
+
+  peer_key_ = std::make_unique<PaillierPublicKey>(
+      PaillierPublicKey::Deserialize(lctx_->Recv(other_rank_, key_tag)));
+
+  // each term of a product is a share below 2^64 times a scalar, and a
+  // product sums at most the non-zeros of a row or of a column
+  uint64_t max_scalar = 0;
+  for (auto scalar : scalars_) {
+    max_scalar = std::max(max_scalar, static_cast<uint64_t>(std::abs(scalar)));
+  }
+  int64_t max_terms = 1;
+  std::vector<int64_t> col_terms(cols_);
+  for (int64_t i = 0; i < rows_; ++i) {
+    max_terms = std::max(max_terms,
+                         block_->row_offsets[i + 1] - block_->row_offsets[i]);
+  }
+  for (auto col : block_->columns) {
+    max_terms = std::max(max_terms, ++col_terms[col]);
+  }
+  value_bits_ = 64 + BitWidth(max_scalar) + BitWidth(max_terms);
+  mask_bits_ = value_bits_ + 1 + param.stat_bits;
+  slot_bits_ = mask_bits_ + 1;
+  int32_t key_size = peer_key_->N().BitCount();
+  YACL_ENFORCE(slot_bits_ < key_size, "paillier key of {} bits too short",
+               key_size);
+  slots_ = param.packing ? SlotsPerPlaintext(key_size, slot_bits_) : 1;
+
+  layout = {slots_, slot_bits_};
+  lctx_->SendAsync(
+      other_rank_,
+      std::string(reinterpret_cast<const char*>(layout.data()),
+                  sizeof(layout)),
+      layout_tag);
+}
+
+std::vector<uint64_t> SparseProduct::Multiply(int64_t rows_beg,
+                                              int64_t rows_end,
+                                              const std::vector<uint64_t>& v) {
+  YACL_ENFORCE(0 <= rows_beg && rows_beg <= rows_end && rows_end <= rows_);
+  YACL_ENFORCE(static_cast<int64_t>(v.size()) == cols_);
+  SparseRows rows;
+  if (IsOwner()) {
+    rows.offsets.assign(block_->row_offsets.begin() + rows_beg,
+                        block_->row_offsets.begin() + rows_end + 1);
+    rows.columns = &block_->columns;
+    rows.scalars = &scalars_;
+  }
+
+  return Product(rows, v, rows_end - rows_beg);
+}
+
+std::vector<uint64_t> SparseProduct::MultiplyTransposed(
+    int64_t rows_beg, int64_t rows_end, const std::vector<uint64_t>& v) {
+  YACL_ENFORCE(0 <= rows_beg && rows_beg <= rows_end && rows_end <= rows_);
+  YACL_ENFORCE(static_cast<int64_t>(v.size()) == rows_end - rows_beg);
+  SparseRows rows;
+  std::vector<int32_t> columns;
+  std::vector<int64_t> scalars;
+  if (IsOwner()) {
+    // the columns of the rows as rows, by counting sort
+    auto first = block_->row_offsets[rows_beg];
+    auto last = block_->row_offsets[rows_end];
+    rows.offsets.assign(cols_ + 1, 0);
+    for (auto k = first; k < last; ++k) {
+      ++rows.offsets[block_->columns[k] + 1];
+    }
+    for (int64_t j = 0; j < cols_; ++j) {
+      rows.offsets[j + 1] += rows.offsets[j];
+    }
+    std::vector<int64_t> next(rows.offsets.begin(), rows.offsets.end() - 1);
+    columns.resize(last - first);
+    scalars.resize(last - first);
+    for (auto i = rows_beg; i < rows_end; ++i) {
+      for (auto k = block_->row_offsets[i]; k < block_->row_offsets[i + 1];
+           ++k) {
+        auto pos = next[block_->columns[k]]++;
+        columns[pos] = static_cast<int32_t>(i - rows_beg);
+        scalars[pos] = scalars_[k];
+      }
+    }
+    rows.columns = &columns;
+    rows.scalars = &scalars;
+  }
+
+  return Product(rows, v, cols_);
+}
+
+std::vector<uint64_t> SparseProduct::Product(const SparseRows& rows,
+                                             const std::vector<uint64_t>& v,
+                                             size_t result_size) {
+  auto tag = absl::StrCat("sparse_product:", owner_rank_, ":", counter_++);
+  std::vector<MPInt> plaintexts;
+  if (!IsOwner()) {
+    plaintexts.reserve(v.size());
+    for (auto share : v) {
+      plaintexts.emplace_back(share);
+    }
+    lctx_->SendAsync(
+        other_rank_,
+        SerializeCiphertexts(secret_key_->PublicKey().Encrypt(plaintexts)),
+        absl::StrCat(tag, ":share"));
+
+    auto masked = DeserializeCiphertexts(
+        lctx_->Recv(other_rank_, absl::StrCat(tag, ":masked")));
+    return Truncate(UnpackPlaintexts(secret_key_->Decrypt(masked), slots_,
+                                     slot_bits_, result_size));
+  }
+
+  auto peer_shares = DeserializeCiphertexts(
+      lctx_->Recv(other_rank_, absl::StrCat(tag, ":share")));
+  YACL_ENFORCE(peer_shares.size() == v.size());
+  auto products = peer_key_->SparseDot(peer_shares, rows.offsets,
+                                       *rows.columns, *rows.scalars);
+  YACL_ENFORCE(products.size() == result_size);
+
+  // the offset makes the products non-negative, so the slots of a packed
+  // plaintext never carry into each other, and vanishes modulo 2^64
+  if (slots_ > 1) {
+    products = peer_key_->Pack(products, slots_, slot_bits_);
+  }
+  std::vector<uint64_t> low_masks;
+  auto masks = RandomMasks(result_size, mask_bits_, &low_masks);
+  auto offset = MPInt::_1_ << value_bits_;
+  for (auto& mask : masks) {
+    mask = mask + offset;
+  }
+  auto masked = peer_key_->Add(
+      products,
+      peer_key_->Encrypt(PackPlaintexts(masks, slots_, slot_bits_)));
+  lctx_->SendAsync(other_rank_, SerializeCiphertexts(masked),
+                   absl::StrCat(tag, ":masked"));
+
+  // the own share times the block, minus the masks
+  std::vector<uint64_t> shares(result_size);
+  for (size_t i = 0; i < result_size; ++i) {
+    uint64_t sum = 0;
+    for (auto k = rows.offsets[i]; k < rows.offsets[i + 1]; ++k) {
+      sum += static_cast<uint64_t>((*rows.scalars)[k]) *
+             v[(*rows.columns)[k]];
+    }
+    shares[i] = sum - low_masks[i];
+  }
+
+  return Truncate(std::move(shares));
+}
+
+std::vector<uint64_t> SparseProduct::Truncate(
+    std::vector<uint64_t> shares) const {
+  // rank 0 shifts its share, rank 1 the negation of its share
+  for (auto& share : shares) {
+    if (lctx_->Rank() == 0) {
+      share = static_cast<uint64_t>(static_cast<int64_t>(share) >> fxp_bits_);
+    } else {
+      share = -static_cast<uint64_t>(
+          static_cast<int64_t>(-share) >> fxp_bits_);
+    }
+  }
+  return shares;
+}
+
+}  // namespace ic_impl::algo::lr
@@ -0,0 +1,102 @@
+// Copyright 2024 Ant Group Co., Ltd.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include "yacl/link/context.h"
+
+#include "ic_impl/algo/lr/lr_context.h"
+#include "ic_impl/protocol_family/paillier/paillier.h"
+#include "ic_impl/protocol_family/paillier/paillier_cipher.h"
+
+namespace ic_impl::algo::lr {
+
+// Shares in Z_2^64 of the products of a sparse block of features, held in
+// plaintext by one of two parties, with vectors shared between them. The
+// owner multiplies the block with its own share locally and with the share
+// of the peer under the Paillier key of the peer, so that the cost grows
+// with the non-zeros of the block and the length of the vectors rather than
+// with the dense size of the block. Products keep fxp_bits fraction bits,
+// truncated locally as with TRUNC_MODE_PROBABILISTIC.
+class SparseProduct {
+ public:
+  // `block` is the own block on the owner, null on the peer
+  SparseProduct(std::shared_ptr<yacl::link::Context> lctx, int32_t owner_rank,
+                int64_t rows, int64_t cols, const CsrMatrix* block,
+                int32_t fxp_bits);
+
+  ~SparseProduct();
+
+  // Exchange the key of the peer and the plaintext layout, before any product
+  void Setup(const protocol_family::paillier::PaillierParam& param);
+
+  // Shares of the rows [rows_beg, rows_end) of the block times v, given
+  // shares of v, one per column
+  std::vector<uint64_t> Multiply(int64_t rows_beg, int64_t rows_end,
+                                 const std::vector<uint64_t>& v);
+
+  // Shares of the transpose of those rows times v, given shares of v, one
+  // per row
+  std::vector<uint64_t> MultiplyTransposed(int64_t rows_beg, int64_t rows_end,
+                                           const std::vector<uint64_t>& v);
+
+ private:
+  // Rows of fixed-point scalars, row i at [offsets[i], offsets[i + 1])
+  struct SparseRows {
+    std::vector<int64_t> offsets;
+    const std::vector<int32_t>* columns;
+    const std::vector<int64_t>* scalars;
+  };
+
+  bool IsOwner() const;
+
+  // Shares of the product of `rows`, on the owner only, with v
+  std::vector<uint64_t> Product(const SparseRows& rows,
+                                const std::vector<uint64_t>& v,
+                                size_t result_size);
+
+  // Drop the extra fraction bits of the product of two fixed-point values
+  std::vector<uint64_t> Truncate(std::vector<uint64_t> shares) const;
+
+  std::shared_ptr<yacl::link::Context> lctx_;
+  int32_t owner_rank_;
+  // the rank of the other party
+  int32_t other_rank_;
+  int64_t rows_;
+  int64_t cols_;
+  int32_t fxp_bits_;
+
+  // the block on the owner, encoded to fixed point
+  const CsrMatrix* block_;
+  std::vector<int64_t> scalars_;
+
+  // the key of the peer, on the owner
+  std::unique_ptr<protocol_family::paillier::PaillierPublicKey> peer_key_;
+  std::unique_ptr<protocol_family::paillier::PaillierSecretKey> secret_key_;
+
+  // a product plus the offset making it non-negative fits in value_bits + 1
+  // bits, hidden by masks of mask_bits bits
+  int32_t value_bits_{};
+  int32_t mask_bits_{};
+  int32_t slots_ = 1;
+  int32_t slot_bits_{};
+
+  // products run so far, which tag their messages
+  int64_t counter_{};
+};
+
+}  // namespace ic_impl::algo::lr
@@ -0,0 +1,257 @@
+// Copyright 2024 Ant Group Co., Ltd.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "ic_impl/algo/psi/v2/compact_result.h"
+
+#include <algorithm>
+#include <cstring>
+#include <unordered_set>
+
+#include "yacl/base/exception.h"
+#include "yacl/base/int128.h"
+#include "yacl/crypto/hash/hash_utils.h"
+
+namespace ic_impl::algo::psi::v2 {
+
+namespace {
+
+// statistical security parameter of a false match on the peer side
+constexpr int32_t kStatisticalSecurityBits = 40;
+
+constexpr int32_t kMaxHashBits = 128;
+
+int32_t CeilLog2(uint64_t value) {
+  int32_t bits = 0;
+  while (bits < 64 && (uint64_t{1} << bits) < value) {
+    ++bits;
+  }
+  return bits;
+}
+
+int32_t ChooseHashBits(size_t item_count, int64_t peer_item_num) {
+  int32_t bits = CeilLog2(std::max<uint64_t>(item_count, 1)) +
+                 CeilLog2(std::max<int64_t>(peer_item_num, 1)) +
+                 kStatisticalSecurityBits;
+  return std::min(bits, kMaxHashBits);
+}
+
+uint128_t TruncatedHash(std::string_view key, int32_t hash_bits) {
+  auto digest = yacl::crypto::Sha256(key);
+  uint128_t value = 0;
+  for (size_t i = 0; i < sizeof(uint128_t); ++i) {
+    value = (value << 8) | digest[i];
+  }
+  return hash_bits == kMaxHashBits ? value
+                                   : value >> (kMaxHashBits - hash_bits);
+}
+
+template <typename T>
+void PutVarint(std::string *out, T value) {
+  while (value >= 0x80) {
+    out->push_back(static_cast<char>((value & 0x7f) | 0x80));
+    value >>= 7;
+  }
+  out->push_back(static_cast<char>(value));
+}
+
+size_t VarintSize(uint64_t value) {
+  size_t size = 1;
+  while (value >= 0x80) {
+    value >>= 7;
+    ++size;
+  }
+  return size;
+}
+
+class Reader {
+ public:
+  explicit Reader(yacl::ByteContainerView buf) : buf_(buf) {}
+
+  uint8_t GetByte() {
+    YACL_ENFORCE(pos_ < buf_.size(), "compact result: unexpected end of data");
+    return buf_[pos_++];
+  }
+
+  template <typename T>
+  T GetVarint() {
+    T value = 0;
+    for (size_t shift = 0; shift < sizeof(T) * 8; shift += 7) {
+      uint8_t byte = GetByte();
+      value |= static_cast<T>(byte & 0x7f) << shift;
+      if ((byte & 0x80) == 0) {
+        return value;
+      }
+    }
+    YACL_THROW("compact result: varint overflow");
+  }
+
+  std::string_view GetBytes(size_t size) {
+    YACL_ENFORCE(size <= buf_.size() - pos_,
+                 "compact result: unexpected end of data");
+    std::string_view bytes(reinterpret_cast<const char *>(buf_.data()) + pos_,
+                           size);
+    pos_ += size;
+    return bytes;
+  }
+
+  bool Done() const { return pos_ == buf_.size(); }
+
+ private:
+  yacl::ByteContainerView buf_;
+  size_t pos_ = 0;
+};
+
+std::string EncodePlainKeys(const std::vector<std::string> &keys) {
+  std::string out;
+  for (const auto &key : keys) {
+    PutVarint<uint64_t>(&out, key.size());
+    out.append(key);
+  }
+  return out;
+}
+
+std::string EncodeDeltaHashes(const std::vector<std::string> &keys,
+                              int32_t hash_bits) {
+  std::vector<uint128_t> hashes;
+  hashes.reserve(keys.size());
+  for (const auto &key : keys) {
+    hashes.push_back(TruncatedHash(key, hash_bits));
+  }
+  std::sort(hashes.begin(), hashes.end());
+
+  std::string out;
+  out.push_back(static_cast<char>(hash_bits));
+  uint128_t last = 0;
+  for (const auto &hash : hashes) {
+    PutVarint<uint128_t>(&out, hash - last);
+    last = hash;
+  }
+  return out;
+}
+
+std::vector<uint64_t> MatchPlainKeys(
+    Reader *reader, size_t count, const std::vector<std::string> &self_keys) {
+  std::unordered_set<std::string_view> keys;
+  keys.reserve(count);
+  for (size_t i = 0; i < count; ++i) {
+    keys.insert(reader->GetBytes(reader->GetVarint<uint64_t>()));
+  }
+
+  std::vector<uint64_t> indices;
+  for (size_t i = 0; i < self_keys.size(); ++i) {
+    if (keys.count(self_keys[i]) != 0) {
+      indices.push_back(i);
+    }
+  }
+  return indices;
+}
+
+std::vector<uint64_t> MatchDeltaHashes(
+    Reader *reader, size_t count, const std::vector<std::string> &self_keys) {
+  int32_t hash_bits = reader->GetByte();
+  YACL_ENFORCE(hash_bits > 0 && hash_bits <= kMaxHashBits,
+               "compact result: invalid hash bits {}", hash_bits);
+
+  std::vector<uint128_t> hashes(count);
+  uint128_t last = 0;
+  for (auto &hash : hashes) {
+    hash = last + reader->GetVarint<uint128_t>();
+    last = hash;
+  }
+
+  std::vector<uint64_t> indices;
+  for (size_t i = 0; i < self_keys.size(); ++i) {
+    if (std::binary_search(hashes.begin(), hashes.end(),
+                           TruncatedHash(self_keys[i], hash_bits))) {
+      indices.push_back(i);
+    }
+  }
+  return indices;
+}
+
+}  // namespace
+
+yacl::Buffer EncodeCompactResult(const std::vector<std::string> &keys,
+                                 int64_t peer_item_num,
+                                 CompactResultStats *stats) {
+  std::string plain = EncodePlainKeys(keys);
+  std::string hashes =
+      EncodeDeltaHashes(keys, ChooseHashBits(keys.size(), peer_item_num));
+
+  CompactResultEncoding encoding = hashes.size() < plain.size()
+                                       ? CompactResultEncoding::kDeltaHashes
+                                       : CompactResultEncoding::kPlainKeys;
+  const std::string &payload =
+      encoding == CompactResultEncoding::kDeltaHashes ? hashes : plain;
+
+  std::string header;
+  header.push_back(static_cast<char>(encoding));
+  PutVarint<uint64_t>(&header, keys.size());
+
+  yacl::Buffer buf(header.size() + payload.size());
+  std::memcpy(buf.data<char>(), header.data(), header.size());
+  std::memcpy(buf.data<char>() + header.size(), payload.data(), payload.size());
+
+  if (stats != nullptr) {
+    stats->encoding = encoding;
+    stats->item_count = keys.size();
+    stats->plain_bytes = VarintSize(keys.size()) + plain.size() + 1;
+    stats->encoded_bytes = buf.size();
+  }
+
+  return buf;
+}
+
+std::vector<uint64_t> DecodeCompactResult(
+    yacl::ByteContainerView buf, const std::vector<std::string> &self_keys,
+    CompactResultStats *stats) {
+  Reader reader(buf);
+  auto encoding = static_cast<CompactResultEncoding>(reader.GetByte());
+  auto count = reader.GetVarint<uint64_t>();
+
+  std::vector<uint64_t> indices;
+  switch (encoding) {
+    case CompactResultEncoding::kPlainKeys:
+      indices = MatchPlainKeys(&reader, count, self_keys);
+      break;
+    case CompactResultEncoding::kDeltaHashes:
+      indices = MatchDeltaHashes(&reader, count, self_keys);
+      break;
+    default:
+      YACL_THROW("compact result: unknown encoding {}",
+                 static_cast<int32_t>(encoding));
+  }
+  YACL_ENFORCE(reader.Done(), "compact result: trailing data");
+
+  if (stats != nullptr) {
+    stats->encoding = encoding;
+    stats->item_count = count;
+    stats->encoded_bytes = buf.size();
+  }
+
+  return indices;
+}
+
+std::string_view CompactResultEncodingName(CompactResultEncoding encoding) {
+  switch (encoding) {
+    case CompactResultEncoding::kPlainKeys:
+      return "plain_keys";
+    case CompactResultEncoding::kDeltaHashes:
+      return "delta_hashes";
+    default:
+      return "unknown";
+  }
+}
+
+}  // namespace ic_impl::algo::psi::v2
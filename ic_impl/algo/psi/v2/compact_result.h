@@ -0,0 +1,58 @@
+// Copyright 2024 Ant Group Co., Ltd.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "yacl/base/buffer.h"
+#include "yacl/base/byte_container_view.h"
+
+namespace ic_impl::algo::psi::v2 {
+
+// Encodings of the intersection result sent by the receiver to the other
+// parties when result_to_rank is -1
+enum class CompactResultEncoding : uint8_t {
+  // length-prefixed intersection keys
+  kPlainKeys = 1,
+  // sorted truncated hashes of the intersection keys, delta-varint encoded
+  kDeltaHashes = 2,
+};
+
+struct CompactResultStats {
+  CompactResultEncoding encoding = CompactResultEncoding::kPlainKeys;
+  size_t item_count = 0;
+  // bytes of the intersection keys sent as they are
+  size_t plain_bytes = 0;
+  // bytes actually sent
+  size_t encoded_bytes = 0;
+};
+
+// Encode the intersection keys with the smaller encoding. `peer_item_num` is
+// the largest input size among the peers, used to choose a hash width that
+// keeps false matches on the peer side negligible.
+yacl::Buffer EncodeCompactResult(const std::vector<std::string> &keys,
+                                 int64_t peer_item_num,
+                                 CompactResultStats *stats);
+
+// Decode the intersection result and return the indices of `self_keys` which
+// are in the intersection, in ascending order
+std::vector<uint64_t> DecodeCompactResult(
+    yacl::ByteContainerView buf, const std::vector<std::string> &self_keys,
+    CompactResultStats *stats);
+
+std::string_view CompactResultEncodingName(CompactResultEncoding encoding);
+
+}  // namespace ic_impl::algo::psi::v2
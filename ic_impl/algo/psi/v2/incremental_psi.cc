@@ -0,0 +1,408 @@
+// Copyright 2024 Ant Group Co., Ltd.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include "ic_impl/algo/psi/v2/incremental_psi.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <type_traits>
+
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_join.h"
+#include "spdlog/spdlog.h"
+#include "yacl/base/exception.h"
+#include "yacl/crypto/hash/hash_utils.h"
+#include "yacl/crypto/rand/rand.h"
+
+#include "ic_impl/protocol_family/ecc/ec_cipher.h"
+
+namespace ic_impl::algo::psi::v2 {
+
+namespace {
+
+constexpr size_t kBatchSize = 4096;
+
+constexpr size_t kValueSize = 16;
+
+constexpr size_t kStateIdSize = 16;
+
+constexpr size_t kMaxKeySize = 64;
+
+constexpr char kValueDomain[] = "ic_impl.incremental_psi.value";
+
+constexpr char kStateMagic[8] = {'I', 'C', 'P', 'S', 'I', 'S', 'T', '1'};
+
+constexpr uint32_t kStateVersion = 2;
+
+// Layout of the state file, followed by own_count own values in row order
+// and peer_count peer values in ascending order, kValueSize bytes each
+struct StateHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t value_size;
+  int32_t curve_type;
+  uint32_t key_size;
+  char state_id[kStateIdSize];
+  // chained Sha256 of the first own_count length prefixed input keys
+  char fingerprint[32];
+  char key[kMaxKeySize];
+  int64_t own_count;
+  int64_t peer_count;
+};
+
+static_assert(std::is_trivially_copyable_v<StateHeader>);
+static_assert(sizeof(StateHeader) == 152);
+
+class MappedState {
+ public:
+  // Return nullptr if `path` does not exist
+  static std::unique_ptr<MappedState> Open(const std::string &path) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0 && errno == ENOENT) {
+      return nullptr;
+    }
+    YACL_ENFORCE(fd >= 0, "open state file={} failed, errno={}", path, errno);
+
+    struct stat st;
+    YACL_ENFORCE(::fstat(fd, &st) == 0, "stat state file={} failed", path);
+    size_t size = st.st_size;
+    YACL_ENFORCE(size >= sizeof(StateHeader), "state file={} is truncated",
+                 path);
+    void *data = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    YACL_ENFORCE(data != MAP_FAILED, "mmap state file={} failed", path);
+
+    auto state = std::unique_ptr<MappedState>(
+        new MappedState(static_cast<const char *>(data), size));
+    const auto &header = state->header();
+    YACL_ENFORCE(std::memcmp(header.magic, kStateMagic, sizeof(kStateMagic)) ==
+                         0 &&
+                     header.value_size == kValueSize &&
+                     header.key_size <= kMaxKeySize,
+                 "state file={} is not a psi state", path);
+    YACL_ENFORCE(header.own_count >= 0 && header.peer_count >= 0 &&
+                     size == sizeof(StateHeader) +
+                                 (header.own_count + header.peer_count) *
+                                     kValueSize,
+                 "state file={} is truncated", path);
+    return state;
+  }
+
+  ~MappedState() { ::munmap(const_cast<char *>(data_), size_); }
+
+  const StateHeader &header() const {
+    return *reinterpret_cast<const StateHeader *>(data_);
+  }
+
+  std::string_view OwnValues() const {
+    return {data_ + sizeof(StateHeader), header().own_count * kValueSize};
+  }
+
+  std::string_view PeerValues() const {
+    return {data_ + sizeof(StateHeader) + header().own_count * kValueSize,
+            header().peer_count * kValueSize};
+  }
+
+  std::string_view Key() const { return {header().key, header().key_size}; }
+
+ private:
+  MappedState(const char *data, size_t size) : data_(data), size_(size) {}
+
+  const char *data_;
+  size_t size_;
+};
+
+std::string Fingerprint(std::string fingerprint,
+                        const std::vector<std::string> &keys, size_t begin,
+                        size_t end) {
+  for (size_t i = begin; i < end; ++i) {
+    // the length keeps key boundaries apart, e.g. "ab","c" from "a","bc"
+    uint64_t size = keys[i].size();
+    auto digest = yacl::crypto::Sha256(absl::StrCat(
+        fingerprint,
+        std::string_view(reinterpret_cast<const char *>(&size), sizeof(size)),
+        keys[i]));
+    fingerprint.assign(digest.begin(), digest.end());
+  }
+  return fingerprint;
+}
+
+std::string EmptyFingerprint() { return std::string(32, '\0'); }
+
+std::string DeriveValue(const std::string &point) {
+  auto digest = yacl::crypto::Sha256(absl::StrCat(kValueDomain, point));
+  return std::string(digest.begin(), digest.begin() + kValueSize);
+}
+
+bool ContainsValue(std::string_view sorted, std::string_view value) {
+  size_t lo = 0;
+  size_t hi = sorted.size() / kValueSize;
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    int cmp = sorted.compare(mid * kValueSize, kValueSize, value);
+    if (cmp == 0) {
+      return true;
+    }
+    if (cmp < 0) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  return false;
+}
+
+size_t NumBatches(size_t item_num) {
+  return (item_num + kBatchSize - 1) / kBatchSize;
+}
+
+std::string BatchTag(std::string_view name, size_t batch) {
+  return absl::StrCat("incremental_psi_", name, "_", batch);
+}
+
+std::vector<std::string> Unpack(const yacl::Buffer &buf, size_t size) {
+  YACL_ENFORCE(buf.size() % size == 0,
+               "incremental psi: invalid batch size {}", buf.size());
+  std::vector<std::string> items(buf.size() / size);
+  for (size_t i = 0; i < items.size(); ++i) {
+    items[i].assign(buf.data<char>() + i * size, size);
+  }
+  return items;
+}
+
+// Write the state to a temporary file and move it over `path`
+void WriteState(const std::string &path, const StateHeader &header,
+                const MappedState *old_state,
+                const std::vector<std::string> &own_values,
+                const std::vector<std::string> &peer_values) {
+  std::string tmp_path = absl::StrCat(path, ".tmp");
+  {
+    std::ofstream out(tmp_path, std::ios::binary | std::ios::trunc);
+    YACL_ENFORCE(out, "open file={} failed", tmp_path);
+    // the state holds the cipher key
+    std::filesystem::permissions(tmp_path,
+                                 std::filesystem::perms::owner_read |
+                                     std::filesystem::perms::owner_write);
+
+    out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+
+    std::string_view old_peers;
+    if (old_state != nullptr) {
+      auto old_own = old_state->OwnValues();
+      out.write(old_own.data(), old_own.size());
+      old_peers = old_state->PeerValues();
+    }
+    for (const auto &value : own_values) {
+      out.write(value.data(), kValueSize);
+    }
+
+    // merge the sorted peer values
+    size_t i = 0;
+    auto it = peer_values.begin();
+    while (i < old_peers.size() || it != peer_values.end()) {
+      if (it == peer_values.end() ||
+          (i < old_peers.size() &&
+           old_peers.compare(i, kValueSize, *it) <= 0)) {
+        out.write(old_peers.data() + i, kValueSize);
+        i += kValueSize;
+      } else {
+        out.write(it->data(), kValueSize);
+        ++it;
+      }
+    }
+
+    YACL_ENFORCE(out.flush(), "write file={} failed", tmp_path);
+  }
+  // the rename must not reach the disk before the data it points to
+  int fd = ::open(tmp_path.c_str(), O_RDONLY);
+  YACL_ENFORCE(fd >= 0, "open file={} failed, errno={}", tmp_path, errno);
+  int ret = ::fsync(fd);
+  int fsync_errno = errno;
+  ::close(fd);
+  YACL_ENFORCE(ret == 0, "fsync file={} failed, errno={}", tmp_path,
+               fsync_errno);
+  std::filesystem::rename(tmp_path, path);
+}
+
+}  // namespace
+
+void LoadIncrementalPsiState(EcdhPsiContext *ctx) {
+  ctx->state_id.clear();
+  ctx->state_own_count = 0;
+  ctx->state_peer_count = 0;
+
+  auto state = MappedState::Open(ctx->state_path);
+  if (state == nullptr) {
+    return;
+  }
+
+  const auto &header = state->header();
+  auto keys = ReadInputKeys(*ctx);
+  // older versions fingerprint the keys differently
+  if (header.version != kStateVersion ||
+      header.curve_type != ctx->curve_type ||
+      header.own_count > static_cast<int64_t>(keys.size()) ||
+      Fingerprint(EmptyFingerprint(), keys, 0, header.own_count) !=
+          std::string_view(header.fingerprint, sizeof(header.fingerprint))) {
+    SPDLOG_WARN("psi state file={} does not match the input, starting over",
+                ctx->state_path);
+    return;
+  }
+
+  ctx->state_id.assign(header.state_id, kStateIdSize);
+  ctx->state_own_count = header.own_count;
+  ctx->state_peer_count = header.peer_count;
+}
+
+std::string NewIncrementalPsiStateId() {
+  auto id = yacl::crypto::SecureRandSeed();
+  return std::string(reinterpret_cast<const char *>(&id), kStateIdSize);
+}
+
+IncrementalPsi::IncrementalPsi(std::shared_ptr<EcdhPsiContext> ctx)
+    : ctx_(std::move(ctx)) {
+  YACL_ENFORCE(ctx_->ic_ctx->lctx->WorldSize() == 2,
+               "incremental psi only supports two parties");
+  YACL_ENFORCE(ctx_->state_id.size() == kStateIdSize);
+}
+
+size_t IncrementalPsi::PeerRank() const {
+  return 1 - ctx_->ic_ctx->lctx->Rank();
+}
+
+std::vector<uint64_t> IncrementalPsi::Run() {
+  auto lctx = ctx_->ic_ctx->lctx;
+
+  // a state is continued only if the handshake resumed it
+  std::unique_ptr<MappedState> old_state;
+  if (ctx_->state_own_count > 0 || ctx_->state_peer_count > 0) {
+    old_state = MappedState::Open(ctx_->state_path);
+    YACL_ENFORCE(old_state != nullptr &&
+                     old_state->header().own_count == ctx_->state_own_count &&
+                     old_state->header().peer_count == ctx_->state_peer_count,
+                 "psi state file={} changed during the handshake",
+                 ctx_->state_path);
+  }
+  auto cipher =
+      old_state != nullptr
+          ? protocol_family::ecc::EcCipher(ctx_->curve_type, old_state->Key())
+          : protocol_family::ecc::EcCipher(ctx_->curve_type);
+  auto key = cipher.SerializeKey();
+  YACL_ENFORCE(key.size() <= kMaxKeySize);
+
+  auto keys = ReadInputKeys(*ctx_);
+  YACL_ENFORCE(keys.size() == static_cast<size_t>(ctx_->item_num));
+  size_t own_begin = ctx_->state_own_count;
+  size_t own_new = keys.size() - own_begin;
+  YACL_ENFORCE(ctx_->peer_item_num >= ctx_->state_peer_count);
+  size_t peer_new = ctx_->peer_item_num - ctx_->state_peer_count;
+
+  // mask the new rows of both sides under both keys
+  for (size_t batch = 0; batch < NumBatches(own_new); ++batch) {
+    size_t begin = own_begin + batch * kBatchSize;
+    size_t end = std::min(begin + kBatchSize, keys.size());
+    std::vector<std::string> items(keys.begin() + begin, keys.begin() + end);
+    lctx->SendAsync(PeerRank(), absl::StrJoin(cipher.HashAndMask(items), ""),
+                    BatchTag("blinded", batch));
+  }
+  for (size_t batch = 0; batch < NumBatches(peer_new); ++batch) {
+    auto buf = lctx->Recv(PeerRank(), BatchTag("blinded", batch));
+    auto masked = cipher.Mask(Unpack(buf, cipher.PointSize()));
+    lctx->SendAsync(PeerRank(), absl::StrJoin(masked, ""),
+                    BatchTag("masked", batch));
+  }
+  std::vector<std::string> own_values;
+  own_values.reserve(own_new);
+  for (size_t batch = 0; batch < NumBatches(own_new); ++batch) {
+    auto buf = lctx->Recv(PeerRank(), BatchTag("masked", batch));
+    for (const auto &point : Unpack(buf, cipher.PointSize())) {
+      own_values.push_back(DeriveValue(point));
+    }
+  }
+  YACL_ENFORCE(own_values.size() == own_new);
+
+  // exchange the values of the new rows in a random order
+  std::vector<std::string> shuffled = own_values;
+  std::shuffle(shuffled.begin(), shuffled.end(),
+               std::mt19937_64(std::random_device()()));
+  for (size_t batch = 0; batch < NumBatches(own_new); ++batch) {
+    size_t begin = batch * kBatchSize;
+    size_t end = std::min(begin + kBatchSize, shuffled.size());
+    std::vector<std::string> values(shuffled.begin() + begin,
+                                    shuffled.begin() + end);
+    lctx->SendAsync(PeerRank(), absl::StrJoin(values, ""),
+                    BatchTag("values", batch));
+  }
+  std::vector<std::string> peer_values;
+  peer_values.reserve(peer_new);
+  for (size_t batch = 0; batch < NumBatches(peer_new); ++batch) {
+    auto buf = lctx->Recv(PeerRank(), BatchTag("values", batch));
+    for (auto &value : Unpack(buf, kValueSize)) {
+      peer_values.push_back(std::move(value));
+    }
+  }
+  YACL_ENFORCE(peer_values.size() == peer_new);
+  std::sort(peer_values.begin(), peer_values.end());
+
+  // persist the updated state and compute the intersection from it
+  StateHeader header = {};
+  std::memcpy(header.magic, kStateMagic, sizeof(kStateMagic));
+  header.version = kStateVersion;
+  header.value_size = kValueSize;
+  header.curve_type = ctx_->curve_type;
+  header.key_size = key.size();
+  std::memcpy(header.state_id, ctx_->state_id.data(), kStateIdSize);
+  auto fingerprint =
+      old_state != nullptr
+          ? std::string(old_state->header().fingerprint,
+                        sizeof(header.fingerprint))
+          : EmptyFingerprint();
+  fingerprint = Fingerprint(std::move(fingerprint), keys, own_begin,
+                            keys.size());
+  std::memcpy(header.fingerprint, fingerprint.data(), fingerprint.size());
+  std::memcpy(header.key, key.data(), key.size());
+  header.own_count = keys.size();
+  header.peer_count = ctx_->peer_item_num;
+  WriteState(ctx_->state_path, header, old_state.get(), own_values,
+             peer_values);
+  old_state.reset();
+
+  auto state = MappedState::Open(ctx_->state_path);
+  YACL_ENFORCE(state != nullptr);
+  auto own = state->OwnValues();
+  auto peers = state->PeerValues();
+  std::vector<uint64_t> indices;
+  for (size_t i = 0; i < keys.size(); ++i) {
+    if (ContainsValue(peers, own.substr(i * kValueSize, kValueSize))) {
+      indices.push_back(i);
+    }
+  }
+
+  SPDLOG_INFO(
+      "rank:{} incremental psi new_items:{} peer_new_items:{} "
+      "intersection_count:{}",
+      lctx->Rank(), own_new, peer_new, indices.size());
+
+  return indices;
+}
+
+}  // namespace ic_impl::algo::psi::v2
@@ -0,0 +1,53 @@
+// Copyright 2024 Ant Group Co., Ltd.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "ic_impl/algo/psi/v2/psi_context_v2.h"
+
+namespace ic_impl::algo::psi::v2 {
+
+// Incremental ECDH-PSI between two parties whose input files only grow by
+// appended rows.
+//
+// Each party keeps its cipher key and, for every item processed so far, a
+// digest of k_0 * k_1 * H(x): in row order for its own items and sorted for
+// the items of the peer. A run only masks the rows appended since the
+// previous one, so its cost is proportional to the new rows on both sides.
+// The state is a file of fixed-size records which is memory-mapped when
+// read.
+class IncrementalPsi {
+ public:
+  explicit IncrementalPsi(std::shared_ptr<EcdhPsiContext> ctx);
+
+  // Return the indices of the own input rows in the updated intersection,
+  // ascending, and replace the state file
+  std::vector<uint64_t> Run();
+
+ private:
+  size_t PeerRank() const;
+
+  std::shared_ptr<EcdhPsiContext> ctx_;
+};
+
+// Fill the state summary of `ctx` from its state file. A state that does not
+// match the head of the input is dropped.
+void LoadIncrementalPsiState(EcdhPsiContext *ctx);
+
+std::string NewIncrementalPsiStateId();
+
+}  // namespace ic_impl::algo::psi::v2
@@ -0,0 +1,295 @@
+// Copyright 2024 Ant Group Co., Ltd.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "ic_impl/algo/psi/v2/labeled_psi.h"
+
+#include <algorithm>
+#include <cstring>
+#include <numeric>
+#include <random>
+#include <unordered_map>
+
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_join.h"
+#include "spdlog/spdlog.h"
+#include "yacl/base/exception.h"
+#include "yacl/crypto/hash/hash_utils.h"
+
+#include "ic_impl/algo/psi/v2/compact_result.h"
+#include "ic_impl/protocol_family/ecc/ec_cipher.h"
+
+namespace ic_impl::algo::psi::v2 {
+
+namespace {
+
+constexpr size_t kBatchSize = 4096;
+
+constexpr size_t kTagSize = 16;
+
+constexpr char kTagDomain[] = "ic_impl.labeled_psi.tag";
+
+constexpr char kPayloadDomain[] = "ic_impl.labeled_psi.payload";
+
+constexpr size_t kPayloadAlignment = 16;
+
+std::string DeriveTag(const std::string &prf) {
+  auto digest = yacl::crypto::Sha256(absl::StrCat(kTagDomain, prf));
+  return std::string(digest.begin(), digest.begin() + kTagSize);
+}
+
+// XOR `data` with the key stream derived from `prf`; it both encrypts and
+// decrypts
+std::string XorKeyStream(const std::string &prf, std::string_view data) {
+  std::string out(data);
+  for (size_t offset = 0, block = 0; offset < out.size(); ++block) {
+    auto stream = yacl::crypto::Sha256(
+        absl::StrCat(kPayloadDomain, prf, ":", block));
+    for (size_t i = 0; i < stream.size() && offset < out.size(); ++i) {
+      out[offset++] ^= static_cast<char>(stream[i]);
+    }
+  }
+  return out;
+}
+
+// Prefix `payload` with its size and pad it with zeros to `width` bytes,
+// so that the ciphertexts do not tell the payloads apart by their sizes
+std::string PadPayload(std::string_view payload, size_t width) {
+  uint32_t size = payload.size();
+  std::string out(reinterpret_cast<const char *>(&size), sizeof(size));
+  out.append(payload);
+  out.resize(width, '\0');
+  return out;
+}
+
+std::string UnpadPayload(std::string_view padded) {
+  uint32_t size;
+  YACL_ENFORCE(padded.size() >= sizeof(size), "labeled psi: invalid payload");
+  std::memcpy(&size, padded.data(), sizeof(size));
+  padded.remove_prefix(sizeof(size));
+  YACL_ENFORCE(size <= padded.size(), "labeled psi: invalid payload");
+  return std::string(padded.substr(0, size));
+}
+
+// The padded size of every payload, which the receiver learns: the longest
+// one rounded up to kPayloadAlignment bytes
+size_t PaddedPayloadWidth(const std::vector<std::string> &payloads) {
+  size_t longest = 0;
+  for (const auto &payload : payloads) {
+    longest = std::max(longest, payload.size());
+  }
+  size_t width = sizeof(uint32_t) + longest;
+  return (width + kPayloadAlignment - 1) / kPayloadAlignment *
+         kPayloadAlignment;
+}
+
+size_t NumBatches(size_t item_num) {
+  return (item_num + kBatchSize - 1) / kBatchSize;
+}
+
+std::string BatchTag(std::string_view name, size_t batch) {
+  return absl::StrCat("labeled_psi_", name, "_", batch);
+}
+
+std::string PackPoints(const std::vector<std::string> &points) {
+  return absl::StrJoin(points, "");
+}
+
+std::vector<std::string> UnpackPoints(const yacl::Buffer &buf,
+                                      size_t point_size) {
+  YACL_ENFORCE(buf.size() % point_size == 0,
+               "labeled psi: invalid point batch size {}", buf.size());
+  std::vector<std::string> points(buf.size() / point_size);
+  for (size_t i = 0; i < points.size(); ++i) {
+    points[i].assign(buf.data<char>() + i * point_size, point_size);
+  }
+  return points;
+}
+
+struct Record {
+  std::string tag;
+  std::string ciphertext;
+};
+
+std::string PackRecords(const std::vector<Record> &records) {
+  std::string out;
+  for (const auto &record : records) {
+    out.append(record.tag);
+    uint32_t size = record.ciphertext.size();
+    out.append(reinterpret_cast<const char *>(&size), sizeof(size));
+    out.append(record.ciphertext);
+  }
+  return out;
+}
+
+std::vector<Record> UnpackRecords(const yacl::Buffer &buf) {
+  std::vector<Record> records;
+  std::string_view data(buf.data<char>(), buf.size());
+  while (!data.empty()) {
+    YACL_ENFORCE(data.size() >= kTagSize + sizeof(uint32_t),
+                 "labeled psi: truncated record");
+    Record record;
+    record.tag = data.substr(0, kTagSize);
+    uint32_t size;
+    std::memcpy(&size, data.data() + kTagSize, sizeof(size));
+    data.remove_prefix(kTagSize + sizeof(size));
+    YACL_ENFORCE(data.size() >= size, "labeled psi: truncated record");
+    record.ciphertext = data.substr(0, size);
+    data.remove_prefix(size);
+    records.push_back(std::move(record));
+  }
+  return records;
+}
+
+}  // namespace
+
+LabeledPsi::LabeledPsi(std::shared_ptr<EcdhPsiContext> ctx)
+    : ctx_(std::move(ctx)) {
+  YACL_ENFORCE(ctx_->ic_ctx->lctx->WorldSize() == 2,
+               "labeled psi only supports two parties");
+}
+
+std::vector<uint64_t> LabeledPsi::Run(std::vector<std::string> *payloads) {
+  return IsSender() ? RunSender() : RunReceiver(payloads);
+}
+
+bool LabeledPsi::IsSender() const {
+  return static_cast<int32_t>(ctx_->ic_ctx->lctx->Rank()) == ctx_->payload_rank;
+}
+
+size_t LabeledPsi::PeerRank() const {
+  return 1 - ctx_->ic_ctx->lctx->Rank();
+}
+
+std::vector<uint64_t> LabeledPsi::RunSender() {
+  auto lctx = ctx_->ic_ctx->lctx;
+  protocol_family::ecc::EcCipher cipher(ctx_->curve_type);
+
+  // evaluate the oblivious PRF on the blinded items of the receiver
+  for (size_t batch = 0; batch < NumBatches(ctx_->peer_item_num); ++batch) {
+    auto buf = lctx->Recv(PeerRank(), BatchTag("blinded", batch));
+    auto masked = cipher.Mask(UnpackPoints(buf, cipher.PointSize()));
+    lctx->SendAsync(PeerRank(), PackPoints(masked), BatchTag("masked", batch));
+  }
+
+  // publish the tags and the encrypted payloads in a random order
+  auto keys = ReadInputKeys(*ctx_);
+  auto payloads = ReadInputFields(*ctx_, ctx_->payload_fields);
+  YACL_ENFORCE(keys.size() == static_cast<size_t>(ctx_->item_num));
+  CheckUniqueKeys(*ctx_, keys);
+  auto prfs = cipher.HashAndMask(keys);
+  size_t payload_width = PaddedPayloadWidth(payloads);
+
+  std::vector<std::string> tags(prfs.size());
+  std::vector<size_t> order(prfs.size());
+  std::iota(order.begin(), order.end(), 0);
+  std::shuffle(order.begin(), order.end(),
+               std::mt19937_64(std::random_device()()));
+  for (size_t batch = 0; batch < NumBatches(order.size()); ++batch) {
+    size_t begin = batch * kBatchSize;
+    size_t end = std::min(begin + kBatchSize, order.size());
+    std::vector<Record> records;
+    records.reserve(end - begin);
+    for (size_t i = begin; i < end; ++i) {
+      size_t index = order[i];
+      tags[index] = DeriveTag(prfs[index]);
+      records.push_back(
+          {tags[index],
+           XorKeyStream(prfs[index],
+                        PadPayload(payloads[index], payload_width))});
+    }
+    lctx->SendAsync(PeerRank(), PackRecords(records),
+                    BatchTag("records", batch));
+  }
+
+  if (ctx_->result_to_rank != -1) {
+    return {};
+  }
+
+  // the receiver tells which tags matched
+  auto buf = lctx->Recv(PeerRank(), "labeled_psi_result");
+  CompactResultStats stats;
+  return DecodeCompactResult(buf, tags, &stats);
+}
+
+std::vector<uint64_t> LabeledPsi::RunReceiver(
+    std::vector<std::string> *payloads) {
+  auto lctx = ctx_->ic_ctx->lctx;
+  protocol_family::ecc::EcCipher cipher(ctx_->curve_type);
+
+  auto keys = ReadInputKeys(*ctx_);
+  YACL_ENFORCE(keys.size() == static_cast<size_t>(ctx_->item_num));
+  // a tag stands for one row
+  CheckUniqueKeys(*ctx_, keys);
+
+  // blind the own items and remove the blinding from the masked results
+  std::unordered_map<std::string, size_t> tag_to_index;
+  std::vector<std::string> prfs;
+  prfs.reserve(keys.size());
+  for (size_t batch = 0; batch < NumBatches(keys.size()); ++batch) {
+    size_t begin = batch * kBatchSize;
+    size_t end = std::min(begin + kBatchSize, keys.size());
+    std::vector<std::string> items(keys.begin() + begin, keys.begin() + end);
+    lctx->SendAsync(PeerRank(), PackPoints(cipher.HashAndMask(items)),
+                    BatchTag("blinded", batch));
+  }
+  for (size_t batch = 0; batch < NumBatches(keys.size()); ++batch) {
+    auto buf = lctx->Recv(PeerRank(), BatchTag("masked", batch));
+    for (auto &prf : cipher.Unmask(UnpackPoints(buf, cipher.PointSize()))) {
+      tag_to_index.emplace(DeriveTag(prf), prfs.size());
+      prfs.push_back(std::move(prf));
+    }
+  }
+  YACL_ENFORCE(prfs.size() == keys.size());
+
+  // open the payloads of the matched tags
+  std::vector<std::pair<uint64_t, std::string>> matches;
+  std::vector<std::string> matched_tags;
+  for (size_t batch = 0; batch < NumBatches(ctx_->peer_item_num); ++batch) {
+    auto buf = lctx->Recv(PeerRank(), BatchTag("records", batch));
+    for (auto &record : UnpackRecords(buf)) {
+      auto it = tag_to_index.find(record.tag);
+      if (it == tag_to_index.end()) {
+        continue;
+      }
+      matches.emplace_back(it->second,
+                           UnpadPayload(XorKeyStream(prfs[it->second],
+                                                     record.ciphertext)));
+      matched_tags.push_back(std::move(record.tag));
+    }
+  }
+
+  if (ctx_->result_to_rank == -1) {
+    CompactResultStats stats;
+    auto buf = EncodeCompactResult(matched_tags, ctx_->peer_item_num, &stats);
+    lctx->Send(PeerRank(), buf, "labeled_psi_result");
+  }
+
+  std::sort(matches.begin(), matches.end());
+  std::vector<uint64_t> indices;
+  indices.reserve(matches.size());
+  payloads->clear();
+  payloads->reserve(matches.size());
+  for (auto &[index, payload] : matches) {
+    indices.push_back(index);
+    payloads->push_back(std::move(payload));
+  }
+
+  SPDLOG_INFO("rank:{} labeled psi matched:{} payload_fields:{}",
+              lctx->Rank(), indices.size(),
+              absl::StrJoin(ctx_->payload_fields, ","));
+
+  return indices;
+}
+
+}  // namespace ic_impl::algo::psi::v2
@@ -0,0 +1,53 @@
+// Copyright 2024 Ant Group Co., Ltd.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "ic_impl/algo/psi/v2/psi_context_v2.h"
+
+namespace ic_impl::algo::psi::v2 {
+
+// Labeled ECDH-PSI between two parties, returning the intersection together
+// with the payload of the sender for each matched item in a single pass.
+//
+// The receiver obtains F_s(y) = s * H(y) for its items through blinding, the
+// sender publishes for each of its items a tag and the payload encrypted
+// under keys derived from F_s(x). The receiver can therefore only open the
+// payloads of the items it holds.
+class LabeledPsi {
+ public:
+  explicit LabeledPsi(std::shared_ptr<EcdhPsiContext> ctx);
+
+  // Return the indices of the own input rows in the intersection, ascending.
+  // The receiver also gets the ','-joined payload of each of these rows.
+  // The sender gets an empty result unless result_to_rank is -1.
+  std::vector<uint64_t> Run(std::vector<std::string> *payloads);
+
+ private:
+  std::vector<uint64_t> RunSender();
+
+  std::vector<uint64_t> RunReceiver(std::vector<std::string> *payloads);
+
+  bool IsSender() const;
+
+  size_t PeerRank() const;
+
+  std::shared_ptr<EcdhPsiContext> ctx_;
+};
+
+}  // namespace ic_impl::algo::psi::v2
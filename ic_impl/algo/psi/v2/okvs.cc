@@ -0,0 +1,170 @@
+// Copyright 2024 Ant Group Co., Ltd.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "ic_impl/algo/psi/v2/okvs.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+
+#include "yacl/base/exception.h"
+#include "yacl/crypto/rand/rand.h"
+#include "yacl/crypto/tools/prg.h"
+
+namespace ic_impl::algo::psi::v2 {
+
+namespace {
+
+// table size / number of keys; peeling three-hash hypergraphs succeeds with
+// high probability above 1.23
+constexpr double kOkvsScale = 1.3;
+
+constexpr uint64_t kOkvsMinSize = 64;
+
+constexpr int kOkvsMaxTries = 16;
+
+uint64_t Mix(uint64_t x) {
+  x += 0x9e3779b97f4a7c15ULL;
+  x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+  return x ^ (x >> 31);
+}
+
+std::array<uint64_t, 3> Positions(uint128_t key, uint64_t seed,
+                                  uint64_t size) {
+  uint64_t h = Mix(static_cast<uint64_t>(key) ^ seed) ^
+               static_cast<uint64_t>(key >> 64);
+  std::array<uint64_t, 3> positions;
+  for (size_t i = 0; i < positions.size();) {
+    positions[i] = (h = Mix(h)) % size;
+    bool duplicated = false;
+    for (size_t j = 0; j < i; ++j) {
+      duplicated |= positions[j] == positions[i];
+    }
+    if (!duplicated) {
+      ++i;
+    }
+  }
+  return positions;
+}
+
+// Return the keys in peeling order along with the position each one owns,
+// empty if the hypergraph has a 2-core
+std::vector<std::pair<size_t, uint64_t>> Peel(
+    const std::vector<std::array<uint64_t, 3>> &positions, uint64_t size) {
+  std::vector<uint32_t> degrees(size, 0);
+  std::vector<size_t> key_xor(size, 0);
+  for (size_t i = 0; i < positions.size(); ++i) {
+    for (auto position : positions[i]) {
+      ++degrees[position];
+      key_xor[position] ^= i;
+    }
+  }
+
+  std::vector<uint64_t> stack;
+  for (uint64_t position = 0; position < size; ++position) {
+    if (degrees[position] == 1) {
+      stack.push_back(position);
+    }
+  }
+
+  std::vector<std::pair<size_t, uint64_t>> order;
+  order.reserve(positions.size());
+  while (!stack.empty()) {
+    uint64_t position = stack.back();
+    stack.pop_back();
+    if (degrees[position] != 1) {
+      continue;
+    }
+    size_t key = key_xor[position];
+    order.emplace_back(key, position);
+    for (auto other : positions[key]) {
+      --degrees[other];
+      key_xor[other] ^= key;
+      if (degrees[other] == 1) {
+        stack.push_back(other);
+      }
+    }
+  }
+
+  if (order.size() != positions.size()) {
+    order.clear();
+  }
+  return order;
+}
+
+}  // namespace
+
+Okvs EncodeOkvs(const std::vector<uint128_t> &keys,
+                const std::vector<uint64_t> &values, int32_t cols) {
+  YACL_ENFORCE(cols > 0);
+  YACL_ENFORCE(values.size() == keys.size() * cols);
+  // equal keys make equal hyperedges, which no seed can peel
+  std::vector<uint128_t> sorted_keys(keys);
+  std::sort(sorted_keys.begin(), sorted_keys.end());
+  YACL_ENFORCE(std::adjacent_find(sorted_keys.begin(), sorted_keys.end()) ==
+                   sorted_keys.end(),
+               "okvs: duplicate key among {} keys", keys.size());
+
+  Okvs okvs;
+  okvs.cols = cols;
+  okvs.size = std::max<uint64_t>(
+      kOkvsMinSize, static_cast<uint64_t>(std::ceil(keys.size() * kOkvsScale)));
+
+  std::vector<std::array<uint64_t, 3>> positions(keys.size());
+  std::vector<std::pair<size_t, uint64_t>> order;
+  for (int tries = 0; order.size() != keys.size(); ++tries) {
+    YACL_ENFORCE(tries < kOkvsMaxTries, "okvs: encoding {} keys failed",
+                 keys.size());
+    okvs.seed = yacl::crypto::SecureRandU64();
+    for (size_t i = 0; i < keys.size(); ++i) {
+      positions[i] = Positions(keys[i], okvs.seed, okvs.size);
+    }
+    order = Peel(positions, okvs.size);
+  }
+
+  // the cells no key owns stay random; the others are solved backwards
+  okvs.cells.resize(okvs.size * cols);
+  yacl::crypto::Prg<uint64_t> prg(yacl::crypto::SecureRandSeed());
+  for (auto &cell : okvs.cells) {
+    cell = prg();
+  }
+  for (auto it = order.rbegin(); it != order.rend(); ++it) {
+    auto [key, owned] = *it;
+    for (int32_t c = 0; c < cols; ++c) {
+      uint64_t value = values[key * cols + c];
+      for (auto position : positions[key]) {
+        if (position != owned) {
+          value -= okvs.cells[position * cols + c];
+        }
+      }
+      okvs.cells[owned * cols + c] = value;
+    }
+  }
+
+  return okvs;
+}
+
+void DecodeOkvs(const Okvs &okvs, uint128_t key, uint64_t *out) {
+  auto positions = Positions(key, okvs.seed, okvs.size);
+  for (int32_t c = 0; c < okvs.cols; ++c) {
+    uint64_t value = 0;
+    for (auto position : positions) {
+      value += okvs.cells[position * okvs.cols + c];
+    }
+    out[c] = value;
+  }
+}
+
+}  // namespace ic_impl::algo::psi::v2
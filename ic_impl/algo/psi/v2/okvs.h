@@ -0,0 +1,45 @@
+// Copyright 2024 Ant Group Co., Ltd.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "yacl/base/int128.h"
+
+namespace ic_impl::algo::psi::v2 {
+
+// Oblivious key-value store over Z_2^64 (a garbled cuckoo table with three
+// hash positions). Decoding an encoded key returns its values; decoding any
+// other key returns unrelated values, and the table itself looks random as
+// long as the encoded values do.
+struct Okvs {
+  uint64_t seed = 0;
+  uint64_t size = 0;
+  // number of values per key
+  int32_t cols = 0;
+  // size x cols, row major
+  std::vector<uint64_t> cells;
+};
+
+// Encode `values` (keys.size() x cols, row major) under pseudo-random `keys`,
+// which must be distinct
+Okvs EncodeOkvs(const std::vector<uint128_t> &keys,
+                const std::vector<uint64_t> &values, int32_t cols);
+
+// Write the `cols` values of `key` to `out`
+void DecodeOkvs(const Okvs &okvs, uint128_t key, uint64_t *out);
+
+}  // namespace ic_impl::algo::psi::v2
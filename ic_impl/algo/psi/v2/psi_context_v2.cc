@@ -14,7 +14,13 @@
 
 #include "ic_impl/algo/psi/v2/psi_context_v2.h"
 
+#include <algorithm>
+#include <fstream>
+#include <unordered_map>
+
+#include "absl/strings/str_join.h"
 #include "absl/strings/str_split.h"
+#include "absl/strings/strip.h"
 #include "gflags/gflags.h"
 #include "psi/legacy/bucket_psi.h"
 #include "psi/utils/csv_checker.h"
@@ -29,17 +35,31 @@ DEFINE_string(field_names, "id", "field names");
 DEFINE_string(out_path, "", "psi out file path");
 
 DEFINE_int32(result_to_rank, -1, "which rank gets the result");
+DEFINE_bool(compact_psi_result, true,
+            "whether to send the intersection in compact form when every "
+            "rank gets the result");
+
+DEFINE_string(payload_fields, "",
+              "comma-separated fields sent to the receiver along with the "
+              "intersection, enables the labeled mode");
+
+DEFINE_string(psi_state_path, "",
+              "file keeping the keys and the processed items between runs, "
+              "enables the incremental mode for input files that only grow "
+              "by appended rows");
+
+DECLARE_bool(disable_handshake);
 
 namespace ic_impl::algo::psi::v2 {
 
 namespace {
 
 std::string GetPsiInputFileName() {
-  return util::GetInputFileName(FLAGS_in_path);
+  return util::GetInputFileName(util::GetParamEnv("in_path", FLAGS_in_path));
 }
 
 std::string GetPsiOutputFileName() {
-  return util::GetOutputFileName(FLAGS_out_path);
+  return util::GetOutputFileName(util::GetParamEnv("out_path", FLAGS_out_path));
 }
 
 std::string GetPsiInputFileFieldNames() {
@@ -50,6 +70,62 @@ int32_t SuggestedResultToRank() {
   return util::GetParamEnv("result_to_rank", FLAGS_result_to_rank);
 }
 
+bool SuggestedCompactResult() {
+  // the compact result is agreed on through the handshake
+  return !util::GetParamEnv("disable_handshake", FLAGS_disable_handshake) &&
+         util::GetParamEnv("compact_psi_result", FLAGS_compact_psi_result);
+}
+
+std::vector<std::string> GetSelectedFields() {
+  std::vector<std::string> fields =
+      absl::StrSplit(GetPsiInputFileFieldNames(), ',');
+  return fields;
+}
+
+std::vector<std::string> SuggestedPayloadFields() {
+  // the labeled mode is agreed on through the handshake
+  if (util::GetParamEnv("disable_handshake", FLAGS_disable_handshake)) {
+    return {};
+  }
+  std::vector<std::string> fields =
+      absl::StrSplit(util::GetParamEnv("payload_fields", FLAGS_payload_fields),
+                     ',', absl::SkipEmpty());
+  return fields;
+}
+
+std::string SuggestedStatePath() {
+  // the incremental mode is agreed on through the handshake
+  if (util::GetParamEnv("disable_handshake", FLAGS_disable_handshake)) {
+    return "";
+  }
+  return util::GetParamEnv("psi_state_path", FLAGS_psi_state_path);
+}
+
+void TrimLine(std::string &line) {
+  if (!line.empty() && line.back() == '\r') {
+    line.pop_back();
+  }
+}
+
+// The fields of a csv line. Only the plain csv read alike by this splitter
+// and the reader of psi is accepted, as the rows of both have to match:
+// quoted fields and fields padded with whitespace are refused.
+std::vector<std::string_view> SplitCsvLine(std::string_view line,
+                                           const std::string &input_file) {
+  YACL_ENFORCE(line.find('"') == std::string_view::npos,
+               "quoted fields are not supported, line `{}` in file={}", line,
+               input_file);
+  std::vector<std::string_view> fields = absl::StrSplit(line, ',');
+  for (auto field : fields) {
+    YACL_ENFORCE(field == absl::StripAsciiWhitespace(field),
+                 "fields padded with whitespace are not supported, line `{}` "
+                 "in file={}",
+                 line, input_file);
+  }
+
+  return fields;
+}
+
 }  // namespace
 
 using org::interconnection::v2::protocol::CURVE_TYPE_CURVE25519;
@@ -72,6 +148,14 @@ std::shared_ptr<EcdhPsiContext> CreateEcdhPsiContext(
   ctx->bit_length_after_truncated =
       protocol_family::ecc::SuggestedBitLengthAfterTruncated();
   ctx->result_to_rank = SuggestedResultToRank();  // TODO: check
+  ctx->compact_result = SuggestedCompactResult();
+  ctx->peer_item_num = 0;
+  ctx->payload_fields = SuggestedPayloadFields();
+  ctx->payload_rank = -1;
+  ctx->state_path = SuggestedStatePath();
+  ctx->incremental = false;
+  ctx->state_own_count = 0;
+  ctx->state_peer_count = 0;
 
   ctx->ic_ctx = std::move(ic_context);
 
@@ -90,7 +174,11 @@ std::unique_ptr<::psi::BucketPsi> CreateBucketPsi(const EcdhPsiContext &ctx) {
 
   config.set_psi_type(::psi::PsiType::ECDH_PSI_2PC);
 
-  if (ctx.result_to_rank == -1) {
+  if (UseCompactResult(ctx)) {
+    // the receiver sends the intersection to the others afterwards
+    config.set_broadcast_result(false);
+    config.set_receiver_rank(kCompactResultReceiverRank);
+  } else if (ctx.result_to_rank == -1) {
     config.set_broadcast_result(true);
   } else {
     config.set_broadcast_result(false);
@@ -137,4 +225,135 @@ std::unique_ptr<::psi::CsvChecker> CheckInput(const EcdhPsiContext &ctx) {
                            selected_fields, false, true);
 }
 
+bool UseCompactResult(const EcdhPsiContext &ctx) {
+  return ctx.compact_result && ctx.result_to_rank == -1;
+}
+
+bool UseLabeledPsi(const EcdhPsiContext &ctx) {
+  return ctx.payload_rank != -1;
+}
+
+bool UseIncrementalPsi(const EcdhPsiContext &ctx) { return ctx.incremental; }
+
+std::vector<std::string> ReadInputKeys(const EcdhPsiContext &ctx) {
+  return ReadInputFields(ctx, GetSelectedFields());
+}
+
+void CheckUniqueKeys(const EcdhPsiContext &,
+                     const std::vector<std::string> &keys) {
+  std::unordered_map<std::string_view, size_t> rows;
+  rows.reserve(keys.size());
+  for (size_t i = 0; i < keys.size(); ++i) {
+    auto [it, inserted] = rows.emplace(keys[i], i);
+    YACL_ENFORCE(inserted, "duplicate key in rows {} and {} of file={}",
+                 it->second + 1, i + 1, GetPsiInputFileName());
+  }
+}
+
+std::vector<std::string> ReadUnselectedFields(const EcdhPsiContext &) {
+  std::string input_file = GetPsiInputFileName();
+  std::ifstream in(input_file);
+  YACL_ENFORCE(in, "open file={} failed", input_file);
+
+  std::string line;
+  YACL_ENFORCE(std::getline(in, line), "file={} has no header", input_file);
+  TrimLine(line);
+  auto header = SplitCsvLine(line, input_file);
+
+  auto selected = GetSelectedFields();
+  std::vector<std::string> fields;
+  for (auto field : header) {
+    if (std::find(selected.begin(), selected.end(), field) == selected.end()) {
+      fields.emplace_back(field);
+    }
+  }
+
+  return fields;
+}
+
+std::vector<std::string> ReadInputFields(
+    const EcdhPsiContext &ctx, const std::vector<std::string> &fields) {
+  std::string input_file = GetPsiInputFileName();
+  std::ifstream in(input_file);
+  YACL_ENFORCE(in, "open file={} failed", input_file);
+
+  std::string line;
+  YACL_ENFORCE(std::getline(in, line), "file={} has no header", input_file);
+  TrimLine(line);
+  auto header = SplitCsvLine(line, input_file);
+
+  std::vector<size_t> columns;
+  for (const auto &field : fields) {
+    auto it = std::find(header.begin(), header.end(), field);
+    YACL_ENFORCE(it != header.end(), "field {} not in file={}", field,
+                 input_file);
+    columns.push_back(it - header.begin());
+  }
+
+  std::vector<std::string> rows;
+  rows.reserve(ctx.item_num);
+  while (std::getline(in, line)) {
+    TrimLine(line);
+    if (line.empty()) {
+      continue;
+    }
+    auto values = SplitCsvLine(line, input_file);
+    YACL_ENFORCE(values.size() == header.size(),
+                 "invalid line `{}` in file={}", line, input_file);
+    std::vector<std::string_view> selected;
+    for (auto column : columns) {
+      selected.push_back(values[column]);
+    }
+    rows.push_back(absl::StrJoin(selected, ","));
+  }
+  // the rows are those counted by the reader of psi
+  YACL_ENFORCE(static_cast<int64_t>(rows.size()) == ctx.item_num,
+               "file={} has {} rows, {} expected", input_file, rows.size(),
+               ctx.item_num);
+
+  return rows;
+}
+
+void WriteOutputRows(const EcdhPsiContext &ctx,
+                     const std::vector<uint64_t> &indices,
+                     const std::vector<std::string> &payload_fields,
+                     const std::vector<std::string> &payloads) {
+  YACL_ENFORCE(payload_fields.empty() || payloads.size() == indices.size());
+
+  std::string input_file = GetPsiInputFileName();
+  std::ifstream in(input_file);
+  YACL_ENFORCE(in, "open file={} failed", input_file);
+
+  std::string output_file = GetPsiOutputFileName();
+  std::ofstream out(output_file);
+  YACL_ENFORCE(out, "open file={} failed", output_file);
+
+  std::string line;
+  if (std::getline(in, line)) {
+    TrimLine(line);
+    out << line;
+    for (const auto &field : payload_fields) {
+      out << ',' << field;
+    }
+    out << '\n';
+  }
+
+  uint64_t row = 0;
+  size_t i = 0;
+  while (i < indices.size() && std::getline(in, line)) {
+    TrimLine(line);
+    if (line.empty()) {
+      continue;
+    }
+    if (row++ == indices[i]) {
+      out << line;
+      if (!payload_fields.empty()) {
+        out << ',' << payloads[i];
+      }
+      out << '\n';
+      ++i;
+    }
+  }
+}
+
 }  // namespace ic_impl::algo::psi::v2
@@ -14,6 +14,9 @@
 
 #pragma once
 
+#include <string>
+#include <vector>
+
 #include "ic_impl/context.h"
 
 namespace psi {
@@ -23,6 +26,10 @@ class CsvChecker;
 
 namespace ic_impl::algo::psi::v2 {
 
+// The rank that computes the intersection and sends it to the others in
+// compact form when result_to_rank is -1
+constexpr int32_t kCompactResultReceiverRank = 0;
+
 struct EcdhPsiContext {
   int32_t curve_type;
   int32_t hash_type;
@@ -31,6 +38,20 @@ struct EcdhPsiContext {
   int32_t bit_length_after_truncated;
   int64_t item_num;
   int32_t result_to_rank;
+  bool compact_result;
+  int64_t peer_item_num;
+  // fields sent along with the intersection in labeled mode
+  std::vector<std::string> payload_fields;
+  // the rank which sends the payload, -1 if the labeled mode is off
+  int32_t payload_rank;
+  // file keeping the state of the incremental mode, empty if it is off
+  std::string state_path;
+  // whether the incremental mode is used
+  bool incremental;
+  // summary of the state to continue; state_id is empty if there is none
+  std::string state_id;
+  int64_t state_own_count;
+  int64_t state_peer_count;
   std::shared_ptr<IcContext> ic_ctx;
 };
 
@@ -41,4 +62,33 @@ std::unique_ptr<::psi::BucketPsi> CreateBucketPsi(const EcdhPsiContext &);
 
 std::unique_ptr<::psi::CsvChecker> CheckInput(const EcdhPsiContext &);
 
+bool UseCompactResult(const EcdhPsiContext &);
+
+bool UseLabeledPsi(const EcdhPsiContext &);
+
+bool UseIncrementalPsi(const EcdhPsiContext &);
+
+// Read the given fields of every input row, joined by ','
+std::vector<std::string> ReadInputFields(
+    const EcdhPsiContext &, const std::vector<std::string> &fields);
+
+// Read the selected fields of every input row, joined by ','
+std::vector<std::string> ReadInputKeys(const EcdhPsiContext &);
+
+// Fail on the first key found twice, for the protocols which match each key
+// of a party at most once
+void CheckUniqueKeys(const EcdhPsiContext &,
+                     const std::vector<std::string> &keys);
+
+// Read the names of the input columns which are not selected, in file order
+std::vector<std::string> ReadUnselectedFields(const EcdhPsiContext &);
+
+// Write the header and the input rows at `indices` (ascending) to the output.
+// If `payload_fields` is not empty, `payloads` holds the ','-joined payload
+// values appended to each of the rows.
+void WriteOutputRows(const EcdhPsiContext &,
+                     const std::vector<uint64_t> &indices,
+                     const std::vector<std::string> &payload_fields = {},
+                     const std::vector<std::string> &payloads = {});
+
 }  // namespace ic_impl::algo::psi::v2
@@ -14,8 +14,19 @@
 
 #include "ic_impl/algo/psi/v2/psi_handler_v2.h"
 
+#include <algorithm>
+
 #include "psi/legacy/bucket_psi.h"
 
+#include "ic_impl/algo/psi/v2/compact_result.h"
+#include "ic_impl/algo/psi/v2/incremental_psi.h"
+#include "ic_impl/algo/psi/v2/labeled_psi.h"
+#include "ic_impl/link/wire_codec.h"
+#include "ic_impl/protocol_family/ecc/ec_cipher.h"
+
+#include "ic_impl/proto/psi_ext.pb.h"
+#include "ic_impl/proto/wire_format.pb.h"
+
 namespace org::interconnection::v2::protocol {
 
 bool operator<(const EcSuit &lhs, const EcSuit &rhs) {
@@ -52,6 +63,10 @@ using org::interconnection::v2::protocol::EccProtocolProposal;
 using org::interconnection::v2::protocol::EccProtocolResult;
 using org::interconnection::v2::protocol::EcSuit;
 
+using ic_impl::proto::EccProtocolProposalExt;
+using ic_impl::proto::EccProtocolResultExt;
+using ic_impl::proto::PsiDataIoProposalExt;
+
 namespace {
 std::vector<EccProtocolProposal> ExtractReqEccParams(
     const std::vector<HandshakeRequestV2> &requests) {
@@ -79,6 +94,8 @@ std::set<int32_t> IntersectPointOctetFormats(
   return util::IntersectParamItems<EccProtocolProposal>(ecc_params, field_num);
 }
 
+constexpr char kCompactResultTag[] = "psi_compact_result";
+
 }  // namespace
 
 EcdhPsiV2Handler::EcdhPsiV2Handler(std::shared_ptr<EcdhPsiContext> ctx)
@@ -87,11 +104,13 @@ EcdhPsiV2Handler::EcdhPsiV2Handler(std::shared_ptr<EcdhPsiContext> ctx)
 EcdhPsiV2Handler::~EcdhPsiV2Handler() = default;
 
 bool EcdhPsiV2Handler::PrepareDataset() {
-  bucket_psi_ = CreateBucketPsi(*ctx_);
-
   auto checker = CheckInput(*ctx_);
   ctx_->item_num = checker->data_count();
 
+  if (!ctx_->state_path.empty()) {
+    LoadIncrementalPsiState(ctx_.get());
+  }
+
   return true;
 }
 
@@ -112,17 +131,53 @@ HandshakeRequestV2 EcdhPsiV2Handler::BuildHandshakeRequest() {
   ecc_param.add_point_octet_formats(ctx_->point_octet_format);
   ecc_param.set_support_point_truncation(ctx_->bit_length_after_truncated !=
                                          -1);
+  if (!ctx_->ic_ctx->wire_formats.empty()) {
+    EccProtocolProposalExt ecc_ext;
+    ecc_ext.mutable_wire_formats()->Add(ctx_->ic_ctx->wire_formats.begin(),
+                                        ctx_->ic_ctx->wire_formats.end());
+    util::SetVendorExt(&ecc_param, ecc_ext);
+  }
   request.add_protocol_family_params()->PackFrom(ecc_param);
 
   PsiDataIoProposal psi_io;
   psi_io.add_supported_versions(1);
   psi_io.set_item_num(ctx_->item_num);
   psi_io.set_result_to_rank(ctx_->result_to_rank);
+  PsiDataIoProposalExt psi_io_ext;
+  psi_io_ext.set_compact_result(ctx_->compact_result);
+  psi_io_ext.mutable_payload_fields()->Add(ctx_->payload_fields.begin(),
+                                           ctx_->payload_fields.end());
+  psi_io_ext.set_incremental(!ctx_->state_path.empty());
+  psi_io_ext.set_state_id(ctx_->state_id);
+  psi_io_ext.set_state_own_count(ctx_->state_own_count);
+  psi_io_ext.set_state_peer_count(ctx_->state_peer_count);
+  util::SetVendorExt(&psi_io, psi_io_ext);
   request.mutable_io_param()->PackFrom(psi_io);
 
   return request;
 }
 
+bool EcdhPsiV2Handler::ResumeHandshake(
+    const std::vector<HandshakeRequestV2> &requests,
+    const HandshakeResponseV2 &response) {
+  // the incremental mode renews its state with every job
+  if (!ctx_->state_path.empty()) {
+    return false;
+  }
+
+  if (!ProcessHandshakeResponse(response)) {
+    return false;
+  }
+
+  // the response carries the item number of rank 0 itself
+  ctx_->peer_item_num = 0;
+  for (const auto &io_param : ExtractReqIoParams<PsiDataIoProposal>(requests)) {
+    ctx_->peer_item_num = std::max(ctx_->peer_item_num, io_param.item_num());
+  }
+
+  return true;
+}
+
 status::ErrorStatus EcdhPsiV2Handler::NegotiateHandshakeParams(
     const std::vector<HandshakeRequestV2> &requests) {
   auto status = NegotiateEccParams(requests);
@@ -168,6 +223,23 @@ bool EcdhPsiV2Handler::NegotiateBitLengthAfterTruncated(
   return true;
 }
 
+void EcdhPsiV2Handler::NegotiateWireFormat(
+    const std::vector<EccProtocolProposal> &ecc_params) {
+  std::vector<std::set<int32_t>> formats;
+  for (const auto &ecc_param : ecc_params) {
+    auto ext = util::GetVendorExt<EccProtocolProposalExt>(ecc_param);
+    if (!ext.has_value()) {
+      formats.emplace_back();
+      continue;
+    }
+    formats.emplace_back(ext->wire_formats().begin(),
+                         ext->wire_formats().end());
+  }
+
+  ctx_->ic_ctx->wire_format = link::ChooseWireFormat(
+      ctx_->ic_ctx->wire_formats, util::Intersection(formats));
+}
+
 bool EcdhPsiV2Handler::NegotiateResultToRank(
     const std::vector<PsiDataIoProposal> &io_params) {
   int field_num = PsiDataIoProposal::kResultToRankFieldNumber;
@@ -177,6 +249,103 @@ bool EcdhPsiV2Handler::NegotiateResultToRank(
   return ctx_->result_to_rank == result_to_rank;
 }
 
+bool EcdhPsiV2Handler::NegotiateCompactResult(
+    const std::vector<PsiDataIoProposal> &io_params) {
+  for (const auto &io_param : io_params) {
+    auto ext = util::GetVendorExt<PsiDataIoProposalExt>(io_param);
+    if (!ext.has_value() || !ext->compact_result()) {
+      ctx_->compact_result = false;
+    }
+    // the hash width of the compact result is sized by it
+    if (io_param.item_num() < 0) {
+      SPDLOG_WARN("invalid item_num {}", io_param.item_num());
+      return false;
+    }
+    ctx_->peer_item_num = std::max(ctx_->peer_item_num, io_param.item_num());
+  }
+
+  return true;
+}
+
+status::ErrorStatus EcdhPsiV2Handler::NegotiateLabeledMode(
+    const std::vector<HandshakeRequestV2> &requests,
+    const std::vector<PsiDataIoProposal> &io_params) {
+  int32_t payload_rank = -1;
+  if (!ctx_->payload_fields.empty()) {
+    payload_rank = ctx_->ic_ctx->lctx->Rank();
+  }
+
+  for (size_t i = 0; i < requests.size(); ++i) {
+    auto ext = util::GetVendorExt<PsiDataIoProposalExt>(io_params[i]);
+    if (!ext.has_value() || ext->payload_fields().empty()) {
+      continue;
+    }
+    if (payload_rank != -1) {
+      return status::HandshakeRefusedError("more than one party has payload");
+    }
+    payload_rank = requests[i].requester_rank();
+    ctx_->payload_fields.assign(ext->payload_fields().begin(),
+                                ext->payload_fields().end());
+  }
+
+  if (payload_rank == -1) {
+    return status::OkStatus();
+  }
+
+  if (ctx_->ic_ctx->lctx->WorldSize() != 2) {
+    return status::UnsupportedArgumentError(
+        "labeled mode only supports two parties");
+  }
+
+  if (!protocol_family::ecc::IsEcCipherSupported(ctx_->curve_type)) {
+    return status::UnsupportedArgumentError(
+        "labeled mode is unsupported with the negotiated curve");
+  }
+
+  if (ctx_->result_to_rank == payload_rank) {
+    return status::HandshakeRefusedError(
+        "the payload sender cannot be the only result receiver");
+  }
+
+  ctx_->payload_rank = payload_rank;
+
+  return status::OkStatus();
+}
+
+void EcdhPsiV2Handler::NegotiateIncrementalMode(
+    const std::vector<PsiDataIoProposal> &io_params) {
+  bool incremental = !ctx_->state_path.empty();
+  bool resume = !ctx_->state_id.empty();
+  for (const auto &io_param : io_params) {
+    auto ext = util::GetVendorExt<PsiDataIoProposalExt>(io_param);
+    if (!ext.has_value() || !ext->incremental()) {
+      incremental = false;
+      break;
+    }
+    // each side must have processed what the other one remembers of it
+    resume = resume && ext->state_id() == ctx_->state_id &&
+             ext->state_own_count() == ctx_->state_peer_count &&
+             ext->state_peer_count() == ctx_->state_own_count;
+  }
+
+  if (incremental &&
+      (ctx_->ic_ctx->lctx->WorldSize() != 2 ||
+       !protocol_family::ecc::IsEcCipherSupported(ctx_->curve_type) ||
+       UseLabeledPsi(*ctx_) || ctx_->result_to_rank != -1)) {
+    SPDLOG_WARN(
+        "incremental psi needs two parties, the sm2 curve, no payload and "
+        "result_to_rank -1, running the full psi");
+    incremental = false;
+  }
+
+  ctx_->incremental = incremental;
+  if (incremental && !resume) {
+    ctx_->state_id = NewIncrementalPsiStateId();
+    ctx_->state_own_count = 0;
+    ctx_->state_peer_count = 0;
+  }
+}
+
 status::ErrorStatus EcdhPsiV2Handler::NegotiateEccParams(
     const std::vector<HandshakeRequestV2> &requests) {
   auto ecc_params = ExtractReqEccParams(requests);
@@ -197,6 +366,8 @@ status::ErrorStatus EcdhPsiV2Handler::NegotiateEccParams(
         "negotiate bit length after truncated failed");
   }
 
+  NegotiateWireFormat(ecc_params);
+
   return status::OkStatus();
 }
 
@@ -211,6 +382,17 @@ status::ErrorStatus EcdhPsiV2Handler::NegotiatePsiIoParams(
     return status::HandshakeRefusedError("negotiate result_to_rank failed");
   }
 
+  if (!NegotiateCompactResult(io_params)) {
+    return status::HandshakeRefusedError("negotiate compact result failed");
+  }
+
+  auto status = NegotiateLabeledMode(requests, io_params);
+  if (!status.ok()) {
+    return status;
+  }
+
+  NegotiateIncrementalMode(io_params);
+
   return status::OkStatus();
 }
 
@@ -227,11 +409,28 @@ HandshakeResponseV2 EcdhPsiV2Handler::BuildHandshakeResponse() {
   ec_suit->set_hash2curve_strategy(ctx_->hash_to_curve_strategy);
   ecc_param.set_point_octet_format(ctx_->point_octet_format);
   ecc_param.set_bit_length_after_truncated(ctx_->bit_length_after_truncated);
+  if (link::IsEncodedWireFormat(ctx_->ic_ctx->wire_format)) {
+    EccProtocolResultExt ecc_ext;
+    ecc_ext.set_wire_format(ctx_->ic_ctx->wire_format);
+    util::SetVendorExt(&ecc_param, ecc_ext);
+  }
   response.add_protocol_family_params()->PackFrom(ecc_param);
 
   PsiDataIoProposal psi_io;
   psi_io.set_item_num(ctx_->item_num);
   psi_io.set_result_to_rank(ctx_->result_to_rank);
+  PsiDataIoProposalExt psi_io_ext;
+  psi_io_ext.set_compact_result(ctx_->compact_result);
+  if (UseLabeledPsi(*ctx_)) {
+    psi_io_ext.mutable_payload_fields()->Add(ctx_->payload_fields.begin(),
+                                             ctx_->payload_fields.end());
+    psi_io_ext.set_payload_rank(ctx_->payload_rank);
+  }
+  if (UseIncrementalPsi(*ctx_)) {
+    psi_io_ext.set_incremental(true);
+    psi_io_ext.set_state_id(ctx_->state_id);
+  }
+  util::SetVendorExt(&psi_io, psi_io_ext);
   response.mutable_io_param()->PackFrom(psi_io);
 
   return response;
@@ -258,19 +457,71 @@ bool EcdhPsiV2Handler::ProcessHandshakeResponse(
   }
   ctx_->bit_length_after_truncated = ecc_param.bit_length_after_truncated();
 
+  auto ecc_ext = util::GetVendorExt<EccProtocolResultExt>(ecc_param);
+  ctx_->ic_ctx->wire_format = ic_impl::proto::WIRE_FORMAT_RAW;
+  if (ecc_ext.has_value() && ecc_ext->wire_format() != 0) {
+    const auto &wire_formats = ctx_->ic_ctx->wire_formats;
+    YACL_ENFORCE(std::find(wire_formats.begin(), wire_formats.end(),
+                           ecc_ext->wire_format()) != wire_formats.end(),
+                 "unexpected wire format {}", ecc_ext->wire_format());
+    ctx_->ic_ctx->wire_format = ecc_ext->wire_format();
+  }
+
+  PsiDataIoProposal psi_io;
+  YACL_ENFORCE(response.io_param().UnpackTo(&psi_io));
+  auto psi_io_ext = util::GetVendorExt<PsiDataIoProposalExt>(psi_io);
+  if (!psi_io_ext.has_value() || !psi_io_ext->compact_result()) {
+    ctx_->compact_result = false;
+  }
+  ctx_->peer_item_num = psi_io.item_num();
+
+  if (psi_io_ext.has_value() && !psi_io_ext->payload_fields().empty()) {
+    ctx_->payload_rank = psi_io_ext->payload_rank();
+    std::vector<std::string> payload_fields(
+        psi_io_ext->payload_fields().begin(),
+        psi_io_ext->payload_fields().end());
+    int32_t self_rank = ctx_->ic_ctx->lctx->Rank();
+    if (ctx_->payload_rank == self_rank) {
+      YACL_ENFORCE(payload_fields == ctx_->payload_fields,
+                   "payload fields mismatch");
+    }
+    ctx_->payload_fields = std::move(payload_fields);
+  } else {
+    YACL_ENFORCE(ctx_->payload_fields.empty(),
+                 "the labeled mode is refused by the peer");
+  }
+
+  ctx_->incremental = psi_io_ext.has_value() && psi_io_ext->incremental();
+  if (UseIncrementalPsi(*ctx_)) {
+    YACL_ENFORCE(!ctx_->state_path.empty());
+    if (psi_io_ext->state_id() != ctx_->state_id) {
+      ctx_->state_id = psi_io_ext->state_id();
+      ctx_->state_own_count = 0;
+      ctx_->state_peer_count = 0;
+    }
+  }
+
   return true;
 }
 
 void EcdhPsiV2Handler::RunAlgo() {
-  YACL_ENFORCE(bucket_psi_);
+  if (UseLabeledPsi(*ctx_)) {
+    RunLabeledPsi();
+    return;
+  }
 
   try {
     ::psi::PsiResultReport report;
     report.set_original_count(ctx_->item_num);
-    uint64_t self_items_count = ctx_->item_num;
-    auto progress = std::make_shared<::psi::Progress>();
-    auto indices = bucket_psi_->RunPsi(progress, self_items_count);
-    bucket_psi_->ProduceOutput(false, indices, report);
+    auto indices = RunPsi();
+    if (UseIncrementalPsi(*ctx_) ||
+        (UseCompactResult(*ctx_) &&
+         ctx_->ic_ctx->lctx->Rank() != kCompactResultReceiverRank)) {
+      WriteOutputRows(*ctx_, indices);
+      report.set_intersection_count(indices.size());
+    } else {
+      bucket_psi_->ProduceOutput(false, indices, report);
+    }
 
     SPDLOG_INFO("rank:{} original_count:{} intersection_count:{}",
                 ctx_->ic_ctx->lctx->Rank(), report.original_count(),
@@ -280,4 +531,91 @@ void EcdhPsiV2Handler::RunAlgo() {
   }
 }
 
+std::vector<uint64_t> EcdhPsiV2Handler::RunPsi() {
+  if (UseIncrementalPsi(*ctx_)) {
+    return IncrementalPsi(ctx_).Run();
+  }
+
+  bucket_psi_ = CreateBucketPsi(*ctx_);
+
+  uint64_t self_items_count = ctx_->item_num;
+  auto progress = std::make_shared<::psi::Progress>();
+  auto indices = bucket_psi_->RunPsi(progress, self_items_count);
+  if (UseCompactResult(*ctx_)) {
+    if (ctx_->ic_ctx->lctx->Rank() == kCompactResultReceiverRank) {
+      SendCompactResult(indices);
+    } else {
+      indices = RecvCompactResult();
+    }
+  }
+
+  return indices;
+}
+
+void EcdhPsiV2Handler::RunLabeledPsi() {
+  try {
+    LabeledPsi labeled_psi(ctx_);
+    std::vector<std::string> payloads;
+    auto indices = labeled_psi.Run(&payloads);
+
+    int32_t self_rank = ctx_->ic_ctx->lctx->Rank();
+    int64_t intersection_count = -1;
+    if (self_rank != ctx_->payload_rank) {
+      WriteOutputRows(*ctx_, indices, ctx_->payload_fields, payloads);
+      intersection_count = indices.size();
+    } else if (ctx_->result_to_rank == -1) {
+      WriteOutputRows(*ctx_, indices);
+      intersection_count = indices.size();
+    }
+
+    SPDLOG_INFO("rank:{} original_count:{} intersection_count:{}", self_rank,
+                ctx_->item_num, intersection_count);
+  } catch (const std::exception &e) {
+    SPDLOG_ERROR("run labeled psi failed: {}", e.what());
+  }
+}
+
+void EcdhPsiV2Handler::SendCompactResult(const std::vector<uint64_t> &indices) {
+  auto keys = ReadInputKeys(*ctx_);
+  std::vector<std::string> intersection;
+  intersection.reserve(indices.size());
+  for (auto index : indices) {
+    YACL_ENFORCE(index < keys.size(), "invalid intersection index {}", index);
+    intersection.push_back(std::move(keys[index]));
+  }
+
+  CompactResultStats stats;
+  auto buf = EncodeCompactResult(intersection, ctx_->peer_item_num, &stats);
+
+  auto lctx = ctx_->ic_ctx->lctx;
+  for (size_t i = 0; i < lctx->WorldSize(); ++i) {
+    if (i == lctx->Rank()) {
+      continue;
+    }
+    lctx->Send(i, buf, kCompactResultTag);
+  }
+
+  SPDLOG_INFO(
+      "rank:{} compact result encoding:{} items:{} sent_bytes:{} "
+      "plain_bytes:{} saved_bytes:{}",
+      lctx->Rank(), CompactResultEncodingName(stats.encoding),
+      stats.item_count, stats.encoded_bytes, stats.plain_bytes,
+      static_cast<int64_t>(stats.plain_bytes) -
+          static_cast<int64_t>(stats.encoded_bytes));
+}
+
+std::vector<uint64_t> EcdhPsiV2Handler::RecvCompactResult() {
+  auto lctx = ctx_->ic_ctx->lctx;
+  auto buf = lctx->Recv(kCompactResultReceiverRank, kCompactResultTag);
+
+  CompactResultStats stats;
+  auto indices = DecodeCompactResult(buf, ReadInputKeys(*ctx_), &stats);
+
+  SPDLOG_INFO("rank:{} compact result encoding:{} items:{} recv_bytes:{}",
+              lctx->Rank(), CompactResultEncodingName(stats.encoding),
+              stats.item_count, stats.encoded_bytes);
+
+  return indices;
+}
+
 }  // namespace ic_impl::algo::psi::v2
@@ -24,9 +24,15 @@ namespace psi::psi {
 class BucketPsi;
 }
 
+namespace ic_impl::algo::psi_lr {
+class PsiLrHandler;
+}
+
 namespace ic_impl::algo::psi::v2 {
 
 class EcdhPsiV2Handler : public AlgoV2Handler {
+  friend class psi_lr::PsiLrHandler;
+
  public:
   explicit EcdhPsiV2Handler(std::shared_ptr<EcdhPsiContext> ctx);
 
@@ -43,6 +49,9 @@ class EcdhPsiV2Handler : public AlgoV2Handler {
 
   void RunAlgo() override;
 
+  bool ResumeHandshake(const std::vector<HandshakeRequestV2> &requests,
+                       const HandshakeResponseV2 &response) override;
+
   status::ErrorStatus NegotiateHandshakeParams(
       const std::vector<HandshakeRequestV2> &) override;
 
@@ -58,16 +67,43 @@ class EcdhPsiV2Handler : public AlgoV2Handler {
       const std::vector<org::interconnection::v2::protocol::EccProtocolProposal>
           &ecc_params);
 
+  void NegotiateWireFormat(
+      const std::vector<org::interconnection::v2::protocol::EccProtocolProposal>
+          &ecc_params);
+
   bool NegotiateResultToRank(
       const std::vector<org::interconnection::v2::algos::PsiDataIoProposal>
           &io_params);
 
+  bool NegotiateCompactResult(
+      const std::vector<org::interconnection::v2::algos::PsiDataIoProposal>
+          &io_params);
+
+  status::ErrorStatus NegotiateLabeledMode(
+      const std::vector<HandshakeRequestV2> &requests,
+      const std::vector<org::interconnection::v2::algos::PsiDataIoProposal>
+          &io_params);
+
+  void NegotiateIncrementalMode(
+      const std::vector<org::interconnection::v2::algos::PsiDataIoProposal>
+          &io_params);
+
   status::ErrorStatus NegotiateEccParams(
       const std::vector<HandshakeRequestV2> &requests);
 
   status::ErrorStatus NegotiatePsiIoParams(
       const std::vector<HandshakeRequestV2> &requests);
 
+  // Run the PSI and return the indices of the intersected input rows, which
+  // are only valid on the ranks that get the result
+  std::vector<uint64_t> RunPsi();
+
+  void RunLabeledPsi();
+
+  void SendCompactResult(const std::vector<uint64_t> &indices);
+
+  std::vector<uint64_t> RecvCompactResult();
+
   std::shared_ptr<EcdhPsiContext> ctx_;
 
   std::unique_ptr<::psi::BucketPsi> bucket_psi_;
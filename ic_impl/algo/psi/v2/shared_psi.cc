@@ -0,0 +1,364 @@
+// Copyright 2024 Ant Group Co., Ltd.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "ic_impl/algo/psi/v2/shared_psi.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+
+#include "absl/strings/numbers.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_join.h"
+#include "absl/strings/str_split.h"
+#include "spdlog/spdlog.h"
+#include "yacl/base/exception.h"
+#include "yacl/crypto/hash/hash_utils.h"
+#include "yacl/crypto/rand/rand.h"
+#include "yacl/crypto/tools/prg.h"
+
+#include "ic_impl/algo/psi/v2/okvs.h"
+#include "ic_impl/protocol_family/ecc/ec_cipher.h"
+
+namespace ic_impl::algo::psi::v2 {
+
+namespace {
+
+constexpr size_t kBatchSize = 4096;
+
+constexpr size_t kCuckooHashNum = 3;
+
+// bins / items of the cuckoo table
+constexpr double kCuckooScale = 1.27;
+
+constexpr uint64_t kCuckooMinBins = 16;
+
+constexpr int kCuckooMaxKicks = 512;
+
+constexpr int kCuckooMaxTries = 16;
+
+constexpr size_t kOkvsChunkCells = size_t{1} << 20;
+
+constexpr char kOkvsKeyDomain[] = "ic_impl.shared_psi.okvs_key";
+
+using Bins = std::array<uint64_t, kCuckooHashNum>;
+
+Bins CandidateBins(std::string_view item, uint64_t seed, uint64_t bin_num) {
+  auto digest = yacl::crypto::Sha256(absl::StrCat(seed, ":", item));
+  Bins bins;
+  for (size_t i = 0; i < bins.size(); ++i) {
+    uint64_t value;
+    std::memcpy(&value, digest.data() + i * sizeof(value), sizeof(value));
+    bins[i] = value % bin_num;
+  }
+  return bins;
+}
+
+// The input of the PRF for an item placed in a bin
+std::string BinnedItem(std::string_view item, uint64_t bin) {
+  return absl::StrCat(item, "#", bin);
+}
+
+uint128_t OkvsKey(const std::string &prf) {
+  auto digest = yacl::crypto::Sha256(absl::StrCat(kOkvsKeyDomain, prf));
+  uint128_t key;
+  std::memcpy(&key, digest.data(), sizeof(key));
+  return key;
+}
+
+// Place each item into one of its candidate bins; return the item index of
+// each bin, -1 if empty
+std::vector<int64_t> BuildCuckooTable(const std::vector<std::string> &items,
+                                      uint64_t seed, uint64_t bin_num) {
+  std::vector<int64_t> table(bin_num, -1);
+  std::vector<Bins> candidates(items.size());
+  for (size_t i = 0; i < items.size(); ++i) {
+    candidates[i] = CandidateBins(items[i], seed, bin_num);
+  }
+
+  yacl::crypto::Prg<uint64_t> prg(yacl::crypto::SecureRandSeed());
+  for (size_t i = 0; i < items.size(); ++i) {
+    int64_t item = i;
+    for (int kicks = 0; item != -1; ++kicks) {
+      if (kicks > kCuckooMaxKicks) {
+        return {};
+      }
+      const auto &bins = candidates[item];
+      auto empty = std::find_if(bins.begin(), bins.end(), [&](uint64_t bin) {
+        return table[bin] == -1;
+      });
+      uint64_t bin = empty != bins.end() ? *empty : bins[prg() % bins.size()];
+      std::swap(table[bin], item);
+    }
+  }
+
+  return table;
+}
+
+std::string BatchTag(std::string_view name, size_t batch) {
+  return absl::StrCat("shared_psi_", name, "_", batch);
+}
+
+size_t NumBatches(size_t item_num, size_t batch_size) {
+  return (item_num + batch_size - 1) / batch_size;
+}
+
+std::string PackPoints(const std::vector<std::string> &points) {
+  return absl::StrJoin(points, "");
+}
+
+std::vector<std::string> UnpackPoints(const yacl::Buffer &buf,
+                                      size_t point_size) {
+  YACL_ENFORCE(buf.size() % point_size == 0,
+               "shared psi: invalid point batch size {}", buf.size());
+  std::vector<std::string> points(buf.size() / point_size);
+  for (size_t i = 0; i < points.size(); ++i) {
+    points[i].assign(buf.data<char>() + i * point_size, point_size);
+  }
+  return points;
+}
+
+yacl::Buffer PackWords(const uint64_t *words, size_t count) {
+  yacl::Buffer buf(count * sizeof(uint64_t));
+  std::memcpy(buf.data(), words, buf.size());
+  return buf;
+}
+
+std::vector<uint64_t> UnpackWords(const yacl::Buffer &buf) {
+  YACL_ENFORCE(buf.size() % sizeof(uint64_t) == 0,
+               "shared psi: invalid message size {}", buf.size());
+  std::vector<uint64_t> words(buf.size() / sizeof(uint64_t));
+  std::memcpy(words.data(), buf.data(), buf.size());
+  return words;
+}
+
+uint64_t EncodeFixedPoint(std::string_view value, int32_t fxp_bits) {
+  double number;
+  YACL_ENFORCE(absl::SimpleAtod(value, &number), "invalid payload value `{}`",
+               value);
+  return static_cast<uint64_t>(
+      static_cast<int64_t>(std::llround(std::ldexp(number, fxp_bits))));
+}
+
+}  // namespace
+
+SharedPsi::SharedPsi(std::shared_ptr<EcdhPsiContext> ctx,
+                     int32_t receiver_rank)
+    : ctx_(std::move(ctx)), receiver_rank_(receiver_rank) {
+  YACL_ENFORCE(ctx_->ic_ctx->lctx->WorldSize() == 2,
+               "shared psi only supports two parties");
+}
+
+SharedPsiResult SharedPsi::Run(const std::vector<std::string> &payload_fields,
+                               int32_t fxp_bits) {
+  if (static_cast<int32_t>(ctx_->ic_ctx->lctx->Rank()) == receiver_rank_) {
+    return RunReceiver();
+  }
+  return RunSender(payload_fields, fxp_bits);
+}
+
+size_t SharedPsi::PeerRank() const { return 1 - ctx_->ic_ctx->lctx->Rank(); }
+
+SharedPsiResult SharedPsi::RunReceiver() {
+  auto lctx = ctx_->ic_ctx->lctx;
+  protocol_family::ecc::EcCipher cipher(ctx_->curve_type);
+
+  auto keys = ReadInputKeys(*ctx_);
+  YACL_ENFORCE(keys.size() == static_cast<size_t>(ctx_->item_num));
+  // equal items would compete for the same bins forever
+  CheckUniqueKeys(*ctx_, keys);
+
+  SharedPsiResult result;
+  auto bin_num = static_cast<uint64_t>(std::ceil(keys.size() * kCuckooScale));
+  result.row_num = std::max(kCuckooMinBins, bin_num);
+  uint64_t seed = 0;
+  for (int tries = 0; result.row_indices.empty(); ++tries) {
+    YACL_ENFORCE(tries < kCuckooMaxTries,
+                 "shared psi: building the cuckoo table failed");
+    seed = yacl::crypto::SecureRandU64();
+    result.row_indices = BuildCuckooTable(keys, seed, result.row_num);
+  }
+
+  std::array<uint64_t, 3> params{seed, result.row_num, keys.size()};
+  lctx->SendAsync(PeerRank(), PackWords(params.data(), params.size()),
+                  "shared_psi_params");
+
+  // evaluate the PRF on the occupied bins through blinding
+  std::vector<uint64_t> occupied;
+  std::vector<std::string> binned_items;
+  occupied.reserve(keys.size());
+  binned_items.reserve(keys.size());
+  for (uint64_t bin = 0; bin < result.row_num; ++bin) {
+    if (result.row_indices[bin] != -1) {
+      occupied.push_back(bin);
+      binned_items.push_back(BinnedItem(keys[result.row_indices[bin]], bin));
+    }
+  }
+  for (size_t batch = 0; batch < NumBatches(occupied.size(), kBatchSize);
+       ++batch) {
+    size_t begin = batch * kBatchSize;
+    size_t end = std::min(begin + kBatchSize, occupied.size());
+    std::vector<std::string> items(binned_items.begin() + begin,
+                                   binned_items.begin() + end);
+    lctx->SendAsync(PeerRank(), PackPoints(cipher.HashAndMask(items)),
+                    BatchTag("blinded", batch));
+  }
+  std::vector<uint128_t> okvs_keys;
+  okvs_keys.reserve(occupied.size());
+  for (size_t batch = 0; batch < NumBatches(occupied.size(), kBatchSize);
+       ++batch) {
+    auto buf = lctx->Recv(PeerRank(), BatchTag("masked", batch));
+    for (const auto &prf :
+         cipher.Unmask(UnpackPoints(buf, cipher.PointSize()))) {
+      okvs_keys.push_back(OkvsKey(prf));
+    }
+  }
+  YACL_ENFORCE(okvs_keys.size() == occupied.size());
+
+  Okvs okvs;
+  auto okvs_params = UnpackWords(lctx->Recv(PeerRank(), "shared_psi_okvs"));
+  YACL_ENFORCE(okvs_params.size() == 3 && okvs_params[2] > 0);
+  okvs.seed = okvs_params[0];
+  okvs.size = okvs_params[1];
+  okvs.cols = okvs_params[2];
+  okvs.cells.reserve(okvs.size * okvs.cols);
+  for (size_t chunk = 0;
+       chunk < NumBatches(okvs.size * okvs.cols, kOkvsChunkCells); ++chunk) {
+    auto cells = UnpackWords(lctx->Recv(PeerRank(), BatchTag("okvs", chunk)));
+    okvs.cells.insert(okvs.cells.end(), cells.begin(), cells.end());
+  }
+  YACL_ENFORCE(okvs.cells.size() == okvs.size * okvs.cols);
+
+  // the first value is the match target, the others the payload
+  result.payload_cols = okvs.cols - 1;
+  result.match_shares.resize(result.row_num);
+  result.payload_shares.resize(result.row_num * result.payload_cols);
+  yacl::crypto::Prg<uint64_t> prg(yacl::crypto::SecureRandSeed());
+  for (auto &share : result.match_shares) {
+    share = prg();
+  }
+  std::vector<uint64_t> values(okvs.cols);
+  for (size_t i = 0; i < occupied.size(); ++i) {
+    DecodeOkvs(okvs, okvs_keys[i], values.data());
+    result.match_shares[occupied[i]] = values[0];
+    std::copy(values.begin() + 1, values.end(),
+              result.payload_shares.begin() +
+                  occupied[i] * result.payload_cols);
+  }
+
+  SPDLOG_INFO("rank:{} shared psi rows:{} items:{} payload_cols:{}",
+              lctx->Rank(), result.row_num, keys.size(), result.payload_cols);
+
+  return result;
+}
+
+SharedPsiResult SharedPsi::RunSender(
+    const std::vector<std::string> &payload_fields, int32_t fxp_bits) {
+  auto lctx = ctx_->ic_ctx->lctx;
+  protocol_family::ecc::EcCipher cipher(ctx_->curve_type);
+
+  auto params = UnpackWords(lctx->Recv(PeerRank(), "shared_psi_params"));
+  YACL_ENFORCE(params.size() == 3);
+  uint64_t seed = params[0];
+  uint64_t peer_item_num = params[2];
+
+  SharedPsiResult result;
+  result.row_num = params[1];
+  result.payload_cols = payload_fields.size();
+
+  // evaluate the PRF on the blinded items of the receiver
+  for (size_t batch = 0; batch < NumBatches(peer_item_num, kBatchSize);
+       ++batch) {
+    auto buf = lctx->Recv(PeerRank(), BatchTag("blinded", batch));
+    auto masked = cipher.Mask(UnpackPoints(buf, cipher.PointSize()));
+    lctx->SendAsync(PeerRank(), PackPoints(masked), BatchTag("masked", batch));
+  }
+
+  // random target and payload masks per bin; the negation is the own share
+  int32_t cols = result.payload_cols + 1;
+  yacl::crypto::Prg<uint64_t> prg(yacl::crypto::SecureRandSeed());
+  std::vector<uint64_t> masks(result.row_num * cols);
+  for (auto &mask : masks) {
+    mask = prg();
+  }
+  result.match_shares.resize(result.row_num);
+  result.payload_shares.resize(result.row_num * result.payload_cols);
+  for (uint64_t bin = 0; bin < result.row_num; ++bin) {
+    result.match_shares[bin] = -masks[bin * cols];
+    for (int32_t c = 0; c < result.payload_cols; ++c) {
+      result.payload_shares[bin * result.payload_cols + c] =
+          -masks[bin * cols + 1 + c];
+    }
+  }
+
+  // program the store at every candidate bin of the own items
+  auto keys = ReadInputKeys(*ctx_);
+  auto payloads = ReadInputFields(*ctx_, payload_fields);
+  YACL_ENFORCE(keys.size() == payloads.size());
+  // equal items would make equal okvs keys, which never peel
+  CheckUniqueKeys(*ctx_, keys);
+  std::vector<std::string> binned_items;
+  std::vector<uint64_t> values;
+  binned_items.reserve(keys.size() * kCuckooHashNum);
+  values.reserve(keys.size() * kCuckooHashNum * cols);
+  for (size_t i = 0; i < keys.size(); ++i) {
+    std::vector<uint64_t> encoded;
+    for (auto value : absl::StrSplit(payloads[i], ',')) {
+      encoded.push_back(EncodeFixedPoint(value, fxp_bits));
+    }
+    YACL_ENFORCE(encoded.size() == payload_fields.size());
+
+    auto bins = CandidateBins(keys[i], seed, result.row_num);
+    for (size_t j = 0; j < bins.size(); ++j) {
+      if (std::find(bins.begin(), bins.begin() + j, bins[j]) !=
+          bins.begin() + j) {
+        continue;
+      }
+      binned_items.push_back(BinnedItem(keys[i], bins[j]));
+      values.push_back(masks[bins[j] * cols]);
+      for (int32_t c = 0; c < result.payload_cols; ++c) {
+        values.push_back(encoded[c] + masks[bins[j] * cols + 1 + c]);
+      }
+    }
+  }
+
+  std::vector<uint128_t> okvs_keys;
+  okvs_keys.reserve(binned_items.size());
+  for (const auto &prf : cipher.HashAndMask(binned_items)) {
+    okvs_keys.push_back(OkvsKey(prf));
+  }
+  auto okvs = EncodeOkvs(okvs_keys, values, cols);
+
+  std::array<uint64_t, 3> okvs_params{okvs.seed, okvs.size,
+                                      static_cast<uint64_t>(okvs.cols)};
+  lctx->SendAsync(PeerRank(),
+                  PackWords(okvs_params.data(), okvs_params.size()),
+                  "shared_psi_okvs");
+  for (size_t chunk = 0;
+       chunk < NumBatches(okvs.cells.size(), kOkvsChunkCells); ++chunk) {
+    size_t begin = chunk * kOkvsChunkCells;
+    size_t end = std::min(begin + kOkvsChunkCells, okvs.cells.size());
+    lctx->SendAsync(PeerRank(),
+                    PackWords(okvs.cells.data() + begin, end - begin),
+                    BatchTag("okvs", chunk));
+  }
+
+  SPDLOG_INFO("rank:{} shared psi rows:{} items:{} payload_cols:{}",
+              lctx->Rank(), result.row_num, keys.size(), result.payload_cols);
+
+  return result;
+}
+
+}  // namespace ic_impl::algo::psi::v2
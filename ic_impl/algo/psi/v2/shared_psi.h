@@ -0,0 +1,74 @@
+// Copyright 2024 Ant Group Co., Ltd.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "ic_impl/algo/psi/v2/psi_context_v2.h"
+
+namespace ic_impl::algo::psi::v2 {
+
+// Output of SharedPsi. The rows are the bins of the cuckoo table of the
+// receiver, which is the order both parties share; which of them are in the
+// intersection is only known in secret-shared form.
+struct SharedPsiResult {
+  uint64_t row_num = 0;
+  // the input row of the receiver in each bin, -1 for empty bins; empty on
+  // the sender
+  std::vector<int64_t> row_indices;
+  // additive shares in Z_2^64 of a value which is zero iff the row is in the
+  // intersection
+  std::vector<uint64_t> match_shares;
+  // additive shares in Z_2^64 of the fixed-point encoded payload of the
+  // sender, row_num x payload_cols, row major; garbage on the other rows
+  int32_t payload_cols = 0;
+  std::vector<uint64_t> payload_shares;
+};
+
+// Circuit-PSI style ECDH-PSI between two parties whose result stays secret
+// shared.
+//
+// The receiver places its items into a cuckoo table and gets
+// F_s(x || bin) = s * H(x || bin) for each of them through blinding. The
+// sender programs an oblivious key-value store with F_s(y || bin) for each
+// candidate bin of its items, mapping to a random per-bin target and the
+// payload masked by per-bin randomness. Decoding the store at its own keys
+// gives the receiver one share of each bin, the sender keeps the negated
+// randomness as the other; neither learns which bins match.
+class SharedPsi {
+ public:
+  SharedPsi(std::shared_ptr<EcdhPsiContext> ctx, int32_t receiver_rank);
+
+  // `payload_fields` are the fields of the sender shared along with the
+  // result, encoded with `fxp_bits` fraction bits; ignored on the receiver
+  SharedPsiResult Run(const std::vector<std::string> &payload_fields,
+                      int32_t fxp_bits);
+
+ private:
+  SharedPsiResult RunSender(const std::vector<std::string> &payload_fields,
+                            int32_t fxp_bits);
+
+  SharedPsiResult RunReceiver();
+
+  size_t PeerRank() const;
+
+  std::shared_ptr<EcdhPsiContext> ctx_;
+
+  int32_t receiver_rank_;
+};
+
+}  // namespace ic_impl::algo::psi::v2
@@ -0,0 +1,85 @@
+// Copyright 2024 Ant Group Co., Ltd.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "ic_impl/algo/psi_lr/psi_lr_context.h"
+
+#include <algorithm>
+
+#include "gflags/gflags.h"
+
+#include "ic_impl/util.h"
+
+#include "interconnection/handshake/entry.pb.h"
+
+DEFINE_bool(shared_psi_output, false,
+            "keep the intersection secret shared when running ECDH-PSI "
+            "followed by SS-LR");
+
+DECLARE_bool(disable_handshake);
+
+namespace ic_impl::algo::psi_lr {
+
+using org::interconnection::v2::ALGO_TYPE_ECDH_PSI;
+using org::interconnection::v2::ALGO_TYPE_SS_LR;
+using org::interconnection::v2::PROTOCOL_FAMILY_ECC;
+using org::interconnection::v2::PROTOCOL_FAMILY_SS;
+
+namespace {
+
+std::shared_ptr<IcContext> CreateAlgoIcContext(const IcContext &ic_ctx,
+                                               int32_t algo,
+                                               int32_t protocol_family) {
+  const auto &families = ic_ctx.protocol_families;
+  YACL_ENFORCE(
+      std::find(families.begin(), families.end(), protocol_family) !=
+          families.end(),
+      "protocol family {} is required by algo {}", protocol_family, algo);
+
+  auto ctx = std::make_shared<IcContext>(ic_ctx);
+  ctx->algo = algo;
+  ctx->algos = {algo};
+  ctx->protocol_families = {protocol_family};
+
+  return ctx;
+}
+
+bool SuggestedSharedPsiOutput() {
+  // the shared output is agreed on through the handshake
+  return !util::GetParamEnv("disable_handshake", FLAGS_disable_handshake) &&
+         util::GetParamEnv("shared_psi_output", FLAGS_shared_psi_output);
+}
+
+}  // namespace
+
+std::shared_ptr<PsiLrContext> CreatePsiLrContext(
+    std::shared_ptr<IcContext> ic_ctx) {
+  auto ctx = std::make_shared<PsiLrContext>();
+
+  ctx->psi_ctx = psi::v2::CreateEcdhPsiContext(
+      CreateAlgoIcContext(*ic_ctx, ALGO_TYPE_ECDH_PSI, PROTOCOL_FAMILY_ECC));
+  // every party trains on the intersection
+  ctx->psi_ctx->result_to_rank = -1;
+  ctx->psi_ctx->payload_fields.clear();
+
+  ctx->lr_ctx = lr::CreateLrContext(
+      CreateAlgoIcContext(*ic_ctx, ALGO_TYPE_SS_LR, PROTOCOL_FAMILY_SS));
+
+  ctx->shared_psi_output = SuggestedSharedPsiOutput();
+
+  ctx->ic_ctx = std::move(ic_ctx);
+
+  return ctx;
+}
+
+}  // namespace ic_impl::algo::psi_lr
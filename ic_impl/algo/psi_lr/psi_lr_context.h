@@ -0,0 +1,38 @@
+// Copyright 2024 Ant Group Co., Ltd.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include "ic_impl/algo/lr/lr_context.h"
+#include "ic_impl/algo/psi/v2/psi_context_v2.h"
+
+namespace ic_impl::algo::psi_lr {
+
+// ECDH-PSI followed by SS-LR on the intersection. Each algorithm sees the job
+// through its own IcContext, which shares the link with the others.
+struct PsiLrContext {
+  std::shared_ptr<psi::v2::EcdhPsiContext> psi_ctx;
+
+  std::shared_ptr<lr::LrContext> lr_ctx;
+
+  // whether the intersection is handed over in secret-shared form instead
+  // of being revealed to every party
+  bool shared_psi_output;
+
+  std::shared_ptr<IcContext> ic_ctx;
+};
+
+std::shared_ptr<PsiLrContext> CreatePsiLrContext(std::shared_ptr<IcContext>);
+
+}  // namespace ic_impl::algo::psi_lr
@@ -0,0 +1,324 @@
+// Copyright 2024 Ant Group Co., Ltd.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "ic_impl/algo/psi_lr/psi_lr_handler.h"
+
+#include <algorithm>
+
+#include "absl/strings/numbers.h"
+#include "absl/strings/str_split.h"
+#include "gflags/gflags.h"
+#include "spdlog/spdlog.h"
+#include "xtensor/xbuilder.hpp"
+
+#include "ic_impl/algo/psi/v2/shared_psi.h"
+#include "ic_impl/proto/handshake_ext.pb.h"
+#include "ic_impl/proto/wire_format.pb.h"
+#include "ic_impl/protocol_family/ecc/ec_cipher.h"
+
+DECLARE_bool(disable_handshake);
+
+namespace ic_impl::algo::psi_lr {
+
+using org::interconnection::v2::ALGO_TYPE_ECDH_PSI;
+using org::interconnection::v2::ALGO_TYPE_SS_LR;
+
+using org::interconnection::v2::protocol::FIELD_TYPE_64;
+using org::interconnection::v2::protocol::PROTOCOL_KIND_SEMI2K;
+
+using ic_impl::proto::CompositeHandshakeExt;
+
+namespace {
+
+// the party which places its items into the cuckoo table
+constexpr int32_t kSharedPsiReceiverRank = 0;
+
+void ParseFeatures(const std::string &row,
+                   const std::vector<std::string> &fields, float *out) {
+  std::vector<std::string_view> values = absl::StrSplit(row, ',');
+  YACL_ENFORCE(values.size() == fields.size());
+  for (size_t j = 0; j < values.size(); ++j) {
+    YACL_ENFORCE(absl::SimpleAtof(values[j], out + j),
+                 "invalid value `{}` of field {}", values[j], fields[j]);
+  }
+}
+
+// The link carries both algorithms, which negotiate the wire format on
+// their own
+int32_t CombineWireFormats(const IcContext &psi_ctx, const IcContext &lr_ctx) {
+  if (psi_ctx.wire_format != lr_ctx.wire_format) {
+    return ic_impl::proto::WIRE_FORMAT_RAW;
+  }
+  return psi_ctx.wire_format;
+}
+
+}  // namespace
+
+PsiLrHandler::PsiLrHandler(std::shared_ptr<PsiLrContext> ctx)
+    : AlgoV2Handler(ctx->ic_ctx),
+      ctx_(std::move(ctx)),
+      psi_handler_(std::make_unique<psi::v2::EcdhPsiV2Handler>(ctx_->psi_ctx)),
+      lr_handler_(std::make_unique<lr::LrHandler>(ctx_->lr_ctx)) {}
+
+PsiLrHandler::~PsiLrHandler() = default;
+
+bool PsiLrHandler::PrepareDataset() {
+  if (!psi_handler_->PrepareDataset()) {
+    return false;
+  }
+
+  feature_fields_ = psi::v2::ReadUnselectedFields(*ctx_->psi_ctx);
+
+  auto &lr_ctx = *ctx_->lr_ctx;
+  int32_t feature_num = lr_ctx.HasLabel() ? feature_fields_.size() - 1
+                                          : feature_fields_.size();
+  // the sample size is the intersection size, known after the PSI
+  lr_ctx.io_param.sample_size = 0;
+  auto self_rank = ctx_->ic_ctx->lctx->Rank();
+
+  if (util::GetParamEnv("disable_handshake", FLAGS_disable_handshake)) {
+    YACL_ENFORCE(lr_ctx.io_param.feature_nums.at(self_rank) == feature_num);
+  } else {
+    YACL_ENFORCE(feature_num > 0);
+    lr_ctx.io_param.feature_nums.resize(ctx_->ic_ctx->lctx->WorldSize());
+    lr_ctx.io_param.feature_nums.at(self_rank) = feature_num;
+  }
+
+  return true;
+}
+
+HandshakeRequestV2 PsiLrHandler::BuildHandshakeRequest() {
+  auto request = psi_handler_->BuildHandshakeRequest();
+  auto lr_request = lr_handler_->BuildHandshakeRequest();
+
+  // algos are paired with algo_params by position and the PSI has no algo
+  // params, so SS-LR is listed first
+  YACL_ENFORCE(request.algo_params().empty());
+  request.clear_supported_algos();
+  request.mutable_supported_algos()->MergeFrom(lr_request.supported_algos());
+  request.add_supported_algos(ALGO_TYPE_ECDH_PSI);
+  request.mutable_algo_params()->MergeFrom(lr_request.algo_params());
+
+  request.mutable_ops()->MergeFrom(lr_request.ops());
+  request.mutable_op_params()->MergeFrom(lr_request.op_params());
+  request.mutable_protocol_families()->MergeFrom(
+      lr_request.protocol_families());
+  request.mutable_protocol_family_params()->MergeFrom(
+      lr_request.protocol_family_params());
+
+  CompositeHandshakeExt ext;
+  ext.set_algo(ALGO_TYPE_SS_LR);
+  *ext.mutable_io_param() = lr_request.io_param();
+  ext.set_shared_psi_output(ctx_->shared_psi_output);
+  util::SetVendorExt(&request, ext);
+
+  return request;
+}
+
+status::ErrorStatus PsiLrHandler::NegotiateHandshakeParams(
+    const std::vector<HandshakeRequestV2> &requests) {
+  std::vector<HandshakeRequestV2> lr_requests;
+  for (const auto &request : requests) {
+    auto ext = util::GetVendorExt<CompositeHandshakeExt>(request);
+    if (!ext.has_value() || ext->algo() != ALGO_TYPE_SS_LR) {
+      return status::InvalidRequestError("certain request has no ss lr params");
+    }
+
+    lr_requests.push_back(request);
+    *lr_requests.back().mutable_io_param() = ext->io_param();
+  }
+
+  auto status = psi_handler_->NegotiateHandshakeParams(requests);
+  if (!status.ok()) {
+    return status;
+  }
+
+  status = lr_handler_->NegotiateHandshakeParams(lr_requests);
+  if (!status.ok()) {
+    return status;
+  }
+
+  ctx_->ic_ctx->wire_format = CombineWireFormats(*ctx_->psi_ctx->ic_ctx,
+                                                 *ctx_->lr_ctx->ic_ctx);
+
+  return NegotiateSharedPsiOutput(requests);
+}
+
+status::ErrorStatus PsiLrHandler::NegotiateSharedPsiOutput(
+    const std::vector<HandshakeRequestV2> &requests) {
+  // falling back to the revealed intersection would disclose what a party
+  // asked to keep secret, so every party has to agree
+  for (const auto &request : requests) {
+    auto ext = util::GetVendorExt<CompositeHandshakeExt>(request);
+    if (ext->shared_psi_output() != ctx_->shared_psi_output) {
+      return status::HandshakeRefusedError(
+          "parties disagree on the shared psi output");
+    }
+  }
+
+  if (!ctx_->shared_psi_output) {
+    return status::OkStatus();
+  }
+
+  if (ctx_->ic_ctx->lctx->WorldSize() != 2) {
+    return status::UnsupportedArgumentError(
+        "shared psi output only supports two parties");
+  }
+
+  if (!protocol_family::ecc::IsEcCipherSupported(ctx_->psi_ctx->curve_type)) {
+    return status::UnsupportedArgumentError(
+        "shared psi output is unsupported with the negotiated curve");
+  }
+
+  const auto &ss_param = ctx_->lr_ctx->ss_param;
+  if (ss_param.protocol != PROTOCOL_KIND_SEMI2K ||
+      ss_param.field_type != FIELD_TYPE_64) {
+    return status::UnsupportedArgumentError(
+        "shared psi output requires semi2k over a 64-bit field");
+  }
+
+  return status::OkStatus();
+}
+
+HandshakeResponseV2 PsiLrHandler::BuildHandshakeResponse() {
+  auto response = psi_handler_->BuildHandshakeResponse();
+  auto lr_response = lr_handler_->BuildHandshakeResponse();
+
+  response.mutable_ops()->MergeFrom(lr_response.ops());
+  response.mutable_op_params()->MergeFrom(lr_response.op_params());
+  response.mutable_protocol_families()->MergeFrom(
+      lr_response.protocol_families());
+  response.mutable_protocol_family_params()->MergeFrom(
+      lr_response.protocol_family_params());
+
+  CompositeHandshakeExt ext;
+  ext.set_algo(lr_response.algo());
+  *ext.mutable_algo_param() = lr_response.algo_param();
+  *ext.mutable_io_param() = lr_response.io_param();
+  ext.set_shared_psi_output(ctx_->shared_psi_output);
+  util::SetVendorExt(&response, ext);
+
+  return response;
+}
+
+bool PsiLrHandler::ProcessHandshakeResponse(
+    const HandshakeResponseV2 &response) {
+  if (!AlgoV2Handler::ProcessHandshakeResponse(response)) {
+    return false;
+  }
+
+  auto ext = util::GetVendorExt<CompositeHandshakeExt>(response);
+  YACL_ENFORCE(ext.has_value() && ext->algo() == ALGO_TYPE_SS_LR,
+               "handshake response has no ss lr params");
+  YACL_ENFORCE(ext->shared_psi_output() == ctx_->shared_psi_output,
+               "parties disagree on the shared psi output");
+
+  HandshakeResponseV2 lr_response = response;
+  lr_response.set_algo(ext->algo());
+  *lr_response.mutable_algo_param() = ext->algo_param();
+  *lr_response.mutable_io_param() = ext->io_param();
+
+  if (!psi_handler_->ProcessHandshakeResponse(response) ||
+      !lr_handler_->ProcessHandshakeResponse(lr_response)) {
+    return false;
+  }
+
+  ctx_->ic_ctx->wire_format = CombineWireFormats(*ctx_->psi_ctx->ic_ctx,
+                                                 *ctx_->lr_ctx->ic_ctx);
+  return true;
+}
+
+void PsiLrHandler::RunAlgo() {
+  if (ctx_->shared_psi_output) {
+    RunSharedPsiLr();
+    return;
+  }
+
+  // the rows are aligned by key, which must name one sample each
+  psi::v2::CheckUniqueKeys(*ctx_->psi_ctx,
+                           psi::v2::ReadInputKeys(*ctx_->psi_ctx));
+  auto indices = psi_handler_->RunPsi();
+  SPDLOG_INFO("rank:{} original_count:{} intersection_count:{}",
+              ctx_->ic_ctx->lctx->Rank(), ctx_->psi_ctx->item_num,
+              indices.size());
+
+  lr_handler_->SetDataset(ReadAlignedDataset(indices));
+  lr_handler_->RunAlgo();
+}
+
+void PsiLrHandler::RunSharedPsiLr() {
+  psi::v2::SharedPsi shared_psi(ctx_->psi_ctx, kSharedPsiReceiverRank);
+  auto result =
+      shared_psi.Run(feature_fields_, ctx_->lr_ctx->ss_param.fxp_bits);
+
+  auto dataset = std::make_unique<lr::SharedDataset>();
+  dataset->row_num = result.row_num;
+  dataset->shared_rank = 1 - kSharedPsiReceiverRank;
+  dataset->shared_col_num = result.payload_cols;
+  dataset->shared_columns = std::move(result.payload_shares);
+  dataset->match_shares = std::move(result.match_shares);
+  if (static_cast<int32_t>(ctx_->ic_ctx->lctx->Rank()) ==
+      kSharedPsiReceiverRank) {
+    dataset->plain_columns = ReadBinnedDataset(result.row_indices);
+  }
+
+  lr_handler_->SetSharedDataset(std::move(dataset));
+  lr_handler_->RunAlgo();
+}
+
+std::unique_ptr<xt::xarray<float>> PsiLrHandler::ReadAlignedDataset(
+    const std::vector<uint64_t> &indices) {
+  const auto &psi_ctx = *ctx_->psi_ctx;
+  auto keys = psi::v2::ReadInputKeys(psi_ctx);
+  auto rows = psi::v2::ReadInputFields(psi_ctx, feature_fields_);
+
+  std::vector<uint64_t> order = indices;
+  for (auto index : order) {
+    YACL_ENFORCE(index < keys.size(), "invalid intersection index {}", index);
+  }
+  // ties only break the same way on every party if the keys are unique,
+  // but keep the order deterministic anyway
+  std::sort(order.begin(), order.end(), [&keys](uint64_t lhs, uint64_t rhs) {
+    return keys[lhs] != keys[rhs] ? keys[lhs] < keys[rhs] : lhs < rhs;
+  });
+
+  auto dataset = std::make_unique<xt::xarray<float>>(
+      xt::xarray<float>::from_shape({order.size(), feature_fields_.size()}));
+  for (size_t i = 0; i < order.size(); ++i) {
+    ParseFeatures(rows[order[i]], feature_fields_, &(*dataset)(i, 0));
+  }
+
+  return dataset;
+}
+
+xt::xarray<float> PsiLrHandler::ReadBinnedDataset(
+    const std::vector<int64_t> &row_indices) {
+  auto rows = psi::v2::ReadInputFields(*ctx_->psi_ctx, feature_fields_);
+
+  xt::xarray<float> dataset = xt::zeros<float>(
+      std::vector<size_t>{row_indices.size(), feature_fields_.size()});
+  for (size_t bin = 0; bin < row_indices.size(); ++bin) {
+    int64_t index = row_indices[bin];
+    if (index == -1) {
+      continue;
+    }
+    YACL_ENFORCE(static_cast<size_t>(index) < rows.size(),
+                 "invalid bin row index {}", index);
+    ParseFeatures(rows[index], feature_fields_, &dataset(bin, 0));
+  }
+
+  return dataset;
+}
+
+}  // namespace ic_impl::algo::psi_lr
@@ -0,0 +1,72 @@
+// Copyright 2024 Ant Group Co., Ltd.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include "xtensor/xarray.hpp"
+
+#include "ic_impl/algo/lr/lr_handler.h"
+#include "ic_impl/algo/psi/v2/psi_handler_v2.h"
+#include "ic_impl/algo/psi_lr/psi_lr_context.h"
+#include "ic_impl/handler.h"
+
+namespace ic_impl::algo::psi_lr {
+
+// Runs ECDH-PSI and trains SS-LR on the intersected rows in the same job. The
+// parameters of both algorithms are negotiated in a single handshake and the
+// intersection is handed over in memory.
+class PsiLrHandler : public AlgoV2Handler {
+ public:
+  explicit PsiLrHandler(std::shared_ptr<PsiLrContext> ctx);
+
+  ~PsiLrHandler() override;
+
+ private:
+  bool ProcessHandshakeResponse(const HandshakeResponseV2 &) override;
+
+  HandshakeRequestV2 BuildHandshakeRequest() override;
+
+  HandshakeResponseV2 BuildHandshakeResponse() override;
+
+  bool PrepareDataset() override;
+
+  void RunAlgo() override;
+
+  status::ErrorStatus NegotiateHandshakeParams(
+      const std::vector<HandshakeRequestV2> &) override;
+
+  status::ErrorStatus NegotiateSharedPsiOutput(
+      const std::vector<HandshakeRequestV2> &);
+
+  void RunSharedPsiLr();
+
+  // Read the unselected columns of the intersected rows, ordered by key so
+  // that every party gets the samples in the same order
+  std::unique_ptr<xt::xarray<float>> ReadAlignedDataset(
+      const std::vector<uint64_t> &indices);
+
+  // Read the unselected columns of the rows in each bin of the shared PSI,
+  // zero for empty bins
+  xt::xarray<float> ReadBinnedDataset(const std::vector<int64_t> &row_indices);
+
+  std::shared_ptr<PsiLrContext> ctx_;
+
+  std::unique_ptr<psi::v2::EcdhPsiV2Handler> psi_handler_;
+
+  std::unique_ptr<lr::LrHandler> lr_handler_;
+
+  std::vector<std::string> feature_fields_;
+};
+
+}  // namespace ic_impl::algo::psi_lr
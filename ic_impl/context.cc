@@ -14,8 +14,12 @@
 
 #include "ic_impl/context.h"
 
+#include "absl/strings/str_split.h"
 #include "gflags/gflags.h"
+#include "spdlog/spdlog.h"
 
+#include "ic_impl/proto/vendor_types.pb.h"
+#include "ic_impl/proto/wire_format.pb.h"
 #include "ic_impl/util.h"
 
 #include "interconnection/handshake/entry.pb.h"
@@ -24,9 +28,19 @@ DEFINE_string(parties, "127.0.0.1:9530,127.0.0.1:9531",
               "server list, format: host1:port1[,host2:port2, ...].");
 DEFINE_int32(rank, 0, "self rank");
 DEFINE_int32(ic_version, 2, "handshake request version suggested");
-DEFINE_string(algo, "ECDH_PSI", "algorithm suggested");
+DEFINE_string(algo, "ECDH_PSI",
+              "algorithm suggested, or a comma-separated list of algorithms "
+              "run one after another in the same job");
 DEFINE_string(protocol_families, "ecc",
               "comma-separated list of protocol families");
+DEFINE_string(wire_formats, "bitpack,bitpack_zlib",
+              "comma-separated list of link message formats offered in the "
+              "handshake, raw is always accepted");
+DEFINE_int64(link_bandwidth_mbps, 0,
+             "bandwidth of the links in Mbps deciding whether messages are "
+             "deflated, measured after the handshake if 0");
+
+DECLARE_bool(disable_handshake);
 
 namespace ic_impl {
 
@@ -34,16 +48,56 @@ namespace {
 
 constexpr std::array<int32_t, 2> kSupportedVersions{1, 2};
 
-int32_t SuggestedAlgo() {
-  return util::GetFlagValue(org::interconnection::v2::AlgoType_descriptor(),
-                            "ALGO_TYPE_",
-                            util::GetParamEnv("algo", FLAGS_algo));
+std::vector<int32_t> SuggestedAlgos() {
+  std::vector<std::string> names =
+      absl::StrSplit(util::GetParamEnv("algo", FLAGS_algo), ',');
+  std::vector<int32_t> algos;
+  for (const auto &name : names) {
+    algos.push_back(util::GetFlagValue(
+        org::interconnection::v2::AlgoType_descriptor(), "ALGO_TYPE_", name,
+        ic_impl::proto::VendorAlgoType_descriptor()));
+  }
+
+  return algos;
 }
 
 std::vector<int32_t> SuggestedProtocolFamilies() {
   return util::GetFlagValues(
       org::interconnection::v2::ProtocolFamily_descriptor(), "PROTOCOL_FAMILY_",
-      util::GetParamEnv("protocol_families", FLAGS_protocol_families));
+      util::GetParamEnv("protocol_families", FLAGS_protocol_families),
+      ic_impl::proto::VendorProtocolFamily_descriptor());
+}
+
+std::vector<int32_t> SuggestedWireFormats(const IcContext &ctx) {
+  // the format is agreed on through the handshake, and only white box links
+  // can carry it
+  auto names = util::GetParamEnv("wire_formats", FLAGS_wire_formats);
+  bool disable_handshake =
+      util::GetParamEnv("disable_handshake", FLAGS_disable_handshake);
+  if (disable_handshake || ctx.codec_channels.empty() || names.empty()) {
+    return {};
+  }
+  return util::GetFlagValues(ic_impl::proto::WireFormat_descriptor(),
+                             "WIRE_FORMAT_", names);
+}
+
+int64_t SuggestedLinkBandwidth() {
+  return util::GetParamEnv("link_bandwidth_mbps", FLAGS_link_bandwidth_mbps);
+}
+
+void SetJobParams(IcContext *ic_ctx) {
+  int32_t version = util::GetParamEnv("ic_version", FLAGS_ic_version);
+  YACL_ENFORCE(util::IsFlagSupported(kSupportedVersions, version));
+  ic_ctx->version = version;
+
+  ic_ctx->algos = SuggestedAlgos();
+
+  YACL_ENFORCE(!ic_ctx->algos.empty());
+  ic_ctx->algo = ic_ctx->algos.front();
+
+  ic_ctx->protocol_families = SuggestedProtocolFamilies();
+
+  YACL_ENFORCE(!ic_ctx->protocol_families.empty());
 }
 
 }  // namespace
@@ -51,18 +105,88 @@ std::vector<int32_t> SuggestedProtocolFamilies() {
 std::shared_ptr<IcContext> CreateIcContext() {
   std::shared_ptr<IcContext> ic_ctx = std::make_shared<IcContext>();
 
-  YACL_ENFORCE(util::IsFlagSupported(kSupportedVersions, FLAGS_ic_version));
-  ic_ctx->version = FLAGS_ic_version;
+  SetJobParams(ic_ctx.get());
 
-  ic_ctx->algo = SuggestedAlgo();
+  ic_ctx->lctx =
+      util::MakeLink(FLAGS_parties, FLAGS_rank, &ic_ctx->codec_channels);
+  ic_ctx->mesh_ready =
+      std::async(std::launch::async,
+                 [lctx = ic_ctx->lctx] { lctx->ConnectToMesh(); })
+          .share();
 
-  ic_ctx->protocol_families = SuggestedProtocolFamilies();
+  ic_ctx->wire_formats = SuggestedWireFormats(*ic_ctx);
+  ic_ctx->wire_format = ic_impl::proto::WIRE_FORMAT_RAW;
 
-  YACL_ENFORCE(!ic_ctx->protocol_families.empty());
+  return ic_ctx;
+}
+
+std::shared_ptr<IcContext> CreateJobContext(const IcContext &link_ctx,
+                                            const std::string &session,
+                                            bool share) {
+  std::shared_ptr<IcContext> ic_ctx = std::make_shared<IcContext>();
+
+  SetJobParams(ic_ctx.get());
+
+  // a sub-context of its own keeps the messages of the job, the handshake
+  // included, apart from those of other jobs on the same channels
+  ic_ctx->lctx = link_ctx.lctx->Spawn(session);
+  ic_ctx->mesh_ready = link_ctx.mesh_ready;
+  ic_ctx->shared_links = share;
+  if (!share) {
+    // the channels switch formats as a whole
+    ic_ctx->codec_channels = link_ctx.codec_channels;
+  }
 
-  ic_ctx->lctx = util::MakeLink(FLAGS_parties, FLAGS_rank);
+  ic_ctx->wire_formats = SuggestedWireFormats(*ic_ctx);
+  ic_ctx->wire_format = ic_impl::proto::WIRE_FORMAT_RAW;
+  ResetWireFormat(*ic_ctx);
 
   return ic_ctx;
 }
 
+void WaitMeshReady(const IcContext &ctx) {
+  if (ctx.mesh_ready.valid()) {
+    ctx.mesh_ready.get();
+  }
+}
+
+void EnableWireFormat(const IcContext &ctx) {
+  if (ctx.codec_channels.empty()) {
+    return;
+  }
+
+  // deflating pays off only when the link is slower than the codec
+  constexpr double kDeflateBelowMbps = 1000;
+  bool zlib = ctx.wire_format == ic_impl::proto::WIRE_FORMAT_BITPACK_ZLIB;
+  int64_t bandwidth = SuggestedLinkBandwidth();
+  size_t self_rank = ctx.lctx->Rank();
+  for (size_t rank = 0; rank < ctx.codec_channels.size(); ++rank) {
+    const auto &channel = ctx.codec_channels[rank];
+    if (rank == self_rank) {
+      continue;
+    }
+
+    bool allow_zlib = false;
+    if (zlib && bandwidth > 0) {
+      allow_zlib = bandwidth < kDeflateBelowMbps;
+    } else if (zlib) {
+      double mbps = channel->MeasureBandwidth(self_rank < rank);
+      allow_zlib = mbps < kDeflateBelowMbps;
+      SPDLOG_INFO("link to rank {} measured at {:.0f} Mbps", rank, mbps);
+    }
+    channel->SetWireFormat(ctx.wire_format, allow_zlib);
+  }
+
+  SPDLOG_INFO("wire format {}",
+              ic_impl::proto::WireFormat_Name(ctx.wire_format));
+}
+
+void ResetWireFormat(const IcContext &ctx) {
+  for (const auto &channel : ctx.codec_channels) {
+    if (channel) {
+      channel->SetWireFormat(ic_impl::proto::WIRE_FORMAT_RAW, false);
+    }
+  }
+}
+
 }  // namespace ic_impl
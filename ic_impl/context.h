@@ -14,8 +14,15 @@
 
 #pragma once
 
+#include <future>
+#include <memory>
+#include <string>
+#include <vector>
+
 #include "yacl/link/context.h"
 
+#include "ic_impl/link/codec_channel.h"
+
 namespace yacl::link {
 class Context;
 }
@@ -25,10 +32,42 @@ namespace ic_impl {
 struct IcContext {
   int32_t version;
   int32_t algo;
+  // algorithms run one after another in the same job, starting with `algo`
+  std::vector<int32_t> algos;
   std::vector<int32_t> protocol_families;
   std::shared_ptr<yacl::link::Context> lctx;
+  // connected in the background while the dataset is prepared
+  std::shared_future<void> mesh_ready;
+  // by peer rank, empty on black box links
+  std::vector<std::shared_ptr<link::CodecChannel>> codec_channels;
+  // ic_impl.proto.WireFormat values offered in the handshake
+  std::vector<int32_t> wire_formats;
+  // the negotiated one
+  int32_t wire_format;
+  // whether other jobs run on the channels of lctx at the same time, which
+  // then must keep their receive timeout
+  bool shared_links = false;
 };
 
 std::shared_ptr<IcContext> CreateIcContext();
 
+// Context of one more job between the parties of `link_ctx`, reusing its
+// connected links. The messages of the job are tagged with `session`, which
+// the parties must name alike. Jobs which `share` the links with others
+// running at the same time keep to raw messages. The job parameters are
+// read again.
+std::shared_ptr<IcContext> CreateJobContext(const IcContext &link_ctx,
+                                            const std::string &session,
+                                            bool share);
+
+// Wait until every party is reachable
+void WaitMeshReady(const IcContext &ctx);
+
+// Switch the channels to the negotiated wire format, called by every party
+// right after the handshake
+void EnableWireFormat(const IcContext &ctx);
+
+// Switch the channels back to raw messages, for the handshake of the next job
+void ResetWireFormat(const IcContext &ctx);
+
 }  // namespace ic_impl
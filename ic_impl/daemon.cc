@@ -0,0 +1,344 @@
+// Copyright 2024 Ant Group Co., Ltd.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "ic_impl/daemon.h"
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <optional>
+#include <sstream>
+#include <thread>
+
+#include "absl/strings/match.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_split.h"
+#include "absl/strings/strip.h"
+#include "gflags/gflags.h"
+#include "spdlog/spdlog.h"
+#include "yacl/link/context.h"
+
+#include "ic_impl/context.h"
+#include "ic_impl/party.h"
+#include "ic_impl/util.h"
+
+DEFINE_string(daemon_spool_dir, "",
+              "keep the links up and run the jobs whose specs are put in "
+              "this directory, a single job is run if empty");
+DEFINE_int32(daemon_max_sessions, 1,
+             "number of jobs run at the same time over the links, which "
+             "then carry raw messages only");
+DEFINE_int32(daemon_poll_ms, 200,
+             "interval at which the spool directory is scanned for jobs");
+
+namespace ic_impl {
+
+namespace {
+
+constexpr std::string_view kJobSuffix = ".flags";
+constexpr std::string_view kRunningSuffix = ".running";
+constexpr std::string_view kShutdownFile = "shutdown";
+
+// Announcements of rank 0 other than job names, which never contain a '/'
+constexpr std::string_view kIdle = "";
+constexpr std::string_view kShutdown = "/shutdown";
+
+constexpr std::string_view kAnnounceTag = "ic_daemon_job";
+constexpr std::string_view kReadyTag = "ic_daemon_ready";
+
+std::string SpoolDir() {
+  return util::GetParamEnv("daemon_spool_dir", FLAGS_daemon_spool_dir);
+}
+
+size_t MaxSessions() {
+  return std::max(
+      1, util::GetParamEnv("daemon_max_sessions", FLAGS_daemon_max_sessions));
+}
+
+std::optional<std::string> NextJob(const std::filesystem::path &dir) {
+  if (std::filesystem::exists(dir / kShutdownFile)) {
+    std::filesystem::remove(dir / kShutdownFile);
+    return std::string(kShutdown);
+  }
+
+  std::optional<std::string> next;
+  for (const auto &entry : std::filesystem::directory_iterator(dir)) {
+    const auto &path = entry.path();
+    if (!entry.is_regular_file() || path.extension() != kJobSuffix) {
+      continue;
+    }
+    auto job = path.stem().string();
+    if (!next || job < next.value()) {
+      next = std::move(job);
+    }
+  }
+
+  return next;
+}
+
+bool IsBoolFlag(const std::string &name) {
+  google::CommandLineFlagInfo info;
+  return google::GetCommandLineFlagInfo(name.c_str(), &info) &&
+         info.type == "bool";
+}
+
+// The parameters set by a flag file, one -name=value per line. Boolean
+// flags may also be given as -name or -noname.
+std::optional<util::SessionParams> ParseJobSpec(const std::string &spec) {
+  util::SessionParams params;
+  std::istringstream lines(spec);
+  std::string line;
+  while (std::getline(lines, line)) {
+    std::string_view flag = absl::StripAsciiWhitespace(line);
+    if (flag.empty() || flag.front() == '#') {
+      continue;
+    }
+    if (!absl::ConsumePrefix(&flag, "-")) {
+      SPDLOG_ERROR("not a flag: {}", line);
+      return std::nullopt;
+    }
+    absl::ConsumePrefix(&flag, "-");
+
+    std::pair<std::string, std::string> name_value =
+        absl::StrSplit(flag, absl::MaxSplits('=', 1));
+    auto &[name, value] = name_value;
+    google::CommandLineFlagInfo info;
+    if (absl::StrContains(flag, '=')) {
+      if (!google::GetCommandLineFlagInfo(name.c_str(), &info)) {
+        SPDLOG_ERROR("unknown flag: {}", line);
+        return std::nullopt;
+      }
+    } else if (IsBoolFlag(name)) {
+      value = "true";
+    } else if (absl::StartsWith(name, "no") && IsBoolFlag(name.substr(2))) {
+      name = name.substr(2);
+      value = "false";
+    } else {
+      SPDLOG_ERROR("flag without a value: {}", line);
+      return std::nullopt;
+    }
+    params[name] = value;
+  }
+
+  return params;
+}
+
+// The parameters of the spec at `path`, waiting up to `wait` for it to show
+// up
+std::optional<util::SessionParams> LoadJobSpec(
+    const std::filesystem::path &path, std::chrono::milliseconds wait) {
+  auto deadline = std::chrono::steady_clock::now() + wait;
+  while (!std::filesystem::exists(path)) {
+    if (std::chrono::steady_clock::now() >= deadline) {
+      SPDLOG_WARN("job spec {} not found", path.string());
+      return std::nullopt;
+    }
+    std::this_thread::sleep_for(
+        std::chrono::milliseconds(FLAGS_daemon_poll_ms));
+  }
+
+  std::ifstream in(path);
+  std::stringstream spec;
+  spec << in.rdbuf();
+  auto params = in ? ParseJobSpec(spec.str()) : std::nullopt;
+  if (!params) {
+    SPDLOG_ERROR("invalid job spec {}", path.string());
+  }
+
+  return params;
+}
+
+// Move the spec at `path` out of the sight of NextJob while the job runs,
+// nullopt if that fails
+std::optional<std::filesystem::path> ClaimJob(
+    const std::filesystem::path &path) {
+  auto claimed = path;
+  claimed += kRunningSuffix;
+  std::error_code ec;
+  std::filesystem::rename(path, claimed, ec);
+  if (ec) {
+    SPDLOG_ERROR("claim job spec {} failed: {}", path.string(), ec.message());
+    // never pick it again
+    std::filesystem::remove(path, ec);
+    return std::nullopt;
+  }
+  return claimed;
+}
+
+// Rename the spec at `path`, which `claimed` holds if set, after the job
+void MarkJob(const std::filesystem::path &path,
+             const std::optional<std::filesystem::path> &claimed,
+             bool succeeded) {
+  const auto &from = claimed.value_or(path);
+  std::error_code ec;
+  std::filesystem::rename(
+      from, absl::StrCat(path.string(), succeeded ? ".done" : ".failed"), ec);
+  if (ec) {
+    // never pick it again
+    std::filesystem::remove(from, ec);
+  }
+}
+
+}  // namespace
+
+Daemon::Daemon(std::shared_ptr<IcContext> ctx)
+    : ctx_(std::move(ctx)),
+      spool_dir_(SpoolDir()),
+      control_(ctx_->lctx->Spawn("daemon")) {}
+
+Daemon::~Daemon() = default;
+
+bool Daemon::Enabled() { return !SpoolDir().empty(); }
+
+void Daemon::Run() {
+  YACL_ENFORCE(std::filesystem::is_directory(spool_dir_),
+               "spool directory {} not found", spool_dir_.string());
+  WaitMeshReady(*ctx_);
+  SPDLOG_INFO("serving jobs from {}", spool_dir_.string());
+
+  while (true) {
+    auto job = control_->Rank() == 0 ? AnnounceNextJob() : ReceiveNextJob();
+    if (job == kShutdown) {
+      break;
+    }
+    StartJob(job);
+    ReapJobs();
+  }
+
+  for (auto &running : running_) {
+    running.get();
+  }
+  control_->WaitLinkTaskFinish();
+  SPDLOG_INFO("daemon stopped");
+}
+
+std::string Daemon::AnnounceNextJob() {
+  // peers take rank 0 for gone after a link timeout without news
+  auto heartbeat = std::chrono::milliseconds(control_->GetRecvTimeout() / 3);
+  auto last_announced = std::chrono::steady_clock::now();
+  while (true) {
+    std::optional<std::string> job;
+    if (ReapJobs() < MaxSessions()) {
+      job = NextJob(spool_dir_);
+    }
+    auto now = std::chrono::steady_clock::now();
+    if (job || now - last_announced >= heartbeat) {
+      std::string announcement = job.value_or(std::string(kIdle));
+      for (size_t rank = 1; rank < control_->WorldSize(); ++rank) {
+        control_->SendAsync(rank, announcement, kAnnounceTag);
+      }
+      last_announced = now;
+    }
+    if (job) {
+      return job.value();
+    }
+
+    std::this_thread::sleep_for(
+        std::chrono::milliseconds(FLAGS_daemon_poll_ms));
+  }
+}
+
+std::string Daemon::ReceiveNextJob() {
+  std::string job;
+  do {
+    auto buf = control_->Recv(0, kAnnounceTag);
+    job.assign(buf.data<char>(), buf.size());
+  } while (job == kIdle);
+
+  return job;
+}
+
+bool Daemon::AgreeOnJob(bool ready) {
+  auto vote = [](bool value) { return std::string(value ? "1" : "0"); };
+  auto parse = [](const yacl::Buffer &buf) {
+    return buf.size() == 1 && buf.data<char>()[0] == '1';
+  };
+
+  if (control_->Rank() != 0) {
+    control_->SendAsync(0, vote(ready), kReadyTag);
+    return parse(control_->Recv(0, kReadyTag));
+  }
+
+  for (size_t rank = 1; rank < control_->WorldSize(); ++rank) {
+    ready = parse(control_->Recv(rank, kReadyTag)) && ready;
+  }
+  for (size_t rank = 1; rank < control_->WorldSize(); ++rank) {
+    control_->SendAsync(rank, vote(ready), kReadyTag);
+  }
+
+  return ready;
+}
+
+void Daemon::StartJob(const std::string &job) {
+  auto path = spool_dir_ / absl::StrCat(job, kJobSuffix);
+  auto session = absl::StrCat("job", job_count_++);
+
+  // the spec of rank 0 is there already, the others may still be on their
+  // way, but rank 0 waits for their votes no longer than the link timeout
+  auto wait = std::chrono::milliseconds(
+      control_->Rank() == 0 ? 0 : control_->GetRecvTimeout() / 2);
+  auto params = LoadJobSpec(path, wait);
+  // claimed before the job starts, or rank 0 would announce it again while
+  // it runs along with the next ones
+  std::optional<std::filesystem::path> claimed;
+  if (params.has_value()) {
+    claimed = ClaimJob(path);
+  }
+  if (!AgreeOnJob(claimed.has_value())) {
+    SPDLOG_WARN("skip job {}, not every party has a valid spec", job);
+    MarkJob(path, claimed, false);
+    return;
+  }
+
+  bool share = MaxSessions() > 1;
+  auto run = [this, job, path, claimed, session, share,
+              job_params = std::make_shared<const util::SessionParams>(
+                  std::move(params.value()))] {
+    // the spec stands in for the flags of the daemon in this job only
+    util::ScopedSessionParams scope(job_params);
+    bool succeeded = false;
+    try {
+      auto job_ctx = CreateJobContext(*ctx_, session, share);
+      SPDLOG_INFO("run job {} in session {}", job, session);
+      Party party(job_ctx);
+      party.Run();
+      job_ctx->lctx->WaitLinkTaskFinish();
+      succeeded = true;
+    } catch (const std::exception &e) {
+      SPDLOG_ERROR("job {} failed: {}", job, e.what());
+    }
+    if (!share) {
+      ResetWireFormat(*ctx_);
+    }
+    MarkJob(path, claimed, succeeded);
+  };
+
+  if (share) {
+    running_.push_back(std::async(std::launch::async, std::move(run)));
+  } else {
+    run();
+  }
+}
+
+size_t Daemon::ReapJobs() {
+  auto finished = [](const std::future<void> &running) {
+    return running.wait_for(std::chrono::seconds(0)) ==
+           std::future_status::ready;
+  };
+  running_.erase(std::remove_if(running_.begin(), running_.end(), finished),
+                 running_.end());
+  return running_.size();
+}
+
+}  // namespace ic_impl
@@ -0,0 +1,80 @@
+// Copyright 2024 Ant Group Co., Ltd.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <filesystem>
+#include <future>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace yacl::link {
+class Context;
+}
+
+namespace ic_impl {
+
+struct IcContext;
+
+// Runs jobs over the links of one IcContext, saving the link setup and mesh
+// connection of a process per job.
+//
+// Each party keeps the specs of its jobs in its spool directory, as gflags
+// flag files named <job>.flags. Rank 0 picks the jobs in name order and
+// announces them to the other parties, which run the spec of the same name
+// from their own spool. Up to -daemon_max_sessions jobs run at the same
+// time, each in a session of its own. A spec is renamed to <job>.flags.done
+// or <job>.flags.failed once run, and a file named `shutdown` in the spool
+// of rank 0 stops every party.
+class Daemon {
+ public:
+  explicit Daemon(std::shared_ptr<IcContext> ctx);
+
+  ~Daemon();
+
+  // Whether ic_main is asked to run as a daemon
+  static bool Enabled();
+
+  void Run();
+
+ private:
+  // The next job once a session is free, telling idle peers that rank 0 is
+  // alive in the meantime
+  std::string AnnounceNextJob();
+
+  std::string ReceiveNextJob();
+
+  // Whether every party has a valid spec of the job
+  bool AgreeOnJob(bool ready);
+
+  void StartJob(const std::string &job);
+
+  // Forget the finished jobs, returns the number still running
+  size_t ReapJobs();
+
+  std::shared_ptr<IcContext> ctx_;
+
+  std::filesystem::path spool_dir_;
+
+  // carries the announcements, apart from the messages of the jobs
+  std::shared_ptr<yacl::link::Context> control_;
+
+  // jobs announced so far, which numbers the sessions alike on every party
+  uint64_t job_count_ = 0;
+
+  std::vector<std::future<void>> running_;
+};
+
+}  // namespace ic_impl
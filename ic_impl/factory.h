@@ -41,4 +41,28 @@ class LrHandlerFactory : public AlgoHandlerFactory {
       std::shared_ptr<IcContext> ctx) override;
 };
 
+class PsiLrHandlerFactory : public AlgoHandlerFactory {
+ public:
+  std::unique_ptr<AlgoV2Handler> CreateAlgoV2Handler(
+      std::shared_ptr<IcContext> ctx) override;
+};
+
+class HeSsHandlerFactory : public AlgoHandlerFactory {
+ public:
+  std::unique_ptr<AlgoV2Handler> CreateAlgoV2Handler(
+      std::shared_ptr<IcContext> ctx) override;
+};
+
+class HeLrHandlerFactory : public AlgoHandlerFactory {
+ public:
+  std::unique_ptr<AlgoV2Handler> CreateAlgoV2Handler(
+      std::shared_ptr<IcContext> ctx) override;
+};
+
+class HorizontalLrHandlerFactory : public AlgoHandlerFactory {
+ public:
+  std::unique_ptr<AlgoV2Handler> CreateAlgoV2Handler(
+      std::shared_ptr<IcContext> ctx) override;
+};
+
 }  // namespace ic_impl
@@ -14,30 +14,76 @@
 
 #include "ic_impl/handler.h"
 
+#include <algorithm>
+#include <chrono>
+#include <future>
+
+#include "absl/strings/str_join.h"
+#include "gflags/gflags.h"
 #include "spdlog/spdlog.h"
 
 #include "ic_impl/context.h"
+#include "ic_impl/proto/handshake_ext.pb.h"
+#include "ic_impl/session_ticket.h"
 
 DEFINE_bool(disable_handshake, false, "whether to disable handshake");
+DEFINE_int32(handshake_timeout_ms, 0,
+             "how long rank 0 waits for the handshake request of each peer, "
+             "counted from the start of the handshake, 0 for the receive "
+             "timeout of the link, which jobs sharing the links always use");
 
 namespace ic_impl {
 
 namespace {
 
-HandshakeRequestV2 ParseHandshakeReqeust(const yacl::Buffer &buf) {
-  org::interconnection::v2::HandshakeVersionCheckHelper helper;
-  YACL_ENFORCE(helper.ParseFromArray(buf.data(), buf.size()),
-               "handshake: parse from array failed");
+using ic_impl::proto::SessionTicketExt;
+
+std::string SummarizeHandshakeRequest(const HandshakeRequestV2 &request) {
+  return fmt::format(
+      "version={} requester_rank={} algos=[{}] ops=[{}] "
+      "protocol_families=[{}] size={}",
+      request.version(), request.requester_rank(),
+      absl::StrJoin(request.supported_algos(), ","),
+      absl::StrJoin(request.ops(), ","),
+      absl::StrJoin(request.protocol_families(), ","), request.ByteSizeLong());
+}
 
-  YACL_ENFORCE(helper.version() >= 2,
-               "recv invalid HandshakeRequest version {}", helper.version());
+std::string SummarizeHandshakeResponse(const HandshakeResponseV2 &response) {
+  return fmt::format(
+      "error_code={} algo={} ops=[{}] protocol_families=[{}] size={}",
+      response.header().error_code(), response.algo(),
+      absl::StrJoin(response.ops(), ","),
+      absl::StrJoin(response.protocol_families(), ","),
+      response.ByteSizeLong());
+}
 
+std::optional<HandshakeRequestV2> ParseHandshakeRequest(const yacl::Buffer &buf,
+                                                        size_t src_rank) {
   HandshakeRequestV2 request;
-  YACL_ENFORCE(request.ParseFromArray(buf.data(), buf.size()),
-               "handshake: parse from array failed");
-  SPDLOG_INFO("recv HandshakeRequest:\n{}", request.DebugString());
+  if (request.ParseFromArray(buf.data(), buf.size()) &&
+      request.version() >= 2) {
+    SPDLOG_INFO("recv HandshakeRequest from rank {}: {}", src_rank,
+                SummarizeHandshakeRequest(request));
+    SPDLOG_DEBUG("{}", request.ShortDebugString());
+    return request;
+  }
 
-  return request;
+  // only the version is readable in requests of other versions
+  org::interconnection::v2::HandshakeVersionCheckHelper helper;
+  if (helper.ParseFromArray(buf.data(), buf.size())) {
+    SPDLOG_WARN("recv invalid HandshakeRequest version {} from rank {}",
+                helper.version(), src_rank);
+  } else {
+    SPDLOG_WARN("recv malformed HandshakeRequest from rank {}", src_rank);
+  }
+  return std::nullopt;
+}
+
+HandshakeResponseV2 BuildErrorResponse(int32_t code, std::string_view message) {
+  HandshakeResponseV2 response;
+  response.mutable_header()->set_error_code(code);
+  response.mutable_header()->set_error_msg(std::string(message));
+  return response;
 }
 
 int32_t AlignHandshakeVersion(const std::vector<HandshakeRequestV2> &requests) {
@@ -53,17 +99,89 @@ int32_t AlignHandshakeVersion(const std::vector<HandshakeRequestV2> &requests) {
   return version;
 }
 
+// Put the receive timeout of a link context back when leaving the scope
+class ScopedRecvTimeout {
+ public:
+  explicit ScopedRecvTimeout(std::shared_ptr<yacl::link::Context> lctx)
+      : lctx_(std::move(lctx)), saved_ms_(lctx_->GetRecvTimeout()) {}
+
+  ~ScopedRecvTimeout() {
+    if (changed_) {
+      lctx_->SetRecvTimeout(saved_ms_);
+    }
+  }
+
+  ScopedRecvTimeout(const ScopedRecvTimeout &) = delete;
+  ScopedRecvTimeout &operator=(const ScopedRecvTimeout &) = delete;
+
+  uint64_t saved_ms() const { return saved_ms_; }
+
+  void Set(uint64_t timeout_ms) {
+    lctx_->SetRecvTimeout(timeout_ms);
+    changed_ = true;
+  }
+
+ private:
+  std::shared_ptr<yacl::link::Context> lctx_;
+  uint64_t saved_ms_;
+  bool changed_ = false;
+};
+
+// Join the dataset loader on every way out, logging what it threw unless
+// Get() passed it on already
+class ScopedLoading {
+ public:
+  explicit ScopedLoading(std::future<void> loading)
+      : loading_(std::move(loading)) {}
+
+  ~ScopedLoading() {
+    if (!loading_.valid()) {
+      return;
+    }
+    try {
+      loading_.get();
+    } catch (const std::exception &e) {
+      SPDLOG_ERROR("load dataset failed: {}", e.what());
+    }
+  }
+
+  ScopedLoading(const ScopedLoading &) = delete;
+  ScopedLoading &operator=(const ScopedLoading &) = delete;
+
+  void Get() { loading_.get(); }
+
+ private:
+  std::future<void> loading_;
+};
+
+bool HandshakeDisabled() {
+  return util::GetParamEnv("disable_handshake", FLAGS_disable_handshake);
+}
+
 }  // namespace
 
+std::future<void> AlgoV2Handler::LoadDatasetAsync() {
+  // the loader reads the parameters of the session as well
+  return std::async(std::launch::async,
+                    [this, params = util::CurrentSessionParams()] {
+                      util::ScopedSessionParams scope(params);
+                      LoadDataset();
+                    });
+}
+
 void AlgoV2Handler::PassiveRun() {
   if (!PrepareDataset()) {
     return;
   }
 
-  if (!FLAGS_disable_handshake && !PassiveHandshake()) {
+  ScopedLoading loading(LoadDatasetAsync());
+  WaitMeshReady(*ctx_);
+
+  if (!HandshakeDisabled() && !PassiveHandshake()) {
     return;
   }
 
+  loading.Get();
   RunAlgo();
 }
 
@@ -72,25 +190,33 @@ void AlgoV2Handler::ActiveRun(int32_t recv_rank) {
     return;
   }
 
-  if (!FLAGS_disable_handshake && !ActiveHandshake(recv_rank)) {
+  ScopedLoading loading(LoadDatasetAsync());
+  WaitMeshReady(*ctx_);
+
+  if (!HandshakeDisabled() && !ActiveHandshake(recv_rank)) {
     return;
   }
 
+  loading.Get();
   RunAlgo();
 }
 
 bool AlgoV2Handler::PassiveHandshake() {
-  auto requests = RecvHandshakeRequests();
+  std::vector<HandshakeRequestV2> requests;
+  auto status = RecvHandshakeRequests(&requests);
+  if (!status.ok()) {
+    SPDLOG_WARN("recv handshake requests failed, {}", status.message());
+    SendHandshakeResponse(BuildErrorResponse(status.code(), status.message()));
+    return false;
+  }
 
   // Check HandshakeRequest versions
   int32_t version = AlignHandshakeVersion(requests);
   if (version != ctx_->version) {
     SPDLOG_WARN("Handshake versions are inconsistent");
-    HandshakeResponseV2 response;
-    response.mutable_header()->set_error_code(
-        org::interconnection::HANDSHAKE_REFUSED);
-    response.mutable_header()->set_error_msg("handshake versions inconsistent");
-    SendHandshakeResponse(response);
+    SendHandshakeResponse(
+        BuildErrorResponse(org::interconnection::HANDSHAKE_REFUSED,
+                           "handshake versions inconsistent"));
     return false;
   }
 
@@ -98,30 +224,111 @@ bool AlgoV2Handler::PassiveHandshake() {
 
   SendHandshakeResponse(response);
 
-  return response.header().error_code() == org::interconnection::OK;
+  if (response.header().error_code() != org::interconnection::OK) {
+    return false;
+  }
+
+  EnableWireFormat(*ctx_);
+  return true;
 }
 
 bool AlgoV2Handler::ActiveHandshake(int32_t dst_rank) {
   auto request = BuildHandshakeRequest();
+  SessionTicketCache tickets;
+  auto proposal = request;
+  auto ticket = tickets.LoadTicket(proposal);
+  if (!ticket.empty()) {
+    SessionTicketExt ext;
+    ext.set_ticket(ticket);
+    util::SetVendorExt(&request, ext, util::kSessionTicketFieldNumber);
+  }
   SendHandshakeRequest(request, dst_rank);
 
   auto response = RecvHandshakeResponse(dst_rank);
-  return ProcessHandshakeResponse(response);
+  if (!ProcessHandshakeResponse(response)) {
+    return false;
+  }
+
+  auto ext = util::GetVendorExt<SessionTicketExt>(
+      response, util::kSessionTicketFieldNumber);
+  if (ext.has_value()) {
+    SPDLOG_INFO("handshake {}", ext->resumed() ? "resumed" : "negotiated");
+    if (ext->ticket() != ticket) {
+      tickets.StoreTicket(proposal, ext->ticket());
+    }
+  }
+
+  EnableWireFormat(*ctx_);
+  return true;
 }
 
 HandshakeResponseV2 AlgoV2Handler::ProcessHandshakeRequests(
     const std::vector<HandshakeRequestV2> &requests) {
+  SessionTicketCache tickets;
+  std::string ticket;
+  if (tickets.Enabled()) {
+    auto proposals = requests;
+    proposals.push_back(BuildHandshakeRequest());
+    // the response also carries settings of rank 0 its proposal leaves out,
+    // e.g. the epochs and the learning rate of LR. Built before the
+    // negotiation, it depends on the settings of rank 0 only.
+    ticket = ComputeSessionTicket(proposals, BuildHandshakeResponse());
+
+    auto response = ResumeSession(requests, ticket, tickets);
+    if (response.has_value()) {
+      return response.value();
+    }
+  }
+
   auto status = NegotiateHandshakeParams(requests);
   if (!status.ok()) {
     SPDLOG_WARN("negotiate handshake params failed, {}", status.message());
-    HandshakeResponseV2 response;
-    response.mutable_header()->set_error_code(status.code());
-    response.mutable_header()->set_error_msg(status.message());
+    return BuildErrorResponse(status.code(), status.message());
+  }
+
+  auto response = BuildHandshakeResponse();
+  if (!ticket.empty()) {
+    tickets.StoreResponse(ticket, response);
+    SessionTicketExt ext;
+    ext.set_ticket(ticket);
+    util::SetVendorExt(&response, ext, util::kSessionTicketFieldNumber);
+  }
+
+  return response;
+}
+
+std::optional<HandshakeResponseV2> AlgoV2Handler::ResumeSession(
+    const std::vector<HandshakeRequestV2> &requests, const std::string &ticket,
+    const SessionTicketCache &tickets) {
+  for (const auto &request : requests) {
+    auto ext = util::GetVendorExt<SessionTicketExt>(
+        request, util::kSessionTicketFieldNumber);
+    if (!ext.has_value() || ext->ticket() != ticket) {
+      return std::nullopt;
+    }
+  }
 
-    return response;
+  auto response = tickets.LoadResponse(ticket);
+  if (!response.has_value()) {
+    return std::nullopt;
   }
 
-  return BuildHandshakeResponse();
+  try {
+    if (!ResumeHandshake(requests, response.value())) {
+      return std::nullopt;
+    }
+  } catch (const std::exception &e) {
+    SPDLOG_WARN("resume handshake failed: {}", e.what());
+    return std::nullopt;
+  }
+
+  SessionTicketExt ext;
+  ext.set_ticket(ticket);
+  ext.set_resumed(true);
+  util::SetVendorExt(&response.value(), ext, util::kSessionTicketFieldNumber);
+  SPDLOG_INFO("handshake resumed, negotiation skipped");
+
+  return response;
 }
 
 bool AlgoV2Handler::ProcessHandshakeResponse(
@@ -139,38 +346,95 @@ void AlgoV2Handler::SendHandshakeRequest(const HandshakeRequestV2 &request,
                                          int32_t dst_rank) {
   ctx_->lctx->Send(dst_rank, request.SerializeAsString(), "Handshake");
 
-  SPDLOG_INFO("send HandshakeRequest:\n{}", request.DebugString());
+  SPDLOG_INFO("send HandshakeRequest to rank {}: {}", dst_rank,
+              SummarizeHandshakeRequest(request));
 }
 
 void AlgoV2Handler::SendHandshakeResponse(const HandshakeResponseV2 &response) {
   size_t self_rank = ctx_->lctx->Rank();
   size_t world_size = ctx_->lctx->WorldSize();
+  auto buf = response.SerializeAsString();
   for (size_t i = 0; i < world_size; ++i) {
     if (i == self_rank) {
       continue;
     }
-    ctx_->lctx->SendAsync(i, response.SerializeAsString(),
-                          "Handshake_response");
-    SPDLOG_INFO("send HandshakeResponse:\n{}", response.DebugString());
+    ctx_->lctx->SendAsync(i, buf, "Handshake_response");
   }
+  SPDLOG_INFO("send HandshakeResponse: {}",
+              SummarizeHandshakeResponse(response));
+  SPDLOG_DEBUG("{}", response.ShortDebugString());
 }
 
-std::vector<HandshakeRequestV2> AlgoV2Handler::RecvHandshakeRequests() {
-  std::vector<HandshakeRequestV2> requests;
+status::ErrorStatus AlgoV2Handler::RecvHandshakeRequests(
+    std::vector<HandshakeRequestV2> *requests) {
   auto lctx = ctx_->lctx;
   size_t self_rank = lctx->Rank();
-  size_t word_size = lctx->WorldSize();
+  size_t world_size = lctx->WorldSize();
+
+  // The receiver loop buffers the requests of all peers as they arrive, so
+  // waiting for them in rank order against one deadline costs the slowest
+  // peer only. Context::Recv itself is not safe to call concurrently.
+  //
+  // yacl has no deadline per receive: the timeout below is set on the
+  // channels, which every context spawned from the same link shares. It is
+  // therefore shortened only while this session has the channels to itself,
+  // jobs running side by side wait for the link timeout instead.
+  ScopedRecvTimeout recv_timeout(lctx);
+  int64_t timeout_ms =
+      util::GetParamEnv("handshake_timeout_ms", FLAGS_handshake_timeout_ms);
+  if (timeout_ms > 0 && ctx_->shared_links) {
+    SPDLOG_INFO("handshake_timeout_ms is ignored on links shared by jobs");
+    timeout_ms = 0;
+  }
+  if (timeout_ms <= 0) {
+    timeout_ms = static_cast<int64_t>(recv_timeout.saved_ms());
+  }
+  auto deadline =
+      std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
 
-  // Recv HandshakeRequest from rank 1 ~ n-1
-  for (size_t i = 0; i < word_size; ++i) {
+  std::vector<size_t> missing_ranks;
+  std::vector<size_t> invalid_ranks;
+  for (size_t i = 0; i < world_size; ++i) {
     if (i == self_rank) {
       continue;
     }
-    auto buf = lctx->Recv(i, "Handshake");
-    requests.push_back(ParseHandshakeReqeust(buf));
+
+    if (!ctx_->shared_links) {
+      auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(
+          deadline - std::chrono::steady_clock::now());
+      // requests which arrived in time are already buffered
+      recv_timeout.Set(std::max<int64_t>(remaining.count(), 1));
+    }
+    yacl::Buffer buf;
+    try {
+      buf = lctx->Recv(i, "Handshake");
+    } catch (const yacl::IoError &e) {
+      SPDLOG_WARN("recv HandshakeRequest from rank {} failed: {}", i,
+                  e.what());
+      missing_ranks.push_back(i);
+      continue;
+    }
+
+    auto request = ParseHandshakeRequest(buf, i);
+    if (request.has_value()) {
+      requests->push_back(std::move(request.value()));
+    } else {
+      invalid_ranks.push_back(i);
+    }
+  }
+
+  if (!missing_ranks.empty()) {
+    return status::HandshakeRefusedError(
+        fmt::format("no handshake request from ranks {} within {} ms",
+                    absl::StrJoin(missing_ranks, ","), timeout_ms));
+  }
+  if (!invalid_ranks.empty()) {
+    return status::InvalidRequestError(
+        fmt::format("invalid handshake request from ranks {}",
+                    absl::StrJoin(invalid_ranks, ",")));
   }
 
-  return requests;
+  return status::OkStatus();
 }
 
 HandshakeResponseV2 AlgoV2Handler::RecvHandshakeResponse(int32_t src_rank) {
@@ -178,7 +442,9 @@ HandshakeResponseV2 AlgoV2Handler::RecvHandshakeResponse(int32_t src_rank) {
   auto buf = ctx_->lctx->Recv(src_rank, "Handshake_response");
   YACL_ENFORCE(response.ParseFromArray(buf.data(), buf.size()),
                "handshake: parse from array fail");
-  SPDLOG_INFO("recv HandshakeResponse:\n{}", response.DebugString());
+  SPDLOG_INFO("recv HandshakeResponse from rank {}: {}", src_rank,
+              SummarizeHandshakeResponse(response));
+  SPDLOG_DEBUG("{}", response.ShortDebugString());
 
   return response;
 }
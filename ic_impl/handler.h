@@ -14,6 +14,8 @@
 
 #pragma once
 
+#include <future>
+
 #include "ic_impl/status.h"
 #include "ic_impl/util.h"
 
@@ -26,6 +28,7 @@ using HandshakeRequestV2 = org::interconnection::v2::HandshakeRequest;
 using HandshakeResponseV2 = org::interconnection::v2::HandshakeResponse;
 
 struct IcContext;
+class SessionTicketCache;
 
 class AlgoV2Handler {
   friend class Party;
@@ -49,7 +52,10 @@ class AlgoV2Handler {
 
   void SendHandshakeResponse(const HandshakeResponseV2 &response);
 
-  std::vector<HandshakeRequestV2> RecvHandshakeRequests();
+  // Receive the requests of all other ranks, failing if one of them is
+  // missing or malformed
+  status::ErrorStatus RecvHandshakeRequests(
+      std::vector<HandshakeRequestV2> *requests);
 
   HandshakeResponseV2 RecvHandshakeResponse(int32_t src_rank);
 
@@ -60,6 +66,11 @@ class AlgoV2Handler {
   HandshakeResponseV2 ProcessHandshakeRequests(
       const std::vector<HandshakeRequestV2> &);
 
+  // The stored response if every requester presents `ticket`
+  std::optional<HandshakeResponseV2> ResumeSession(
+      const std::vector<HandshakeRequestV2> &requests,
+      const std::string &ticket, const SessionTicketCache &tickets);
+
   virtual HandshakeRequestV2 BuildHandshakeRequest() = 0;
 
   virtual HandshakeResponseV2 BuildHandshakeResponse() = 0;
@@ -67,8 +78,21 @@ class AlgoV2Handler {
   virtual status::ErrorStatus NegotiateHandshakeParams(
       const std::vector<HandshakeRequestV2> &requests) = 0;
 
+  // Take over the response of an earlier negotiation of the same proposals
+  // instead of negotiating, returns false if the handler cannot
+  virtual bool ResumeHandshake(const std::vector<HandshakeRequestV2> &,
+                               const HandshakeResponseV2 &) {
+    return false;
+  }
+
+  // Read what the handshake needs to know about the dataset
   virtual bool PrepareDataset() = 0;
 
+  // Finish loading the dataset, run in the background during the handshake
+  virtual void LoadDataset() {}
+
+  std::future<void> LoadDatasetAsync();
+
   virtual void RunAlgo() = 0;
 
   std::shared_ptr<IcContext> ctx_;
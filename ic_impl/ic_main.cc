@@ -16,6 +16,7 @@
 #include "spdlog/spdlog.h"
 
 #include "ic_impl/context.h"
+#include "ic_impl/daemon.h"
 #include "ic_impl/party.h"
 
 int main(int argc, char** argv) {
@@ -23,7 +24,10 @@ int main(int argc, char** argv) {
   // spdlog::set_level(spdlog::level::debug);
   try {
     auto ctx = ic_impl::CreateIcContext();
-    if (ctx) {
+    if (ctx && ic_impl::Daemon::Enabled()) {
+      ic_impl::Daemon daemon(ctx);
+      daemon.Run();
+    } else if (ctx) {
       ic_impl::Party party(ctx);
       party.Run();
       ctx->lctx->WaitLinkTaskFinish();
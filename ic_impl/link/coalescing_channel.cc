@@ -0,0 +1,261 @@
+// Copyright 2024 Ant Group Co., Ltd.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include "ic_impl/link/coalescing_channel.h"
+
+#include <cstring>
+
+#include "absl/strings/str_cat.h"
+#include "spdlog/spdlog.h"
+#include "yacl/base/exception.h"
+
+namespace ic_impl::link {
+
+namespace {
+
+constexpr char kBatchKeyPrefix[] = "ic_impl_coalesced:";
+
+// A batch is the number of its messages, then the size and bytes of the key
+// and of the value of each one
+constexpr size_t kCountSize = sizeof(uint32_t);
+
+size_t EntrySize(const std::string &key, size_t value_size) {
+  return sizeof(uint32_t) + key.size() + sizeof(uint64_t) + value_size;
+}
+
+std::string BatchKey(size_t seq) { return absl::StrCat(kBatchKeyPrefix, seq); }
+
+template <typename T>
+void Put(T value, uint8_t **out) {
+  std::memcpy(*out, &value, sizeof(value));
+  *out += sizeof(value);
+}
+
+template <typename T>
+T Take(yacl::ByteContainerView *in) {
+  T value;
+  YACL_ENFORCE(in->size() >= sizeof(value), "truncated coalesced batch");
+  std::memcpy(&value, in->data(), sizeof(value));
+  *in = yacl::ByteContainerView(in->data() + sizeof(value),
+                                in->size() - sizeof(value));
+  return value;
+}
+
+yacl::ByteContainerView TakeBytes(size_t size, yacl::ByteContainerView *in) {
+  YACL_ENFORCE(in->size() >= size, "truncated coalesced batch");
+  yacl::ByteContainerView bytes(in->data(), size);
+  *in = yacl::ByteContainerView(in->data() + size, in->size() - size);
+  return bytes;
+}
+
+}  // namespace
+
+CoalescingChannel::CoalescingChannel(
+    std::shared_ptr<yacl::link::transport::IChannel> inner,
+    const CoalescingOptions &options)
+    : inner_(std::move(inner)), options_(options) {
+  YACL_ENFORCE(options_.Enabled(), "invalid coalescing window {} ms of {} B",
+               options_.window_ms, options_.max_bytes);
+  flusher_ = std::thread(&CoalescingChannel::FlushLoop, this);
+  receiver_ = std::thread(&CoalescingChannel::ReceiveLoop, this);
+}
+
+CoalescingChannel::~CoalescingChannel() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+  }
+  cond_.notify_all();
+  flusher_.join();
+  // an empty batch wakes the receiver, a late one is dropped with the inner
+  inner_->OnMessage(BatchKey(recv_seq_.load()), {});
+  receiver_.join();
+}
+
+size_t CoalescingChannel::SentBatches() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return sent_batches_;
+}
+
+bool CoalescingChannel::Enqueue(const std::string &key,
+                                yacl::ByteContainerView value) {
+  size_t entry_size = EntrySize(key, value.size());
+  if (kCountSize + entry_size > options_.max_bytes) {
+    return false;
+  }
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (pending_bytes_ + entry_size > options_.max_bytes) {
+    FlushLocked();
+  }
+  if (pending_.empty()) {
+    pending_bytes_ = kCountSize;
+    deadline_ = std::chrono::steady_clock::now() +
+                std::chrono::milliseconds(options_.window_ms);
+    cond_.notify_all();
+  }
+  pending_.emplace_back(
+      key, std::string(reinterpret_cast<const char *>(value.data()),
+                       value.size()));
+  pending_bytes_ += entry_size;
+  return true;
+}
+
+void CoalescingChannel::FlushLocked() {
+  if (pending_.empty()) {
+    return;
+  }
+  auto messages = std::move(pending_);
+  pending_.clear();
+  size_t batch_size = pending_bytes_;
+  pending_bytes_ = 0;
+
+  // a lone message is not worth the frame
+  if (messages.size() == 1) {
+    inner_->SendAsync(messages[0].first, messages[0].second);
+    return;
+  }
+
+  yacl::Buffer batch(batch_size);
+  auto *out = batch.data<uint8_t>();
+  Put<uint32_t>(messages.size(), &out);
+  for (const auto &[key, value] : messages) {
+    Put<uint32_t>(key.size(), &out);
+    std::memcpy(out, key.data(), key.size());
+    out += key.size();
+    Put<uint64_t>(value.size(), &out);
+    std::memcpy(out, value.data(), value.size());
+    out += value.size();
+  }
+  inner_->SendAsync(BatchKey(send_seq_++), std::move(batch));
+  ++sent_batches_;
+}
+
+void CoalescingChannel::Flush() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  FlushLocked();
+}
+
+void CoalescingChannel::FlushLoop() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (!stopping_) {
+    if (pending_.empty()) {
+      cond_.wait(lock);
+      continue;
+    }
+    cond_.wait_until(lock, deadline_);
+    if (!pending_.empty() &&
+        std::chrono::steady_clock::now() >= deadline_) {
+      try {
+        FlushLocked();
+      } catch (const std::exception &e) {
+        SPDLOG_ERROR("coalesced batch {} lost: {}", send_seq_, e.what());
+      }
+    }
+  }
+
+  try {
+    FlushLocked();
+  } catch (const std::exception &e) {
+    SPDLOG_ERROR("coalesced batch {} lost: {}", send_seq_, e.what());
+  }
+}
+
+void CoalescingChannel::ReceiveLoop() {
+  while (true) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (stopping_) {
+        return;
+      }
+    }
+
+    size_t seq = recv_seq_.load();
+    yacl::Buffer batch;
+    try {
+      batch = inner_->Recv(BatchKey(seq));
+    } catch (const yacl::IoError &) {
+      // no batch within the receive timeout, wait again
+      continue;
+    } catch (const std::exception &e) {
+      SPDLOG_ERROR("stop receiving coalesced batches: {}", e.what());
+      return;
+    }
+    recv_seq_.store(seq + 1);
+    if (batch.size() == 0) {
+      // woken up to stop
+      continue;
+    }
+
+    try {
+      yacl::ByteContainerView in(batch);
+      for (auto count = Take<uint32_t>(&in); count > 0; --count) {
+        auto key = TakeBytes(Take<uint32_t>(&in), &in);
+        auto value = TakeBytes(Take<uint64_t>(&in), &in);
+        inner_->OnMessage(
+            std::string(reinterpret_cast<const char *>(key.data()),
+                        key.size()),
+            value);
+      }
+    } catch (const std::exception &e) {
+      SPDLOG_ERROR("coalesced batch {} dropped: {}", seq, e.what());
+    }
+  }
+}
+
+void CoalescingChannel::SendAsync(const std::string &key,
+                                  yacl::ByteContainerView value) {
+  if (!Enqueue(key, value)) {
+    Flush();
+    inner_->SendAsync(key, value);
+  }
+}
+
+void CoalescingChannel::SendAsync(const std::string &key,
+                                  yacl::Buffer &&value) {
+  if (!Enqueue(key, value)) {
+    Flush();
+    inner_->SendAsync(key, std::move(value));
+  }
+}
+
+void CoalescingChannel::SendAsyncThrottled(const std::string &key,
+                                           yacl::ByteContainerView value) {
+  Flush();
+  inner_->SendAsyncThrottled(key, value);
+}
+
+void CoalescingChannel::SendAsyncThrottled(const std::string &key,
+                                           yacl::Buffer &&value) {
+  Flush();
+  inner_->SendAsyncThrottled(key, std::move(value));
+}
+
+void CoalescingChannel::Send(const std::string &key,
+                             yacl::ByteContainerView value) {
+  Flush();
+  inner_->Send(key, value);
+}
+
+yacl::Buffer CoalescingChannel::Recv(const std::string &key) {
+  // the answer may be to a message still in the batch
+  Flush();
+  return inner_->Recv(key);
+}
+
+void CoalescingChannel::WaitLinkTaskFinish() {
+  Flush();
+  inner_->WaitLinkTaskFinish();
+}
+
+}  // namespace ic_impl::link
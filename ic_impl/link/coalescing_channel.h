@@ -0,0 +1,142 @@
+// Copyright 2024 Ant Group Co., Ltd.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "yacl/link/transport/channel.h"
+
+namespace ic_impl::link {
+
+struct CoalescingOptions {
+  // how long the first small message of a batch waits for others, 0 for no
+  // coalescing
+  size_t window_ms = 0;
+  // largest batch, messages that do not fit in one go out on their own
+  size_t max_bytes = 64 << 10;
+
+  bool Enabled() const { return window_ms > 0 && max_bytes > 0; }
+};
+
+// Channel sending small asynchronous messages to the peer in batches, each
+// one request on links paying a round trip per message, as black box links
+// do through the gateway. A batch goes out once the window of its first
+// message is over, once it is full, or before any other message is sent or
+// received, so a party waiting for an answer never holds back its question.
+// Inbound batches are split back into messages by a receiver thread. Both
+// ends must coalesce, as the batches are frames of ic_impl.
+class CoalescingChannel final : public yacl::link::transport::IChannel {
+ public:
+  CoalescingChannel(std::shared_ptr<yacl::link::transport::IChannel> inner,
+                    const CoalescingOptions &options);
+
+  ~CoalescingChannel() override;
+
+  void SendAsync(const std::string &key,
+                 yacl::ByteContainerView value) override;
+
+  void SendAsync(const std::string &key, yacl::Buffer &&value) override;
+
+  void SendAsyncThrottled(const std::string &key,
+                          yacl::ByteContainerView value) override;
+
+  void SendAsyncThrottled(const std::string &key,
+                          yacl::Buffer &&value) override;
+
+  void Send(const std::string &key, yacl::ByteContainerView value) override;
+
+  yacl::Buffer Recv(const std::string &key) override;
+
+  void OnMessage(const std::string &key,
+                 yacl::ByteContainerView value) override {
+    inner_->OnMessage(key, value);
+  }
+
+  void OnChunkedMessage(const std::string &key, yacl::ByteContainerView value,
+                        size_t offset, size_t total_length) override {
+    inner_->OnChunkedMessage(key, value, offset, total_length);
+  }
+
+  void SetRecvTimeout(uint64_t timeout_ms) override {
+    inner_->SetRecvTimeout(timeout_ms);
+  }
+
+  uint64_t GetRecvTimeout() const override {
+    return inner_->GetRecvTimeout();
+  }
+
+  void WaitLinkTaskFinish() override;
+
+  void SetThrottleWindowSize(size_t size) override {
+    inner_->SetThrottleWindowSize(size);
+  }
+
+  void TestSend(uint32_t timeout) override { inner_->TestSend(timeout); }
+
+  void TestRecv() override { inner_->TestRecv(); }
+
+  // Batches sent so far, for the logs and tests
+  size_t SentBatches() const;
+
+ private:
+  // Queue a small message, false if it has to go out on its own
+  bool Enqueue(const std::string &key, yacl::ByteContainerView value);
+
+  // Send the pending messages, the caller holds mutex_
+  void FlushLocked();
+
+  void Flush();
+
+  void FlushLoop();
+
+  void ReceiveLoop();
+
+  std::shared_ptr<yacl::link::transport::IChannel> inner_;
+
+  CoalescingOptions options_;
+
+  mutable std::mutex mutex_;
+
+  std::condition_variable cond_;
+
+  std::vector<std::pair<std::string, std::string>> pending_;
+
+  size_t pending_bytes_ = 0;
+
+  // when the window of the pending batch is over
+  std::chrono::steady_clock::time_point deadline_;
+
+  size_t send_seq_ = 0;
+
+  size_t sent_batches_ = 0;
+
+  bool stopping_ = false;
+
+  // next batch the receiver waits for
+  std::atomic<size_t> recv_seq_{0};
+
+  std::thread flusher_;
+
+  std::thread receiver_;
+};
+
+}  // namespace ic_impl::link
@@ -0,0 +1,158 @@
+// Copyright 2024 Ant Group Co., Ltd.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include "ic_impl/link/coalescing_channel.h"
+
+#include <chrono>
+#include <future>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "brpc/channel.h"
+#include "fmt/format.h"
+#include "gtest/gtest.h"
+#include "yacl/link/factory.h"
+#include "yacl/link/transport/blackbox_interconnect/mock_transport.h"
+#include "yacl/link/transport/channel_mem.h"
+
+#include "ic_impl/link/link_factory.h"
+
+namespace ic_impl::link {
+namespace {
+
+using yacl::link::transport::ChannelMem;
+
+class CoalescingChannelTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    auto mem0 = std::make_shared<ChannelMem>(0, 1, 1000);
+    auto mem1 = std::make_shared<ChannelMem>(1, 0, 1000);
+    mem0->SetPeer(mem1);
+    mem1->SetPeer(mem0);
+
+    CoalescingOptions options;
+    options.window_ms = 50;
+    options.max_bytes = 1024;
+    sender_ = std::make_shared<CoalescingChannel>(mem0, options);
+    receiver_ = std::make_shared<CoalescingChannel>(mem1, options);
+  }
+
+  std::string RecvString(const std::string &key) {
+    auto buf = receiver_->Recv(key);
+    return std::string(buf.data<char>(), buf.size());
+  }
+
+  std::shared_ptr<CoalescingChannel> sender_;
+  std::shared_ptr<CoalescingChannel> receiver_;
+};
+
+TEST_F(CoalescingChannelTest, SmallMessagesShareABatch) {
+  for (int i = 0; i < 10; ++i) {
+    sender_->SendAsync(fmt::format("key{}", i), fmt::format("value{}", i));
+  }
+
+  for (int i = 0; i < 10; ++i) {
+    EXPECT_EQ(RecvString(fmt::format("key{}", i)), fmt::format("value{}", i));
+  }
+  EXPECT_EQ(sender_->SentBatches(), 1);
+}
+
+TEST_F(CoalescingChannelTest, FullBatchGoesOut) {
+  std::string value(300, 'x');
+  for (int i = 0; i < 10; ++i) {
+    sender_->SendAsync(fmt::format("key{}", i), value);
+  }
+  sender_->WaitLinkTaskFinish();
+
+  for (int i = 0; i < 10; ++i) {
+    EXPECT_EQ(RecvString(fmt::format("key{}", i)), value);
+  }
+  // three fit in 1024 bytes, the last one goes out on its own
+  EXPECT_EQ(sender_->SentBatches(), 3);
+}
+
+TEST_F(CoalescingChannelTest, LargeMessageGoesOutRaw) {
+  sender_->SendAsync("small", std::string("a"));
+  sender_->SendAsync("large", std::string(4096, 'b'));
+
+  EXPECT_EQ(RecvString("large"), std::string(4096, 'b'));
+  EXPECT_EQ(RecvString("small"), "a");
+  EXPECT_EQ(sender_->SentBatches(), 0);
+}
+
+TEST_F(CoalescingChannelTest, RecvFlushesTheQuestion) {
+  auto start = std::chrono::steady_clock::now();
+  sender_->SendAsync("question0", std::string("q0"));
+  sender_->SendAsync("question1", std::string("q1"));
+  auto answer = std::async(std::launch::async, [&] {
+    auto buf = sender_->Recv("answer");
+    return std::string(buf.data<char>(), buf.size());
+  });
+
+  EXPECT_EQ(RecvString("question1"), "q1");
+  receiver_->SendAsync("answer", std::string("a"));
+  EXPECT_EQ(RecvString("question0"), "q0");
+  EXPECT_EQ(answer.get(), "a");
+  // neither end waited for its window
+  EXPECT_LT(std::chrono::steady_clock::now() - start,
+            std::chrono::milliseconds(50));
+}
+
+// Runs once per party with the black box environment of that party, for
+// example two processes against the transport each one starts, and is
+// skipped without it.
+TEST(CoalescingBlackBoxTest, MockTransport) {
+  yacl::link::ContextDesc desc;
+  desc.brpc_channel_protocol = "http";
+  size_t self_rank;
+  try {
+    yacl::link::FactoryBrpcBlackBox::GetPartyNodeInfoFromEnv(desc.parties,
+                                                             self_rank);
+  } catch (const std::exception &e) {
+    GTEST_SKIP() << "no black box environment: " << e.what();
+  }
+  ASSERT_EQ(desc.parties.size(), 2);
+
+  static yacl::link::transport::blackbox_interconnect::MockTransport transport;
+  brpc::ChannelOptions options;
+  options.protocol = "http";
+  options.connection_type = "";
+  options.connect_timeout_ms = 20000;
+  options.timeout_ms = 1e4;
+  options.max_retry = 3;
+  transport.StartFromEnv(options);
+
+  CoalescingOptions coalescing;
+  coalescing.window_ms = 20;
+  std::vector<std::shared_ptr<CoalescingChannel>> channels;
+  auto lctx =
+      CreateBlackBoxLinkContext(desc, self_rank, coalescing, &channels);
+  lctx->ConnectToMesh();
+
+  size_t peer = 1 - self_rank;
+  for (int i = 0; i < 32; ++i) {
+    lctx->SendAsync(peer, fmt::format("{}:{}", self_rank, i),
+                    fmt::format("tag{}", i));
+  }
+  for (int i = 0; i < 32; ++i) {
+    auto buf = lctx->Recv(peer, fmt::format("tag{}", i));
+    EXPECT_EQ(std::string(buf.data<char>(), buf.size()),
+              fmt::format("{}:{}", peer, i));
+  }
+  lctx->WaitLinkTaskFinish();
+  EXPECT_GE(channels[peer]->SentBatches(), 1);
+}
+
+}  // namespace
+}  // namespace ic_impl::link
@@ -0,0 +1,116 @@
+// Copyright 2024 Ant Group Co., Ltd.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include "ic_impl/link/codec_channel.h"
+
+#include <algorithm>
+#include <chrono>
+
+#include "ic_impl/link/wire_codec.h"
+
+namespace ic_impl::link {
+
+namespace {
+
+constexpr size_t kProbeSize = 1 << 20;
+
+constexpr char kProbeKey[] = "ic_impl_wire_probe";
+
+}  // namespace
+
+void CodecChannel::SetWireFormat(int32_t format, bool allow_zlib) {
+  encoded_ = IsEncodedWireFormat(format);
+  allow_zlib_ = allow_zlib;
+}
+
+double CodecChannel::MeasureBandwidth(bool send_first) {
+  // random bytes keep compressing transports from flattering the link
+  std::string probe(kProbeSize, '\0');
+  uint64_t state = 0x9e3779b97f4a7c15;
+  for (auto &c : probe) {
+    state = state * 6364136223846793005 + 1442695040888963407;
+    c = static_cast<char>(state >> 56);
+  }
+
+  if (!send_first) {
+    inner_->Recv(kProbeKey);
+  }
+  auto start = std::chrono::steady_clock::now();
+  inner_->Send(kProbeKey, probe);
+  std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+  if (send_first) {
+    inner_->Recv(kProbeKey);
+  }
+
+  return kProbeSize * 8 / 1e6 / std::max(elapsed.count(), 1e-6);
+}
+
+yacl::Buffer CodecChannel::Encode(yacl::ByteContainerView value) const {
+  return EncodeWireMessage(value, allow_zlib_);
+}
+
+void CodecChannel::SendAsync(const std::string &key,
+                             yacl::ByteContainerView value) {
+  if (encoded_) {
+    inner_->SendAsync(key, Encode(value));
+  } else {
+    inner_->SendAsync(key, value);
+  }
+}
+
+void CodecChannel::SendAsync(const std::string &key, yacl::Buffer &&value) {
+  if (encoded_) {
+    inner_->SendAsync(key, Encode(value));
+  } else {
+    inner_->SendAsync(key, std::move(value));
+  }
+}
+
+void CodecChannel::SendAsyncThrottled(const std::string &key,
+                                      yacl::ByteContainerView value) {
+  if (encoded_) {
+    inner_->SendAsyncThrottled(key, Encode(value));
+  } else {
+    inner_->SendAsyncThrottled(key, value);
+  }
+}
+
+void CodecChannel::SendAsyncThrottled(const std::string &key,
+                                      yacl::Buffer &&value) {
+  if (encoded_) {
+    inner_->SendAsyncThrottled(key, Encode(value));
+  } else {
+    inner_->SendAsyncThrottled(key, std::move(value));
+  }
+}
+
+void CodecChannel::Send(const std::string &key,
+                        yacl::ByteContainerView value) {
+  if (encoded_) {
+    inner_->Send(key, Encode(value));
+  } else {
+    inner_->Send(key, value);
+  }
+}
+
+yacl::Buffer CodecChannel::Recv(const std::string &key) {
+  auto value = inner_->Recv(key);
+  // the peer may switch before or after self, so trust the message
+  if (!IsWireMessage(value)) {
+    return value;
+  }
+  return DecodeWireMessage(value);
+}
+
+}  // namespace ic_impl::link
@@ -0,0 +1,93 @@
+// Copyright 2024 Ant Group Co., Ltd.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <string>
+
+#include "yacl/link/transport/channel.h"
+
+namespace ic_impl::link {
+
+// Channel passing messages through the wire codec once a format is agreed
+// on. Until then, and with WIRE_FORMAT_RAW, messages go out unchanged, so
+// the handshake itself is readable by any peer.
+class CodecChannel final : public yacl::link::transport::IChannel {
+ public:
+  explicit CodecChannel(std::shared_ptr<yacl::link::transport::IChannel> inner)
+      : inner_(std::move(inner)) {}
+
+  // Send in `format`, an ic_impl.proto.WireFormat, from now on. Received
+  // messages are decoded by their own header whatever the format.
+  void SetWireFormat(int32_t format, bool allow_zlib);
+
+  // Time a probe message in both directions and return the bandwidth of the
+  // outbound direction in Mbps. `send_first` must differ between the ends.
+  double MeasureBandwidth(bool send_first);
+
+  void SendAsync(const std::string &key,
+                 yacl::ByteContainerView value) override;
+
+  void SendAsync(const std::string &key, yacl::Buffer &&value) override;
+
+  void SendAsyncThrottled(const std::string &key,
+                          yacl::ByteContainerView value) override;
+
+  void SendAsyncThrottled(const std::string &key,
+                          yacl::Buffer &&value) override;
+
+  void Send(const std::string &key, yacl::ByteContainerView value) override;
+
+  yacl::Buffer Recv(const std::string &key) override;
+
+  void OnMessage(const std::string &key,
+                 yacl::ByteContainerView value) override {
+    inner_->OnMessage(key, value);
+  }
+
+  void OnChunkedMessage(const std::string &key, yacl::ByteContainerView value,
+                        size_t offset, size_t total_length) override {
+    inner_->OnChunkedMessage(key, value, offset, total_length);
+  }
+
+  void SetRecvTimeout(uint64_t timeout_ms) override {
+    inner_->SetRecvTimeout(timeout_ms);
+  }
+
+  uint64_t GetRecvTimeout() const override {
+    return inner_->GetRecvTimeout();
+  }
+
+  void WaitLinkTaskFinish() override { inner_->WaitLinkTaskFinish(); }
+
+  void SetThrottleWindowSize(size_t size) override {
+    inner_->SetThrottleWindowSize(size);
+  }
+
+  void TestSend(uint32_t timeout) override { inner_->TestSend(timeout); }
+
+  void TestRecv() override { inner_->TestRecv(); }
+
+ private:
+  yacl::Buffer Encode(yacl::ByteContainerView value) const;
+
+  std::shared_ptr<yacl::link::transport::IChannel> inner_;
+
+  std::atomic<bool> encoded_{false};
+
+  std::atomic<bool> allow_zlib_{false};
+};
+
+}  // namespace ic_impl::link
@@ -0,0 +1,226 @@
+// Copyright 2024 Ant Group Co., Ltd.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include "ic_impl/link/link_factory.h"
+
+#include <algorithm>
+
+#include "spdlog/spdlog.h"
+#include "yacl/base/exception.h"
+#include "yacl/link/transport/channel_brpc.h"
+#include "yacl/link/transport/channel_brpc_blackbox.h"
+#include "yacl/link/transport/channel_mem.h"
+
+#include "ic_impl/link/shm_channel.h"
+
+namespace ic_impl::link {
+
+namespace {
+
+using Channels = std::vector<std::shared_ptr<yacl::link::transport::IChannel>>;
+
+// Put the emulated wide area links and the codecs over `channels`
+void WrapChannels(size_t self_rank, const std::vector<WanProfile> &wan_profiles,
+                  Channels *channels,
+                  std::vector<std::shared_ptr<CodecChannel>> *codec_channels) {
+  for (size_t rank = 0; rank < wan_profiles.size(); ++rank) {
+    const auto &profile = wan_profiles[rank];
+    if (rank != self_rank && profile.Enabled()) {
+      // below the codec, so that the emulated wire carries encoded messages
+      (*channels)[rank] =
+          std::make_shared<WanChannel>((*channels)[rank], profile);
+      SPDLOG_INFO(
+          "emulate link to rank {}: latency {} ms, bandwidth {} Mbps, "
+          "jitter {} ms",
+          rank, profile.latency_ms, profile.bandwidth_mbps, profile.jitter_ms);
+    }
+  }
+
+  codec_channels->assign(channels->size(), nullptr);
+  for (size_t rank = 0; rank < channels->size(); ++rank) {
+    if (rank != self_rank) {
+      (*codec_channels)[rank] =
+          std::make_shared<CodecChannel>((*channels)[rank]);
+      (*channels)[rank] = (*codec_channels)[rank];
+    }
+  }
+}
+
+}  // namespace
+
+std::shared_ptr<yacl::link::Context> CreateWhiteBoxLinkContext(
+    const yacl::link::ContextDesc &desc, size_t self_rank,
+    const std::vector<bool> &local, const std::string &session,
+    const std::vector<WanProfile> &wan_profiles,
+    std::vector<std::shared_ptr<CodecChannel>> *codec_channels) {
+  using yacl::link::transport::ChannelBrpc;
+  using yacl::link::transport::ReceiverLoopBrpc;
+
+  size_t world_size = desc.parties.size();
+  YACL_ENFORCE(local.size() == world_size && self_rank < world_size);
+  YACL_ENFORCE(!desc.enable_ssl, "ssl is not supported with white box links");
+  YACL_ENFORCE(wan_profiles.empty() || wan_profiles.size() == world_size);
+
+  auto brpc_loop = std::make_shared<ReceiverLoopBrpc>();
+  bool has_remote = false;
+  Channels channels(world_size);
+  std::vector<std::shared_ptr<ShmChannel>> shm_channels;
+  for (size_t rank = 0; rank < world_size; ++rank) {
+    if (rank == self_rank) {
+      continue;
+    }
+
+    if (local[self_rank] && local[rank]) {
+      auto channel = std::make_shared<ShmChannel>(self_rank, rank, session,
+                                                  desc.recv_timeout_ms);
+      channel->StartReceive();
+      shm_channels.push_back(channel);
+      channels[rank] = std::move(channel);
+      continue;
+    }
+
+    auto opts = ChannelBrpc::GetDefaultOptions();
+    opts.http_timeout_ms = desc.http_timeout_ms;
+    opts.http_max_payload_size = desc.http_max_payload_size;
+    if (!desc.brpc_channel_protocol.empty()) {
+      opts.channel_protocol = desc.brpc_channel_protocol;
+    }
+    if (!desc.brpc_channel_connection_type.empty()) {
+      opts.channel_connection_type = desc.brpc_channel_connection_type;
+    }
+    auto channel = std::make_shared<ChannelBrpc>(
+        self_rank, rank, desc.recv_timeout_ms, opts, desc.exit_if_async_error);
+    channel->SetPeerHost(desc.parties[rank].host, nullptr);
+    channel->SetThrottleWindowSize(desc.throttle_window_size);
+    brpc_loop->AddListener(rank, channel);
+    channels[rank] = std::move(channel);
+    has_remote = true;
+  }
+
+  // every party creates its inbound rings before connecting to the others
+  for (auto &channel : shm_channels) {
+    channel->ConnectPeer(desc.connect_retry_times,
+                         desc.connect_retry_interval_ms);
+  }
+
+  WrapChannels(self_rank, wan_profiles, &channels, codec_channels);
+
+  std::shared_ptr<yacl::link::transport::IReceiverLoop> msg_loop;
+  if (has_remote) {
+    brpc_loop->Start(desc.parties[self_rank].host, nullptr);
+    msg_loop = std::move(brpc_loop);
+  } else {
+    msg_loop = std::make_shared<yacl::link::transport::ReceiverLoopMem>();
+  }
+
+  SPDLOG_INFO("rank:{} shm link peers:{} brpc link peers:{}", self_rank,
+              shm_channels.size(), world_size - 1 - shm_channels.size());
+
+  return std::make_shared<yacl::link::Context>(desc, self_rank,
+                                               std::move(channels), msg_loop);
+}
+
+std::shared_ptr<yacl::link::Context> CreateRouterLinkContext(
+    const yacl::link::ContextDesc &desc, size_t self_rank,
+    const RouterOptions &router, const std::string &session,
+    const std::vector<WanProfile> &wan_profiles,
+    std::vector<std::shared_ptr<CodecChannel>> *codec_channels) {
+  size_t world_size = desc.parties.size();
+  YACL_ENFORCE(self_rank < world_size);
+  YACL_ENFORCE(wan_profiles.empty() || wan_profiles.size() == world_size);
+
+  Channels channels(world_size);
+  for (size_t rank = 0; rank < world_size; ++rank) {
+    if (rank == self_rank) {
+      continue;
+    }
+    auto channel = std::make_shared<RouterChannel>(
+        self_rank, rank, session, router, desc.recv_timeout_ms);
+    channel->Connect(desc.connect_retry_times, desc.connect_retry_interval_ms);
+    channels[rank] = std::move(channel);
+  }
+
+  WrapChannels(self_rank, wan_profiles, &channels, codec_channels);
+
+  SPDLOG_INFO("rank:{} router link peers:{} through {}", self_rank,
+              world_size - 1, router.server);
+
+  return std::make_shared<yacl::link::Context>(
+      desc, self_rank, std::move(channels),
+      std::make_shared<yacl::link::transport::ReceiverLoopMem>());
+}
+
+std::shared_ptr<yacl::link::Context> CreateBlackBoxLinkContext(
+    const yacl::link::ContextDesc &desc, size_t self_rank,
+    const CoalescingOptions &coalescing,
+    std::vector<std::shared_ptr<CoalescingChannel>> *coalescing_channels) {
+  using yacl::link::transport::ChannelBrpcBlackBox;
+  using yacl::link::transport::ReceiverLoopBlackBox;
+
+  size_t world_size = desc.parties.size();
+  YACL_ENFORCE(self_rank < world_size);
+
+  // a batch is one request through the gateway, never a chunked one
+  auto options = coalescing;
+  if (desc.http_max_payload_size > 0) {
+    options.max_bytes =
+        std::min<size_t>(options.max_bytes, desc.http_max_payload_size);
+  }
+
+  auto msg_loop = std::make_shared<ReceiverLoopBlackBox>();
+  Channels channels(world_size);
+  if (coalescing_channels != nullptr) {
+    coalescing_channels->assign(world_size, nullptr);
+  }
+  for (size_t rank = 0; rank < world_size; ++rank) {
+    if (rank == self_rank) {
+      continue;
+    }
+
+    auto opts = ChannelBrpcBlackBox::GetDefaultOptions();
+    opts.http_timeout_ms = desc.http_timeout_ms;
+    opts.http_max_payload_size = desc.http_max_payload_size;
+    if (!desc.brpc_channel_protocol.empty()) {
+      opts.channel_protocol = desc.brpc_channel_protocol;
+    }
+    if (!desc.brpc_channel_connection_type.empty()) {
+      opts.channel_connection_type = desc.brpc_channel_connection_type;
+    }
+    auto channel = std::make_shared<ChannelBrpcBlackBox>(
+        self_rank, rank, desc.recv_timeout_ms, opts, desc.exit_if_async_error);
+    channel->SetPeerHost(desc.parties[self_rank].id, desc.parties[rank].id,
+                         desc.enable_ssl ? &desc.client_ssl_opts : nullptr);
+    channel->SetThrottleWindowSize(desc.throttle_window_size);
+    msg_loop->AddListener(rank, channel);
+    channels[rank] = std::move(channel);
+
+    if (options.Enabled()) {
+      auto coalescer =
+          std::make_shared<CoalescingChannel>(channels[rank], options);
+      if (coalescing_channels != nullptr) {
+        (*coalescing_channels)[rank] = coalescer;
+      }
+      channels[rank] = std::move(coalescer);
+    }
+  }
+  msg_loop->Start();
+
+  SPDLOG_INFO("rank:{} black box link peers:{} coalescing:{} ms {} B",
+              self_rank, world_size - 1, options.window_ms,
+              options.Enabled() ? options.max_bytes : 0);
+
+  return std::make_shared<yacl::link::Context>(desc, self_rank,
+                                               std::move(channels), msg_loop);
+}
+
+}  // namespace ic_impl::link
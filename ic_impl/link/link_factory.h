@@ -0,0 +1,58 @@
+// Copyright 2024 Ant Group Co., Ltd.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "yacl/link/context.h"
+
+#include "ic_impl/link/coalescing_channel.h"
+#include "ic_impl/link/codec_channel.h"
+#include "ic_impl/link/router_channel.h"
+#include "ic_impl/link/wan_channel.h"
+
+namespace ic_impl::link {
+
+// Create a link context in which the co-located parties, marked in `local`,
+// exchange messages through shared memory and the others through brpc.
+// `session` must be the same on every party of the job. Outbound messages
+// to the peers with a profile in `wan_profiles`, by rank or empty, are held
+// back as on a wide area link. Every channel goes through a CodecChannel,
+// returned by peer rank in `codec_channels`.
+std::shared_ptr<yacl::link::Context> CreateWhiteBoxLinkContext(
+    const yacl::link::ContextDesc &desc, size_t self_rank,
+    const std::vector<bool> &local, const std::string &session,
+    const std::vector<WanProfile> &wan_profiles,
+    std::vector<std::shared_ptr<CodecChannel>> *codec_channels);
+
+// Create a link context in which every message goes through the router
+// server of `router`, wrapped as CreateWhiteBoxLinkContext does.
+std::shared_ptr<yacl::link::Context> CreateRouterLinkContext(
+    const yacl::link::ContextDesc &desc, size_t self_rank,
+    const RouterOptions &router, const std::string &session,
+    const std::vector<WanProfile> &wan_profiles,
+    std::vector<std::shared_ptr<CodecChannel>> *codec_channels);
+
+// Create a link context in which every message goes through the gateway of
+// the black box, as yacl::link::FactoryBrpcBlackBox does. With `coalescing`
+// enabled, every channel goes through a CoalescingChannel, returned by peer
+// rank in `coalescing_channels` unless null.
+std::shared_ptr<yacl::link::Context> CreateBlackBoxLinkContext(
+    const yacl::link::ContextDesc &desc, size_t self_rank,
+    const CoalescingOptions &coalescing,
+    std::vector<std::shared_ptr<CoalescingChannel>> *coalescing_channels);
+
+}  // namespace ic_impl::link
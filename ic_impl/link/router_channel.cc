@@ -0,0 +1,254 @@
+// Copyright 2024 Ant Group Co., Ltd.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include "ic_impl/link/router_channel.h"
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+
+#include "fmt/format.h"
+#include "spdlog/spdlog.h"
+#include "yacl/base/exception.h"
+
+#include "ic_impl/link/router_frame.h"
+
+#include "ic_impl/proto/router.pb.h"
+
+namespace ic_impl::link {
+
+RouterChannel::RouterChannel(size_t self_rank, size_t peer_rank,
+                             std::string session, RouterOptions options,
+                             size_t recv_timeout_ms)
+    : ChannelBase(self_rank, peer_rank, recv_timeout_ms),
+      session_(std::move(session)),
+      options_(std::move(options)),
+      send_timeout_ms_(recv_timeout_ms) {
+  YACL_ENFORCE(options_.package_size > 0 && options_.window > 0);
+}
+
+RouterChannel::~RouterChannel() {
+  {
+    std::lock_guard lock(mutex_);
+    stopping_ = true;
+  }
+  cond_.notify_all();
+  if (fd_ >= 0) {
+    // wakes the receiver up
+    ::shutdown(fd_, SHUT_RDWR);
+  }
+  if (sender_.joinable()) {
+    sender_.join();
+  }
+  if (receiver_.joinable()) {
+    receiver_.join();
+  }
+  if (fd_ >= 0) {
+    ::close(fd_);
+  }
+}
+
+std::string RouterChannel::NodeId(size_t rank) const {
+  // one node per direction, so that the RS keeps the channels of a party
+  // to different peers apart
+  size_t peer = rank == self_rank_ ? peer_rank_ : self_rank_;
+  return fmt::format("{}/party{}/party{}", session_, rank, peer);
+}
+
+void RouterChannel::Connect(size_t retry_times, size_t retry_interval_ms) {
+  fd_ = ConnectRouter(options_.server, retry_times, retry_interval_ms);
+
+  ic_impl::proto::RouterFrame hello;
+  hello.mutable_hello()->set_node_id(NodeId(self_rank_));
+  WriteFrame(fd_, hello);
+
+  receiver_ = std::thread(&RouterChannel::ReceiveLoop, this);
+  sender_ = std::thread(&RouterChannel::SendLoop, this);
+}
+
+void RouterChannel::SendAsyncImpl(const std::string &key,
+                                  yacl::ByteContainerView value) {
+  yacl::Buffer buffer(value.data(), value.size());
+  yacl::ByteContainerView view(buffer.data(), buffer.size());
+  Enqueue({key, std::move(buffer), view, nullptr});
+}
+
+void RouterChannel::SendAsyncImpl(const std::string &key,
+                                  yacl::Buffer &&value) {
+  yacl::ByteContainerView view(value.data(), value.size());
+  Enqueue({key, std::move(value), view, nullptr});
+}
+
+void RouterChannel::SendImpl(const std::string &key,
+                             yacl::ByteContainerView value) {
+  SendImpl(key, value, send_timeout_ms_);
+}
+
+void RouterChannel::SendImpl(const std::string &key,
+                             yacl::ByteContainerView value, uint32_t) {
+  // written from the buffer of the caller, which waits until it is through
+  std::promise<void> sent;
+  auto done = sent.get_future();
+  Enqueue({key, yacl::Buffer(), value, &sent});
+  done.get();
+}
+
+void RouterChannel::Enqueue(Outbound &&message) {
+  {
+    std::lock_guard lock(mutex_);
+    YACL_ENFORCE(fd_ >= 0, "router channel to rank {} not connected",
+                 peer_rank_);
+    YACL_ENFORCE(error_.empty(), "router channel to rank {} failed: {}",
+                 peer_rank_, error_);
+    queue_.push_back(std::move(message));
+  }
+  cond_.notify_all();
+}
+
+void RouterChannel::SendLoop() {
+  while (true) {
+    Outbound message;
+    {
+      std::unique_lock lock(mutex_);
+      cond_.wait(lock, [this] { return stopping_ || !queue_.empty(); });
+      if (queue_.empty()) {
+        return;
+      }
+      message = std::move(queue_.front());
+      queue_.pop_front();
+    }
+
+    try {
+      WriteMessage(message);
+      if (message.sent != nullptr) {
+        message.sent->set_value();
+      }
+    } catch (const std::exception &e) {
+      {
+        std::lock_guard lock(mutex_);
+        if (error_.empty()) {
+          error_ = e.what();
+        }
+      }
+      if (message.sent != nullptr) {
+        message.sent->set_exception(std::current_exception());
+      } else {
+        SPDLOG_ERROR("router channel to rank {} dropped message {}: {}",
+                     peer_rank_, message.key, e.what());
+      }
+    }
+  }
+}
+
+void RouterChannel::WriteMessage(const Outbound &message) {
+  size_t size = message.value.size();
+  size_t total = std::max<size_t>((size + options_.package_size - 1) /
+                                      options_.package_size,
+                                  1);
+  ic_impl::proto::RouterFrame frame;
+  frame.set_cid(message.key);
+  auto *package = frame.mutable_package();
+  package->set_source_id(NodeId(self_rank_));
+  package->set_target_id(NodeId(peer_rank_));
+  package->set_total(total);
+  package->set_message_size(size);
+
+  for (size_t i = 0; i < total; ++i) {
+    {
+      std::unique_lock lock(mutex_);
+      bool ready = cond_.wait_for(
+          lock, std::chrono::milliseconds(send_timeout_ms_), [this] {
+            return stopping_ || !error_.empty() ||
+                   in_flight_ < options_.window;
+          });
+      YACL_ENFORCE(!stopping_, "router channel to rank {} closed", peer_rank_);
+      YACL_ENFORCE(error_.empty(), "router server failed: {}", error_);
+      YACL_ENFORCE(ready, "send to rank {} through router timeout",
+                   peer_rank_);
+      ++in_flight_;
+      package->set_seq(++seq_);
+    }
+
+    size_t offset = i * options_.package_size;
+    size_t data_size = std::min(options_.package_size, size - offset);
+    package->set_offset(offset);
+    package->set_data_size(data_size);
+    WriteFrame(fd_, frame,
+               yacl::ByteContainerView(message.value.data() + offset,
+                                       data_size));
+  }
+}
+
+void RouterChannel::ReceiveLoop() {
+  ic_impl::proto::RouterFrame frame;
+  try {
+    while (ReadFrame(fd_, &frame)) {
+      if (frame.has_ack()) {
+        {
+          std::lock_guard lock(mutex_);
+          --in_flight_;
+        }
+        cond_.notify_all();
+        continue;
+      }
+
+      if (frame.has_error()) {
+        SPDLOG_ERROR("router server: {} {}", frame.error().code(),
+                     frame.error().detail());
+        {
+          std::lock_guard lock(mutex_);
+          error_ = frame.error().detail();
+        }
+        cond_.notify_all();
+        continue;
+      }
+
+      YACL_ENFORCE(frame.has_package(), "unexpected router frame");
+      const auto &package = frame.package();
+      auto &message = inbound_[frame.cid()];
+      if (message.received == 0) {
+        message.buffer = yacl::Buffer(package.message_size());
+      }
+      YACL_ENFORCE(package.offset() + package.data_size() <=
+                       message.buffer.size(),
+                   "package {} of {} out of its message", package.seq(),
+                   frame.cid());
+      ReadFull(fd_, message.buffer.data<uint8_t>() + package.offset(),
+               package.data_size());
+      message.received += package.data_size();
+      if (message.received == static_cast<size_t>(message.buffer.size())) {
+        OnMessage(frame.cid(), message.buffer);
+        inbound_.erase(frame.cid());
+      }
+    }
+  } catch (const std::exception &e) {
+    std::lock_guard lock(mutex_);
+    if (!stopping_) {
+      SPDLOG_ERROR("router channel from rank {} failed: {}", peer_rank_,
+                   e.what());
+      error_ = e.what();
+    }
+  }
+
+  {
+    std::lock_guard lock(mutex_);
+    if (!stopping_ && error_.empty()) {
+      error_ = "connection closed by the router server";
+    }
+  }
+  cond_.notify_all();
+}
+
+}  // namespace ic_impl::link
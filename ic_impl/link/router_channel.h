@@ -0,0 +1,127 @@
+// Copyright 2024 Ant Group Co., Ltd.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <future>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "yacl/link/transport/channel.h"
+
+namespace ic_impl::link {
+
+struct RouterOptions {
+  // host:port of the router server, empty for direct links
+  std::string server;
+  // largest data of a package, messages are split into as many as needed
+  size_t package_size = 1 << 20;
+  // packages sent but not acknowledged by the RS yet
+  size_t window = 16;
+
+  bool Enabled() const { return !server.empty(); }
+};
+
+// Router client (RC) channel, sending the messages to the peer through a
+// router server (RS) as the router of anyconn does. A message is split into
+// packages written straight from its buffer, with up to `window` of them in
+// flight. Inbound packages are read into the buffer of their message.
+class RouterChannel final : public yacl::link::transport::ChannelBase {
+ public:
+  // `session` tells the nodes of concurrent jobs apart on the RS
+  RouterChannel(size_t self_rank, size_t peer_rank, std::string session,
+                RouterOptions options, size_t recv_timeout_ms);
+
+  ~RouterChannel() override;
+
+  // Connect to the RS and start receiving
+  void Connect(size_t retry_times, size_t retry_interval_ms);
+
+  void SetThrottleWindowSize(size_t) override {}
+
+  void TestSend(uint32_t) override {}
+
+ protected:
+  void SendAsyncImpl(const std::string &key,
+                     yacl::ByteContainerView value) override;
+
+  void SendAsyncImpl(const std::string &key, yacl::Buffer &&value) override;
+
+  void SendImpl(const std::string &key,
+                yacl::ByteContainerView value) override;
+
+  void SendImpl(const std::string &key, yacl::ByteContainerView value,
+                uint32_t timeout) override;
+
+ private:
+  struct Outbound {
+    std::string key;
+    // owned by the queue for asynchronous sends
+    yacl::Buffer buffer;
+    yacl::ByteContainerView value;
+    // set once a synchronous send is through
+    std::promise<void> *sent;
+  };
+
+  struct Inbound {
+    yacl::Buffer buffer;
+    size_t received = 0;
+  };
+
+  void Enqueue(Outbound &&message);
+
+  void SendLoop();
+
+  void ReceiveLoop();
+
+  void WriteMessage(const Outbound &message);
+
+  std::string NodeId(size_t rank) const;
+
+  std::string session_;
+
+  RouterOptions options_;
+
+  // how long a package waits for room in the window
+  size_t send_timeout_ms_;
+
+  int fd_ = -1;
+
+  std::mutex mutex_;
+
+  std::condition_variable cond_;
+
+  std::deque<Outbound> queue_;
+
+  size_t in_flight_ = 0;
+
+  bool stopping_ = false;
+
+  // reported by the RS, fails the sends from then on
+  std::string error_;
+
+  int64_t seq_ = 0;
+
+  // messages partly received, by key, touched by the receiver only
+  std::map<std::string, Inbound> inbound_;
+
+  std::thread sender_;
+
+  std::thread receiver_;
+};
+
+}  // namespace ic_impl::link
@@ -0,0 +1,175 @@
+// Copyright 2024 Ant Group Co., Ltd.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include "ic_impl/link/router_frame.h"
+
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <thread>
+
+#include "yacl/base/exception.h"
+
+namespace ic_impl::link {
+
+namespace {
+
+// larger headers are a corrupted stream
+constexpr uint32_t kMaxHeaderSize = 1 << 20;
+
+std::pair<std::string, std::string> SplitAddress(const std::string &address) {
+  auto pos = address.rfind(':');
+  YACL_ENFORCE(pos != std::string::npos, "invalid address {}", address);
+  return {address.substr(0, pos), address.substr(pos + 1)};
+}
+
+addrinfo *Resolve(const std::string &address, bool passive) {
+  auto [host, port] = SplitAddress(address);
+  addrinfo hints{};
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  hints.ai_flags = passive ? AI_PASSIVE : 0;
+  addrinfo *result = nullptr;
+  int ret = ::getaddrinfo(host.empty() ? nullptr : host.c_str(), port.c_str(),
+                          &hints, &result);
+  YACL_ENFORCE(ret == 0, "resolve {} failed: {}", address, gai_strerror(ret));
+  return result;
+}
+
+void SetNoDelay(int fd) {
+  // packages are written whole, Nagle would only hold back the last one
+  int one = 1;
+  ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+}
+
+}  // namespace
+
+int ConnectRouter(const std::string &address, size_t retry_times,
+                  size_t retry_interval_ms) {
+  for (size_t i = 0; i <= retry_times; ++i) {
+    addrinfo *addrs = Resolve(address, false);
+    for (auto *addr = addrs; addr != nullptr; addr = addr->ai_next) {
+      int fd = ::socket(addr->ai_family, addr->ai_socktype, addr->ai_protocol);
+      if (fd < 0) {
+        continue;
+      }
+      if (::connect(fd, addr->ai_addr, addr->ai_addrlen) == 0) {
+        ::freeaddrinfo(addrs);
+        SetNoDelay(fd);
+        return fd;
+      }
+      ::close(fd);
+    }
+    ::freeaddrinfo(addrs);
+    std::this_thread::sleep_for(std::chrono::milliseconds(retry_interval_ms));
+  }
+  YACL_THROW("connect to router server {} failed", address);
+}
+
+int ListenRouter(const std::string &address) {
+  addrinfo *addrs = Resolve(address, true);
+  int fd = -1;
+  for (auto *addr = addrs; addr != nullptr && fd < 0; addr = addr->ai_next) {
+    fd = ::socket(addr->ai_family, addr->ai_socktype, addr->ai_protocol);
+    if (fd < 0) {
+      continue;
+    }
+    int one = 1;
+    ::setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    if (::bind(fd, addr->ai_addr, addr->ai_addrlen) != 0 ||
+        ::listen(fd, SOMAXCONN) != 0) {
+      ::close(fd);
+      fd = -1;
+    }
+  }
+  ::freeaddrinfo(addrs);
+  YACL_ENFORCE(fd >= 0, "listen on {} failed, errno={}", address, errno);
+  return fd;
+}
+
+void WriteFrame(int fd, const ic_impl::proto::RouterFrame &frame,
+                yacl::ByteContainerView data) {
+  auto header = frame.SerializeAsString();
+  uint32_t header_size = header.size();
+
+  iovec iov[3] = {
+      {&header_size, sizeof(header_size)},
+      {header.data(), header.size()},
+      {const_cast<uint8_t *>(data.data()), data.size()},
+  };
+  int iov_num = data.empty() ? 2 : 3;
+  iovec *pending = iov;
+  while (iov_num > 0) {
+    msghdr msg{};
+    msg.msg_iov = pending;
+    msg.msg_iovlen = iov_num;
+    ssize_t written = ::sendmsg(fd, &msg, MSG_NOSIGNAL);
+    if (written < 0 && errno == EINTR) {
+      continue;
+    }
+    YACL_ENFORCE(written >= 0, "write to router socket failed, errno={}",
+                 errno);
+    // skip what is through, a partial write leaves the rest of an iovec
+    size_t done = written;
+    while (iov_num > 0 && done >= pending->iov_len) {
+      done -= pending->iov_len;
+      ++pending;
+      --iov_num;
+    }
+    if (iov_num > 0) {
+      pending->iov_base = static_cast<char *>(pending->iov_base) + done;
+      pending->iov_len -= done;
+    }
+  }
+}
+
+bool ReadFrame(int fd, ic_impl::proto::RouterFrame *frame) {
+  uint32_t header_size = 0;
+  ssize_t got;
+  do {
+    got = ::recv(fd, &header_size, 1, MSG_PEEK);
+  } while (got < 0 && errno == EINTR);
+  if (got == 0) {
+    return false;
+  }
+  ReadFull(fd, &header_size, sizeof(header_size));
+  YACL_ENFORCE(header_size <= kMaxHeaderSize, "router frame of {} bytes",
+               header_size);
+
+  std::string header(header_size, '\0');
+  ReadFull(fd, header.data(), header.size());
+  YACL_ENFORCE(frame->ParseFromString(header), "invalid router frame");
+  return true;
+}
+
+void ReadFull(int fd, void *buf, size_t size) {
+  auto *dst = static_cast<char *>(buf);
+  while (size > 0) {
+    ssize_t got = ::recv(fd, dst, size, 0);
+    if (got < 0 && errno == EINTR) {
+      continue;
+    }
+    YACL_ENFORCE(got > 0, "read from router socket failed, errno={}", errno);
+    dst += got;
+    size -= got;
+  }
+}
+
+}  // namespace ic_impl::link
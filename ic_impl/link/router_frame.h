@@ -0,0 +1,42 @@
+// Copyright 2024 Ant Group Co., Ltd.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#pragma once
+
+#include <string>
+
+#include "yacl/base/byte_container_view.h"
+
+#include "ic_impl/proto/router.pb.h"
+
+namespace ic_impl::link {
+
+// Connect to `address`, host:port, retrying as the link does
+int ConnectRouter(const std::string &address, size_t retry_times,
+                  size_t retry_interval_ms);
+
+// Listen on `address`, host:port, the host may be empty for any
+int ListenRouter(const std::string &address);
+
+// Write `frame` followed by `data` in one go, straight from their buffers
+void WriteFrame(int fd, const ic_impl::proto::RouterFrame &frame,
+                yacl::ByteContainerView data = {});
+
+// Read the next frame, leaving the data of a package on the socket. False
+// once the peer closed the connection.
+bool ReadFrame(int fd, ic_impl::proto::RouterFrame *frame);
+
+// Read exactly `size` bytes into `buf`
+void ReadFull(int fd, void *buf, size_t size);
+
+}  // namespace ic_impl::link
@@ -0,0 +1,166 @@
+// Copyright 2024 Ant Group Co., Ltd.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include "ic_impl/link/router_server.h"
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <chrono>
+
+#include "spdlog/spdlog.h"
+#include "yacl/base/exception.h"
+
+#include "ic_impl/link/router_frame.h"
+
+#include "ic_impl/proto/router.pb.h"
+
+namespace ic_impl::link {
+
+namespace {
+
+// how long a package waits for its target to connect
+constexpr auto kTargetWaitTimeout = std::chrono::seconds(60);
+
+}  // namespace
+
+struct RouterServer::Client {
+  explicit Client(int fd) : fd(fd) {}
+
+  ~Client() { ::close(fd); }
+
+  // written by the threads of every source forwarding to it
+  void Write(const ic_impl::proto::RouterFrame &frame,
+             yacl::ByteContainerView data = {}) {
+    std::lock_guard lock(write_mutex);
+    WriteFrame(fd, frame, data);
+  }
+
+  void WriteError(const std::string &cid, const std::string &code,
+                  const std::string &detail) {
+    ic_impl::proto::RouterFrame frame;
+    frame.set_cid(cid);
+    frame.mutable_error()->set_code(code);
+    frame.mutable_error()->set_detail(detail);
+    Write(frame);
+  }
+
+  const int fd;
+  std::mutex write_mutex;
+  std::string node_id;
+};
+
+RouterServer::RouterServer(const std::string &address)
+    : listen_fd_(ListenRouter(address)) {
+  SPDLOG_INFO("router server listening on {}", address);
+}
+
+RouterServer::~RouterServer() {
+  Stop();
+  for (auto &thread : threads_) {
+    thread.join();
+  }
+  ::close(listen_fd_);
+}
+
+void RouterServer::Run() {
+  while (!stopping_) {
+    int fd = ::accept(listen_fd_, nullptr, nullptr);
+    if (fd < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      YACL_ENFORCE(stopping_, "accept failed, errno={}", errno);
+      break;
+    }
+    auto client = std::make_shared<Client>(fd);
+    threads_.emplace_back(&RouterServer::Serve, this, std::move(client));
+  }
+}
+
+void RouterServer::Stop() {
+  if (stopping_.exchange(true)) {
+    return;
+  }
+  ::shutdown(listen_fd_, SHUT_RDWR);
+  std::lock_guard lock(mutex_);
+  for (auto &[node_id, client] : clients_) {
+    ::shutdown(client->fd, SHUT_RDWR);
+  }
+  registered_.notify_all();
+}
+
+std::shared_ptr<RouterServer::Client> RouterServer::WaitClient(
+    const std::string &node_id) {
+  std::unique_lock lock(mutex_);
+  registered_.wait_for(lock, kTargetWaitTimeout, [&] {
+    return stopping_ || clients_.count(node_id) > 0;
+  });
+  auto it = clients_.find(node_id);
+  return it == clients_.end() ? nullptr : it->second;
+}
+
+void RouterServer::Serve(std::shared_ptr<Client> client) {
+  ic_impl::proto::RouterFrame frame;
+  std::string data;
+  try {
+    if (!ReadFrame(client->fd, &frame) || !frame.has_hello()) {
+      return;
+    }
+    client->node_id = frame.hello().node_id();
+    {
+      std::lock_guard lock(mutex_);
+      // a client reconnecting for a later job takes over its node
+      clients_[client->node_id] = client;
+    }
+    registered_.notify_all();
+    SPDLOG_INFO("router client {} connected", client->node_id);
+
+    while (ReadFrame(client->fd, &frame)) {
+      if (!frame.has_package()) {
+        continue;
+      }
+      const auto &package = frame.package();
+      data.resize(package.data_size());
+      ReadFull(client->fd, data.data(), data.size());
+
+      auto target = WaitClient(package.target_id());
+      if (target == nullptr) {
+        client->WriteError(frame.cid(), "SEND_TIMEOUT",
+                           "node " + package.target_id() + " not connected");
+        continue;
+      }
+      try {
+        target->Write(frame, data);
+      } catch (const std::exception &e) {
+        client->WriteError(frame.cid(), "SEND_FAIL", e.what());
+        continue;
+      }
+
+      ic_impl::proto::RouterFrame ack;
+      ack.set_cid(frame.cid());
+      ack.mutable_ack()->set_seq(package.seq());
+      client->Write(ack);
+    }
+  } catch (const std::exception &e) {
+    SPDLOG_WARN("router client {} dropped: {}", client->node_id, e.what());
+  }
+
+  std::lock_guard lock(mutex_);
+  auto it = clients_.find(client->node_id);
+  if (it != clients_.end() && it->second == client) {
+    clients_.erase(it);
+  }
+}
+
+}  // namespace ic_impl::link
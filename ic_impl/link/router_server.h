@@ -0,0 +1,64 @@
+// Copyright 2024 Ant Group Co., Ltd.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace ic_impl::link {
+
+// Stand-in router server (RS) forwarding the packages of router clients
+// (RC) to their target nodes, for running jobs over RouterChannel without
+// a deployed router. A package waits for its target to connect and is
+// acknowledged to its source once forwarded.
+class RouterServer {
+ public:
+  // Listen on `address`, host:port
+  explicit RouterServer(const std::string &address);
+
+  ~RouterServer();
+
+  // Serve until Stop is called
+  void Run();
+
+  void Stop();
+
+ private:
+  struct Client;
+
+  void Serve(std::shared_ptr<Client> client);
+
+  // The client registered as `node_id`, waiting up to the wait timeout
+  std::shared_ptr<Client> WaitClient(const std::string &node_id);
+
+  int listen_fd_;
+
+  std::atomic<bool> stopping_{false};
+
+  std::mutex mutex_;
+
+  std::condition_variable registered_;
+
+  std::map<std::string, std::shared_ptr<Client>> clients_;
+
+  std::vector<std::thread> threads_;
+};
+
+}  // namespace ic_impl::link
@@ -0,0 +1,397 @@
+// Copyright 2024 Ant Group Co., Ltd.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include "ic_impl/link/shm_channel.h"
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstring>
+#include <ctime>
+
+#include "absl/strings/str_cat.h"
+#include "spdlog/spdlog.h"
+#include "yacl/base/exception.h"
+
+namespace ic_impl::link {
+
+namespace {
+
+constexpr uint64_t kRingMagic = 0x676e6972'6d68'7369;
+
+constexpr size_t kRingCapacity = 16 << 20;
+
+constexpr size_t kInlineLimit = kRingCapacity / 4;
+
+constexpr uint32_t kRingReady = 1;
+
+constexpr uint32_t kRingClosed = 2;
+
+// how often a blocked reader or writer checks for shutdown
+constexpr int64_t kWaitSliceMs = 100;
+
+enum RecordKind : uint32_t {
+  kInlineRecord = 0,
+  // the value lives in a dedicated segment whose name is the payload
+  kReferenceRecord = 1,
+};
+
+struct RecordHeader {
+  uint32_t kind;
+  uint32_t key_size;
+  uint64_t value_size;
+};
+
+struct RingHeader {
+  uint64_t magic;
+  std::atomic<uint32_t> state;
+  uint64_t capacity;
+  pthread_mutex_t mutex;
+  pthread_cond_t not_empty;
+  pthread_cond_t not_full;
+  // total bytes read and written
+  uint64_t head;
+  uint64_t tail;
+};
+
+// Wait on `cond` for at most `ms`, return false on timeout
+bool TimedWait(pthread_cond_t *cond, pthread_mutex_t *mutex, int64_t ms) {
+  struct timespec deadline;
+  clock_gettime(CLOCK_REALTIME, &deadline);
+  deadline.tv_sec += ms / 1000;
+  deadline.tv_nsec += (ms % 1000) * 1000000;
+  if (deadline.tv_nsec >= 1000000000) {
+    deadline.tv_sec += 1;
+    deadline.tv_nsec -= 1000000000;
+  }
+  return pthread_cond_timedwait(cond, mutex, &deadline) == 0;
+}
+
+class RingLock {
+ public:
+  explicit RingLock(RingHeader *header) : header_(header) {
+    pthread_mutex_lock(&header_->mutex);
+  }
+
+  ~RingLock() { pthread_mutex_unlock(&header_->mutex); }
+
+ private:
+  RingHeader *header_;
+};
+
+void *MapSegment(int fd, size_t size) {
+  void *data = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  return data == MAP_FAILED ? nullptr : data;
+}
+
+// Close a stale ring left by a previous job so that its writers reconnect
+void CloseStaleRing(const std::string &name) {
+  int fd = ::shm_open(name.c_str(), O_RDWR, 0600);
+  if (fd < 0) {
+    return;
+  }
+  struct stat st;
+  if (::fstat(fd, &st) == 0 &&
+      static_cast<size_t>(st.st_size) >= sizeof(RingHeader)) {
+    if (auto *header =
+            static_cast<RingHeader *>(MapSegment(fd, sizeof(RingHeader)))) {
+      header->state.store(kRingClosed);
+      ::munmap(header, sizeof(RingHeader));
+    }
+  }
+  ::close(fd);
+  ::shm_unlink(name.c_str());
+}
+
+}  // namespace
+
+struct ShmRing {
+  ~ShmRing() {
+    if (owner) {
+      header->state.store(kRingClosed);
+      pthread_cond_broadcast(&header->not_full);
+    }
+    ::munmap(header, map_size);
+    if (owner) {
+      ::shm_unlink(name.c_str());
+    }
+  }
+
+  static std::unique_ptr<ShmRing> Create(const std::string &name) {
+    CloseStaleRing(name);
+
+    int fd = ::shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+    YACL_ENFORCE(fd >= 0, "create shm segment {} failed, errno={}", name,
+                 errno);
+    size_t map_size = sizeof(RingHeader) + kRingCapacity;
+    YACL_ENFORCE(::ftruncate(fd, map_size) == 0,
+                 "resize shm segment {} failed", name);
+    void *data = MapSegment(fd, map_size);
+    ::close(fd);
+    YACL_ENFORCE(data != nullptr, "mmap shm segment {} failed", name);
+
+    auto ring = std::make_unique<ShmRing>();
+    ring->name = name;
+    ring->owner = true;
+    ring->map_size = map_size;
+    ring->header = static_cast<RingHeader *>(data);
+    ring->data = static_cast<char *>(data) + sizeof(RingHeader);
+
+    auto *header = ring->header;
+    pthread_mutexattr_t mutex_attr;
+    pthread_mutexattr_init(&mutex_attr);
+    pthread_mutexattr_setpshared(&mutex_attr, PTHREAD_PROCESS_SHARED);
+    pthread_mutex_init(&header->mutex, &mutex_attr);
+    pthread_mutexattr_destroy(&mutex_attr);
+    pthread_condattr_t cond_attr;
+    pthread_condattr_init(&cond_attr);
+    pthread_condattr_setpshared(&cond_attr, PTHREAD_PROCESS_SHARED);
+    pthread_cond_init(&header->not_empty, &cond_attr);
+    pthread_cond_init(&header->not_full, &cond_attr);
+    pthread_condattr_destroy(&cond_attr);
+    header->capacity = kRingCapacity;
+    header->head = 0;
+    header->tail = 0;
+    header->magic = kRingMagic;
+    header->state.store(kRingReady);
+
+    return ring;
+  }
+
+  // Return nullptr if the ring does not exist or is not ready yet
+  static std::unique_ptr<ShmRing> Open(const std::string &name) {
+    int fd = ::shm_open(name.c_str(), O_RDWR, 0600);
+    if (fd < 0) {
+      return nullptr;
+    }
+    struct stat st;
+    size_t map_size = sizeof(RingHeader) + kRingCapacity;
+    if (::fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) != map_size) {
+      ::close(fd);
+      return nullptr;
+    }
+    void *data = MapSegment(fd, map_size);
+    ::close(fd);
+    if (data == nullptr) {
+      return nullptr;
+    }
+
+    auto ring = std::make_unique<ShmRing>();
+    ring->name = name;
+    ring->owner = false;
+    ring->map_size = map_size;
+    ring->header = static_cast<RingHeader *>(data);
+    ring->data = static_cast<char *>(data) + sizeof(RingHeader);
+    if (ring->header->magic != kRingMagic ||
+        ring->header->state.load() != kRingReady) {
+      return nullptr;
+    }
+    return ring;
+  }
+
+  void Push(const RecordHeader &record, std::string_view key,
+            std::string_view payload, int64_t timeout_ms) {
+    size_t size = sizeof(record) + key.size() + payload.size();
+    YACL_ENFORCE(size <= header->capacity, "shm record of {} bytes too large",
+                 size);
+
+    RingLock lock(header);
+    auto deadline = std::chrono::steady_clock::now() +
+                    std::chrono::milliseconds(timeout_ms);
+    while (header->capacity - (header->tail - header->head) < size) {
+      YACL_ENFORCE(header->state.load() == kRingReady,
+                   "shm segment {} is closed by the peer", name);
+      YACL_ENFORCE(std::chrono::steady_clock::now() < deadline,
+                   "send to shm segment {} timeout", name);
+      TimedWait(&header->not_full, &header->mutex, kWaitSliceMs);
+    }
+    Write(&record, sizeof(record));
+    Write(key.data(), key.size());
+    Write(payload.data(), payload.size());
+    pthread_cond_signal(&header->not_empty);
+  }
+
+  // Return false if `stopping` is set before a record arrives
+  bool Pop(const std::atomic<bool> &stopping, RecordHeader *record,
+           std::string *key, yacl::Buffer *payload) {
+    RingLock lock(header);
+    while (header->tail == header->head) {
+      if (stopping.load()) {
+        return false;
+      }
+      TimedWait(&header->not_empty, &header->mutex, kWaitSliceMs);
+    }
+    Read(record, sizeof(*record));
+    key->resize(record->key_size);
+    Read(key->data(), key->size());
+    size_t payload_size = record->value_size;
+    if (record->kind == kReferenceRecord) {
+      // the payload is the segment name, prefixed by its size
+      uint32_t name_size;
+      Read(&name_size, sizeof(name_size));
+      payload_size = name_size;
+    }
+    *payload = yacl::Buffer(payload_size);
+    Read(payload->data(), payload_size);
+    pthread_cond_signal(&header->not_full);
+    return true;
+  }
+
+  void Write(const void *src, size_t size) {
+    size_t offset = header->tail % header->capacity;
+    size_t first = std::min(size, header->capacity - offset);
+    std::memcpy(data + offset, src, first);
+    std::memcpy(data, static_cast<const char *>(src) + first, size - first);
+    header->tail += size;
+  }
+
+  void Read(void *dst, size_t size) {
+    size_t offset = header->head % header->capacity;
+    size_t first = std::min(size, header->capacity - offset);
+    std::memcpy(dst, data + offset, first);
+    std::memcpy(static_cast<char *>(dst) + first, data, size - first);
+    header->head += size;
+  }
+
+  std::string name;
+  bool owner = false;
+  size_t map_size = 0;
+  RingHeader *header = nullptr;
+  char *data = nullptr;
+};
+
+ShmChannel::ShmChannel(size_t self_rank, size_t peer_rank, std::string session,
+                       size_t recv_timeout_ms)
+    : ChannelBase(self_rank, peer_rank, recv_timeout_ms),
+      session_(std::move(session)),
+      send_timeout_ms_(recv_timeout_ms) {}
+
+ShmChannel::~ShmChannel() {
+  stopping_.store(true);
+  if (receiver_.joinable()) {
+    receiver_.join();
+  }
+}
+
+std::string ShmChannel::SegmentName(size_t from, size_t to) const {
+  return absl::StrCat("/ic_impl_", session_, "_", from, "_", to);
+}
+
+void ShmChannel::StartReceive() {
+  inbound_ = ShmRing::Create(SegmentName(peer_rank_, self_rank_));
+  receiver_ = std::thread(&ShmChannel::ReceiveLoop, this);
+}
+
+void ShmChannel::ConnectPeer(size_t retry_times, size_t retry_interval_ms) {
+  auto name = SegmentName(self_rank_, peer_rank_);
+  for (size_t i = 0; i <= retry_times; ++i) {
+    outbound_ = ShmRing::Open(name);
+    if (outbound_ != nullptr) {
+      return;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(retry_interval_ms));
+  }
+  YACL_THROW("connect to shm segment {} of rank {} failed", name, peer_rank_);
+}
+
+void ShmChannel::ReceiveLoop() {
+  RecordHeader record;
+  std::string key;
+  yacl::Buffer payload;
+  while (inbound_->Pop(stopping_, &record, &key, &payload)) {
+    try {
+      if (record.kind == kInlineRecord) {
+        OnMessage(key, payload);
+        continue;
+      }
+
+      // map the segment of a large value, it is removed once delivered
+      std::string name(payload.data<char>(), payload.size());
+      int fd = ::shm_open(name.c_str(), O_RDONLY, 0600);
+      YACL_ENFORCE(fd >= 0, "open shm segment {} failed", name);
+      void *data = record.value_size == 0
+                       ? nullptr
+                       : ::mmap(nullptr, record.value_size, PROT_READ,
+                                MAP_SHARED, fd, 0);
+      ::close(fd);
+      ::shm_unlink(name.c_str());
+      YACL_ENFORCE(data != MAP_FAILED, "mmap shm segment {} failed", name);
+      OnMessage(key, yacl::ByteContainerView(data, record.value_size));
+      if (data != nullptr) {
+        ::munmap(data, record.value_size);
+      }
+    } catch (const std::exception &e) {
+      SPDLOG_ERROR("shm channel from rank {} dropped message {}: {}",
+                   peer_rank_, key, e.what());
+    }
+  }
+}
+
+void ShmChannel::SendAsyncImpl(const std::string &key,
+                               yacl::ByteContainerView value) {
+  SendImpl(key, value);
+}
+
+void ShmChannel::SendAsyncImpl(const std::string &key, yacl::Buffer &&value) {
+  SendImpl(key, value);
+}
+
+void ShmChannel::SendImpl(const std::string &key,
+                          yacl::ByteContainerView value) {
+  SendImpl(key, value, send_timeout_ms_);
+}
+
+void ShmChannel::SendImpl(const std::string &key,
+                          yacl::ByteContainerView value, uint32_t timeout) {
+  YACL_ENFORCE(outbound_ != nullptr, "shm channel to rank {} not connected",
+               peer_rank_);
+
+  RecordHeader record{kInlineRecord, static_cast<uint32_t>(key.size()),
+                      value.size()};
+  if (value.size() <= kInlineLimit) {
+    outbound_->Push(record, key,
+                    std::string_view(reinterpret_cast<const char *>(
+                                         value.data()),
+                                     value.size()),
+                    timeout);
+    return;
+  }
+
+  // write a large value once into its own segment and pass the reference
+  auto name = absl::StrCat(SegmentName(self_rank_, peer_rank_), "_",
+                           ref_seq_.fetch_add(1));
+  int fd = ::shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+  YACL_ENFORCE(fd >= 0, "create shm segment {} failed, errno={}", name, errno);
+  bool ok = ::ftruncate(fd, value.size()) == 0;
+  void *data = ok ? MapSegment(fd, value.size()) : nullptr;
+  ::close(fd);
+  if (data == nullptr) {
+    ::shm_unlink(name.c_str());
+    YACL_THROW("map shm segment {} of {} bytes failed", name, value.size());
+  }
+  std::memcpy(data, value.data(), value.size());
+  ::munmap(data, value.size());
+
+  record.kind = kReferenceRecord;
+  uint32_t name_size = name.size();
+  std::string payload(reinterpret_cast<const char *>(&name_size),
+                      sizeof(name_size));
+  payload.append(name);
+  outbound_->Push(record, key, payload, timeout);
+}
+
+}  // namespace ic_impl::link
@@ -0,0 +1,82 @@
+// Copyright 2024 Ant Group Co., Ltd.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+
+#include "yacl/link/transport/channel.h"
+
+namespace ic_impl::link {
+
+struct ShmRing;
+
+// Channel between two processes on the same host. Each direction is a
+// single-producer single-consumer ring buffer in POSIX shared memory owned
+// by the receiver. Messages larger than a quarter of the ring are written to
+// a dedicated segment once and only referenced through the ring.
+class ShmChannel final : public yacl::link::transport::ChannelBase {
+ public:
+  // `session` tells the segments of concurrent jobs apart
+  ShmChannel(size_t self_rank, size_t peer_rank, std::string session,
+             size_t recv_timeout_ms);
+
+  ~ShmChannel() override;
+
+  // Create the inbound ring and start receiving from it
+  void StartReceive();
+
+  // Open the inbound ring of the peer, waiting until it exists
+  void ConnectPeer(size_t retry_times, size_t retry_interval_ms);
+
+  void SetThrottleWindowSize(size_t) override {}
+
+  void TestSend(uint32_t) override {}
+
+ protected:
+  void SendAsyncImpl(const std::string &key,
+                     yacl::ByteContainerView value) override;
+
+  void SendAsyncImpl(const std::string &key, yacl::Buffer &&value) override;
+
+  void SendImpl(const std::string &key,
+                yacl::ByteContainerView value) override;
+
+  void SendImpl(const std::string &key, yacl::ByteContainerView value,
+                uint32_t timeout) override;
+
+ private:
+  void ReceiveLoop();
+
+  std::string SegmentName(size_t from, size_t to) const;
+
+  std::string session_;
+
+  // how long a send waits for room in the ring
+  size_t send_timeout_ms_;
+
+  std::unique_ptr<ShmRing> inbound_;
+
+  std::unique_ptr<ShmRing> outbound_;
+
+  std::atomic<bool> stopping_{false};
+
+  std::thread receiver_;
+
+  std::atomic<uint64_t> ref_seq_{0};
+};
+
+}  // namespace ic_impl::link
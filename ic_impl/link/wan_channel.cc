@@ -0,0 +1,195 @@
+// Copyright 2024 Ant Group Co., Ltd.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "ic_impl/link/wan_channel.h"
+
+#include <algorithm>
+
+#include "absl/strings/numbers.h"
+#include "absl/strings/str_split.h"
+#include "spdlog/spdlog.h"
+#include "yacl/base/exception.h"
+
+namespace ic_impl::link {
+
+namespace {
+
+WanProfile ParseWanProfile(std::string_view spec) {
+  std::vector<std::string_view> fields = absl::StrSplit(spec, ':');
+  YACL_ENFORCE(fields.size() <= 3, "invalid link profile {}", spec);
+
+  WanProfile profile;
+  double *values[] = {&profile.latency_ms, &profile.bandwidth_mbps,
+                      &profile.jitter_ms};
+  for (size_t i = 0; i < fields.size(); ++i) {
+    YACL_ENFORCE(absl::SimpleAtod(fields[i], values[i]) && *values[i] >= 0,
+                 "invalid link profile {}", spec);
+  }
+
+  return profile;
+}
+
+}  // namespace
+
+std::vector<WanProfile> ParseWanProfiles(std::string_view spec,
+                                         size_t world_size) {
+  if (spec.empty()) {
+    return {};
+  }
+
+  std::vector<std::string_view> specs = absl::StrSplit(spec, ',');
+  YACL_ENFORCE(specs.size() == 1 || specs.size() == world_size,
+               "expect 1 or {} link profiles, got {}", world_size,
+               specs.size());
+  std::vector<WanProfile> profiles;
+  for (size_t rank = 0; rank < world_size; ++rank) {
+    profiles.push_back(ParseWanProfile(specs[specs.size() == 1 ? 0 : rank]));
+  }
+
+  return profiles;
+}
+
+WanChannel::WanChannel(std::shared_ptr<yacl::link::transport::IChannel> inner,
+                       const WanProfile &profile)
+    : inner_(std::move(inner)),
+      profile_(profile),
+      wire_free_(Clock::now()),
+      last_due_(wire_free_),
+      rng_(std::random_device()()) {
+  deliverer_ = std::thread(&WanChannel::DeliverLoop, this);
+}
+
+WanChannel::~WanChannel() {
+  {
+    std::lock_guard lock(mutex_);
+    stopping_ = true;
+  }
+  cond_.notify_all();
+  deliverer_.join();
+}
+
+void WanChannel::SendAsync(const std::string &key,
+                           yacl::ByteContainerView value) {
+  Enqueue(key, yacl::Buffer(value.data(), value.size()), SendMode::kAsync);
+}
+
+void WanChannel::SendAsync(const std::string &key, yacl::Buffer &&value) {
+  Enqueue(key, std::move(value), SendMode::kAsync);
+}
+
+void WanChannel::SendAsyncThrottled(const std::string &key,
+                                    yacl::ByteContainerView value) {
+  Enqueue(key, yacl::Buffer(value.data(), value.size()), SendMode::kThrottled);
+}
+
+void WanChannel::SendAsyncThrottled(const std::string &key,
+                                    yacl::Buffer &&value) {
+  Enqueue(key, std::move(value), SendMode::kThrottled);
+}
+
+void WanChannel::Send(const std::string &key, yacl::ByteContainerView value) {
+  std::promise<void> sent;
+  auto done = sent.get_future();
+  Enqueue(key, yacl::Buffer(value.data(), value.size()), SendMode::kSync,
+          &sent);
+  done.get();
+}
+
+void WanChannel::WaitLinkTaskFinish() {
+  {
+    std::unique_lock lock(mutex_);
+    cond_.wait(lock, [this] { return queue_.empty() && delivering_ == 0; });
+  }
+  inner_->WaitLinkTaskFinish();
+}
+
+void WanChannel::Enqueue(const std::string &key, yacl::Buffer &&value,
+                         SendMode mode, std::promise<void> *sent) {
+  {
+    std::lock_guard lock(mutex_);
+    auto now = Clock::now();
+    auto start = std::max(now, wire_free_);
+    std::chrono::duration<double, std::milli> transmit(0);
+    if (profile_.bandwidth_mbps > 0) {
+      transmit = std::chrono::duration<double, std::milli>(
+          value.size() * 8 / (profile_.bandwidth_mbps * 1000));
+    }
+    wire_free_ = start + std::chrono::duration_cast<Clock::duration>(transmit);
+
+    double delay_ms = profile_.latency_ms;
+    if (profile_.jitter_ms > 0) {
+      std::uniform_real_distribution<double> jitter(-profile_.jitter_ms,
+                                                    profile_.jitter_ms);
+      delay_ms = std::max(0.0, delay_ms + jitter(rng_));
+    }
+    auto due = wire_free_ + std::chrono::duration_cast<Clock::duration>(
+                                std::chrono::duration<double, std::milli>(
+                                    delay_ms));
+    last_due_ = std::max(due, last_due_);
+
+    queue_.push_back({last_due_, key, std::move(value), mode, sent});
+  }
+  cond_.notify_all();
+}
+
+void WanChannel::DeliverLoop() {
+  std::unique_lock lock(mutex_);
+  while (true) {
+    cond_.wait(lock, [this] { return stopping_ || !queue_.empty(); });
+    if (queue_.empty()) {
+      return;
+    }
+    if (Clock::now() < queue_.front().due) {
+      // woken early by a new message or the destructor, which lets the
+      // queue drain first
+      cond_.wait_until(lock, queue_.front().due);
+      continue;
+    }
+
+    auto message = std::move(queue_.front());
+    queue_.pop_front();
+    ++delivering_;
+    lock.unlock();
+
+    try {
+      switch (message.mode) {
+        case SendMode::kAsync:
+          inner_->SendAsync(message.key, std::move(message.value));
+          break;
+        case SendMode::kThrottled:
+          inner_->SendAsyncThrottled(message.key, std::move(message.value));
+          break;
+        case SendMode::kSync:
+          inner_->Send(message.key, message.value);
+          break;
+      }
+      if (message.sent) {
+        message.sent->set_value();
+      }
+    } catch (const std::exception &e) {
+      if (message.sent) {
+        message.sent->set_exception(std::current_exception());
+      } else {
+        SPDLOG_ERROR("emulated link dropped message {}: {}", message.key,
+                     e.what());
+      }
+    }
+
+    lock.lock();
+    --delivering_;
+    cond_.notify_all();
+  }
+}
+
+}  // namespace ic_impl::link
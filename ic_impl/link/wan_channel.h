@@ -0,0 +1,154 @@
+// Copyright 2024 Ant Group Co., Ltd.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "yacl/link/transport/channel.h"
+
+namespace ic_impl::link {
+
+// Conditions of an emulated wide area link, in one direction
+struct WanProfile {
+  // delay added to every message
+  double latency_ms = 0;
+  // 0 for no limit
+  double bandwidth_mbps = 0;
+  // the delay varies uniformly by up to this much either way, messages still
+  // arrive in order
+  double jitter_ms = 0;
+
+  bool Enabled() const {
+    return latency_ms > 0 || bandwidth_mbps > 0 || jitter_ms > 0;
+  }
+};
+
+// Profiles by peer rank from a comma-separated list of
+// latency_ms[:bandwidth_mbps[:jitter_ms]], one per party or a single one for
+// all of them
+std::vector<WanProfile> ParseWanProfiles(std::string_view spec,
+                                         size_t world_size);
+
+// Channel holding back outbound messages as a link with the given profile
+// would. Each message queues behind the previous one for its transmission
+// time, then takes the latency to arrive. Inbound messages are left to the
+// peer to delay.
+class WanChannel final : public yacl::link::transport::IChannel {
+ public:
+  WanChannel(std::shared_ptr<yacl::link::transport::IChannel> inner,
+             const WanProfile &profile);
+
+  ~WanChannel() override;
+
+  void SendAsync(const std::string &key,
+                 yacl::ByteContainerView value) override;
+
+  void SendAsync(const std::string &key, yacl::Buffer &&value) override;
+
+  void SendAsyncThrottled(const std::string &key,
+                          yacl::ByteContainerView value) override;
+
+  void SendAsyncThrottled(const std::string &key,
+                          yacl::Buffer &&value) override;
+
+  void Send(const std::string &key, yacl::ByteContainerView value) override;
+
+  yacl::Buffer Recv(const std::string &key) override {
+    return inner_->Recv(key);
+  }
+
+  void OnMessage(const std::string &key,
+                 yacl::ByteContainerView value) override {
+    inner_->OnMessage(key, value);
+  }
+
+  void OnChunkedMessage(const std::string &key, yacl::ByteContainerView value,
+                        size_t offset, size_t total_length) override {
+    inner_->OnChunkedMessage(key, value, offset, total_length);
+  }
+
+  void SetRecvTimeout(uint64_t timeout_ms) override {
+    inner_->SetRecvTimeout(timeout_ms);
+  }
+
+  uint64_t GetRecvTimeout() const override {
+    return inner_->GetRecvTimeout();
+  }
+
+  void WaitLinkTaskFinish() override;
+
+  void SetThrottleWindowSize(size_t size) override {
+    inner_->SetThrottleWindowSize(size);
+  }
+
+  void TestSend(uint32_t timeout) override { inner_->TestSend(timeout); }
+
+  void TestRecv() override { inner_->TestRecv(); }
+
+ private:
+  using Clock = std::chrono::steady_clock;
+
+  enum class SendMode { kAsync, kThrottled, kSync };
+
+  struct Message {
+    Clock::time_point due;
+    std::string key;
+    yacl::Buffer value;
+    SendMode mode;
+    // set once a synchronous send is through
+    std::promise<void> *sent;
+  };
+
+  void Enqueue(const std::string &key, yacl::Buffer &&value, SendMode mode,
+               std::promise<void> *sent = nullptr);
+
+  void DeliverLoop();
+
+  std::shared_ptr<yacl::link::transport::IChannel> inner_;
+
+  WanProfile profile_;
+
+  std::mutex mutex_;
+
+  std::condition_variable cond_;
+
+  std::deque<Message> queue_;
+
+  // messages taken off the queue but not handed to the inner channel yet
+  size_t delivering_ = 0;
+
+  bool stopping_ = false;
+
+  // when the emulated wire is done with the messages queued so far
+  Clock::time_point wire_free_;
+
+  Clock::time_point last_due_;
+
+  std::mt19937_64 rng_;
+
+  std::thread deliverer_;
+};
+
+}  // namespace ic_impl::link
@@ -0,0 +1,271 @@
+// Copyright 2024 Ant Group Co., Ltd.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include "ic_impl/link/wire_codec.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "yacl/base/exception.h"
+#include "zlib.h"
+
+#include "ic_impl/proto/wire_format.pb.h"
+
+namespace ic_impl::link {
+
+namespace {
+
+enum WireTag : uint8_t {
+  kRawTag = 0,
+  kBitpackTag = 1,
+  kZlibTag = 2,
+  kBitpackZlibTag = 3,
+};
+
+// in front of every encoded message, so that the receiver tells them from
+// the raw ones without knowing when the sender switched
+constexpr char kWireMagic[8] = {'I', 'C', 'W', 'I', 'R', 'E', 'V', '1'};
+
+constexpr size_t kHeaderSize = sizeof(kWireMagic) + 1;
+
+// shorter messages go out raw
+constexpr size_t kMinEncodedSize = 64;
+
+// a larger message is deflated only if its first kDeflateProbeSize bytes
+// shrink by at least 1/kMinDeflateRatio
+constexpr size_t kDeflateProbeSize = 4096;
+
+constexpr size_t kMinDeflateRatio = 16;
+
+// packing is skipped when it would save less than this many bits per lane
+constexpr int kMinSavedBits = 4;
+
+// formats in the order of preference
+constexpr int32_t kPreferredFormats[] = {
+    proto::WIRE_FORMAT_BITPACK_ZLIB,
+    proto::WIRE_FORMAT_BITPACK,
+};
+
+int LaneWidth(int64_t lane) { return 64 - __builtin_clrsbll(lane); }
+
+// Body: the lane width, then the lanes in two's complement at that width
+std::string Bitpack(yacl::ByteContainerView message) {
+  if (message.size() % sizeof(uint64_t) != 0) {
+    return {};
+  }
+
+  size_t lanes = message.size() / sizeof(uint64_t);
+  int width = 1;
+  for (size_t i = 0; i < lanes && width <= 64 - kMinSavedBits; ++i) {
+    int64_t lane;
+    std::memcpy(&lane, message.data() + i * sizeof(lane), sizeof(lane));
+    width = std::max(width, LaneWidth(lane));
+  }
+  if (width > 64 - kMinSavedBits) {
+    return {};
+  }
+
+  std::string body(1 + (lanes * width + 7) / 8, '\0');
+  body[0] = static_cast<char>(width);
+  auto *out = reinterpret_cast<uint8_t *>(body.data() + 1);
+  uint64_t mask = (uint64_t{1} << width) - 1;
+  unsigned __int128 acc = 0;
+  int bits = 0;
+  size_t pos = 0;
+  for (size_t i = 0; i < lanes; ++i) {
+    uint64_t lane;
+    std::memcpy(&lane, message.data() + i * sizeof(lane), sizeof(lane));
+    acc |= static_cast<unsigned __int128>(lane & mask) << bits;
+    bits += width;
+    while (bits >= 8) {
+      out[pos++] = static_cast<uint8_t>(acc);
+      acc >>= 8;
+      bits -= 8;
+    }
+  }
+  if (bits > 0) {
+    out[pos++] = static_cast<uint8_t>(acc);
+  }
+  return body;
+}
+
+std::string Unbitpack(std::string_view body, size_t size) {
+  YACL_ENFORCE(!body.empty() && size % sizeof(uint64_t) == 0,
+               "invalid bit-packed message");
+  int width = static_cast<uint8_t>(body[0]);
+  size_t lanes = size / sizeof(uint64_t);
+  YACL_ENFORCE(width >= 1 && width <= 64 &&
+                   body.size() == 1 + (lanes * width + 7) / 8,
+               "invalid bit-packed message");
+
+  std::string message(size, '\0');
+  const auto *in = reinterpret_cast<const uint8_t *>(body.data() + 1);
+  unsigned __int128 acc = 0;
+  int bits = 0;
+  size_t pos = 0;
+  for (size_t i = 0; i < lanes; ++i) {
+    while (bits < width) {
+      acc |= static_cast<unsigned __int128>(in[pos++]) << bits;
+      bits += 8;
+    }
+    auto lane = static_cast<uint64_t>(acc) << (64 - width);
+    acc >>= width;
+    bits -= width;
+    // sign extend
+    auto value = static_cast<int64_t>(lane) >> (64 - width);
+    std::memcpy(message.data() + i * sizeof(value), &value, sizeof(value));
+  }
+  return message;
+}
+
+std::string Deflate(std::string_view data) {
+  uLongf size = compressBound(data.size());
+  std::string body(size, '\0');
+  int ret = compress2(reinterpret_cast<Bytef *>(body.data()), &size,
+                      reinterpret_cast<const Bytef *>(data.data()),
+                      data.size(), Z_BEST_SPEED);
+  YACL_ENFORCE(ret == Z_OK, "deflate failed, ret={}", ret);
+  body.resize(size);
+  return body;
+}
+
+// Points and random shares are incompressible, a probe of their prefix
+// spares deflating all of them
+bool WorthDeflating(std::string_view data) {
+  if (data.size() <= kDeflateProbeSize) {
+    return true;
+  }
+  auto probe = Deflate(data.substr(0, kDeflateProbeSize));
+  return probe.size() <
+         kDeflateProbeSize - kDeflateProbeSize / kMinDeflateRatio;
+}
+
+std::string Inflate(std::string_view body, size_t size) {
+  std::string data(size, '\0');
+  uLongf data_size = size;
+  int ret = uncompress(reinterpret_cast<Bytef *>(data.data()), &data_size,
+                       reinterpret_cast<const Bytef *>(body.data()),
+                       body.size());
+  YACL_ENFORCE(ret == Z_OK && data_size == size, "inflate failed, ret={}",
+               ret);
+  return data;
+}
+
+char *WriteHeader(WireTag tag, char *out) {
+  std::memcpy(out, kWireMagic, sizeof(kWireMagic));
+  out[sizeof(kWireMagic)] = static_cast<char>(tag);
+  return out + kHeaderSize;
+}
+
+yacl::Buffer MakeMessage(WireTag tag, uint64_t size, std::string_view body) {
+  yacl::Buffer buf(kHeaderSize + sizeof(size) + body.size());
+  auto *out = WriteHeader(tag, buf.data<char>());
+  std::memcpy(out, &size, sizeof(size));
+  std::memcpy(out + sizeof(size), body.data(), body.size());
+  return buf;
+}
+
+}  // namespace
+
+yacl::Buffer EncodeWireMessage(yacl::ByteContainerView message,
+                               bool allow_zlib) {
+  std::string_view raw(reinterpret_cast<const char *>(message.data()),
+                       message.size());
+  if (message.size() >= kMinEncodedSize) {
+    auto packed = Bitpack(message);
+    std::string_view best = packed.empty() ? raw : packed;
+    WireTag tag = packed.empty() ? kRawTag : kBitpackTag;
+
+    std::string deflated;
+    if (allow_zlib && WorthDeflating(best)) {
+      deflated = Deflate(best);
+      if (tag == kBitpackTag) {
+        // the lane width stays in front, it gives the inflated size
+        deflated.insert(deflated.begin(), packed[0]);
+      }
+      if (deflated.size() < best.size()) {
+        best = deflated;
+        tag = tag == kBitpackTag ? kBitpackZlibTag : kZlibTag;
+      }
+    }
+
+    if (tag != kRawTag) {
+      return MakeMessage(tag, message.size(), best);
+    }
+  }
+
+  yacl::Buffer buf(kHeaderSize + message.size());
+  auto *out = WriteHeader(kRawTag, buf.data<char>());
+  std::memcpy(out, message.data(), message.size());
+  return buf;
+}
+
+bool IsWireMessage(yacl::ByteContainerView message) {
+  return message.size() >= kHeaderSize &&
+         std::memcmp(message.data(), kWireMagic, sizeof(kWireMagic)) == 0;
+}
+
+yacl::Buffer DecodeWireMessage(yacl::ByteContainerView message) {
+  YACL_ENFORCE(IsWireMessage(message), "not a wire message");
+  auto tag = static_cast<WireTag>(message[sizeof(kWireMagic)]);
+  std::string_view rest(
+      reinterpret_cast<const char *>(message.data()) + kHeaderSize,
+      message.size() - kHeaderSize);
+  if (tag == kRawTag) {
+    return yacl::Buffer(rest.data(), rest.size());
+  }
+
+  uint64_t size;
+  YACL_ENFORCE(rest.size() >= sizeof(size), "truncated wire message");
+  std::memcpy(&size, rest.data(), sizeof(size));
+  rest.remove_prefix(sizeof(size));
+
+  std::string data;
+  switch (tag) {
+    case kBitpackTag:
+      data = Unbitpack(rest, size);
+      break;
+    case kZlibTag:
+      data = Inflate(rest, size);
+      break;
+    case kBitpackZlibTag: {
+      size_t lanes = size / sizeof(uint64_t);
+      YACL_ENFORCE(rest.size() >= 1, "truncated wire message");
+      int width = static_cast<uint8_t>(rest[0]);
+      auto packed = Inflate(rest.substr(1), 1 + (lanes * width + 7) / 8);
+      data = Unbitpack(packed, size);
+      break;
+    }
+    default:
+      YACL_THROW("unknown wire message tag {}", static_cast<int>(tag));
+  }
+  return yacl::Buffer(data.data(), data.size());
+}
+
+bool IsEncodedWireFormat(int32_t format) {
+  return format == proto::WIRE_FORMAT_BITPACK ||
+         format == proto::WIRE_FORMAT_BITPACK_ZLIB;
+}
+
+int32_t ChooseWireFormat(const std::vector<int32_t> &own,
+                         const std::set<int32_t> &common) {
+  for (auto format : kPreferredFormats) {
+    if (std::find(own.begin(), own.end(), format) != own.end() &&
+        common.count(format) > 0) {
+      return format;
+    }
+  }
+  return proto::WIRE_FORMAT_RAW;
+}
+
+}  // namespace ic_impl::link
@@ -0,0 +1,46 @@
+// Copyright 2024 Ant Group Co., Ltd.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#pragma once
+
+#include <cstdint>
+#include <set>
+#include <vector>
+
+#include "yacl/base/buffer.h"
+#include "yacl/base/byte_container_view.h"
+
+namespace ic_impl::link {
+
+// Encode a link message as a magic, a tag byte and the body, picking the
+// smallest of the allowed codecs. Secret shares and points rarely shrink,
+// but lanes whose high bits are mere sign extension do, as do the
+// protobuf and text messages.
+yacl::Buffer EncodeWireMessage(yacl::ByteContainerView message,
+                               bool allow_zlib);
+
+// Whether `message` came from EncodeWireMessage rather than a raw send
+bool IsWireMessage(yacl::ByteContainerView message);
+
+yacl::Buffer DecodeWireMessage(yacl::ByteContainerView message);
+
+// Whether `format`, an ic_impl.proto.WireFormat, changes what goes on the
+// wire
+bool IsEncodedWireFormat(int32_t format);
+
+// The preferred format offered by self (`own`) and accepted by every peer
+// (`common`), WIRE_FORMAT_RAW if there is none
+int32_t ChooseWireFormat(const std::vector<int32_t> &own,
+                         const std::set<int32_t> &common);
+
+}  // namespace ic_impl::link
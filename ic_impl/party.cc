@@ -19,6 +19,8 @@
 #include "ic_impl/context.h"
 #include "ic_impl/factory.h"
 
+#include "ic_impl/proto/vendor_types.pb.h"
+
 namespace ic_impl {
 
 Party::Party(std::shared_ptr<IcContext> ctx) : ctx_(std::move(ctx)) {}
@@ -44,7 +46,15 @@ void Party::Run() {
 }
 
 std::unique_ptr<AlgoHandlerFactory> Party::CreateHandlerFactory() {
-  if (ctx_->algo == org::interconnection::v2::ALGO_TYPE_ECDH_PSI) {
+  if (ctx_->algos.size() > 1) {
+    YACL_ENFORCE(ctx_->algos ==
+                     std::vector<int32_t>{
+                         org::interconnection::v2::ALGO_TYPE_ECDH_PSI,
+                         org::interconnection::v2::ALGO_TYPE_SS_LR},
+                 "only ECDH-PSI followed by SS-LR can run in the same job");
+    SPDLOG_INFO("run ECDH-PSI + SS-LR");
+    return std::make_unique<PsiLrHandlerFactory>();
+  } else if (ctx_->algo == org::interconnection::v2::ALGO_TYPE_ECDH_PSI) {
     YACL_ENFORCE(!ctx_->protocol_families.empty());
     YACL_ENFORCE(ctx_->protocol_families.at(0) ==
                  org::interconnection::v2::PROTOCOL_FAMILY_ECC);
@@ -56,6 +66,25 @@ std::unique_ptr<AlgoHandlerFactory> Party::CreateHandlerFactory() {
                  org::interconnection::v2::PROTOCOL_FAMILY_SS);
     SPDLOG_INFO("run SS-LR");
     return std::make_unique<LrHandlerFactory>();
+  } else if (ctx_->algo == ic_impl::proto::ALGO_TYPE_HE_LR) {
+    YACL_ENFORCE(!ctx_->protocol_families.empty());
+    YACL_ENFORCE(ctx_->protocol_families.at(0) ==
+                 ic_impl::proto::PROTOCOL_FAMILY_PAILLIER);
+    SPDLOG_INFO("run HE-LR");
+    return std::make_unique<HeLrHandlerFactory>();
+  } else if (ctx_->algo == ic_impl::proto::ALGO_TYPE_HORIZONTAL_LR) {
+    YACL_ENFORCE(!ctx_->protocol_families.empty());
+    YACL_ENFORCE(ctx_->protocol_families.at(0) ==
+                 org::interconnection::v2::PROTOCOL_FAMILY_SS);
+    SPDLOG_INFO("run horizontal LR");
+    return std::make_unique<HorizontalLrHandlerFactory>();
+  } else if (ctx_->algo == ic_impl::proto::ALGO_TYPE_HE2SS ||
+             ctx_->algo == ic_impl::proto::ALGO_TYPE_SS2HE) {
+    YACL_ENFORCE(!ctx_->protocol_families.empty());
+    YACL_ENFORCE(ctx_->protocol_families.at(0) ==
+                 ic_impl::proto::PROTOCOL_FAMILY_PAILLIER);
+    SPDLOG_INFO("run {}", ic_impl::proto::VendorAlgoType_Name(ctx_->algo));
+    return std::make_unique<HeSsHandlerFactory>();
   }
 
   SPDLOG_ERROR("Create algo handler failed");
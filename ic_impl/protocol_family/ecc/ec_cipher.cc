@@ -0,0 +1,109 @@
+// Copyright 2024 Ant Group Co., Ltd.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "ic_impl/protocol_family/ecc/ec_cipher.h"
+
+#include "yacl/base/exception.h"
+#include "yacl/utils/parallel.h"
+
+#include "interconnection/handshake/protocol_family/ecc.pb.h"
+
+namespace ic_impl::protocol_family::ecc {
+
+namespace {
+
+constexpr int64_t kParallelGrainSize = 1024;
+
+constexpr auto kPointOctetFormat =
+    yacl::crypto::PointOctetFormat::X962Compressed;
+
+std::string ToString(const yacl::Buffer &buf) {
+  return std::string(buf.data<char>(), buf.size());
+}
+
+}  // namespace
+
+bool IsEcCipherSupported(int32_t curve_type) {
+  return curve_type == org::interconnection::v2::protocol::CURVE_TYPE_SM2;
+}
+
+EcCipher::EcCipher(int32_t curve_type) {
+  YACL_ENFORCE(IsEcCipherSupported(curve_type),
+               "Unsupported curve type {} for ec cipher", curve_type);
+
+  group_ = yacl::crypto::EcGroupFactory::Instance().Create("sm2");
+  hash_to_curve_strategy_ = yacl::crypto::HashToCurveStrategy::TryAndRehash_SM;
+
+  const auto &order = group_->GetOrder();
+  do {
+    yacl::math::MPInt::RandomLtN(order, &key_);
+  } while (key_.IsZero());
+  key_inverse_ = key_.InvertMod(order);
+
+  point_size_ =
+      group_->SerializePoint(group_->GetGenerator(), kPointOctetFormat).size();
+}
+
+EcCipher::EcCipher(int32_t curve_type, yacl::ByteContainerView key)
+    : EcCipher(curve_type) {
+  const auto &order = group_->GetOrder();
+  key_.Deserialize(key);
+  YACL_ENFORCE(!key_.IsZero() && key_ < order, "invalid ec cipher key");
+  key_inverse_ = key_.InvertMod(order);
+}
+
+std::string EcCipher::SerializeKey() const {
+  return ToString(key_.Serialize());
+}
+
+std::vector<std::string> EcCipher::HashAndMask(
+    const std::vector<std::string> &items) const {
+  std::vector<std::string> points(items.size());
+  yacl::parallel_for(
+      0, items.size(), kParallelGrainSize, [&](int64_t begin, int64_t end) {
+        for (int64_t i = begin; i < end; ++i) {
+          auto point = group_->HashToCurve(hash_to_curve_strategy_, items[i]);
+          points[i] = ToString(group_->SerializePoint(
+              group_->Mul(point, key_), kPointOctetFormat));
+        }
+      });
+  return points;
+}
+
+std::vector<std::string> EcCipher::Mask(
+    const std::vector<std::string> &points) const {
+  return MulEach(points, key_);
+}
+
+std::vector<std::string> EcCipher::Unmask(
+    const std::vector<std::string> &points) const {
+  return MulEach(points, key_inverse_);
+}
+
+std::vector<std::string> EcCipher::MulEach(
+    const std::vector<std::string> &points,
+    const yacl::math::MPInt &scalar) const {
+  std::vector<std::string> results(points.size());
+  yacl::parallel_for(
+      0, points.size(), kParallelGrainSize, [&](int64_t begin, int64_t end) {
+        for (int64_t i = begin; i < end; ++i) {
+          auto point = group_->DeserializePoint(points[i], kPointOctetFormat);
+          results[i] = ToString(group_->SerializePoint(
+              group_->Mul(point, scalar), kPointOctetFormat));
+        }
+      });
+  return results;
+}
+
+}  // namespace ic_impl::protocol_family::ecc
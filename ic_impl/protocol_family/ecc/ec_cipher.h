@@ -0,0 +1,68 @@
+// Copyright 2024 Ant Group Co., Ltd.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "yacl/base/byte_container_view.h"
+#include "yacl/crypto/ecc/ecc_spi.h"
+#include "yacl/math/mpint/mp_int.h"
+
+namespace ic_impl::protocol_family::ecc {
+
+// Commutative cipher E_k(x) = k * HashToCurve(x) over a prime-order curve.
+// Unlike the cryptors inside the bucket PSI it can also remove its own mask,
+// which turns it into an oblivious PRF: F_k(x) = k^-1 * E_k(r * H(x)).
+class EcCipher {
+ public:
+  // `curve_type` is the negotiated CurveType; only prime-order curves are
+  // supported
+  explicit EcCipher(int32_t curve_type);
+
+  // Use `key`, as returned by SerializeKey, instead of a random one
+  EcCipher(int32_t curve_type, yacl::ByteContainerView key);
+
+  // k * HashToCurve(item) for each item
+  std::vector<std::string> HashAndMask(
+      const std::vector<std::string> &items) const;
+
+  // k * P for each serialized point
+  std::vector<std::string> Mask(const std::vector<std::string> &points) const;
+
+  // k^-1 * P for each serialized point
+  std::vector<std::string> Unmask(const std::vector<std::string> &points) const;
+
+  // size of a serialized point
+  size_t PointSize() const { return point_size_; }
+
+  std::string SerializeKey() const;
+
+ private:
+  std::vector<std::string> MulEach(const std::vector<std::string> &points,
+                                   const yacl::math::MPInt &scalar) const;
+
+  std::unique_ptr<yacl::crypto::EcGroup> group_;
+  yacl::crypto::HashToCurveStrategy hash_to_curve_strategy_;
+  yacl::math::MPInt key_;
+  yacl::math::MPInt key_inverse_;
+  size_t point_size_;
+};
+
+// Whether EcCipher supports `curve_type`
+bool IsEcCipherSupported(int32_t curve_type);
+
+}  // namespace ic_impl::protocol_family::ecc
@@ -0,0 +1,204 @@
+// Copyright 2024 Ant Group Co., Ltd.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include "ic_impl/protocol_family/paillier/paillier.h"
+
+#include <algorithm>
+#include <array>
+#include <set>
+#include <thread>
+
+#include "gflags/gflags.h"
+
+#include "ic_impl/util.h"
+
+DEFINE_int32(paillier_key_size, 2048, "bit length of the Paillier modulus");
+DEFINE_int32(paillier_stat_bits, 40,
+             "statistical security in bits of the masks hiding plaintexts");
+DEFINE_bool(paillier_packing, true,
+            "pack several values into one Paillier ciphertext");
+DEFINE_int32(paillier_headroom_bits, 0,
+             "extra bits per packed value, allowing to sum up to "
+             "2^headroom_bits packed ciphertexts slot-wise");
+DEFINE_int32(paillier_pool_size, 8192,
+             "number of encryption random factors precomputed in the "
+             "background, 0 to compute them on demand");
+DEFINE_int32(paillier_pool_threads, 0,
+             "threads precomputing random factors, a quarter of the cores "
+             "if 0");
+
+namespace ic_impl::protocol_family::paillier {
+
+namespace {
+
+constexpr std::array<int32_t, 3> kSupportedKeySizes{2048, 3072, 4096};
+
+constexpr int32_t kMinStatBits = 20;
+constexpr int32_t kMaxStatBits = 64;
+constexpr int32_t kMaxHeadroomBits = 32;
+
+int32_t SuggestedKeySize() {
+  int32_t key_size =
+      util::GetParamEnv("paillier_key_size", FLAGS_paillier_key_size);
+  YACL_ENFORCE(util::IsFlagSupported(kSupportedKeySizes, key_size),
+               "unsupported paillier key size {}", key_size);
+  return key_size;
+}
+
+int32_t SuggestedStatBits() {
+  int32_t stat_bits =
+      util::GetParamEnv("paillier_stat_bits", FLAGS_paillier_stat_bits);
+  YACL_ENFORCE(stat_bits >= kMinStatBits && stat_bits <= kMaxStatBits,
+               "paillier stat bits {} out of [{}, {}]", stat_bits,
+               kMinStatBits, kMaxStatBits);
+  return stat_bits;
+}
+
+bool SuggestedPacking() {
+  return util::GetParamEnv("paillier_packing", FLAGS_paillier_packing);
+}
+
+int32_t SuggestedHeadroomBits() {
+  int32_t headroom_bits =
+      util::GetParamEnv("paillier_headroom_bits", FLAGS_paillier_headroom_bits);
+  YACL_ENFORCE(headroom_bits >= 0 && headroom_bits <= kMaxHeadroomBits,
+               "paillier headroom bits {} out of [0, {}]", headroom_bits,
+               kMaxHeadroomBits);
+  return headroom_bits;
+}
+
+int32_t SuggestedPoolThreads() {
+  int32_t threads =
+      util::GetParamEnv("paillier_pool_threads", FLAGS_paillier_pool_threads);
+  if (threads > 0) {
+    return threads;
+  }
+  return std::max<int32_t>(std::thread::hardware_concurrency() / 4, 1);
+}
+
+using ic_impl::proto::PaillierProtocolProposal;
+
+std::set<int32_t> IntersectKeySizes(
+    const std::vector<PaillierProtocolProposal> &proposals) {
+  int field_num = PaillierProtocolProposal::kKeySizesFieldNumber;
+  return util::IntersectParamItems<PaillierProtocolProposal>(proposals,
+                                                             field_num);
+}
+
+void SetLayout(PaillierParam *param) {
+  param->slot_bits = SlotBits(param->stat_bits, param->headroom_bits);
+  param->slots = param->packing
+                     ? SlotsPerPlaintext(param->key_size, param->slot_bits)
+                     : 1;
+}
+
+}  // namespace
+
+PaillierParam SuggestedPaillierParam() {
+  PaillierParam param;
+  param.key_size = SuggestedKeySize();
+  param.stat_bits = SuggestedStatBits();
+  param.headroom_bits = SuggestedHeadroomBits();
+  param.packing = SuggestedPacking();
+  SetLayout(&param);
+  param.pool_size = std::max(
+      0, util::GetParamEnv("paillier_pool_size", FLAGS_paillier_pool_size));
+  param.pool_threads = SuggestedPoolThreads();
+
+  return param;
+}
+
+int32_t MaskBits(int32_t stat_bits, int32_t headroom_bits) {
+  return 64 + headroom_bits + stat_bits;
+}
+
+int32_t SlotBits(int32_t stat_bits, int32_t headroom_bits) {
+  // the sum of a value and its mask carries into one more bit
+  return MaskBits(stat_bits, headroom_bits) + 1;
+}
+
+int32_t SlotsPerPlaintext(int32_t key_size, int32_t slot_bits) {
+  // n has its top bit set, so does any plaintext of key_size - 1 bits fit
+  return (key_size - 1) / slot_bits;
+}
+
+ic_impl::proto::PaillierProtocolProposal BuildPaillierProposal(
+    const PaillierParam &param) {
+  ic_impl::proto::PaillierProtocolProposal proposal;
+  proposal.add_supported_versions(1);
+  proposal.add_key_sizes(param.key_size);
+  proposal.set_stat_bits(param.stat_bits);
+  proposal.set_support_packing(param.packing);
+  proposal.set_headroom_bits(param.headroom_bits);
+  return proposal;
+}
+
+bool NegotiatePaillierParam(
+    const std::vector<ic_impl::proto::PaillierProtocolProposal> &proposals,
+    PaillierParam *param) {
+  auto key_sizes = IntersectKeySizes(proposals);
+  if (key_sizes.find(param->key_size) == key_sizes.end()) {
+    return false;
+  }
+
+  for (const auto &proposal : proposals) {
+    param->stat_bits = std::max(param->stat_bits, proposal.stat_bits());
+    param->headroom_bits =
+        std::max(param->headroom_bits, proposal.headroom_bits());
+    param->packing = param->packing && proposal.support_packing();
+  }
+  if (param->stat_bits > kMaxStatBits ||
+      param->headroom_bits > kMaxHeadroomBits) {
+    return false;
+  }
+  SetLayout(param);
+
+  return true;
+}
+
+ic_impl::proto::PaillierProtocolResult BuildPaillierResult(
+    const PaillierParam &param) {
+  ic_impl::proto::PaillierProtocolResult result;
+  result.set_version(1);
+  result.set_key_size(param.key_size);
+  result.set_stat_bits(param.stat_bits);
+  result.set_slots(param.slots);
+  result.set_slot_bits(param.slot_bits);
+  result.set_headroom_bits(param.headroom_bits);
+  return result;
+}
+
+void ProcessPaillierResult(const ic_impl::proto::PaillierProtocolResult &result,
+                           PaillierParam *param) {
+  YACL_ENFORCE(result.key_size() == param->key_size);
+  YACL_ENFORCE(result.stat_bits() >= param->stat_bits &&
+               result.stat_bits() <= kMaxStatBits);
+  YACL_ENFORCE(result.headroom_bits() >= param->headroom_bits &&
+               result.headroom_bits() <= kMaxHeadroomBits);
+  YACL_ENFORCE(result.slot_bits() ==
+               SlotBits(result.stat_bits(), result.headroom_bits()));
+  if (result.slots() > 1) {
+    YACL_ENFORCE(param->packing);
+    YACL_ENFORCE(result.slots() ==
+                 SlotsPerPlaintext(param->key_size, result.slot_bits()));
+  } else {
+    YACL_ENFORCE(result.slots() == 1);
+  }
+  param->stat_bits = result.stat_bits();
+  param->headroom_bits = result.headroom_bits();
+  param->slot_bits = result.slot_bits();
+  param->slots = result.slots();
+  param->packing = param->slots > 1;
+}
+
+}  // namespace ic_impl::protocol_family::paillier
@@ -0,0 +1,69 @@
+// Copyright 2024 Ant Group Co., Ltd.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "ic_impl/proto/paillier.pb.h"
+
+namespace ic_impl::protocol_family::paillier {
+
+struct PaillierParam {
+  // bit length of the modulus n
+  int32_t key_size{};
+  // statistical security of the masks hiding plaintexts
+  int32_t stat_bits{};
+  // extra bits per slot, so that up to 2^headroom_bits packed ciphertexts
+  // can be summed slot-wise without carrying into the next slot
+  int32_t headroom_bits{};
+  bool packing{};
+  // layout of the plaintexts, fixed by the handshake
+  int32_t slots = 1;
+  int32_t slot_bits{};
+  // random factors precomputed in the background for own encryptions,
+  // local settings which are not negotiated
+  int32_t pool_size{};
+  int32_t pool_threads{};
+};
+
+PaillierParam SuggestedPaillierParam();
+
+// Bits of the masks hiding a value of Z_2^64 grown by up to headroom_bits
+int32_t MaskBits(int32_t stat_bits, int32_t headroom_bits);
+
+// Bits of a slot holding such a value plus its mask
+int32_t SlotBits(int32_t stat_bits, int32_t headroom_bits);
+
+// Number of slots of `slot_bits` bits in a plaintext, which stays below n
+int32_t SlotsPerPlaintext(int32_t key_size, int32_t slot_bits);
+
+ic_impl::proto::PaillierProtocolProposal BuildPaillierProposal(
+    const PaillierParam &param);
+
+// Agree with the proposals of the other parties on the largest stat and
+// headroom bits, packing only if everybody supports it. False if they do
+// not accept the own key size.
+bool NegotiatePaillierParam(
+    const std::vector<ic_impl::proto::PaillierProtocolProposal> &proposals,
+    PaillierParam *param);
+
+ic_impl::proto::PaillierProtocolResult BuildPaillierResult(
+    const PaillierParam &param);
+
+// Take the layout negotiated by rank 0, which must fit the own proposal
+void ProcessPaillierResult(const ic_impl::proto::PaillierProtocolResult &result,
+                           PaillierParam *param);
+
+}  // namespace ic_impl::protocol_family::paillier
@@ -0,0 +1,375 @@
+// Copyright 2024 Ant Group Co., Ltd.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include "ic_impl/protocol_family/paillier/paillier_cipher.h"
+
+#include <cstring>
+
+#include "yacl/base/exception.h"
+#include "yacl/crypto/rand/rand.h"
+#include "yacl/crypto/tools/prg.h"
+#include "yacl/utils/parallel.h"
+
+namespace ic_impl::protocol_family::paillier {
+
+using yacl::math::MPInt;
+
+namespace {
+
+// every operation is a modular exponentiation or close to it
+constexpr int64_t kParallelGrainSize = 1;
+
+MPInt GeneratePrime(int32_t bits) {
+  MPInt prime;
+  MPInt::RandPrimeOver(bits, &prime);
+  return prime;
+}
+
+std::pair<MPInt, MPInt> GeneratePrimes(int32_t key_size) {
+  YACL_ENFORCE(key_size % 2 == 0, "odd paillier key size {}", key_size);
+  while (true) {
+    auto p = GeneratePrime(key_size / 2);
+    auto q = GeneratePrime(key_size / 2);
+    if (p != q && (p * q).BitCount() == static_cast<size_t>(key_size)) {
+      return {std::move(p), std::move(q)};
+    }
+  }
+}
+
+MPInt RandomUnit(const MPInt &n) {
+  MPInt r;
+  do {
+    MPInt::RandomLtN(n, &r);
+  } while (r.IsZero());
+  return r;
+}
+
+template <typename Func>
+std::vector<MPInt> MapEach(size_t size, Func func) {
+  std::vector<MPInt> results(size);
+  yacl::parallel_for(0, size, kParallelGrainSize,
+                     [&](int64_t begin, int64_t end) {
+                       for (int64_t i = begin; i < end; ++i) {
+                         results[i] = func(i);
+                       }
+                     });
+  return results;
+}
+
+std::string SerializeNumbers(const std::vector<MPInt> &numbers) {
+  std::string buf;
+  for (const auto &number : numbers) {
+    auto bytes = number.Serialize();
+    auto size = static_cast<uint32_t>(bytes.size());
+    buf.append(reinterpret_cast<const char *>(&size), sizeof(size));
+    buf.append(bytes.data<char>(), bytes.size());
+  }
+  return buf;
+}
+
+std::vector<MPInt> DeserializeNumbers(yacl::ByteContainerView buf) {
+  std::vector<MPInt> numbers;
+  size_t offset = 0;
+  while (offset < buf.size()) {
+    uint32_t size = 0;
+    YACL_ENFORCE(offset + sizeof(size) <= buf.size(), "truncated numbers");
+    std::memcpy(&size, buf.data() + offset, sizeof(size));
+    offset += sizeof(size);
+    YACL_ENFORCE(offset + size <= buf.size(), "truncated numbers");
+    numbers.emplace_back().Deserialize(
+        yacl::ByteContainerView(buf.data() + offset, size));
+    offset += size;
+  }
+  return numbers;
+}
+
+}  // namespace
+
+PaillierPublicKey::PaillierPublicKey(MPInt n)
+    : n_(std::move(n)), n_square_(n_ * n_) {}
+
+std::vector<MPInt> PaillierPublicKey::Encrypt(
+    const std::vector<MPInt> &plaintexts) const {
+  return MapEach(plaintexts.size(), [&](size_t i) {
+    // g^m = 1 + m * n mod n^2, which is below n^2 for m below n
+    auto g_m = plaintexts[i].Mod(n_) * n_ + MPInt::_1_;
+    auto r_n = pool_ ? pool_->Take() : RandomFactor();
+    return g_m.MulMod(r_n, n_square_);
+  });
+}
+
+MPInt PaillierPublicKey::RandomFactor() const {
+  return RandomUnit(n_).PowMod(n_, n_square_);
+}
+
+void PaillierPublicKey::StartRandomnessPool(size_t size, size_t threads) {
+  pool_ = std::make_shared<RandomnessPool>(
+      [n = n_, n_square = n_square_] {
+        return RandomUnit(n).PowMod(n, n_square);
+      },
+      size, threads);
+}
+
+std::vector<MPInt> PaillierPublicKey::Add(const std::vector<MPInt> &lhs,
+                                          const std::vector<MPInt> &rhs) const {
+  YACL_ENFORCE(lhs.size() == rhs.size());
+  return MapEach(lhs.size(), [&](size_t i) {
+    return lhs[i].MulMod(rhs[i], n_square_);
+  });
+}
+
+std::vector<MPInt> PaillierPublicKey::AddPlain(
+    const std::vector<MPInt> &ciphertexts,
+    const std::vector<MPInt> &plaintexts) const {
+  YACL_ENFORCE(ciphertexts.size() == plaintexts.size());
+  return MapEach(ciphertexts.size(), [&](size_t i) {
+    auto g_m = plaintexts[i].Mod(n_) * n_ + MPInt::_1_;
+    return ciphertexts[i].MulMod(g_m, n_square_);
+  });
+}
+
+std::vector<MPInt> PaillierPublicKey::Pack(
+    const std::vector<MPInt> &ciphertexts, int32_t slots,
+    int32_t slot_bits) const {
+  YACL_ENFORCE(slots > 0 && slots * slot_bits < static_cast<int32_t>(
+                                                    n_.BitCount()));
+  auto shift = MPInt::_1_ << slot_bits;
+  size_t packed_num = (ciphertexts.size() + slots - 1) / slots;
+  return MapEach(packed_num, [&](size_t i) {
+    size_t begin = i * slots;
+    size_t end = std::min(begin + slots, ciphertexts.size());
+    auto packed = ciphertexts[end - 1];
+    for (size_t j = end - 1; j > begin; --j) {
+      packed = packed.PowMod(shift, n_square_)
+                   .MulMod(ciphertexts[j - 1], n_square_);
+    }
+    return packed;
+  });
+}
+
+std::vector<MPInt> PaillierPublicKey::Dot(
+    const std::vector<MPInt> &ciphertexts,
+    const std::vector<std::vector<int64_t>> &scalars) const {
+  auto negated = MapEach(ciphertexts.size(), [&](size_t i) {
+    return ciphertexts[i].InvertMod(n_square_);
+  });
+  return MapEach(scalars.size(), [&](size_t i) {
+    const auto &row = scalars[i];
+    YACL_ENFORCE(row.size() == ciphertexts.size());
+    auto sum = MPInt::_1_;
+    for (size_t j = 0; j < row.size(); ++j) {
+      if (row[j] > 0) {
+        sum = sum.MulMod(ciphertexts[j].PowMod(MPInt(row[j]), n_square_),
+                         n_square_);
+      } else if (row[j] < 0) {
+        sum = sum.MulMod(negated[j].PowMod(MPInt(-row[j]), n_square_),
+                         n_square_);
+      }
+    }
+    return sum;
+  });
+}
+
+std::vector<MPInt> PaillierPublicKey::SparseDot(
+    const std::vector<MPInt> &ciphertexts, const std::vector<int64_t> &offsets,
+    const std::vector<int32_t> &columns,
+    const std::vector<int64_t> &scalars) const {
+  YACL_ENFORCE(!offsets.empty() && columns.size() == scalars.size() &&
+               offsets.front() >= 0 &&
+               static_cast<size_t>(offsets.back()) <= scalars.size());
+  // only the ciphertexts met by a negative scalar are inverted
+  std::vector<MPInt> negated(ciphertexts.size());
+  std::vector<uint8_t> negative(ciphertexts.size());
+  for (auto k = offsets.front(); k < offsets.back(); ++k) {
+    YACL_ENFORCE(static_cast<size_t>(columns[k]) < ciphertexts.size());
+    if (scalars[k] < 0) {
+      negative[columns[k]] = 1;
+    }
+  }
+  yacl::parallel_for(0, ciphertexts.size(), kParallelGrainSize,
+                     [&](int64_t begin, int64_t end) {
+                       for (int64_t j = begin; j < end; ++j) {
+                         if (negative[j] != 0) {
+                           negated[j] = ciphertexts[j].InvertMod(n_square_);
+                         }
+                       }
+                     });
+
+  return MapEach(offsets.size() - 1, [&](size_t i) {
+    auto sum = MPInt::_1_;
+    for (auto k = offsets[i]; k < offsets[i + 1]; ++k) {
+      if (scalars[k] > 0) {
+        sum = sum.MulMod(
+            ciphertexts[columns[k]].PowMod(MPInt(scalars[k]), n_square_),
+            n_square_);
+      } else if (scalars[k] < 0) {
+        sum = sum.MulMod(
+            negated[columns[k]].PowMod(MPInt(-scalars[k]), n_square_),
+            n_square_);
+      }
+    }
+    return sum;
+  });
+}
+
+std::string PaillierPublicKey::Serialize() const {
+  auto buf = n_.Serialize();
+  return std::string(buf.data<char>(), buf.size());
+}
+
+PaillierPublicKey PaillierPublicKey::Deserialize(yacl::ByteContainerView buf) {
+  MPInt n;
+  n.Deserialize(buf);
+  YACL_ENFORCE(!n.IsZero(), "invalid paillier public key");
+  return PaillierPublicKey(std::move(n));
+}
+
+PaillierSecretKey::PaillierSecretKey(int32_t key_size)
+    : PaillierSecretKey(GeneratePrimes(key_size)) {}
+
+PaillierSecretKey::PaillierSecretKey(const std::pair<MPInt, MPInt> &primes)
+    : public_key_(primes.first * primes.second),
+      p_(MakePrimeFactor(primes.first, public_key_.N())),
+      q_(MakePrimeFactor(primes.second, public_key_.N())),
+      q_inverse_(primes.second.InvertMod(primes.first)) {}
+
+std::string PaillierSecretKey::Serialize() const {
+  return SerializeNumbers({p_.p, q_.p});
+}
+
+PaillierSecretKey PaillierSecretKey::Deserialize(yacl::ByteContainerView buf) {
+  auto primes = DeserializeNumbers(buf);
+  YACL_ENFORCE(primes.size() == 2, "invalid paillier secret key");
+  return PaillierSecretKey(std::make_pair(primes[0], primes[1]));
+}
+
+void PaillierSecretKey::StartRandomnessPool(size_t size, size_t threads) {
+  // r^n mod p^2 = r^(n mod p(p - 1)) mod p^2, as Z*_(p^2) has order p(p - 1)
+  const auto &n = public_key_.N();
+  auto p_exponent = n.Mod(p_.p * p_.p_minus_one);
+  auto q_exponent = n.Mod(q_.p * q_.p_minus_one);
+  auto p_square_inverse = p_.p_square.InvertMod(q_.p_square);
+  // the pool must not refer to the key, which it may outlive in a copy
+  public_key_.pool_ = std::make_shared<RandomnessPool>(
+      [n, p_square = p_.p_square, q_square = q_.p_square, p_exponent,
+       q_exponent, p_square_inverse] {
+        auto r = RandomUnit(n);
+        auto r_p = r.PowMod(p_exponent, p_square);
+        auto r_q = r.PowMod(q_exponent, q_square);
+        // r_p + p^2 * ((r_q - r_p) * (p^2)^-1 mod q^2)
+        auto diff = r_q + q_square - r_p.Mod(q_square);
+        return r_p + p_square * diff.MulMod(p_square_inverse, q_square);
+      },
+      size, threads);
+}
+
+PaillierSecretKey::PrimeFactor PaillierSecretKey::MakePrimeFactor(
+    const MPInt &prime, const MPInt &n) {
+  PrimeFactor factor;
+  factor.p = prime;
+  factor.p_square = prime * prime;
+  factor.p_minus_one = prime - MPInt::_1_;
+  auto g = n + MPInt::_1_;
+  auto l = (g.PowMod(factor.p_minus_one, factor.p_square) - MPInt::_1_) / prime;
+  factor.h = l.InvertMod(prime);
+  return factor;
+}
+
+MPInt PaillierSecretKey::DecryptModPrime(const MPInt &c,
+                                         const PrimeFactor &factor) {
+  // m = L_p(c^(p - 1) mod p^2) * h mod p
+  auto l = (c.PowMod(factor.p_minus_one, factor.p_square) - MPInt::_1_) /
+           factor.p;
+  return l.MulMod(factor.h, factor.p);
+}
+
+std::vector<MPInt> PaillierSecretKey::Decrypt(
+    const std::vector<MPInt> &ciphertexts) const {
+  return MapEach(ciphertexts.size(), [&](size_t i) {
+    auto m_p = DecryptModPrime(ciphertexts[i], p_);
+    auto m_q = DecryptModPrime(ciphertexts[i], q_);
+    // m = m_q + q * ((m_p - m_q) * q^-1 mod p)
+    auto diff = m_p + p_.p - m_q.Mod(p_.p);
+    return m_q + q_.p * diff.MulMod(q_inverse_, p_.p);
+  });
+}
+
+std::vector<MPInt> PackPlaintexts(const std::vector<MPInt> &values,
+                                  int32_t slots, int32_t slot_bits) {
+  YACL_ENFORCE(slots > 0);
+  size_t packed_num = (values.size() + slots - 1) / slots;
+  return MapEach(packed_num, [&](size_t i) {
+    size_t begin = i * slots;
+    size_t end = std::min(begin + slots, values.size());
+    auto packed = values[end - 1];
+    for (size_t j = end - 1; j > begin; --j) {
+      packed = (packed << slot_bits) + values[j - 1];
+    }
+    return packed;
+  });
+}
+
+std::vector<uint64_t> UnpackPlaintexts(const std::vector<MPInt> &plaintexts,
+                                       int32_t slots, int32_t slot_bits,
+                                       size_t count) {
+  YACL_ENFORCE(slots > 0 && plaintexts.size() * slots >= count);
+  auto ring = MPInt::_1_ << 64;
+  std::vector<uint64_t> values(count);
+  yacl::parallel_for(0, plaintexts.size(), kParallelGrainSize,
+                     [&](int64_t begin, int64_t end) {
+                       for (int64_t i = begin; i < end; ++i) {
+                         auto rest = plaintexts[i];
+                         size_t slot_end =
+                             std::min<size_t>((i + 1) * slots, count);
+                         for (size_t j = i * slots; j < slot_end; ++j) {
+                           values[j] = rest.Mod(ring).Get<uint64_t>();
+                           rest = rest >> slot_bits;
+                         }
+                       }
+                     });
+  return values;
+}
+
+std::vector<MPInt> RandomMasks(size_t count, int32_t bits,
+                               std::vector<uint64_t> *low_words) {
+  YACL_ENFORCE(bits >= 64);
+  yacl::crypto::Prg<uint64_t> prg(yacl::crypto::SecureRandSeed());
+  int32_t word_num = (bits + 63) / 64;
+  int32_t top_bits = bits - (word_num - 1) * 64;
+  uint64_t top_mask =
+      top_bits == 64 ? ~uint64_t{0} : (uint64_t{1} << top_bits) - 1;
+
+  std::vector<MPInt> masks(count);
+  low_words->resize(count);
+  for (size_t i = 0; i < count; ++i) {
+    uint64_t word = prg() & top_mask;
+    MPInt mask(word);
+    for (int32_t j = 1; j < word_num; ++j) {
+      word = prg();
+      mask = (mask << 64) + MPInt(word);
+    }
+    (*low_words)[i] = word;
+    masks[i] = std::move(mask);
+  }
+  return masks;
+}
+
+std::string SerializeCiphertexts(const std::vector<MPInt> &ciphertexts) {
+  return SerializeNumbers(ciphertexts);
+}
+
+std::vector<MPInt> DeserializeCiphertexts(yacl::ByteContainerView buf) {
+  return DeserializeNumbers(buf);
+}
+
+}  // namespace ic_impl::protocol_family::paillier
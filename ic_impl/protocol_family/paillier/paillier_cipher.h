@@ -0,0 +1,163 @@
+// Copyright 2024 Ant Group Co., Ltd.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#pragma once
+
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "yacl/base/byte_container_view.h"
+#include "yacl/math/mpint/mp_int.h"
+
+#include "ic_impl/protocol_family/paillier/randomness_pool.h"
+
+namespace ic_impl::protocol_family::paillier {
+
+// Public key of Paillier encryption with g = n + 1. Plaintexts are taken
+// modulo n, ciphertexts are elements of Z_{n^2}. The methods taking vectors
+// run in parallel.
+class PaillierPublicKey {
+ public:
+  explicit PaillierPublicKey(yacl::math::MPInt n);
+
+  // Enc(m) = (1 + m * n) * r^n mod n^2 for each plaintext m
+  std::vector<yacl::math::MPInt> Encrypt(
+      const std::vector<yacl::math::MPInt> &plaintexts) const;
+
+  // r^n mod n^2 for a fresh random r
+  yacl::math::MPInt RandomFactor() const;
+
+  // Take the random factors of Encrypt from up to `size` ones precomputed
+  // by `threads` background threads. Copies of the key share the pool.
+  void StartRandomnessPool(size_t size, size_t threads);
+
+  // Enc(a + b) for each pair of ciphertexts
+  std::vector<yacl::math::MPInt> Add(
+      const std::vector<yacl::math::MPInt> &lhs,
+      const std::vector<yacl::math::MPInt> &rhs) const;
+
+  // Enc(m + p) for each ciphertext Enc(m) and plaintext p, keeping the
+  // randomness of the ciphertext
+  std::vector<yacl::math::MPInt> AddPlain(
+      const std::vector<yacl::math::MPInt> &ciphertexts,
+      const std::vector<yacl::math::MPInt> &plaintexts) const;
+
+  // Enc(sum m_i * 2^(i * slot_bits)) of every `slots` consecutive Enc(m_i),
+  // the last group possibly shorter. Horner's rule keeps the exponents
+  // slot_bits long, far cheaper than decrypting each of them.
+  std::vector<yacl::math::MPInt> Pack(
+      const std::vector<yacl::math::MPInt> &ciphertexts, int32_t slots,
+      int32_t slot_bits) const;
+
+  // Enc(sum_i k_i * m_i) of the ciphertexts Enc(m_i) for each row k of
+  // signed `scalars`. Negative k_i raise Enc(-m_i) to |k_i|, which keeps the
+  // exponents as short as the scalars.
+  std::vector<yacl::math::MPInt> Dot(
+      const std::vector<yacl::math::MPInt> &ciphertexts,
+      const std::vector<std::vector<int64_t>> &scalars) const;
+
+  // Dot for the rows of a sparse matrix of scalars, row i holding
+  // scalars[k] at column columns[k] for k in [offsets[i], offsets[i + 1]).
+  // The cost grows with the number of scalars in the rows only.
+  std::vector<yacl::math::MPInt> SparseDot(
+      const std::vector<yacl::math::MPInt> &ciphertexts,
+      const std::vector<int64_t> &offsets, const std::vector<int32_t> &columns,
+      const std::vector<int64_t> &scalars) const;
+
+  const yacl::math::MPInt &N() const { return n_; }
+
+  std::string Serialize() const;
+
+  static PaillierPublicKey Deserialize(yacl::ByteContainerView buf);
+
+ private:
+  friend class PaillierSecretKey;
+
+  yacl::math::MPInt n_;
+  yacl::math::MPInt n_square_;
+  std::shared_ptr<RandomnessPool> pool_;
+};
+
+// Key pair of Paillier encryption, decrypting by the CRT
+class PaillierSecretKey {
+ public:
+  // Generate a key pair whose modulus n is `key_size` bits long
+  explicit PaillierSecretKey(int32_t key_size);
+
+  const PaillierPublicKey &PublicKey() const { return public_key_; }
+
+  // The primes, to keep the key pair for later jobs
+  std::string Serialize() const;
+
+  static PaillierSecretKey Deserialize(yacl::ByteContainerView buf);
+
+  // The plaintext of each ciphertext, in [0, n)
+  std::vector<yacl::math::MPInt> Decrypt(
+      const std::vector<yacl::math::MPInt> &ciphertexts) const;
+
+  // Like PaillierPublicKey::StartRandomnessPool for the own public key, the
+  // factors computed modulo p^2 and q^2 with exponents half as long, which
+  // is about four times faster
+  void StartRandomnessPool(size_t size, size_t threads);
+
+ private:
+  // Decryption modulo one of the primes
+  struct PrimeFactor {
+    yacl::math::MPInt p;
+    yacl::math::MPInt p_square;
+    yacl::math::MPInt p_minus_one;
+    // L_p(g^(p - 1) mod p^2)^-1 mod p
+    yacl::math::MPInt h;
+  };
+
+  explicit PaillierSecretKey(
+      const std::pair<yacl::math::MPInt, yacl::math::MPInt> &primes);
+
+  static PrimeFactor MakePrimeFactor(const yacl::math::MPInt &prime,
+                                     const yacl::math::MPInt &n);
+
+  static yacl::math::MPInt DecryptModPrime(const yacl::math::MPInt &c,
+                                           const PrimeFactor &factor);
+
+  PaillierPublicKey public_key_;
+  PrimeFactor p_;
+  PrimeFactor q_;
+  // q^-1 mod p
+  yacl::math::MPInt q_inverse_;
+};
+
+// Plaintexts holding `slots` values each, the first one in the lowest bits.
+// The values must be shorter than slot_bits.
+std::vector<yacl::math::MPInt> PackPlaintexts(
+    const std::vector<yacl::math::MPInt> &values, int32_t slots,
+    int32_t slot_bits);
+
+// The first `count` values in the slots of `plaintexts`, modulo 2^64
+std::vector<uint64_t> UnpackPlaintexts(
+    const std::vector<yacl::math::MPInt> &plaintexts, int32_t slots,
+    int32_t slot_bits, size_t count);
+
+// `count` random masks of `bits` bits, and their values mod 2^64
+std::vector<yacl::math::MPInt> RandomMasks(size_t count, int32_t bits,
+                                           std::vector<uint64_t> *low_words);
+
+// Encoding of ciphertexts on the links, each prefixed with its length
+std::string SerializeCiphertexts(
+    const std::vector<yacl::math::MPInt> &ciphertexts);
+
+std::vector<yacl::math::MPInt> DeserializeCiphertexts(
+    yacl::ByteContainerView buf);
+
+}  // namespace ic_impl::protocol_family::paillier
@@ -0,0 +1,74 @@
+// Copyright 2024 Ant Group Co., Ltd.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "ic_impl/protocol_family/paillier/randomness_pool.h"
+
+namespace ic_impl::protocol_family::paillier {
+
+using yacl::math::MPInt;
+
+RandomnessPool::RandomnessPool(std::function<MPInt()> generate,
+                               size_t capacity, size_t threads)
+    : generate_(std::move(generate)), capacity_(capacity) {
+  for (size_t i = 0; i < threads && capacity_ > 0; ++i) {
+    threads_.emplace_back([this] { Fill(); });
+  }
+}
+
+RandomnessPool::~RandomnessPool() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopped_ = true;
+  }
+  not_full_.notify_all();
+  for (auto &thread : threads_) {
+    thread.join();
+  }
+}
+
+MPInt RandomnessPool::Take() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!ready_.empty()) {
+      auto factor = std::move(ready_.front());
+      ready_.pop_front();
+      not_full_.notify_one();
+      return factor;
+    }
+  }
+
+  ++misses_;
+  return generate_();
+}
+
+void RandomnessPool::Fill() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (true) {
+    not_full_.wait(lock, [this] {
+      return stopped_ || ready_.size() + pending_ < capacity_;
+    });
+    if (stopped_) {
+      return;
+    }
+
+    ++pending_;
+    lock.unlock();
+    auto factor = generate_();
+    lock.lock();
+    --pending_;
+    ready_.push_back(std::move(factor));
+  }
+}
+
+}  // namespace ic_impl::protocol_family::paillier
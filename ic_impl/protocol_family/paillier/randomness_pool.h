@@ -0,0 +1,63 @@
+// Copyright 2024 Ant Group Co., Ltd.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "yacl/math/mpint/mp_int.h"
+
+namespace ic_impl::protocol_family::paillier {
+
+// Random factors r^n mod n^2 of Paillier encryptions, which take almost all
+// of their time, computed ahead by background threads
+class RandomnessPool {
+ public:
+  // Keep up to `capacity` results of `generate` ready, computed by
+  // `threads` threads
+  RandomnessPool(std::function<yacl::math::MPInt()> generate, size_t capacity,
+                 size_t threads);
+
+  ~RandomnessPool();
+
+  // A precomputed factor, or one computed now if the pool ran dry
+  yacl::math::MPInt Take();
+
+  // factors computed on demand so far
+  size_t Misses() const { return misses_; }
+
+ private:
+  void Fill();
+
+  std::function<yacl::math::MPInt()> generate_;
+  size_t capacity_;
+
+  std::mutex mutex_;
+  std::condition_variable not_full_;
+  std::deque<yacl::math::MPInt> ready_;
+  // being computed, counted against the capacity
+  size_t pending_ = 0;
+  bool stopped_ = false;
+  std::atomic<size_t> misses_{0};
+
+  std::vector<std::thread> threads_;
+};
+
+}  // namespace ic_impl::protocol_family::paillier
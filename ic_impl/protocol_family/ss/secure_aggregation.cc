@@ -0,0 +1,209 @@
+// Copyright 2024 Ant Group Co., Ltd.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "ic_impl/protocol_family/ss/secure_aggregation.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "absl/strings/str_cat.h"
+#include "gflags/gflags.h"
+#include "yacl/crypto/hash/hash_utils.h"
+#include "yacl/crypto/tools/prg.h"
+
+#include "ic_impl/protocol_family/ecc/ec_cipher.h"
+#include "ic_impl/util.h"
+
+#include "interconnection/handshake/protocol_family/ecc.pb.h"
+
+DEFINE_int64(secure_agg_chunk_size, 1 << 16,
+             "number of values of a secure aggregation message, the smallest "
+             "one proposed is used");
+DEFINE_int32(secure_agg_window, 4,
+             "number of chunks each party sends in secure aggregation ahead "
+             "of the sums received");
+
+namespace ic_impl::protocol_family::ss {
+
+namespace {
+
+constexpr char kKeyTag[] = "secure_agg_key";
+constexpr char kMaskedTag[] = "secure_agg_masked";
+constexpr char kSumTag[] = "secure_agg_sum";
+
+constexpr size_t kAesBlockSize = 16;
+
+// hashed to the base point of the key agreement
+constexpr char kKeyAgreementDomain[] = "ic_impl.secure_agg.key_agreement";
+
+int64_t ChunkNum(size_t size, int64_t chunk_size) {
+  return (static_cast<int64_t>(size) + chunk_size - 1) / chunk_size;
+}
+
+absl::Span<uint64_t> ChunkOf(std::vector<uint64_t> *values, int64_t chunk,
+                             int64_t chunk_size) {
+  size_t beg = chunk * chunk_size;
+  size_t len = std::min<size_t>(chunk_size, values->size() - beg);
+  return absl::MakeSpan(values->data() + beg, len);
+}
+
+}  // namespace
+
+SecureAggParam SuggestedSecureAggParam() {
+  SecureAggParam param;
+  param.chunk_size =
+      util::GetParamEnv("secure_agg_chunk_size", FLAGS_secure_agg_chunk_size);
+  param.window =
+      util::GetParamEnv("secure_agg_window", FLAGS_secure_agg_window);
+
+  return param;
+}
+
+SecureAggregator::SecureAggregator(std::shared_ptr<yacl::link::Context> lctx,
+                                   SecureAggParam param)
+    : lctx_(std::move(lctx)), param_(param) {
+  YACL_ENFORCE(param_.chunk_size > 0, "invalid chunk size {}",
+               param_.chunk_size);
+  param_.window = std::max(param_.window, 1);
+}
+
+void SecureAggregator::ExchangeSeeds() {
+  // Diffie-Hellman over SM2: party i sends k_i * H(domain) and shares
+  // k_i * k_j * H(domain) with party j, so a relay of the messages, e.g. the
+  // router, learns no seed
+  ecc::EcCipher cipher(org::interconnection::v2::protocol::CURVE_TYPE_SM2);
+  auto public_key = cipher.HashAndMask({kKeyAgreementDomain}).front();
+
+  size_t self_rank = lctx_->Rank();
+  for (size_t rank = 0; rank < lctx_->WorldSize(); ++rank) {
+    if (rank != self_rank) {
+      lctx_->SendAsync(rank, public_key, kKeyTag);
+    }
+  }
+
+  seeds_.assign(lctx_->WorldSize(), 0);
+  for (size_t rank = 0; rank < lctx_->WorldSize(); ++rank) {
+    if (rank == self_rank) {
+      continue;
+    }
+    auto buf = lctx_->Recv(rank, kKeyTag);
+    YACL_ENFORCE(static_cast<size_t>(buf.size()) == cipher.PointSize(),
+                 "invalid public key from rank {}", rank);
+    auto shared = cipher.Mask({std::string(buf.data<char>(), buf.size())});
+    auto digest = yacl::crypto::Sha256(shared.front());
+    std::memcpy(&seeds_[rank], digest.data(), sizeof(uint128_t));
+  }
+  round_ = 0;
+}
+
+void SecureAggregator::AllReduceSum(std::vector<uint64_t> *values) {
+  YACL_ENFORCE(seeds_.size() == lctx_->WorldSize(), "seeds not exchanged");
+  if (lctx_->Rank() == 0) {
+    Aggregate(values);
+  } else {
+    Contribute(values);
+  }
+  ++round_;
+}
+
+void SecureAggregator::Aggregate(std::vector<uint64_t> *values) {
+  std::vector<uint64_t> received;
+  for (int64_t chunk = 0; chunk < ChunkNum(values->size(), param_.chunk_size);
+       ++chunk) {
+    auto sum = ChunkOf(values, chunk, param_.chunk_size);
+    Mask(chunk, sum);
+    received.resize(sum.size());
+    for (size_t rank = 1; rank < lctx_->WorldSize(); ++rank) {
+      RecvChunk(rank, chunk, absl::MakeSpan(received), kMaskedTag);
+      for (size_t i = 0; i < sum.size(); ++i) {
+        sum[i] += received[i];
+      }
+    }
+    for (size_t rank = 1; rank < lctx_->WorldSize(); ++rank) {
+      SendChunk(rank, chunk, sum, kSumTag);
+    }
+  }
+}
+
+void SecureAggregator::Contribute(std::vector<uint64_t> *values) {
+  // chunks are masked in place, as their sums replace them anyway
+  int64_t chunk_num = ChunkNum(values->size(), param_.chunk_size);
+  auto send = [&](int64_t chunk) {
+    auto masked = ChunkOf(values, chunk, param_.chunk_size);
+    Mask(chunk, masked);
+    SendChunk(0, chunk, masked, kMaskedTag);
+  };
+
+  for (int64_t chunk = 0; chunk < std::min<int64_t>(param_.window, chunk_num);
+       ++chunk) {
+    send(chunk);
+  }
+  for (int64_t chunk = 0; chunk < chunk_num; ++chunk) {
+    RecvChunk(0, chunk, ChunkOf(values, chunk, param_.chunk_size), kSumTag);
+    if (chunk + param_.window < chunk_num) {
+      send(chunk + param_.window);
+    }
+  }
+}
+
+void SecureAggregator::Mask(int64_t chunk, absl::Span<uint64_t> values) {
+  // the counter is offset by the AES blocks of the chunks before, so each
+  // chunk is masked independently of the others
+  uint64_t blocks_per_chunk =
+      (param_.chunk_size * sizeof(uint64_t) + kAesBlockSize - 1) /
+      kAesBlockSize;
+  uint64_t count = chunk * blocks_per_chunk;
+  stream_.resize(values.size());
+
+  size_t self_rank = lctx_->Rank();
+  for (size_t rank = 0; rank < seeds_.size(); ++rank) {
+    if (rank == self_rank) {
+      continue;
+    }
+    yacl::crypto::FillPRand(
+        yacl::crypto::SymmetricCrypto::CryptoType::AES128_CTR, seeds_[rank],
+        round_, count, absl::MakeSpan(stream_));
+    if (self_rank < rank) {
+      for (size_t i = 0; i < values.size(); ++i) {
+        values[i] += stream_[i];
+      }
+    } else {
+      for (size_t i = 0; i < values.size(); ++i) {
+        values[i] -= stream_[i];
+      }
+    }
+  }
+}
+
+void SecureAggregator::SendChunk(size_t rank, int64_t chunk,
+                                 absl::Span<const uint64_t> values,
+                                 std::string_view tag) {
+  lctx_->SendAsync(rank,
+                   yacl::ByteContainerView(values.data(),
+                                           values.size() * sizeof(uint64_t)),
+                   absl::StrCat(tag, ":", round_, ":", chunk));
+}
+
+void SecureAggregator::RecvChunk(size_t rank, int64_t chunk,
+                                 absl::Span<uint64_t> values,
+                                 std::string_view tag) {
+  auto buf = lctx_->Recv(rank, absl::StrCat(tag, ":", round_, ":", chunk));
+  YACL_ENFORCE(static_cast<size_t>(buf.size()) ==
+                   values.size() * sizeof(uint64_t),
+               "chunk {} from rank {} of unexpected size {}", chunk, rank,
+               buf.size());
+  std::memcpy(values.data(), buf.data(), buf.size());
+}
+
+}  // namespace ic_impl::protocol_family::ss
@@ -0,0 +1,84 @@
+// Copyright 2024 Ant Group Co., Ltd.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "absl/types/span.h"
+#include "yacl/base/int128.h"
+#include "yacl/link/context.h"
+
+namespace ic_impl::protocol_family::ss {
+
+struct SecureAggParam {
+  // ring elements sent at once, agreed on in the handshake
+  int64_t chunk_size{};
+  // chunks a party sends ahead of the sums it has received
+  int32_t window{};
+};
+
+SecureAggParam SuggestedSecureAggParam();
+
+// Sums of vectors in Z_2^64 over every party, of which no party learns more
+// than the sum.
+//
+// Each pair of parties i < j agrees on a seed by Diffie-Hellman, so that
+// neither rank 0 nor a relay of the links learns it, and party i adds the
+// AES128-CTR stream of the seed to its vector while party j subtracts it,
+// so the masks cancel out in the sum. Rank 0 adds up the masked vectors
+// chunk by chunk and sends each sum back as soon as it is complete. Every
+// party keeps at most `window` chunks in flight, which bounds the memory of
+// rank 0 by the size of a vector whatever the number of parties.
+class SecureAggregator {
+ public:
+  SecureAggregator(std::shared_ptr<yacl::link::Context> lctx,
+                   SecureAggParam param);
+
+  // Agree on a fresh seed with every other party. Called by every party
+  // before the first sum.
+  void ExchangeSeeds();
+
+  // Replace `values` with their sum over the parties, which must all pass
+  // vectors of the same size
+  void AllReduceSum(std::vector<uint64_t> *values);
+
+ private:
+  // Add the masks of chunk `chunk` of the current round to `values`
+  void Mask(int64_t chunk, absl::Span<uint64_t> values);
+
+  void SendChunk(size_t rank, int64_t chunk, absl::Span<const uint64_t> values,
+                 std::string_view tag);
+
+  void RecvChunk(size_t rank, int64_t chunk, absl::Span<uint64_t> values,
+                 std::string_view tag);
+
+  void Aggregate(std::vector<uint64_t> *values);
+
+  void Contribute(std::vector<uint64_t> *values);
+
+  std::shared_ptr<yacl::link::Context> lctx_;
+  SecureAggParam param_;
+
+  // by peer rank, none for the own one
+  std::vector<uint128_t> seeds_;
+  // the sums computed so far, which tell the masks of one sum from those of
+  // the next
+  uint64_t round_ = 0;
+  // for the masks of a chunk
+  std::vector<uint64_t> stream_;
+};
+
+}  // namespace ic_impl::protocol_family::ss
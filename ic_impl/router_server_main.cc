@@ -0,0 +1,32 @@
+// Copyright 2024 Ant Group Co., Ltd.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include "gflags/gflags.h"
+#include "spdlog/spdlog.h"
+
+#include "ic_impl/link/router_server.h"
+
+DEFINE_string(listen, "0.0.0.0:9600", "address the router server listens on");
+
+int main(int argc, char** argv) {
+  google::ParseCommandLineFlags(&argc, &argv, true);
+  try {
+    ic_impl::link::RouterServer server(FLAGS_listen);
+    server.Run();
+  } catch (const std::exception& e) {
+    SPDLOG_ERROR("router server failed: {}", e.what());
+    return -1;
+  }
+
+  return 0;
+}
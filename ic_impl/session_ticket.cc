@@ -0,0 +1,171 @@
+// Copyright 2024 Ant Group Co., Ltd.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include "ic_impl/session_ticket.h"
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+
+#include "absl/strings/escaping.h"
+#include "absl/strings/str_cat.h"
+#include "gflags/gflags.h"
+#include "google/protobuf/io/coded_stream.h"
+#include "google/protobuf/io/zero_copy_stream_impl_lite.h"
+#include "spdlog/spdlog.h"
+#include "yacl/crypto/hash/hash_utils.h"
+
+#include "ic_impl/util.h"
+
+DEFINE_string(handshake_ticket_dir, "",
+              "directory keeping session tickets, which let jobs repeating "
+              "the proposals of an earlier one skip the negotiation");
+
+namespace ic_impl {
+
+namespace {
+
+using org::interconnection::v2::HandshakeRequest;
+using org::interconnection::v2::HandshakeResponse;
+
+// Serialize `message` deterministically, an attached ticket left out
+template <typename T>
+std::string SerializeWithoutTicket(T message) {
+  message.GetReflection()
+      ->MutableUnknownFields(&message)
+      ->DeleteByNumber(util::kSessionTicketFieldNumber);
+
+  std::string out;
+  {
+    google::protobuf::io::StringOutputStream stream(&out);
+    google::protobuf::io::CodedOutputStream coded(&stream);
+    coded.SetSerializationDeterministic(true);
+    message.SerializeToCodedStream(&coded);
+  }
+  return out;
+}
+
+std::string SerializeProposal(const HandshakeRequest &request) {
+  return SerializeWithoutTicket(request);
+}
+
+std::string Digest(std::string_view data) {
+  auto digest = yacl::crypto::Sha256(data);
+  return std::string(reinterpret_cast<const char *>(digest.data()),
+                     digest.size());
+}
+
+}  // namespace
+
+SessionTicketCache::SessionTicketCache()
+    : dir_(util::GetParamEnv("handshake_ticket_dir",
+                             FLAGS_handshake_ticket_dir)) {}
+
+std::string SessionTicketCache::LoadTicket(
+    const HandshakeRequest &request) const {
+  if (!Enabled()) {
+    return "";
+  }
+  auto name = absl::StrCat(
+      "request-", absl::BytesToHexString(Digest(SerializeProposal(request))));
+  return Load(name).value_or("");
+}
+
+void SessionTicketCache::StoreTicket(const HandshakeRequest &request,
+                                     const std::string &ticket) const {
+  if (!Enabled()) {
+    return;
+  }
+  auto name = absl::StrCat(
+      "request-", absl::BytesToHexString(Digest(SerializeProposal(request))));
+  Store(name, ticket);
+}
+
+std::optional<HandshakeResponse> SessionTicketCache::LoadResponse(
+    const std::string &ticket) const {
+  if (!Enabled()) {
+    return std::nullopt;
+  }
+  auto value = Load(absl::StrCat("response-", absl::BytesToHexString(ticket)));
+  HandshakeResponse response;
+  if (!value.has_value() || !response.ParseFromString(value.value())) {
+    return std::nullopt;
+  }
+  return response;
+}
+
+void SessionTicketCache::StoreResponse(
+    const std::string &ticket, const HandshakeResponse &response) const {
+  if (!Enabled()) {
+    return;
+  }
+  Store(absl::StrCat("response-", absl::BytesToHexString(ticket)),
+        response.SerializeAsString());
+}
+
+std::optional<std::string> SessionTicketCache::Load(
+    const std::string &name) const {
+  std::ifstream in(std::filesystem::path(dir_) / name, std::ios::binary);
+  if (!in) {
+    return std::nullopt;
+  }
+  std::ostringstream value;
+  value << in.rdbuf();
+  return value.str();
+}
+
+void SessionTicketCache::Store(const std::string &name,
+                               const std::string &value) const {
+  // a missing ticket only costs a full negotiation, so failures are logged
+  std::error_code ec;
+  std::filesystem::create_directories(dir_, ec);
+  auto path = std::filesystem::path(dir_) / name;
+  auto tmp_path = path;
+  tmp_path += ".tmp";
+  {
+    std::ofstream out(tmp_path, std::ios::binary | std::ios::trunc);
+    out << value;
+    if (!out) {
+      SPDLOG_WARN("write session ticket file={} failed", tmp_path.string());
+      return;
+    }
+  }
+  std::filesystem::rename(tmp_path, path, ec);
+  if (ec) {
+    SPDLOG_WARN("rename session ticket file={} failed: {}", path.string(),
+                ec.message());
+  }
+}
+
+std::string ComputeSessionTicket(const std::vector<HandshakeRequest> &requests,
+                                 const HandshakeResponse &settings) {
+  std::vector<const HandshakeRequest *> sorted;
+  for (const auto &request : requests) {
+    sorted.push_back(&request);
+  }
+  std::sort(sorted.begin(), sorted.end(), [](const auto *a, const auto *b) {
+    return a->requester_rank() < b->requester_rank();
+  });
+
+  std::string data;
+  for (const auto *request : sorted) {
+    auto proposal = SerializeProposal(*request);
+    absl::StrAppend(&data, proposal.size(), ":", proposal);
+  }
+  auto own = SerializeWithoutTicket(settings);
+  absl::StrAppend(&data, own.size(), ":", own);
+  return Digest(data);
+}
+
+}  // namespace ic_impl
@@ -0,0 +1,64 @@
+// Copyright 2024 Ant Group Co., Ltd.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#pragma once
+
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "interconnection/handshake/entry.pb.h"
+
+namespace ic_impl {
+
+// Session tickets let rank 0 skip the negotiation when every party proposes
+// exactly what it did in an earlier job and rank 0 has the same settings.
+// Rank 0 keeps the response of that job under the ticket, a digest of all
+// proposals and of its settings, and the others keep the ticket under the
+// digest of their own proposal, so they can present it.
+class SessionTicketCache {
+ public:
+  // Keep the tickets in -handshake_ticket_dir, disabled if it is empty
+  SessionTicketCache();
+
+  bool Enabled() const { return !dir_.empty(); }
+
+  // The ticket to present along with `request`, empty if there is none
+  std::string LoadTicket(
+      const org::interconnection::v2::HandshakeRequest &request) const;
+
+  void StoreTicket(const org::interconnection::v2::HandshakeRequest &request,
+                   const std::string &ticket) const;
+
+  std::optional<org::interconnection::v2::HandshakeResponse> LoadResponse(
+      const std::string &ticket) const;
+
+  void StoreResponse(
+      const std::string &ticket,
+      const org::interconnection::v2::HandshakeResponse &response) const;
+
+ private:
+  std::optional<std::string> Load(const std::string &name) const;
+
+  void Store(const std::string &name, const std::string &value) const;
+
+  std::string dir_;
+};
+
+// Digest of the proposals of the parties in rank order and of `settings`,
+// what rank 0 would respond before negotiating, attached tickets left out
+std::string ComputeSessionTicket(
+    const std::vector<org::interconnection::v2::HandshakeRequest> &requests,
+    const org::interconnection::v2::HandshakeResponse &settings);
+
+}  // namespace ic_impl
@@ -14,19 +14,58 @@
 
 #include "ic_impl/util.h"
 
+#include <algorithm>
 #include <cstdlib>
+#include <functional>
 
 #include "absl/strings/match.h"
 #include "absl/strings/str_split.h"
+#include "gflags/gflags.h"
 #include "nlohmann/json.hpp"
 #include "spdlog/spdlog.h"
 #include "yacl/link/factory.h"
 #include "yacl/link/transport/blackbox_interconnect/mock_transport.h"
 
+#include "ic_impl/link/link_factory.h"
+
+DEFINE_string(link_emulation, "",
+              "emulate wide area links to the peers on white box links, "
+              "comma-separated latency_ms[:bandwidth_mbps[:jitter_ms]] per "
+              "party in the order of the parties, or one for all of them");
+DEFINE_string(router_server, "",
+              "host:port of the router server relaying the messages of white "
+              "box links, the parties connect to each other if empty");
+DEFINE_int64(router_package_size, 1 << 20,
+             "largest package messages are split into on router links");
+DEFINE_int32(router_window, 16,
+             "packages in flight on each router link before the router "
+             "server acknowledges them");
+DEFINE_int32(blackbox_http_timeout_ms, 0,
+             "timeout of each HTTP request on black box links, the yacl "
+             "default if 0, or 10 s for the requests of the mock transport");
+DEFINE_int32(blackbox_http_max_retry, 3,
+             "retries of a failed HTTP request on black box links");
+DEFINE_int64(blackbox_http_max_payload_size, 0,
+             "size of the chunks larger messages are split into on black box "
+             "links, the yacl default if 0");
+DEFINE_int32(blackbox_chunk_parallelism, 0,
+             "number of chunks of a message in flight at the same time on "
+             "black box links, the yacl default if 0");
+DEFINE_int32(blackbox_coalesce_window_ms, 0,
+             "how long a small message waits for others to go out in one "
+             "request on black box links, no coalescing if 0, every party "
+             "must set it alike");
+DEFINE_int64(blackbox_coalesce_max_bytes, 64 << 10,
+             "largest batch of small messages on black box links");
+
 namespace ic_impl::util {
 
 namespace {
 
+// Parties listed with this scheme run on the same host and talk to each other
+// through shared memory
+constexpr std::string_view kShmScheme = "shm://";
+
 void StartTransport() {
   static yacl::link::transport::blackbox_interconnect::MockTransport transport;
 
@@ -36,7 +75,13 @@ void StartTransport() {
     options.connection_type = "";
     options.connect_timeout_ms = 20000;
     options.timeout_ms = 1e4;
-    options.max_retry = 3;
+    if (int32_t timeout_ms = GetParamEnv("blackbox_http_timeout_ms",
+                                         FLAGS_blackbox_http_timeout_ms);
+        timeout_ms > 0) {
+      options.timeout_ms = timeout_ms;
+    }
+    options.max_retry =
+        GetParamEnv("blackbox_http_max_retry", FLAGS_blackbox_http_max_retry);
   }
 
   transport.StartFromEnv(options);
@@ -47,6 +92,23 @@ void StartTransport() {
 std::shared_ptr<yacl::link::Context> CreateLinkContextForBlackBox() {
   yacl::link::ContextDesc desc;
   desc.brpc_channel_protocol = "http";
+  // every message is at least one request through the gateway, larger
+  // chunks and more of them in flight save round trips on big tensors
+  if (int32_t timeout_ms = GetParamEnv("blackbox_http_timeout_ms",
+                                       FLAGS_blackbox_http_timeout_ms);
+      timeout_ms > 0) {
+    desc.http_timeout_ms = timeout_ms;
+  }
+  if (int64_t payload_size = GetParamEnv("blackbox_http_max_payload_size",
+                                         FLAGS_blackbox_http_max_payload_size);
+      payload_size > 0) {
+    desc.http_max_payload_size = payload_size;
+  }
+  if (int32_t parallelism = GetParamEnv("blackbox_chunk_parallelism",
+                                        FLAGS_blackbox_chunk_parallelism);
+      parallelism > 0) {
+    desc.chunk_parallel_send_size = parallelism;
+  }
   size_t self_rank;
   yacl::link::FactoryBrpcBlackBox::GetPartyNodeInfoFromEnv(desc.parties,
                                                            self_rank);
@@ -55,32 +117,74 @@ std::shared_ptr<yacl::link::Context> CreateLinkContextForBlackBox() {
     StartTransport();
   }
 
-  return yacl::link::FactoryBrpcBlackBox().CreateContext(desc, self_rank);
+  link::CoalescingOptions coalescing;
+  int32_t window_ms = GetParamEnv("blackbox_coalesce_window_ms",
+                                  FLAGS_blackbox_coalesce_window_ms);
+  int64_t max_bytes = GetParamEnv("blackbox_coalesce_max_bytes",
+                                  FLAGS_blackbox_coalesce_max_bytes);
+  YACL_ENFORCE(window_ms >= 0 && max_bytes > 0,
+               "invalid coalescing window {} ms or batch size {}", window_ms,
+               max_bytes);
+  coalescing.window_ms = window_ms;
+  coalescing.max_bytes = max_bytes;
+
+  return link::CreateBlackBoxLinkContext(desc, self_rank, coalescing, nullptr);
 }
 
 std::shared_ptr<yacl::link::Context> CreateLinkContextForWhiteBox(
-    std::string_view parties, int32_t self_rank) {
+    std::string_view parties, int32_t self_rank,
+    std::vector<std::shared_ptr<link::CodecChannel>>* codec_channels) {
   yacl::link::ContextDesc lctx_desc;
-  std::vector<std::string> hosts = absl::StrSplit(parties, ',');
+  std::vector<std::string_view> hosts = absl::StrSplit(parties, ',');
+  std::vector<bool> local(hosts.size());
   for (size_t rank = 0; rank < hosts.size(); rank++) {
     const auto id = fmt::format("party{}", rank);
-    lctx_desc.parties.push_back({id, hosts[rank]});
+    local[rank] = absl::ConsumePrefix(&hosts[rank], kShmScheme);
+    lctx_desc.parties.push_back({id, std::string(hosts[rank])});
+  }
+
+  if (static_cast<size_t>(self_rank) >= local.size() || !local[self_rank] ||
+      std::count(local.begin(), local.end(), true) < 2) {
+    local.assign(local.size(), false);
   }
 
-  return yacl::link::FactoryBrpc().CreateContext(lctx_desc, self_rank);
+  // every party of the job sees the same list, which names the segments
+  auto session = fmt::format("{:x}", std::hash<std::string_view>()(parties));
+  auto wan_profiles = link::ParseWanProfiles(
+      GetParamEnv("link_emulation", FLAGS_link_emulation), hosts.size());
+
+  link::RouterOptions router;
+  router.server = GetParamEnv("router_server", FLAGS_router_server);
+  if (router.Enabled()) {
+    int64_t package_size =
+        GetParamEnv("router_package_size", FLAGS_router_package_size);
+    int32_t window = GetParamEnv("router_window", FLAGS_router_window);
+    YACL_ENFORCE(package_size > 0 && window > 0,
+                 "invalid router package size {} or window {}", package_size,
+                 window);
+    router.package_size = package_size;
+    router.window = window;
+    return link::CreateRouterLinkContext(lctx_desc, self_rank, router,
+                                         session, wan_profiles,
+                                         codec_channels);
+  }
+
+  return link::CreateWhiteBoxLinkContext(lctx_desc, self_rank, local, session,
+                                         wan_profiles, codec_channels);
 }
 
-std::shared_ptr<yacl::link::Context> MakeLink(std::string_view parties,
-                                              int32_t self_rank) {
+std::shared_ptr<yacl::link::Context> MakeLink(
+    std::string_view parties, int32_t self_rank,
+    std::vector<std::shared_ptr<link::CodecChannel>>* codec_channels) {
   std::shared_ptr<yacl::link::Context> lctx;
+  codec_channels->clear();
   try {
     lctx = CreateLinkContextForBlackBox();
   } catch (const std::exception& e) {
     SPDLOG_INFO("create link context for blackbox failed: {}", e.what());
-    lctx = CreateLinkContextForWhiteBox(parties, self_rank);
+    lctx = CreateLinkContextForWhiteBox(parties, self_rank, codec_channels);
   }
 
-  lctx->ConnectToMesh();
   return lctx;
 }
 
@@ -102,10 +206,28 @@ std::set<int32_t> Intersection(const std::vector<std::set<int32_t>>& sets) {
   return last_intersection;
 }
 
-int32_t GetFlagValue(const google::protobuf::EnumDescriptor* descriptor,
-                     std::string_view prefix, std::string_view name) {
-  const auto* value = descriptor->FindValueByName(
-      absl::StrCat(prefix, absl::AsciiStrToUpper(name)));
+namespace {
+
+const google::protobuf::EnumValueDescriptor* FindFlagValue(
+    const google::protobuf::EnumDescriptor* descriptor, std::string_view prefix,
+    std::string_view name,
+    const google::protobuf::EnumDescriptor* vendor_descriptor) {
+  auto full_name = absl::StrCat(prefix, absl::AsciiStrToUpper(name));
+  const auto* value = descriptor->FindValueByName(full_name);
+  if (!value && vendor_descriptor) {
+    value = vendor_descriptor->FindValueByName(full_name);
+  }
+  return value;
+}
+
+}  // namespace
+
+int32_t GetFlagValue(
+    const google::protobuf::EnumDescriptor* descriptor, std::string_view prefix,
+    std::string_view name,
+    const google::protobuf::EnumDescriptor* vendor_descriptor) {
+  const auto* value =
+      FindFlagValue(descriptor, prefix, name, vendor_descriptor);
   YACL_ENFORCE(value, "Commandline flag {} is unsupported", name);
   YACL_ENFORCE(value->number() != 0, "Unspecified enum value");
 
@@ -114,12 +236,13 @@ int32_t GetFlagValue(const google::protobuf::EnumDescriptor* descriptor,
 
 std::vector<int32_t> GetFlagValues(
     const google::protobuf::EnumDescriptor* descriptor, std::string_view prefix,
-    std::string_view names) {
+    std::string_view names,
+    const google::protobuf::EnumDescriptor* vendor_descriptor) {
   std::vector<int32_t> flag_values;
   std::vector<std::string> name_vec = absl::StrSplit(names, ',');
   for (const auto& name : name_vec) {
-    const auto* value = descriptor->FindValueByName(
-        absl::StrCat(prefix, absl::AsciiStrToUpper(name)));
+    const auto* value =
+        FindFlagValue(descriptor, prefix, name, vendor_descriptor);
     if (value) {
       flag_values.push_back(value->number());
     } else {
@@ -134,7 +257,34 @@ bool ToBool(std::string_view str) {
   return absl::AsciiStrToLower(str) == "true";
 }
 
-char* GetParamEnv(std::string_view env_name) {
+namespace {
+
+thread_local std::shared_ptr<const SessionParams> session_params;
+
+}  // namespace
+
+ScopedSessionParams::ScopedSessionParams(
+    std::shared_ptr<const SessionParams> params)
+    : prev_(std::move(session_params)) {
+  session_params = std::move(params);
+}
+
+ScopedSessionParams::~ScopedSessionParams() {
+  session_params = std::move(prev_);
+}
+
+std::shared_ptr<const SessionParams> CurrentSessionParams() {
+  return session_params;
+}
+
+const char* GetParamEnv(std::string_view env_name) {
+  if (session_params) {
+    auto it = session_params->find(env_name);
+    if (it != session_params->end()) {
+      return it->second.c_str();
+    }
+  }
+
   return std::getenv(
       absl::StrCat("runtime.component.parameter.", env_name).c_str());
 }
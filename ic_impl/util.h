@@ -14,30 +14,84 @@
 
 #pragma once
 
+#include <map>
+#include <memory>
 #include <optional>
 #include <set>
+#include <string>
 #include <string_view>
+#include <vector>
 
 #include "google/protobuf/reflection.h"
 #include "yacl/base/exception.h"
 
 #include "google/protobuf/any.pb.h"
+#include "google/protobuf/unknown_field_set.h"
 
 namespace yacl::link {
 class Context;
 }
 
+namespace ic_impl::link {
+class CodecChannel;
+}
+
 namespace ic_impl::util {
 
-std::shared_ptr<yacl::link::Context> MakeLink(std::string_view parties,
-                                              int32_t self_rank);
+// Create the link context of the job, left to the caller to connect. The
+// channels of a white box link are returned by peer rank in
+// `codec_channels`, a black box link has none.
+std::shared_ptr<yacl::link::Context> MakeLink(
+    std::string_view parties, int32_t self_rank,
+    std::vector<std::shared_ptr<link::CodecChannel>> *codec_channels);
 
-int32_t GetFlagValue(const google::protobuf::EnumDescriptor *descriptor,
-                     std::string_view prefix, std::string_view name);
+// The value of `descriptor` named `prefix` + `name`, looked up among the
+// vendor values of `vendor_descriptor` as well if given
+int32_t GetFlagValue(
+    const google::protobuf::EnumDescriptor *descriptor, std::string_view prefix,
+    std::string_view name,
+    const google::protobuf::EnumDescriptor *vendor_descriptor = nullptr);
 
 std::vector<int32_t> GetFlagValues(
     const google::protobuf::EnumDescriptor *descriptor, std::string_view prefix,
-    std::string_view names);
+    std::string_view names,
+    const google::protobuf::EnumDescriptor *vendor_descriptor = nullptr);
+
+// Field number under which vendor extensions are attached to the standard
+// handshake messages. Peers that do not know an extension skip it as an
+// unknown field.
+constexpr int kVendorExtFieldNumber = 10001;
+
+// Field number of the session ticket, which may accompany any of the above
+constexpr int kSessionTicketFieldNumber = 10002;
+
+template <typename ExtType>
+void SetVendorExt(google::protobuf::Message *message, const ExtType &ext,
+                  int field_number = kVendorExtFieldNumber) {
+  auto *fields = message->GetReflection()->MutableUnknownFields(message);
+  fields->DeleteByNumber(field_number);
+  fields->AddLengthDelimited(field_number, ext.SerializeAsString());
+}
+
+template <typename ExtType>
+std::optional<ExtType> GetVendorExt(const google::protobuf::Message &message,
+                                    int field_number = kVendorExtFieldNumber) {
+  const auto &fields = message.GetReflection()->GetUnknownFields(message);
+  for (int i = 0; i < fields.field_count(); ++i) {
+    const auto &field = fields.field(i);
+    if (field.number() != field_number ||
+        field.type() != google::protobuf::UnknownField::TYPE_LENGTH_DELIMITED) {
+      continue;
+    }
+
+    ExtType ext;
+    if (ext.ParseFromString(field.length_delimited())) {
+      return std::make_optional(ext);
+    }
+  }
+
+  return std::nullopt;
+}
 
 template <typename T, size_t item_num>
 bool IsFlagSupported(const std::array<T, item_num> &flag_list, T flag) {
@@ -254,11 +308,33 @@ AlmostOne(T x) {
 
 bool ToBool(std::string_view str);
 
-char *GetParamEnv(std::string_view env_name);
+// Job parameters by flag name. Jobs sharing the process set their own in
+// place of the process-wide flags, and these take precedence over the
+// environment.
+using SessionParams = std::map<std::string, std::string, std::less<>>;
+
+// Install `params` for the calling thread until destroyed
+class ScopedSessionParams {
+ public:
+  explicit ScopedSessionParams(std::shared_ptr<const SessionParams> params);
+
+  ~ScopedSessionParams();
+
+  ScopedSessionParams(const ScopedSessionParams &) = delete;
+  ScopedSessionParams &operator=(const ScopedSessionParams &) = delete;
+
+ private:
+  std::shared_ptr<const SessionParams> prev_;
+};
+
+// The parameters of the calling thread, to hand over to the threads it starts
+std::shared_ptr<const SessionParams> CurrentSessionParams();
+
+const char *GetParamEnv(std::string_view env_name);
 
 template <typename T>
 T GetParamEnv(std::string_view env_name, const T &default_value) {
-  if (char *env = GetParamEnv(env_name)) {
+  if (const char *env = GetParamEnv(env_name)) {
     if constexpr (std::is_convertible_v<T, std::string>) {
       return env;
     } else if constexpr (std::is_same_v<T, bool>) {